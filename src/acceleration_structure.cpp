@@ -0,0 +1,98 @@
+#include "acceleration_structure.h"
+#include "utilities.h"
+#include <macros.h>
+#include <logger.h>
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::Ptr AccelerationStructure::create(dw::vk::Backend::Ptr backend, VkAccelerationStructureTypeKHR type, VkDeviceSize size)
+{
+    AccelerationStructure::Ptr acceleration_structure = std::make_shared<AccelerationStructure>(backend, type, size);
+
+    if (acceleration_structure->handle() == VK_NULL_HANDLE)
+        return nullptr;
+
+    return acceleration_structure;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::ScratchBuffer AccelerationStructure::create_scratch_buffer(dw::vk::Backend::Ptr backend, VkDeviceSize size)
+{
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR as_properties;
+    DW_ZERO_MEMORY(as_properties);
+
+    as_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+
+    VkPhysicalDeviceProperties2 properties;
+    DW_ZERO_MEMORY(properties);
+
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &as_properties;
+
+    vkGetPhysicalDeviceProperties2(backend->physical_device(), &properties);
+
+    const VkDeviceSize alignment = std::max(VkDeviceSize(1), VkDeviceSize(as_properties.minAccelerationStructureScratchOffsetAlignment));
+
+    ScratchBuffer scratch;
+
+    // Allocated with room to align the start of the scratch memory, buffers are only guaranteed to be aligned to their memory type.
+    scratch.buffer         = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, size + alignment, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    scratch.device_address = (buffer_device_address(backend->device(), scratch.buffer->handle()) + alignment - 1) & ~(alignment - 1);
+
+    return scratch;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::AccelerationStructure(std::weak_ptr<dw::vk::Backend> backend, VkAccelerationStructureTypeKHR type, VkDeviceSize size) :
+    m_backend(backend), m_type(type), m_size(size)
+{
+    auto vk_backend = backend.lock();
+
+    m_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, size, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+    VkAccelerationStructureCreateInfoKHR info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+    info.buffer = m_buffer->handle();
+    info.offset = 0;
+    info.size   = size;
+    info.type   = type;
+
+    if (vkCreateAccelerationStructureKHR(vk_backend->device(), &info, nullptr, &m_handle) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(AccelerationStructure) Failed to create acceleration structure.");
+        m_handle = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkAccelerationStructureDeviceAddressInfoKHR address_info;
+    DW_ZERO_MEMORY(address_info);
+
+    address_info.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    address_info.accelerationStructure = m_handle;
+
+    m_device_address = vkGetAccelerationStructureDeviceAddressKHR(vk_backend->device(), &address_info);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::~AccelerationStructure()
+{
+    auto backend = m_backend.lock();
+
+    if (backend && m_handle != VK_NULL_HANDLE)
+        vkDestroyAccelerationStructureKHR(backend->device(), m_handle, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AccelerationStructure::set_name(const std::string& name)
+{
+    m_buffer->set_name(name);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vk.h>
+#include <memory>
+#include <string>
+
+// VkAccelerationStructureKHR together with the buffer it lives in. The bottom level structures of the meshes and the top level
+// structure of every scene are created through it, the builds themselves are recorded by their owners:
+//
+//   AccelerationStructure::Ptr tlas    = AccelerationStructure::create(backend, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, sizes.accelerationStructureSize);
+//   ScratchBuffer              scratch = AccelerationStructure::create_scratch_buffer(backend, sizes.buildScratchSize);
+class AccelerationStructure
+{
+public:
+    using Ptr = std::shared_ptr<AccelerationStructure>;
+
+    // Scratch memory of a build, device_address is aligned to minAccelerationStructureScratchOffsetAlignment.
+    struct ScratchBuffer
+    {
+        dw::vk::Buffer::Ptr buffer;
+        VkDeviceAddress     device_address = 0;
+    };
+
+public:
+    static AccelerationStructure::Ptr create(dw::vk::Backend::Ptr backend, VkAccelerationStructureTypeKHR type, VkDeviceSize size);
+    static ScratchBuffer              create_scratch_buffer(dw::vk::Backend::Ptr backend, VkDeviceSize size);
+
+    AccelerationStructure(std::weak_ptr<dw::vk::Backend> backend, VkAccelerationStructureTypeKHR type, VkDeviceSize size);
+    ~AccelerationStructure();
+
+    void set_name(const std::string& name);
+
+    inline VkAccelerationStructureKHR     handle() { return m_handle; }
+    inline VkAccelerationStructureTypeKHR type() { return m_type; }
+    inline VkDeviceSize                   size() { return m_size; }
+    inline VkDeviceAddress                device_address() { return m_device_address; }
+    inline dw::vk::Buffer::Ptr            buffer() { return m_buffer; }
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    VkAccelerationStructureKHR     m_handle = VK_NULL_HANDLE;
+    VkAccelerationStructureTypeKHR m_type;
+    VkDeviceSize                   m_size           = 0;
+    VkDeviceAddress                m_device_address = 0;
+    dw::vk::Buffer::Ptr            m_buffer;
+};
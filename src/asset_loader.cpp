@@ -0,0 +1,314 @@
+#include "asset_loader.h"
+#include "utilities.h"
+#include <macros.h>
+#include <logger.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Always expands to four channels, the formats with three channels aren't widely supported for sampling.
+static std::vector<uint8_t> decode_image(const std::string& path, bool hdr, bool flip_vertical)
+{
+    int32_t width, height, channels;
+    void*   data;
+
+    // stbi_set_flip_vertically_on_load() is global state, so flipping happens here instead.
+    if (hdr)
+        data = stbi_loadf(path.c_str(), &width, &height, &channels, 4);
+    else
+        data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+
+    if (!data)
+        return std::vector<uint8_t>();
+
+    size_t   row_size = size_t(width) * 4 * (hdr ? sizeof(float) : sizeof(uint8_t));
+    uint8_t* src      = (uint8_t*)data;
+
+    std::vector<uint8_t> pixels(row_size * height);
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        int32_t src_y = flip_vertical ? height - 1 - y : y;
+        memcpy(&pixels[row_size * y], &src[row_size * src_y], row_size);
+    }
+
+    stbi_image_free(data);
+
+    return pixels;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AssetLoader::AssetLoader(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers) :
+    m_backend(backend)
+{
+    for (uint32_t i = 0; i < num_workers; i++)
+        m_workers.push_back(std::thread(&AssetLoader::worker, this));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+
+    m_work_cv.notify_all();
+
+    for (auto& thread : m_workers)
+        thread.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::Image::Ptr AssetLoader::load_image(const std::string& path, bool hdr, bool flip_vertical, bool srgb, bool mipmaps)
+{
+    int32_t width, height, channels;
+
+    if (!stbi_info(path.c_str(), &width, &height, &channels))
+    {
+        DW_LOG_ERROR("(AssetLoader) Failed to open image: " + path);
+        return nullptr;
+    }
+
+    auto backend = m_backend.lock();
+
+    const uint32_t     mip_levels = mipmaps ? uint32_t(floor(log2(std::max(width, height)))) + 1 : 1;
+    VkFormat           format     = hdr ? VK_FORMAT_R32G32B32A32_SFLOAT : (srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM);
+    VkImageUsageFlags  usage      = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | (mip_levels > 1 ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
+    dw::vk::Image::Ptr image      = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, width, height, 1, mip_levels, 1, format, VMA_MEMORY_USAGE_GPU_ONLY, usage, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    image->set_name(path);
+
+    DecodeTask task([path, hdr, flip_vertical]() { return decode_image(path, hdr, flip_vertical); });
+
+    PendingImage pending;
+
+    pending.image      = image;
+    pending.path       = path;
+    pending.width      = width;
+    pending.height     = height;
+    pending.mip_levels = mip_levels;
+    pending.pixels     = task.get_future();
+
+    m_pending.push_back(std::move(pending));
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+
+    m_work_cv.notify_one();
+
+    return image;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool AssetLoader::is_pending(dw::vk::Image::Ptr image)
+{
+    for (const auto& pending : m_pending)
+    {
+        if (pending.image == image)
+            return true;
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Only known once flush() got to the image. Images that were released in the meantime are forgotten.
+bool AssetLoader::failed(dw::vk::Image::Ptr image)
+{
+    m_failed.erase(std::remove_if(m_failed.begin(), m_failed.end(), [](const std::weak_ptr<dw::vk::Image>& failed_image) { return failed_image.expired(); }), m_failed.end());
+
+    for (const auto& failed_image : m_failed)
+    {
+        if (failed_image.lock() == image)
+            return true;
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AssetLoader::flush(bool wait)
+{
+    struct Upload
+    {
+        dw::vk::Image::Ptr image;
+        uint32_t           width;
+        uint32_t           height;
+        uint32_t           mip_levels;
+        VkDeviceSize       offset;
+    };
+
+    std::vector<std::vector<uint8_t>> uploaded_pixels;
+    std::vector<Upload>               uploads;
+    VkDeviceSize                      staging_size = 0;
+
+    for (auto it = m_pending.begin(); it != m_pending.end();)
+    {
+        if (!wait && it->pixels.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            it++;
+            continue;
+        }
+
+        std::vector<uint8_t> pixels = it->pixels.get();
+
+        if (pixels.empty())
+        {
+            DW_LOG_ERROR("(AssetLoader) Failed to decode image: " + it->path);
+            m_failed.push_back(it->image);
+        }
+        else
+        {
+            Upload upload;
+
+            upload.image      = it->image;
+            upload.width      = it->width;
+            upload.height     = it->height;
+            upload.mip_levels = it->mip_levels;
+            upload.offset     = staging_size;
+
+            // Buffer offsets of copies have to be a multiple of the texel size.
+            staging_size += dw::vk::utilities::aligned_size(pixels.size(), 16);
+
+            uploads.push_back(upload);
+            uploaded_pixels.push_back(std::move(pixels));
+        }
+
+        it = m_pending.erase(it);
+    }
+
+    if (uploads.empty())
+        return;
+
+    auto backend = m_backend.lock();
+
+    dw::vk::Buffer::Ptr staging = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, staging_size, VMA_MEMORY_USAGE_CPU_ONLY, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    for (uint32_t i = 0; i < uploads.size(); i++)
+        memcpy((uint8_t*)staging->mapped_ptr() + uploads[i].offset, uploaded_pixels[i].data(), uploaded_pixels[i].size());
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    std::vector<VkImageMemoryBarrier> barriers;
+
+    for (const auto& upload : uploads)
+    {
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, upload.mip_levels, 0, 1 };
+
+        barriers.push_back(image_memory_barrier(upload.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresource_range, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+    }
+
+    pipeline_barrier(cmd_buf, {}, barriers, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    for (const auto& upload : uploads)
+    {
+        VkBufferImageCopy region;
+        DW_ZERO_MEMORY(region);
+
+        region.bufferOffset                = upload.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent                 = { upload.width, upload.height, 1 };
+
+        vkCmdCopyBufferToImage(cmd_buf->handle(), staging->handle(), upload.image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+
+    barriers.clear();
+
+    for (const auto& upload : uploads)
+    {
+        if (upload.mip_levels > 1)
+            generate_mipmaps(cmd_buf, upload.image, upload.width, upload.height, upload.mip_levels);
+        else
+        {
+            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+            barriers.push_back(image_memory_barrier(upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        }
+    }
+
+    if (!barriers.empty())
+        pipeline_barrier(cmd_buf, {}, barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    // Waits for the copies, so the staging buffer can go right after.
+    backend->flush_graphics({ cmd_buf });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Every level is blitted from the one above it, the image is expected in TRANSFER_DST_OPTIMAL and ends up in
+// SHADER_READ_ONLY_OPTIMAL.
+void AssetLoader::generate_mipmaps(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Image::Ptr image, uint32_t width, uint32_t height, uint32_t mip_levels)
+{
+    int32_t mip_width  = width;
+    int32_t mip_height = height;
+
+    for (uint32_t i = 1; i < mip_levels; i++)
+    {
+        VkImageSubresourceRange src_range = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 1, 0, 1 };
+
+        pipeline_barrier(cmd_buf, {}, { image_memory_barrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, src_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT) }, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        VkImageBlit blit;
+        DW_ZERO_MEMORY(blit);
+
+        blit.srcOffsets[1]                 = { mip_width, mip_height, 1 };
+        blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel       = i - 1;
+        blit.srcSubresource.layerCount     = 1;
+        blit.dstOffsets[1]                 = { std::max(mip_width / 2, 1), std::max(mip_height / 2, 1), 1 };
+        blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel       = i;
+        blit.dstSubresource.layerCount     = 1;
+
+        vkCmdBlitImage(cmd_buf->handle(), image->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        pipeline_barrier(cmd_buf, {}, { image_memory_barrier(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, src_range, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT) }, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+        mip_width  = std::max(mip_width / 2, 1);
+        mip_height = std::max(mip_height / 2, 1);
+    }
+
+    VkImageSubresourceRange last_range = { VK_IMAGE_ASPECT_COLOR_BIT, mip_levels - 1, 1, 0, 1 };
+
+    pipeline_barrier(cmd_buf, {}, { image_memory_barrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, last_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT) }, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AssetLoader::worker()
+{
+    while (true)
+    {
+        DecodeTask task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_work_cv.wait(lock, [this]() { return m_shutdown || !m_tasks.empty(); });
+
+            if (m_shutdown)
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
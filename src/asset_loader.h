@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vk.h>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decodes image files on a pool of worker threads and uploads them in batches. load_image() only reads the header of the file on
+// the calling thread, the returned image is created right away but its contents are undefined until flush() has uploaded them:
+//
+//   m_blue_noise_image = m_asset_loader->load_image("texture/LDR_RGBA_0.png");
+//   m_blue_noise_view  = dw::vk::ImageView::create(backend, m_blue_noise_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+//   ...
+//   m_asset_loader->flush();
+//
+// flush() waits for every pending image and uploads them all through a single staging buffer and command buffer, flush(false) only
+// uploads the images that have finished decoding and returns right away so that assets can stream in while frames are being
+// rendered. Images loaded with mipmaps get their mip chain blitted in the same command buffer. Only the decoding happens on the
+// workers, all Vulkan calls are made from the thread that owns the loader. Images that fail to decode are never uploaded, failed()
+// tells them apart from the ones that were.
+class AssetLoader
+{
+public:
+    AssetLoader(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers);
+    ~AssetLoader();
+
+    dw::vk::Image::Ptr load_image(const std::string& path, bool hdr = false, bool flip_vertical = false, bool srgb = false, bool mipmaps = false);
+    bool               is_pending(dw::vk::Image::Ptr image);
+    bool               failed(dw::vk::Image::Ptr image);
+    void               flush(bool wait = true);
+
+    inline uint32_t num_workers() { return m_workers.size(); }
+
+private:
+    using DecodeTask = std::packaged_task<std::vector<uint8_t>()>;
+
+    struct PendingImage
+    {
+        dw::vk::Image::Ptr                image;
+        std::string                       path;
+        uint32_t                          width;
+        uint32_t                          height;
+        uint32_t                          mip_levels;
+        std::future<std::vector<uint8_t>> pixels;
+    };
+
+    void worker();
+    void generate_mipmaps(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Image::Ptr image, uint32_t width, uint32_t height, uint32_t mip_levels);
+
+private:
+    std::weak_ptr<dw::vk::Backend>            m_backend;
+    std::vector<std::thread>                  m_workers;
+    std::deque<DecodeTask>                    m_tasks;
+    std::list<PendingImage>                   m_pending;
+    std::vector<std::weak_ptr<dw::vk::Image>> m_failed;
+    std::mutex                                m_mutex;
+    std::condition_variable                   m_work_cv;
+    bool                                      m_shutdown = false;
+};
@@ -0,0 +1,407 @@
+#include "async_compute.h"
+#include "pass_timings.h"
+#include "utilities.h"
+#include <macros.h>
+#include <logger.h>
+#include <imgui.h>
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AsyncCompute::AsyncCompute(std::weak_ptr<dw::vk::Backend> backend) :
+    m_backend(backend)
+{
+    auto vk_backend = backend.lock();
+
+    m_graphics_queue_family = vk_backend->queue_infos().graphics_queue_index;
+    m_compute_queue_family  = vk_backend->queue_infos().compute_queue_index;
+    m_graphics_queue        = vk_backend->graphics_queue();
+    m_compute_queue         = vk_backend->compute_queue();
+
+    // Submitting to the graphics queue twice doesn't buy any overlap.
+    m_supported = m_compute_queue != VK_NULL_HANDLE && m_compute_queue != m_graphics_queue;
+
+    if (!m_supported)
+    {
+        DW_LOG_INFO("(AsyncCompute) No separate compute queue available.");
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk_backend->physical_device(), &properties);
+
+    m_timestamp_period        = properties.limits.timestampPeriod;
+    m_graphics_timestamp_mask = timestamp_mask(vk_backend->physical_device(), m_graphics_queue_family);
+    m_compute_timestamp_mask  = timestamp_mask(vk_backend->physical_device(), m_compute_queue_family);
+
+    if (!timestamps())
+        DW_LOG_INFO("(AsyncCompute) The compute queue doesn't support timestamps, the async work won't be timed.");
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        Frame& frame = m_frames[i];
+
+        frame.command_pool  = dw::vk::CommandPool::create(vk_backend, m_compute_queue_family);
+        frame.cmd_buf       = dw::vk::CommandBuffer::create(vk_backend, frame.command_pool);
+        frame.graphics_done = dw::vk::Semaphore::create(vk_backend);
+        frame.compute_done  = dw::vk::Semaphore::create(vk_backend);
+
+        if (timestamps())
+        {
+            VkQueryPoolCreateInfo info;
+            DW_ZERO_MEMORY(info);
+
+            info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+            info.queryCount = QUERY_COUNT;
+
+            vkCreateQueryPool(vk_backend->device(), &info, nullptr, &frame.graphics_query_pool);
+            vkCreateQueryPool(vk_backend->device(), &info, nullptr, &frame.compute_query_pool);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AsyncCompute::~AsyncCompute()
+{
+    auto vk_backend = m_backend.lock();
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        if (m_frames[i].graphics_query_pool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(vk_backend->device(), m_frames[i].graphics_query_pool, nullptr);
+
+        if (m_frames[i].compute_query_pool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(vk_backend->device(), m_frames[i].compute_query_pool, nullptr);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    auto vk_backend = m_backend.lock();
+
+    m_current_frame = vk_backend->current_frame_idx();
+
+    Frame& frame = m_frames[m_current_frame];
+
+    // The fence for this frame slot has already been waited on. The last graphics submission of that frame waited for the
+    // compute work, so the compute command buffer and its queries are done as well.
+    resolve_frame(m_current_frame);
+
+    vkResetCommandPool(vk_backend->device(), frame.command_pool->handle(), 0);
+
+    // The compute pool is reset at the start of the compute command buffer.
+    if (timestamps())
+        vkCmdResetQueryPool(cmd_buf->handle(), frame.graphics_query_pool, 0, QUERY_COUNT);
+
+    frame.pending = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::submit_graphics(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& inputs, const std::vector<dw::vk::Buffer::Ptr>& input_buffers)
+{
+    Frame& frame = m_frames[m_current_frame];
+
+    m_inputs        = inputs;
+    m_input_buffers = input_buffers;
+
+    transfer_ownership(cmd_buf, m_inputs, m_input_buffers, m_graphics_queue_family, m_compute_queue_family, true);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    submit(m_graphics_queue, cmd_buf, nullptr, frame.graphics_done);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::CommandBuffer::Ptr AsyncCompute::begin_compute()
+{
+    Frame& frame = m_frames[m_current_frame];
+
+    VkCommandBufferBeginInfo begin_info;
+    DW_ZERO_MEMORY(begin_info);
+
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(frame.cmd_buf->handle(), &begin_info);
+
+    // The outputs that were handed back at the end of the last frame may hold history, so they have to be acquired too.
+    std::vector<SharedImage> images = m_inputs;
+    images.insert(images.end(), m_released_outputs.begin(), m_released_outputs.end());
+
+    transfer_ownership(frame.cmd_buf, images, m_input_buffers, m_graphics_queue_family, m_compute_queue_family, false);
+
+    m_released_outputs.clear();
+
+    if (timestamps())
+    {
+        vkCmdResetQueryPool(frame.cmd_buf->handle(), frame.compute_query_pool, 0, QUERY_COUNT);
+        vkCmdWriteTimestamp(frame.cmd_buf->handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.compute_query_pool, QUERY_BEGIN);
+    }
+
+    PassTimings* timings = PassTimings::active();
+
+    if (timings)
+        timings->begin_compute(frame.cmd_buf);
+
+    return frame.cmd_buf;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::submit_compute(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& outputs)
+{
+    Frame& frame = m_frames[m_current_frame];
+
+    if (timestamps())
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.compute_query_pool, QUERY_END);
+
+    m_outputs = outputs;
+
+    std::vector<SharedImage> images = m_inputs;
+    images.insert(images.end(), m_outputs.begin(), m_outputs.end());
+
+    transfer_ownership(cmd_buf, images, m_input_buffers, m_compute_queue_family, m_graphics_queue_family, true);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    submit(m_compute_queue, cmd_buf, frame.graphics_done, frame.compute_done);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::begin_overlap(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (timestamps())
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_frames[m_current_frame].graphics_query_pool, QUERY_BEGIN);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::submit_overlap(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (timestamps())
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frames[m_current_frame].graphics_query_pool, QUERY_END);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    submit(m_graphics_queue, cmd_buf, nullptr, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::wait_for_compute()
+{
+    Frame& frame = m_frames[m_current_frame];
+
+    auto vk_backend = m_backend.lock();
+
+    // Waits in a submission of its own so that the rest of the frame can still go through the regular present path. The semaphore
+    // wait only orders the commands of this batch, the barriers recorded here chain with it and block every later command on the
+    // graphics queue.
+    dw::vk::CommandBuffer::Ptr cmd_buf = vk_backend->allocate_graphics_command_buffer(true);
+
+    std::vector<SharedImage> images = m_inputs;
+    images.insert(images.end(), m_outputs.begin(), m_outputs.end());
+
+    if (ownership_transfer() && (!images.empty() || !m_input_buffers.empty()))
+        transfer_ownership(cmd_buf, images, m_input_buffers, m_compute_queue_family, m_graphics_queue_family, false);
+    else
+    {
+        // Without acquire barriers the batch would be empty, which would leave the passes reading the async outputs and later
+        // writes to anything the async work reads (the TLAS, for one) unordered against the compute queue.
+        VkMemoryBarrier barrier;
+        DW_ZERO_MEMORY(barrier);
+
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    submit(m_graphics_queue, cmd_buf, frame.compute_done, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::release_outputs(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    transfer_ownership(cmd_buf, m_outputs, {}, m_graphics_queue_family, m_compute_queue_family, true);
+
+    m_released_outputs = m_outputs;
+    m_inputs.clear();
+    m_input_buffers.clear();
+    m_outputs.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::reset()
+{
+    m_inputs.clear();
+    m_input_buffers.clear();
+    m_outputs.clear();
+    m_released_outputs.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::gui()
+{
+    if (!m_supported)
+    {
+        ImGui::Text("No separate compute queue available");
+        return;
+    }
+
+    ImGui::Text("Compute Queue Family: %u (%s)", m_compute_queue_family, ownership_transfer() ? "Dedicated" : "Shared with Graphics");
+
+    if (!timestamps())
+    {
+        ImGui::Text("No timestamp support on the compute queue");
+        return;
+    }
+
+    ImGui::Text("Async Work: %.3f ms", m_compute_ms);
+    ImGui::Text("Overlap: %.3f ms (%.1f%%)", m_overlap_ms, m_compute_ms > 0.0f ? 100.0f * m_overlap_ms / m_compute_ms : 0.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::resolve_frame(uint32_t frame_idx)
+{
+    Frame& frame = m_frames[frame_idx];
+
+    if (!frame.pending)
+        return;
+
+    frame.pending = false;
+
+    if (!timestamps())
+        return;
+
+    auto vk_backend = m_backend.lock();
+
+    uint64_t compute[QUERY_COUNT];
+    uint64_t graphics[QUERY_COUNT];
+
+    // Frames that skipped the async path never write their queries, which leaves them unavailable.
+    if (vkGetQueryPoolResults(vk_backend->device(), frame.compute_query_pool, 0, QUERY_COUNT, sizeof(compute), compute, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    if (vkGetQueryPoolResults(vk_backend->device(), frame.graphics_query_pool, 0, QUERY_COUNT, sizeof(graphics), graphics, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    // Both queues are assumed to share the device timestamp clock. Only the bits both queues write can be compared.
+    const uint64_t mask          = m_graphics_timestamp_mask & m_compute_timestamp_mask;
+    const double   to_ms         = double(m_timestamp_period) / 1000000.0;
+    const uint64_t overlap_begin = std::max(compute[QUERY_BEGIN] & mask, graphics[QUERY_BEGIN] & mask);
+    const uint64_t overlap_end   = std::min(compute[QUERY_END] & mask, graphics[QUERY_END] & mask);
+
+    m_compute_ms = float(double((compute[QUERY_END] - compute[QUERY_BEGIN]) & m_compute_timestamp_mask) * to_ms);
+    m_overlap_ms = overlap_end > overlap_begin ? float(double(overlap_end - overlap_begin) * to_ms) : 0.0f;
+
+    PassTimings* timings = PassTimings::active();
+
+    if (timings)
+    {
+        timings->add_sample("Async Compute", m_compute_ms);
+        timings->add_sample("Async Compute/Overlap", m_overlap_ms);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::transfer_ownership(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& images, const std::vector<dw::vk::Buffer::Ptr>& buffers, uint32_t src_queue_family, uint32_t dst_queue_family, bool release)
+{
+    // Queues of the same family share ownership, the semaphores alone take care of the dependency.
+    if ((images.empty() && buffers.empty()) || src_queue_family == dst_queue_family)
+        return;
+
+    std::vector<VkImageMemoryBarrier> image_barriers;
+
+    for (const auto& shared : images)
+    {
+        VkImageSubresourceRange subresource_range = { shared.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+        // The access mask of the other half of the transfer is ignored.
+        VkImageMemoryBarrier barrier = image_memory_barrier(shared.image,
+                                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                            subresource_range,
+                                                            release ? VK_ACCESS_MEMORY_WRITE_BIT : 0,
+                                                            release ? 0 : VK_ACCESS_MEMORY_READ_BIT);
+
+        barrier.srcQueueFamilyIndex = src_queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+
+        image_barriers.push_back(barrier);
+    }
+
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+
+    for (const auto& buffer : buffers)
+    {
+        VkBufferMemoryBarrier barrier;
+        DW_ZERO_MEMORY(barrier);
+
+        barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask       = release ? VK_ACCESS_MEMORY_WRITE_BIT : 0;
+        barrier.dstAccessMask       = release ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+        barrier.srcQueueFamilyIndex = src_queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+        barrier.buffer              = buffer->handle();
+        barrier.size                = VK_WHOLE_SIZE;
+
+        buffer_barriers.push_back(barrier);
+    }
+
+    // Acquires chain with the semaphore wait, which happens at VK_PIPELINE_STAGE_ALL_COMMANDS_BIT.
+    vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, buffer_barriers.size(), buffer_barriers.data(), image_barriers.size(), image_barriers.data());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void AsyncCompute::submit(VkQueue queue, dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Semaphore::Ptr wait_semaphore, dw::vk::Semaphore::Ptr signal_semaphore)
+{
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSemaphore          wait_handle;
+    VkSemaphore          signal_handle;
+
+    VkSubmitInfo submit_info;
+    DW_ZERO_MEMORY(submit_info);
+
+    submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers    = &cmd_buf->handle();
+
+    if (wait_semaphore)
+    {
+        wait_handle = wait_semaphore->handle();
+
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores    = &wait_handle;
+        submit_info.pWaitDstStageMask  = &wait_stage;
+    }
+
+    if (signal_semaphore)
+    {
+        signal_handle = signal_semaphore->handle();
+
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores    = &signal_handle;
+    }
+
+    if (vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+        DW_LOG_ERROR("(AsyncCompute) Failed to submit command buffer.");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vk.h>
+#include <vector>
+
+// Runs a part of the frame on the dedicated compute queue. A frame is split into the following submissions:
+//
+//   Graphics: [G-Buffer, release]  ->  [overlapping work]  ->  [acquire]  ->  [rest of the frame]
+//   Compute :                    \->  [acquire, async work, release]  -/
+//
+// When the compute queue belongs to a different queue family, the images shared between both queues are handed over with
+// queue family ownership transfers. Shared images are expected to be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL whenever they
+// change hands. Buffers written on the graphics queue during the frame (the draw motion matrices of the G-Buffer) are handed over
+// the same way, buffers only written at load time or by the host (scene geometry, TLAS, uniforms) are not transferred.
+//
+// Timestamps around the async work and the overlapping graphics work are used to measure how much of the two actually ran
+// concurrently. Each queue writes into a query pool of its own that is also reset on that queue. If the compute queue family
+// reports no valid timestamp bits, the async work is not timed.
+class AsyncCompute
+{
+public:
+    struct SharedImage
+    {
+        dw::vk::Image::Ptr image;
+        VkImageAspectFlags aspect;
+    };
+
+public:
+    AsyncCompute(std::weak_ptr<dw::vk::Backend> backend);
+    ~AsyncCompute();
+
+    void                       begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       submit_graphics(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& inputs, const std::vector<dw::vk::Buffer::Ptr>& input_buffers = {});
+    dw::vk::CommandBuffer::Ptr begin_compute();
+    void                       submit_compute(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& outputs);
+    void                       begin_overlap(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       submit_overlap(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       wait_for_compute();
+    void                       release_outputs(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       reset();
+    void                       gui();
+
+    inline bool  supported() { return m_supported; }
+    inline bool  ownership_transfer() { return m_graphics_queue_family != m_compute_queue_family; }
+    inline bool  timestamps() { return m_graphics_timestamp_mask != 0 && m_compute_timestamp_mask != 0; }
+    inline float compute_time() { return m_compute_ms; }
+    inline float overlap_time() { return m_overlap_ms; }
+
+private:
+    enum Query
+    {
+        QUERY_BEGIN,
+        QUERY_END,
+        QUERY_COUNT
+    };
+
+    struct Frame
+    {
+        dw::vk::CommandPool::Ptr   command_pool;
+        dw::vk::CommandBuffer::Ptr cmd_buf;
+        dw::vk::Semaphore::Ptr     graphics_done;
+        dw::vk::Semaphore::Ptr     compute_done;
+        VkQueryPool                graphics_query_pool = VK_NULL_HANDLE;
+        VkQueryPool                compute_query_pool  = VK_NULL_HANDLE;
+        bool                       pending             = false;
+    };
+
+    void resolve_frame(uint32_t frame_idx);
+    void transfer_ownership(dw::vk::CommandBuffer::Ptr cmd_buf, const std::vector<SharedImage>& images, const std::vector<dw::vk::Buffer::Ptr>& buffers, uint32_t src_queue_family, uint32_t dst_queue_family, bool release);
+    void submit(VkQueue queue, dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Semaphore::Ptr wait_semaphore, dw::vk::Semaphore::Ptr signal_semaphore);
+
+private:
+    std::weak_ptr<dw::vk::Backend>   m_backend;
+    bool                             m_supported = false;
+    uint32_t                         m_graphics_queue_family;
+    uint32_t                         m_compute_queue_family;
+    VkQueue                          m_graphics_queue;
+    VkQueue                          m_compute_queue;
+    float                            m_timestamp_period;
+    uint64_t                         m_graphics_timestamp_mask = 0;
+    uint64_t                         m_compute_timestamp_mask  = 0;
+    uint32_t                         m_current_frame = 0;
+    Frame                            m_frames[dw::vk::Backend::kMaxFramesInFlight];
+    std::vector<SharedImage>         m_inputs;
+    std::vector<dw::vk::Buffer::Ptr> m_input_buffers;
+    std::vector<SharedImage>         m_outputs;
+    std::vector<SharedImage>         m_released_outputs;
+    float                            m_compute_ms = 0.0f;
+    float                            m_overlap_ms = 0.0f;
+};
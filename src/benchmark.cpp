@@ -0,0 +1,109 @@
+#include "benchmark.h"
+#include <logger.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BenchmarkScript::load(const std::string& path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("Failed to open benchmark script: " + path);
+        return false;
+    }
+
+    std::string line;
+    std::string current_scene;
+    uint32_t    line_number = 0;
+
+    while (std::getline(file, line))
+    {
+        line_number++;
+
+        size_t first = line.find_first_not_of(" \t\r");
+
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        if (line.compare(first, 6, "scene ") == 0)
+        {
+            current_scene = line.substr(first + 6);
+            current_scene.erase(current_scene.find_last_not_of(" \t\r") + 1);
+            continue;
+        }
+
+        std::stringstream ss(line);
+        BenchmarkKeyframe keyframe;
+
+        ss >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z >> keyframe.light_direction.x >> keyframe.light_direction.y >> keyframe.light_direction.z;
+
+        if (ss.fail() || current_scene.empty())
+        {
+            DW_LOG_ERROR("Invalid keyframe in " + path + " at line " + std::to_string(line_number));
+            return false;
+        }
+
+        keyframe.light_direction = glm::normalize(keyframe.light_direction);
+
+        m_keyframes[current_scene].push_back(keyframe);
+    }
+
+    for (auto& pair : m_keyframes)
+    {
+        std::stable_sort(pair.second.begin(), pair.second.end(), [](const BenchmarkKeyframe& a, const BenchmarkKeyframe& b) {
+            return a.time < b.time;
+        });
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BenchmarkScript::evaluate(const std::string& scene, float time, BenchmarkKeyframe& keyframe)
+{
+    auto it = m_keyframes.find(scene);
+
+    if (it == m_keyframes.end() || it->second.empty())
+        return false;
+
+    const std::vector<BenchmarkKeyframe>& keyframes = it->second;
+
+    if (time <= keyframes.front().time)
+    {
+        keyframe = keyframes.front();
+        return true;
+    }
+
+    if (time >= keyframes.back().time)
+    {
+        keyframe = keyframes.back();
+        return true;
+    }
+
+    for (uint32_t i = 1; i < keyframes.size(); i++)
+    {
+        const BenchmarkKeyframe& a = keyframes[i - 1];
+        const BenchmarkKeyframe& b = keyframes[i];
+
+        if (time <= b.time)
+        {
+            float t = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+
+            keyframe.time            = time;
+            keyframe.position        = glm::mix(a.position, b.position, t);
+            keyframe.target          = glm::mix(a.target, b.target, t);
+            keyframe.light_direction = glm::normalize(glm::mix(a.light_direction, b.light_direction, t));
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm.hpp>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+struct BenchmarkKeyframe
+{
+    float     time;
+    glm::vec3 position;
+    glm::vec3 target;
+    glm::vec3 light_direction;
+};
+
+// Camera/light keyframes per scene, loaded from a text file of the form:
+//
+// scene Sponza
+// # time  position  target  light direction
+// 0.0  0.0 35.0 125.0  0.0 35.0 0.0  0.568 0.707 -0.421
+//
+// Keyframes are linearly interpolated and clamped to the first/last keyframe.
+class BenchmarkScript
+{
+public:
+    bool load(const std::string& path);
+    bool evaluate(const std::string& scene, float time, BenchmarkKeyframe& keyframe);
+
+private:
+    std::unordered_map<std::string, std::vector<BenchmarkKeyframe>> m_keyframes;
+};
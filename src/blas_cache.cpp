@@ -0,0 +1,338 @@
+#include "blas_cache.h"
+#include "utilities.h"
+#include <macros.h>
+#include <logger.h>
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t kCookedBlasMagic   = 0x53425248; // "HRBS"
+static const uint32_t kCookedBlasVersion = 1;
+
+struct CookedBlasHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint64_t original_size;
+    uint64_t data_size;
+    double   build_ms;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float to_mb(VkDeviceSize size)
+{
+    return float(size) / (1024.0f * 1024.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void submit_and_wait(dw::vk::Backend::Ptr backend, dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    backend->flush_graphics({ cmd_buf });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BlasCache::BlasCache(std::weak_ptr<dw::vk::Backend> backend, bool enabled) :
+    m_backend(backend), m_enabled(enabled)
+{
+    auto vk_backend = backend.lock();
+
+    const VkQueryType query_types[] = { VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR };
+
+    for (int i = 0; i < 2; i++)
+    {
+        VkQueryPoolCreateInfo info;
+        DW_ZERO_MEMORY(info);
+
+        info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        info.queryType  = query_types[i];
+        info.queryCount = 1;
+
+        vkCreateQueryPool(vk_backend->device(), &info, nullptr, &m_query_pools[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BlasCache::~BlasCache()
+{
+    auto backend = m_backend.lock();
+
+    for (int i = 0; i < 2; i++)
+        vkDestroyQueryPool(backend->device(), m_query_pools[i], nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BlasCache::initialize(Mesh::Ptr mesh, const std::string& path, uint64_t hash)
+{
+    auto backend = m_backend.lock();
+
+    const std::string cooked_path = path + ".hrblas";
+
+    if (m_enabled)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+
+        AccelerationStructure::Ptr blas = deserialize(cooked_path, hash);
+
+        if (blas)
+        {
+            mesh->set_acceleration_structure(blas);
+
+            m_stats.num_deserialized++;
+            m_stats.deserialize_ms += elapsed_ms(begin);
+            return;
+        }
+    }
+
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    // The compacted size can only be queried for acceleration structures built with ALLOW_COMPACTION.
+    mesh->initialize_for_ray_tracing(backend, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
+
+    double build_ms = elapsed_ms(begin);
+
+    AccelerationStructure::Ptr blas = mesh->acceleration_structure();
+
+    if (!blas)
+    {
+        DW_LOG_ERROR("(BlasCache) Failed to build the acceleration structure of " + path);
+        return;
+    }
+
+    VkDeviceSize original_size = blas->size();
+    VkDeviceSize compacted_size;
+
+    // The mesh holds the only reference to the original, swapping it out frees it.
+    blas = compact(blas, compacted_size);
+
+    mesh->set_acceleration_structure(blas);
+
+    m_stats.num_built++;
+    m_stats.build_ms += build_ms;
+    m_stats.original_size += original_size;
+    m_stats.compacted_size += compacted_size;
+
+    if (m_enabled && !serialize(blas, cooked_path, hash, build_ms, original_size))
+        DW_LOG_ERROR("(BlasCache) Failed to write " + cooked_path);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BlasCache::log_stats()
+{
+    char buffer[512];
+
+    snprintf(buffer, sizeof(buffer), "(BlasCache) %u BLAS built in %.1f ms, compacted from %.1f MB to %.1f MB (%.1f MB saved). %u BLAS deserialized in %.1f ms (%.1f ms less than building them).", m_stats.num_built, m_stats.build_ms, to_mb(m_stats.original_size), to_mb(m_stats.compacted_size), to_mb(m_stats.original_size - m_stats.compacted_size), m_stats.num_deserialized, m_stats.deserialize_ms, m_stats.saved_build_ms - m_stats.deserialize_ms);
+
+    DW_LOG_INFO(buffer);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::Ptr BlasCache::compact(AccelerationStructure::Ptr blas, VkDeviceSize& compacted_size)
+{
+    auto backend = m_backend.lock();
+
+    compacted_size = query_size(blas, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR);
+
+    if (compacted_size == 0 || compacted_size >= blas->size())
+    {
+        compacted_size = blas->size();
+        return blas;
+    }
+
+    AccelerationStructure::Ptr compacted = AccelerationStructure::create(backend, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compacted_size);
+
+    if (!compacted)
+    {
+        compacted_size = blas->size();
+        return blas;
+    }
+
+    VkCopyAccelerationStructureInfoKHR copy_info;
+    DW_ZERO_MEMORY(copy_info);
+
+    copy_info.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+    copy_info.src   = blas->handle();
+    copy_info.dst   = compacted->handle();
+    copy_info.mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    vkCmdCopyAccelerationStructureKHR(cmd_buf->handle(), &copy_info);
+
+    submit_and_wait(backend, cmd_buf);
+
+    return compacted;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BlasCache::serialize(AccelerationStructure::Ptr blas, const std::string& path, uint64_t hash, double build_ms, VkDeviceSize original_size)
+{
+    auto backend = m_backend.lock();
+
+    VkDeviceSize data_size = query_size(blas, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR);
+
+    if (data_size == 0)
+        return false;
+
+    dw::vk::Buffer::Ptr readback = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, data_size, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    VkCopyAccelerationStructureToMemoryInfoKHR copy_info;
+    DW_ZERO_MEMORY(copy_info);
+
+    copy_info.sType             = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR;
+    copy_info.src               = blas->handle();
+    copy_info.dst.deviceAddress = buffer_device_address(backend->device(), readback->handle());
+    copy_info.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    vkCmdCopyAccelerationStructureToMemoryKHR(cmd_buf->handle(), &copy_info);
+
+    submit_and_wait(backend, cmd_buf);
+
+    CookedBlasHeader header;
+
+    header.magic         = kCookedBlasMagic;
+    header.version       = kCookedBlasVersion;
+    header.hash          = hash;
+    header.original_size = original_size;
+    header.data_size     = data_size;
+    header.build_ms      = build_ms;
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)readback->mapped_ptr(), data_size);
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+AccelerationStructure::Ptr BlasCache::deserialize(const std::string& path, uint64_t hash)
+{
+    auto backend = m_backend.lock();
+
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return nullptr;
+
+    CookedBlasHeader header;
+
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != kCookedBlasMagic || header.version != kCookedBlasVersion)
+        return nullptr;
+
+    if (header.hash != hash)
+    {
+        DW_LOG_INFO("(BlasCache) Mesh of " + path + " changed, building it again.");
+        return nullptr;
+    }
+
+    // The serialized data starts with the driver UUID and the compatibility UUID, followed by its own size and the size of the
+    // deserialized acceleration structure.
+    if (header.data_size < 2 * VK_UUID_SIZE + 2 * sizeof(uint64_t))
+        return nullptr;
+
+    dw::vk::Buffer::Ptr upload = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, header.data_size, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    uint8_t* data = (uint8_t*)upload->mapped_ptr();
+
+    if (!file.read((char*)data, header.data_size))
+    {
+        DW_LOG_ERROR("(BlasCache) Truncated acceleration structure: " + path);
+        return nullptr;
+    }
+
+    VkAccelerationStructureVersionInfoKHR version_info;
+    DW_ZERO_MEMORY(version_info);
+
+    version_info.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR;
+    version_info.pVersionData = data;
+
+    VkAccelerationStructureCompatibilityKHR compatibility;
+
+    vkGetDeviceAccelerationStructureCompatibilityKHR(backend->device(), &version_info, &compatibility);
+
+    if (compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR)
+    {
+        DW_LOG_INFO("(BlasCache) " + path + " was written by an incompatible device or driver, building it again.");
+        return nullptr;
+    }
+
+    uint64_t deserialized_size;
+    memcpy(&deserialized_size, data + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+
+    AccelerationStructure::Ptr blas = AccelerationStructure::create(backend, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, deserialized_size);
+
+    if (!blas)
+        return nullptr;
+
+    VkCopyMemoryToAccelerationStructureInfoKHR copy_info;
+    DW_ZERO_MEMORY(copy_info);
+
+    copy_info.sType             = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR;
+    copy_info.src.deviceAddress = buffer_device_address(backend->device(), upload->handle());
+    copy_info.dst               = blas->handle();
+    copy_info.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    vkCmdCopyMemoryToAccelerationStructureKHR(cmd_buf->handle(), &copy_info);
+
+    submit_and_wait(backend, cmd_buf);
+
+    m_stats.original_size += header.original_size;
+    m_stats.compacted_size += deserialized_size;
+    m_stats.saved_build_ms += header.build_ms;
+
+    return blas;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VkDeviceSize BlasCache::query_size(AccelerationStructure::Ptr blas, VkQueryType type)
+{
+    auto backend = m_backend.lock();
+
+    VkQueryPool query_pool = type == VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR ? m_query_pools[0] : m_query_pools[1];
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    VkAccelerationStructureKHR handle = blas->handle();
+
+    vkCmdResetQueryPool(cmd_buf->handle(), query_pool, 0, 1);
+    vkCmdWriteAccelerationStructuresPropertiesKHR(cmd_buf->handle(), 1, &handle, type, query_pool, 0);
+
+    submit_and_wait(backend, cmd_buf);
+
+    VkDeviceSize size = 0;
+
+    if (vkGetQueryPoolResults(backend->device(), query_pool, 0, 1, sizeof(size), &size, sizeof(size), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+        return 0;
+
+    return size;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
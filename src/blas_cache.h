@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vk.h>
+#include <memory>
+#include <string>
+#include "scene.h"
+
+// Compacts the bottom level acceleration structure of every mesh after its first build and serializes the compacted result next
+// to the mesh (mesh/sponza.obj -> mesh/sponza.obj.hrblas). Later runs deserialize it instead of building it again, as long as
+// the mesh is unchanged and the device reports the serialized data as compatible:
+//
+//   m_blas_cache->initialize(sponza, "mesh/sponza.obj", m_scene_cache->hash("mesh/sponza.obj"));
+//
+// replaces the call to Mesh::initialize_for_ray_tracing().
+class BlasCache
+{
+public:
+    struct Stats
+    {
+        uint32_t     num_built        = 0;
+        uint32_t     num_deserialized = 0;
+        VkDeviceSize original_size    = 0;
+        VkDeviceSize compacted_size   = 0;
+        double       build_ms         = 0.0;
+        double       deserialize_ms   = 0.0;
+        double       saved_build_ms   = 0.0;
+    };
+
+public:
+    BlasCache(std::weak_ptr<dw::vk::Backend> backend, bool enabled = true);
+    ~BlasCache();
+
+    void initialize(Mesh::Ptr mesh, const std::string& path, uint64_t hash);
+    void log_stats();
+
+    inline Stats stats() { return m_stats; }
+
+private:
+    AccelerationStructure::Ptr compact(AccelerationStructure::Ptr blas, VkDeviceSize& compacted_size);
+    bool                       serialize(AccelerationStructure::Ptr blas, const std::string& path, uint64_t hash, double build_ms, VkDeviceSize original_size);
+    AccelerationStructure::Ptr deserialize(const std::string& path, uint64_t hash);
+    VkDeviceSize               query_size(AccelerationStructure::Ptr blas, VkQueryType type);
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    bool                           m_enabled;
+    VkQueryPool                    m_query_pools[2];
+    Stats                          m_stats;
+};
@@ -1,4 +1,5 @@
 #include "blue_noise.h"
+#include "asset_loader.h"
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
@@ -20,14 +21,14 @@ static const char* kSCRAMBLING_RANKING_TEXTURES[] = {
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-BlueNoise::BlueNoise(dw::vk::Backend::Ptr backend)
+BlueNoise::BlueNoise(dw::vk::Backend::Ptr backend, AssetLoader* loader)
 {
-    m_sobol_image      = dw::vk::Image::create_from_file(backend, kSOBOL_TEXTURE);
+    m_sobol_image      = loader->load_image(kSOBOL_TEXTURE);
     m_sobol_image_view = dw::vk::ImageView::create(backend, m_sobol_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
     for (int i = 0; i < 9; i++)
     {
-        m_scrambling_ranking_image[i]      = dw::vk::Image::create_from_file(backend, kSCRAMBLING_RANKING_TEXTURES[i]);
+        m_scrambling_ranking_image[i]      = loader->load_image(kSCRAMBLING_RANKING_TEXTURES[i]);
         m_scrambling_ranking_image_view[i] = dw::vk::ImageView::create(backend, m_scrambling_ranking_image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 }
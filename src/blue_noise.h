@@ -2,6 +2,8 @@
 
 #include <vk.h>
 
+class AssetLoader;
+
 enum BlueNoiseSpp
 {
     BLUE_NOISE_1SPP,
@@ -22,6 +24,7 @@ struct BlueNoise
     dw::vk::ImageView::Ptr m_sobol_image_view;
     dw::vk::ImageView::Ptr m_scrambling_ranking_image_view[9];
 
-    BlueNoise(dw::vk::Backend::Ptr backend);
+    // The images are decoded by the asset loader, they are valid once it has been flushed.
+    BlueNoise(dw::vk::Backend::Ptr backend, AssetLoader* loader);
     ~BlueNoise();
 };
\ No newline at end of file
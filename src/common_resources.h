@@ -1,9 +1,6 @@
 #pragma once
 
-#include <material.h>
-#include <mesh.h>
 #include <vk.h>
-#include <ray_traced_scene.h>
 #include <vk_mem_alloc.h>
 #include <brdf_preintegrate_lut.h>
 #include <hosek_wilkie_sky_model.h>
@@ -11,6 +8,12 @@
 #include <cubemap_prefilter.h>
 #include <stdexcept>
 #include "blue_noise.h"
+#include "transient_allocator.h"
+#include "pipeline_cache.h"
+#include "dynamic_instances.h"
+#include "compact_vertices.h"
+#include "point_lights.h"
+#include "scene.h"
 
 class SVGFDenoiser;
 
@@ -77,6 +80,7 @@ struct CommonResources
     EnvironmentType   current_environment_type   = ENVIRONMENT_TYPE_PROCEDURAL_SKY;
     bool              first_frame                = true;
     bool              ping_pong                  = false;
+    bool              async_compute              = false;
     int32_t           num_frames                 = 0;
     size_t            ubo_size                   = 0;
     glm::vec4         z_buffer_params;
@@ -89,8 +93,8 @@ struct CommonResources
     glm::mat4         prev_view_projection;
 
     // Assets.
-    std::vector<dw::Mesh::Ptr>           meshes;
-    std::vector<dw::RayTracedScene::Ptr> scenes;
+    std::vector<Mesh::Ptr>  meshes;
+    std::vector<Scene::Ptr> scenes;
 
     // Common
     dw::vk::DescriptorSet::Ptr                   per_frame_ds;
@@ -119,6 +123,18 @@ struct CommonResources
     std::unique_ptr<SkyEnvironment>              sky_environment;
     std::vector<std::shared_ptr<HDREnvironment>> hdr_environments;
     std::unique_ptr<dw::BRDFIntegrateLUT>        brdf_preintegrate_lut;
+    std::unique_ptr<TransientAllocator>          transient_allocator;
+    std::unique_ptr<PipelineCache>               pipeline_cache;
+    std::unique_ptr<DynamicInstances>            dynamic_instances;
+    std::unique_ptr<CompactVertices>             compact_vertices; // Only created with COMPACT_VERTICES.
+    std::unique_ptr<PointLights>                 point_lights;
 
-    inline dw::RayTracedScene::Ptr current_scene() { return scenes[current_scene_type]; }
+    inline Scene::Ptr current_scene() { return scenes[current_scene_type]; }
+
+    // Stage to synchronize with the graphics passes that consume ray traced results. The compute queue has no fragment stage, the
+    // queue ownership transfers cover the dependency instead.
+    inline VkPipelineStageFlags consumer_stage() { return async_compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT; }
+
+    // Queue of the passes that may run on the async compute queue, for placing their transient images.
+    inline TransientAllocator::Queue async_queue() { return async_compute ? TransientAllocator::QUEUE_ASYNC_COMPUTE : TransientAllocator::QUEUE_GRAPHICS; }
 };
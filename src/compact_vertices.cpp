@@ -0,0 +1,187 @@
+#include "compact_vertices.h"
+#include "dynamic_instances.h"
+#include <macros.h>
+#include <logger.h>
+#include <imgui.h>
+#include <gtc/packing.hpp>
+#include <algorithm>
+#include <stdio.h>
+
+#define COMPACT_VERTEX_BITANGENT_SIGN_BIT 0x10000u
+
+static_assert(sizeof(CompactVertices::Vertex) == 24, "CompactVertices::Vertex must match CompactVertex in compact_vertex.glsl");
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float to_mb(VkDeviceSize size)
+{
+    return float(size) / (1024.0f * 1024.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same as direction_to_octohedral() in g_buffer_common.glsl.
+static glm::vec2 direction_to_octohedral(glm::vec3 direction)
+{
+    glm::vec2 p = glm::vec2(direction) * (1.0f / glm::dot(glm::abs(direction), glm::vec3(1.0f)));
+    return direction.z > 0.0f ? p : (1.0f - glm::abs(glm::vec2(p.y, p.x))) * (glm::step(0.0f, p) * 2.0f - glm::vec2(1.0f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CompactVertices::CompactVertices(std::weak_ptr<dw::vk::Backend> backend) :
+    m_backend(backend)
+{
+    dw::vk::DescriptorSetLayout::Desc desc;
+
+    desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, DynamicInstances::kMaxInstances, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+
+    m_ds_layout = dw::vk::DescriptorSetLayout::create(backend.lock(), desc);
+    m_ds_layout->set_name("Compact Vertices DS Layout");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CompactVertices::~CompactVertices()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Encoded once per mesh and shared by every instance and scene that uses it.
+void CompactVertices::add_mesh(Mesh::Ptr mesh, const MeshData& data)
+{
+    if (m_buffers.find(mesh.get()) != m_buffers.end())
+        return;
+
+    const auto& vertices = data.vertices;
+
+    std::vector<Vertex> compact(vertices.size());
+
+    for (uint32_t i = 0; i < vertices.size(); i++)
+        compact[i] = encode(vertices[i]);
+
+    auto backend = m_backend.lock();
+
+    // The position comes first, so the acceleration structure is built from these vertices as well.
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+
+    dw::vk::Buffer::Ptr buffer = dw::vk::Buffer::create(backend, usage, sizeof(Vertex) * compact.size(), VMA_MEMORY_USAGE_GPU_ONLY, 0, compact.data());
+    buffer->set_name("Compact Vertices " + std::to_string(m_stats.num_meshes));
+
+    m_buffers[mesh.get()] = buffer;
+
+    // Nothing reads the full vertices any more, the mesh drops them in favour of the compact ones.
+    mesh->set_vertex_buffer(buffer, sizeof(Vertex));
+
+    m_stats.num_meshes++;
+    m_stats.num_vertices += vertices.size();
+    m_stats.full_size += sizeof(::Vertex) * vertices.size();
+    m_stats.compact_size += sizeof(Vertex) * vertices.size();
+
+    char buffer_str[512];
+    snprintf(buffer_str, sizeof(buffer_str), "(CompactVertices) Encoded %u vertices, released %.2f MB of full vertices for %.2f MB", uint32_t(vertices.size()), to_mb(sizeof(::Vertex) * vertices.size()), to_mb(sizeof(Vertex) * vertices.size()));
+    DW_LOG_INFO(buffer_str);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr CompactVertices::descriptor_set(Scene::Ptr scene)
+{
+    const auto& instances = scene->instances();
+
+    SceneState& state = m_scenes[scene->id()];
+
+    bool changed = !state.ds || state.meshes.size() != instances.size();
+
+    for (uint32_t i = 0; !changed && i < instances.size(); i++)
+        changed = state.meshes[i] != instances[i].mesh.lock().get();
+
+    if (changed)
+    {
+        // The previous set may still be in use by the frames in flight.
+        if (state.ds)
+            m_backend.lock()->wait_idle();
+
+        state.meshes.resize(instances.size());
+
+        for (uint32_t i = 0; i < instances.size(); i++)
+            state.meshes[i] = instances[i].mesh.lock().get();
+
+        write_descriptor_set(scene, state);
+    }
+
+    return state.ds;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CompactVertices::gui()
+{
+    ImGui::Text("Vertices: %u in %u meshes", m_stats.num_vertices, m_stats.num_meshes);
+    ImGui::Text("Vertex Memory: %.1f MB resident (%.1f MB of full vertices released)", to_mb(m_stats.compact_size), to_mb(m_stats.full_size));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CompactVertices::Vertex CompactVertices::encode(const ::Vertex& vertex)
+{
+    const glm::vec3 normal    = glm::normalize(glm::vec3(vertex.normal));
+    const glm::vec3 tangent   = glm::normalize(glm::vec3(vertex.tangent));
+    const bool      flip_sign = glm::dot(glm::cross(normal, tangent), glm::vec3(vertex.bitangent)) < 0.0f;
+
+    Vertex compact;
+
+    compact.position[0] = vertex.position.x;
+    compact.position[1] = vertex.position.y;
+    compact.position[2] = vertex.position.z;
+    compact.tex_coord   = glm::packHalf2x16(glm::vec2(vertex.tex_coord));
+    compact.normal      = glm::packSnorm2x16(direction_to_octohedral(normal));
+
+    // Losing the lowest bit of the Y component costs far less precision than a separate word for the sign would cost memory.
+    compact.tangent = (glm::packSnorm2x16(direction_to_octohedral(tangent)) & ~COMPACT_VERTEX_BITANGENT_SIGN_BIT) | (flip_sign ? COMPACT_VERTEX_BITANGENT_SIGN_BIT : 0u);
+
+    return compact;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CompactVertices::write_descriptor_set(Scene::Ptr scene, SceneState& state)
+{
+    const auto&    instances     = scene->instances();
+    const uint32_t num_instances = std::min(uint32_t(instances.size()), DynamicInstances::kMaxInstances);
+
+    if (num_instances == 0)
+        return;
+
+    auto backend = m_backend.lock();
+
+    if (!state.ds)
+        state.ds = backend->allocate_descriptor_set(m_ds_layout);
+
+    // Every element of the array has to be valid, the ones past the last instance point to the first buffer.
+    std::vector<VkDescriptorBufferInfo> buffer_infos(DynamicInstances::kMaxInstances);
+
+    for (uint32_t i = 0; i < DynamicInstances::kMaxInstances; i++)
+    {
+        dw::vk::Buffer::Ptr buffer = m_buffers[instances[i < num_instances ? i : 0].mesh.lock().get()];
+
+        buffer_infos[i].buffer = buffer->handle();
+        buffer_infos[i].offset = 0;
+        buffer_infos[i].range  = VK_WHOLE_SIZE;
+    }
+
+    VkWriteDescriptorSet write_data;
+    DW_ZERO_MEMORY(write_data);
+
+    write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_data.descriptorCount = DynamicInstances::kMaxInstances;
+    write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write_data.pBufferInfo     = buffer_infos.data();
+    write_data.dstBinding      = 0;
+    write_data.dstSet          = state.ds->handle();
+
+    vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
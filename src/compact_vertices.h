@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vk.h>
+#include <unordered_map>
+#include <vector>
+#include "scene.h"
+
+// Quantized copy of the vertices of every mesh, 24 bytes per vertex instead of the 80 of Vertex: a float3 position, a half2
+// texture coordinate, and an octahedral normal and tangent of 2x16 bits each. The tangent also carries the sign of the bitangent,
+// which the shaders rebuild from the normal and the tangent (see compact_vertex.glsl).
+//
+// Built with HYBRID_RENDERING_COMPACT_VERTICES, the G-Buffer vertex shader pulls its vertices from these buffers and the hit
+// shaders decode their triangles from them. Every pipeline that reads them binds the descriptor set of the current scene:
+//
+//   m_common_resources->compact_vertices->descriptor_set(m_common_resources->current_scene())
+//
+// Meshes are encoded when they are loaded, from the vertices SceneCache read for them, before their acceleration structure is
+// built:
+//
+//   m_common_resources->compact_vertices->add_mesh(mesh, data);
+//
+// The compact buffer replaces the vertex buffer of the mesh, which releases the full vertices. Set 0 binds it as Vertices but
+// only compact_vertex.glsl reads it, and the acceleration structure is built from its positions.
+// The set holds one buffer per instance, indexed like the Instance buffer of the scene (gl_InstanceCustomIndexEXT), and is built
+// again whenever the instances point to different meshes. The index buffers still come from the meshes.
+class CompactVertices
+{
+public:
+    // Matches CompactVertex in compact_vertex.glsl.
+    struct Vertex
+    {
+        float    position[3];
+        uint32_t tex_coord;
+        uint32_t normal;
+        uint32_t tangent;
+    };
+
+    struct Stats
+    {
+        uint32_t     num_meshes   = 0;
+        uint32_t     num_vertices = 0;
+        VkDeviceSize full_size    = 0;
+        VkDeviceSize compact_size = 0;
+    };
+
+public:
+    CompactVertices(std::weak_ptr<dw::vk::Backend> backend);
+    ~CompactVertices();
+
+    void                       add_mesh(Mesh::Ptr mesh, const MeshData& data);
+    dw::vk::DescriptorSet::Ptr descriptor_set(Scene::Ptr scene);
+    void                       gui();
+
+    inline dw::vk::DescriptorSetLayout::Ptr ds_layout() { return m_ds_layout; }
+    inline Stats                            stats() { return m_stats; }
+
+    static Vertex encode(const ::Vertex& vertex);
+
+private:
+    struct SceneState
+    {
+        std::vector<const Mesh*>   meshes;
+        dw::vk::DescriptorSet::Ptr ds;
+    };
+
+private:
+    void write_descriptor_set(Scene::Ptr scene, SceneState& state);
+
+private:
+    std::weak_ptr<dw::vk::Backend>                       m_backend;
+    dw::vk::DescriptorSetLayout::Ptr                     m_ds_layout;
+    std::unordered_map<const Mesh*, dw::vk::Buffer::Ptr> m_buffers;
+    std::unordered_map<uint32_t, SceneState>             m_scenes;
+    Stats                                                m_stats;
+};
@@ -1,6 +1,7 @@
 #include "ddgi.h"
 #include "utilities.h"
 #include "g_buffer.h"
+#include "pass_timings.h"
 #include <stdexcept>
 #include <logger.h>
 #include <profiler.h>
@@ -89,19 +90,53 @@ DDGI::~DDGI()
 
 void DDGI::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("DDGI", cmd_buf);
+    HR_SCOPED_SAMPLE("DDGI", cmd_buf);
 
-    // If the scene has changed re-initialize the probe grid
-    if (m_last_scene_id != m_common_resources->current_scene()->id())
-        initialize_probe_grid();
+    update_probes(cmd_buf);
+    sample_probes(cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::update_probes(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (m_probe_update_active)
+    {
+        // If the scene has changed re-initialize the probe grid
+        if (m_last_scene_id != m_common_resources->current_scene()->id())
+            initialize_probe_grid();
+
+        update_properties_ubo();
+        ray_trace(cmd_buf);
+        probe_update(cmd_buf);
+
+        m_first_frame = false;
+        m_ping_pong   = !m_ping_pong;
+    }
+    else
+    {
+        // The probes stop tracking changes in the scene while culled, so they are rebuilt from scratch afterwards.
+        m_first_frame = true;
+    }
+
+    // The probes are sampled by the reflections as well.
+    const uint32_t latest_idx = static_cast<uint32_t>(!m_ping_pong);
 
-    update_properties_ubo();
-    ray_trace(cmd_buf);
-    probe_update(cmd_buf);
-    sample_probe_grid(cmd_buf);
+    m_frame_graph.export_image(m_probe_grid.irradiance_image[latest_idx], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.export_image(m_probe_grid.depth_image[latest_idx], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.barrier(cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    m_first_frame = false;
-    m_ping_pong   = !m_ping_pong;
+void DDGI::sample_probes(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    // Unlike the probe update this reads the G-Buffer.
+    if (m_sampling_active)
+        sample_probe_grid(cmd_buf);
+
+    m_frame_graph.export_image(m_sample_probe_grid.image, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    m_frame_graph.barrier(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -179,13 +214,21 @@ void DDGI::create_images()
 
     // Ray Trace
     {
-        m_ray_trace.radiance_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        TransientAllocator* allocator = m_common_resources->transient_allocator.get();
+
+        // Only read by the probe update, release the previous images first so that their memory can be reused right away.
+        m_ray_trace.radiance_view.reset();
+        m_ray_trace.radiance_image.reset();
+        m_ray_trace.direction_depth_view.reset();
+        m_ray_trace.direction_depth_image.reset();
+
+        m_ray_trace.radiance_image = allocator->create_image(m_ray_trace.rays_per_probe, total_probes, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, TransientAllocator::QUEUE_GRAPHICS, TransientAllocator::PASS_DDGI_PROBE_UPDATE, TransientAllocator::PASS_DDGI_PROBE_UPDATE);
         m_ray_trace.radiance_image->set_name("DDGI Ray Trace Radiance");
 
         m_ray_trace.radiance_view = dw::vk::ImageView::create(backend, m_ray_trace.radiance_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_ray_trace.radiance_view->set_name("DDGI Ray Trace Radiance");
 
-        m_ray_trace.direction_depth_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_ray_trace.direction_depth_image = allocator->create_image(m_ray_trace.rays_per_probe, total_probes, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, TransientAllocator::QUEUE_GRAPHICS, TransientAllocator::PASS_DDGI_PROBE_UPDATE, TransientAllocator::PASS_DDGI_PROBE_UPDATE);
         m_ray_trace.direction_depth_image->set_name("DDGI Ray Trace Direction Depth");
 
         m_ray_trace.direction_depth_view = dw::vk::ImageView::create(backend, m_ray_trace.direction_depth_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -600,19 +643,6 @@ void DDGI::create_pipelines()
         dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rchit.spv");
         dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rmiss.spv");
 
-        dw::vk::ShaderBindingTable::Desc sbt_desc;
-
-        sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
-        sbt_desc.add_miss_group(rmiss, "main");
-
-        m_ray_trace.sbt = dw::vk::ShaderBindingTable::create(vk_backend, sbt_desc);
-
-        dw::vk::RayTracingPipeline::Desc desc;
-
-        desc.set_max_pipeline_ray_recursion_depth(1);
-        desc.set_shader_binding_table(m_ray_trace.sbt);
-
         // ---------------------------------------------------------------------------
         // Create pipeline layout
         // ---------------------------------------------------------------------------
@@ -624,13 +654,14 @@ void DDGI::create_pipelines()
         pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+#if defined(COMPACT_VERTICES)
+        pl_desc.add_descriptor_set_layout(m_common_resources->compact_vertices->ds_layout());
+#endif
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
 
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
-
-        m_ray_trace.pipeline = dw::vk::RayTracingPipeline::create(vk_backend, desc);
+        m_ray_trace.pipeline = m_common_resources->pipeline_cache->create_ray_tracing_pipeline(rgen, rmiss, rchit, m_ray_trace.pipeline_layout);
     }
 
     // Probe Update
@@ -646,10 +677,6 @@ void DDGI::create_pipelines()
         m_probe_update.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
         m_probe_update.pipeline_layout->set_name("Probe Update Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_probe_update.pipeline_layout);
-
         std::string shaders[] = {
             "shaders/gi_irradiance_probe_update.comp.spv",
             "shaders/gi_depth_probe_update.comp.spv"
@@ -659,9 +686,7 @@ void DDGI::create_pipelines()
         {
             dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, shaders[i]);
 
-            comp_desc.set_shader_stage(module, "main");
-
-            m_probe_update.pipeline[i] = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+            m_probe_update.pipeline[i] = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_probe_update.pipeline_layout);
         }
     }
 
@@ -679,15 +704,9 @@ void DDGI::create_pipelines()
         m_sample_probe_grid.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
         m_sample_probe_grid.pipeline_layout->set_name("Sample Probe Grid Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_sample_probe_grid.pipeline_layout);
-
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_sample_probe_grid.comp.spv");
 
-        comp_desc.set_shader_stage(module, "main");
-
-        m_sample_probe_grid.pipeline = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+        m_sample_probe_grid.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_sample_probe_grid.pipeline_layout);
     }
 }
 
@@ -701,6 +720,8 @@ void DDGI::recreate_probe_grid_resources()
 
     m_first_frame = true;
 
+    m_frame_graph.reset();
+
     create_images();
     create_buffers();
     write_descriptor_sets();
@@ -739,41 +760,20 @@ void DDGI::update_properties_ubo()
 
 void DDGI::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    HR_SCOPED_SAMPLE("Ray Trace", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
     uint32_t read_idx = static_cast<uint32_t>(!m_ping_pong);
 
-    if (m_first_frame)
-    {
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_probe_grid.irradiance_image[read_idx]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_probe_grid.depth_image[read_idx]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-    }
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.radiance_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-        image_memory_barrier(m_ray_trace.direction_depth_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_READ_BIT);
+    m_frame_graph.alias(m_ray_trace.radiance_image);
+    m_frame_graph.alias(m_ray_trace.direction_depth_image);
+    m_frame_graph.write(m_ray_trace.radiance_image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, true);
+    m_frame_graph.write(m_ray_trace.direction_depth_image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, true);
+    m_frame_graph.read(m_probe_grid.irradiance_image[read_idx], FrameGraph::ACCESS_SAMPLED, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.read(m_probe_grid.depth_image[read_idx], FrameGraph::ACCESS_SAMPLED, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline->handle());
 
@@ -792,91 +792,60 @@ void DDGI::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
     };
 
     VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_common_resources->current_scene()->descriptor_set(),
         m_ray_trace.write_ds->handle(),
         m_common_resources->per_frame_ds->handle(),
         m_common_resources->current_skybox_ds->handle(),
-        m_probe_grid.read_ds[static_cast<uint32_t>(!m_ping_pong)]->handle(),
+        m_probe_grid.read_ds[read_idx]->handle(),
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->descriptor_set(m_common_resources->current_scene())->handle(),
+#endif
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 2, dynamic_offsets);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, sizeof(descriptor_sets) / sizeof(VkDescriptorSet), descriptor_sets, 2, dynamic_offsets);
 
     auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
 
     VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
     VkDeviceSize group_stride = group_size;
 
-    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->miss_group_offset(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->hit_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->ray_gen_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->miss_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->hit_group_offset(), group_stride, group_size };
     const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
 
     uint32_t num_total_probes = m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y * m_probe_grid.probe_counts.z;
 
     vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, m_ray_trace.rays_per_probe, num_total_probes, 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.radiance_image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.direction_depth_image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Probe Update", cmd_buf);
-
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    HR_SCOPED_SAMPLE("Probe Update", cmd_buf);
 
+    uint32_t read_idx  = static_cast<uint32_t>(!m_ping_pong);
     uint32_t write_idx = static_cast<uint32_t>(m_ping_pong);
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_probe_grid.irradiance_image[write_idx]->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_probe_grid.depth_image[write_idx]->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    // Both passes are independent, so they share a single barrier.
+    m_frame_graph.write(m_probe_grid.irradiance_image[write_idx], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.write(m_probe_grid.depth_image[write_idx], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_probe_grid.irradiance_image[read_idx], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_probe_grid.depth_image[read_idx], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_ray_trace.radiance_image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_ray_trace.direction_depth_image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     probe_update(cmd_buf, true);
     probe_update(cmd_buf, false);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_probe_grid.irradiance_image[write_idx]->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_probe_grid.depth_image[write_idx]->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
 {
-    DW_SCOPED_SAMPLE(is_irradiance ? "Irradiance" : "Depth", cmd_buf);
+    HR_SCOPED_SAMPLE(is_irradiance ? "Irradiance" : "Depth", cmd_buf);
 
     auto backend = m_backend.lock();
 
@@ -921,18 +890,14 @@ void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
 
 void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Sample Probe Grid", cmd_buf);
+    HR_SCOPED_SAMPLE("Sample Probe Grid", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_sample_probe_grid.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    m_frame_graph.write(m_sample_probe_grid.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_probe_grid.irradiance_image[static_cast<uint32_t>(!m_ping_pong)], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_probe_grid.depth_image[static_cast<uint32_t>(!m_ping_pong)], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_sample_probe_grid.pipeline->handle());
 
@@ -950,7 +915,7 @@ void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     VkDescriptorSet descriptor_sets[] = {
         m_sample_probe_grid.write_ds->handle(),
-        m_probe_grid.read_ds[static_cast<uint32_t>(m_ping_pong)]->handle(),
+        m_probe_grid.read_ds[static_cast<uint32_t>(!m_ping_pong)]->handle(),
         m_g_buffer->output_ds()->handle(),
         m_common_resources->per_frame_ds->handle()
     };
@@ -961,13 +926,6 @@ void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_sample_probe_grid.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_sample_probe_grid.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_sample_probe_grid.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common_resources.h"
+#include "frame_graph.h"
 
 #include <random>
 
@@ -13,6 +14,8 @@ public:
     ~DDGI();
 
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       update_probes(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       sample_probes(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
     dw::vk::DescriptorSet::Ptr current_read_ds();
@@ -31,6 +34,7 @@ public:
     inline void          set_infinite_bounce_intensity(float value) { m_ray_trace.infinite_bounce_intensity = value; }
     inline void          set_gi_intensity(float value) { m_sample_probe_grid.gi_intensity = value; }
     inline void          restart_accumulation() { m_first_frame = true; }
+    inline void          set_active(bool probe_update, bool sampling) { m_probe_update_active = probe_update; m_sampling_active = sampling; }
 
 private:
     void initialize_probe_grid();
@@ -56,13 +60,12 @@ private:
         dw::vk::DescriptorSet::Ptr       read_ds;
         dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
-        dw::vk::RayTracingPipeline::Ptr  pipeline;
+        Pipeline::Ptr                    pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
         dw::vk::Image::Ptr               radiance_image;
         dw::vk::Image::Ptr               direction_depth_image;
         dw::vk::ImageView::Ptr           radiance_view;
         dw::vk::ImageView::Ptr           direction_depth_view;
-        dw::vk::ShaderBindingTable::Ptr  sbt;
     };
 
     struct ProbeGrid
@@ -91,7 +94,7 @@ private:
         float                        depth_sharpness = 50.0f;
         float                        max_distance    = 4.0f;
         float                        normal_bias     = 0.25f;
-        dw::vk::ComputePipeline::Ptr pipeline[2];
+        Pipeline::Ptr                pipeline[2];
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
     };
 
@@ -100,7 +103,7 @@ private:
         float                        gi_intensity = 1.0f;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       image_view;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
         dw::vk::DescriptorSet::Ptr   write_ds;
         dw::vk::DescriptorSet::Ptr   read_ds;
@@ -118,8 +121,10 @@ private:
     uint32_t                              m_g_buffer_mip = 0;
     uint32_t                              m_width;
     uint32_t                              m_height;
-    bool                                  m_first_frame = true;
-    bool                                  m_ping_pong   = false;
+    bool                                  m_first_frame         = true;
+    bool                                  m_ping_pong           = false;
+    bool                                  m_probe_update_active = true;
+    bool                                  m_sampling_active     = true;
     std::random_device                    m_random_device;
     std::mt19937                          m_random_generator;
     std::uniform_real_distribution<float> m_random_distribution_zo;
@@ -129,4 +134,5 @@ private:
     ProbeUpdate                           m_probe_update;
     BorderUpdate                          m_border_update;
     SampleProbeGrid                       m_sample_probe_grid;
+    FrameGraph                            m_frame_graph;
 };
\ No newline at end of file
@@ -1,15 +1,20 @@
 #include "deferred_shading.h"
 #include "ray_traced_ao.h"
 #include "ray_traced_shadows.h"
+#include "point_light_shadows.h"
 #include "ray_traced_reflections.h"
 #include "g_buffer.h"
 #include "ddgi.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <profiler.h>
 #include <macros.h>
 #include <imgui.h>
 #include <logger.h>
 
+#define LIGHT_TILE_SIZE 16    // tiled_lights.glsl
+#define LIGHT_TILE_STRIDE 256 // Light count and up to MAX_LIGHTS_PER_TILE indices.
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct ShadingPushConstants
@@ -18,6 +23,7 @@ struct ShadingPushConstants
     int ao          = 1;
     int reflections = 1;
     int gi          = 1;
+    int restir      = 0;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -61,12 +67,19 @@ DeferredShading::~DeferredShading()
 void DeferredShading::render(dw::vk::CommandBuffer::Ptr cmd_buf,
                              RayTracedAO*               ao,
                              RayTracedShadows*          shadows,
+                             PointLightShadows*         point_light_shadows,
                              RayTracedReflections*      reflections,
                              DDGI*                      ddgi)
 {
-    DW_SCOPED_SAMPLE("Deferred Shading", cmd_buf);
+    HR_SCOPED_SAMPLE("Deferred Shading", cmd_buf);
+
+    // The ReSTIR reservoirs already hold the one light every pixel shades.
+    if (!shadows->restir_active())
+        cull_lights(cmd_buf);
+    else
+        m_light_culling.overflowed_tiles = 0;
 
-    render_shading(cmd_buf, ao, shadows, reflections, ddgi);
+    render_shading(cmd_buf, ao, shadows, point_light_shadows, reflections, ddgi);
     render_skybox(cmd_buf, ddgi);
 }
 
@@ -422,6 +435,26 @@ void DeferredShading::create_images()
         m_shading.view = dw::vk::ImageView::create(vk_backend, m_shading.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_shading.view->set_name("Deferred Image View");
     }
+
+    // Light Culling
+    {
+        m_light_culling.num_tiles_x = (m_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+        m_light_culling.num_tiles_y = (m_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+        m_light_culling.buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * LIGHT_TILE_STRIDE * m_light_culling.num_tiles_x * m_light_culling.num_tiles_y, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_light_culling.buffer->set_name("Tiled Lights");
+
+        m_light_culling.stats_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_light_culling.stats_buffer->set_name("Tiled Lights Stats");
+
+        for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        {
+            m_light_culling.stats_readback_buffer[i] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t), VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+            m_light_culling.stats_readback_buffer[i]->set_name("Tiled Lights Stats Readback " + std::to_string(i));
+
+            *(uint32_t*)m_light_culling.stats_readback_buffer[i]->mapped_ptr() = 0;
+        }
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -434,6 +467,20 @@ void DeferredShading::create_descriptor_sets()
     {
         m_shading.read_ds = vk_backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
     }
+
+    // Light Culling
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_light_culling.ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, desc);
+        m_light_culling.ds_layout->set_name("Tiled Lights DS Layout");
+
+        m_light_culling.ds = vk_backend->allocate_descriptor_set(m_light_culling.ds_layout);
+        m_light_culling.ds->set_name("Tiled Lights");
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -462,6 +509,35 @@ void DeferredShading::write_descriptor_sets()
 
         vkUpdateDescriptorSets(vk_backend->device(), 1, &write_data, 0, nullptr);
     }
+
+    // Light Culling
+    {
+        dw::vk::Buffer::Ptr buffers[] = {
+            m_light_culling.buffer,
+            m_light_culling.stats_buffer
+        };
+
+        VkDescriptorBufferInfo buffer_info[2];
+        VkWriteDescriptorSet   write_data[2];
+
+        for (int i = 0; i < 2; i++)
+        {
+            buffer_info[i].buffer = buffers[i]->handle();
+            buffer_info[i].offset = 0;
+            buffer_info[i].range  = VK_WHOLE_SIZE;
+
+            DW_ZERO_MEMORY(write_data[i]);
+
+            write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i].descriptorCount = 1;
+            write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[i].pBufferInfo     = &buffer_info[i];
+            write_data[i].dstBinding      = i;
+            write_data[i].dstSet          = m_light_culling.ds->handle();
+        }
+
+        vkUpdateDescriptorSets(vk_backend->device(), 2, &write_data[0], 0, nullptr);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -628,32 +704,35 @@ void DeferredShading::create_pipeline()
         desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_light_culling.ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
         desc.add_push_constant_range(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ShadingPushConstants));
 
         m_shading.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
-        m_shading.pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(vk_backend, "shaders/triangle.vert.spv", "shaders/deferred.frag.spv", m_shading.pipeline_layout, m_shading.rp);
+        m_shading.pipeline        = m_common_resources->pipeline_cache->create_post_process_pipeline("shaders/triangle.vert.spv", "shaders/deferred.frag.spv", m_shading.pipeline_layout, m_shading.rp);
     }
 
-    // Skybox
+    // Light Culling
     {
-        // ---------------------------------------------------------------------------
-        // Create shader modules
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/skybox.vert.spv");
-        dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/skybox.frag.spv");
+        dw::vk::PipelineLayout::Desc desc;
 
-        dw::vk::GraphicsPipeline::Desc pso_desc;
+        desc.add_descriptor_set_layout(m_light_culling.ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
 
-        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
-            .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
+        m_light_culling.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
+        m_light_culling.pipeline_layout->set_name("Light Culling Pipeline Layout");
 
-        // ---------------------------------------------------------------------------
-        // Create vertex input state
-        // ---------------------------------------------------------------------------
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/deferred_light_cull.comp.spv");
 
-        dw::vk::VertexInputStateDesc vertex_input_state_desc;
+        m_light_culling.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_light_culling.pipeline_layout);
+    }
 
+    // Skybox
+    {
         struct SkyboxVertex
         {
             glm::vec3 position;
@@ -661,99 +740,6 @@ void DeferredShading::create_pipeline()
             glm::vec2 texcoord;
         };
 
-        vertex_input_state_desc.add_binding_desc(0, sizeof(SkyboxVertex), VK_VERTEX_INPUT_RATE_VERTEX);
-
-        vertex_input_state_desc.add_attribute_desc(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
-        vertex_input_state_desc.add_attribute_desc(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SkyboxVertex, normal));
-        vertex_input_state_desc.add_attribute_desc(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SkyboxVertex, texcoord));
-
-        pso_desc.set_vertex_input_state(vertex_input_state_desc);
-
-        // ---------------------------------------------------------------------------
-        // Create pipeline input assembly state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
-
-        input_assembly_state_desc.set_primitive_restart_enable(false)
-            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-        pso_desc.set_input_assembly_state(input_assembly_state_desc);
-
-        // ---------------------------------------------------------------------------
-        // Create viewport state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ViewportStateDesc vp_desc;
-
-        vp_desc.add_viewport(0.0f, 0.0f, m_width, m_height, 0.0f, 1.0f)
-            .add_scissor(0, 0, m_width, m_height);
-
-        pso_desc.set_viewport_state(vp_desc);
-
-        // ---------------------------------------------------------------------------
-        // Create rasterization state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::RasterizationStateDesc rs_state;
-
-        rs_state.set_depth_clamp(VK_FALSE)
-            .set_rasterizer_discard_enable(VK_FALSE)
-            .set_polygon_mode(VK_POLYGON_MODE_FILL)
-            .set_line_width(1.0f)
-            .set_cull_mode(VK_CULL_MODE_NONE)
-            .set_front_face(VK_FRONT_FACE_COUNTER_CLOCKWISE)
-            .set_depth_bias(VK_FALSE);
-
-        pso_desc.set_rasterization_state(rs_state);
-
-        // ---------------------------------------------------------------------------
-        // Create multisample state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::MultisampleStateDesc ms_state;
-
-        ms_state.set_sample_shading_enable(VK_FALSE)
-            .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
-
-        pso_desc.set_multisample_state(ms_state);
-
-        // ---------------------------------------------------------------------------
-        // Create depth stencil state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::DepthStencilStateDesc ds_state;
-
-        ds_state.set_depth_test_enable(VK_TRUE)
-            .set_depth_write_enable(VK_FALSE)
-            .set_depth_compare_op(VK_COMPARE_OP_LESS_OR_EQUAL)
-            .set_depth_bounds_test_enable(VK_FALSE)
-            .set_stencil_test_enable(VK_FALSE);
-
-        pso_desc.set_depth_stencil_state(ds_state);
-
-        // ---------------------------------------------------------------------------
-        // Create color blend state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ColorBlendAttachmentStateDesc blend_att_desc;
-
-        blend_att_desc.set_color_write_mask(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)
-            .set_blend_enable(VK_FALSE);
-
-        dw::vk::ColorBlendStateDesc blend_state;
-
-        blend_state.set_logic_op_enable(VK_FALSE)
-            .set_logic_op(VK_LOGIC_OP_COPY)
-            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
-            .add_attachment(blend_att_desc);
-
-        pso_desc.set_color_blend_state(blend_state);
-
-        // ---------------------------------------------------------------------------
-        // Create pipeline layout
-        // ---------------------------------------------------------------------------
-
         dw::vk::PipelineLayout::Desc pl_desc;
 
         pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout)
@@ -761,156 +747,97 @@ void DeferredShading::create_pipeline()
 
         m_skybox.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
 
-        pso_desc.set_pipeline_layout(m_skybox.pipeline_layout);
-
-        // ---------------------------------------------------------------------------
-        // Create dynamic state
-        // ---------------------------------------------------------------------------
-
-        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
-            .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
-
-        // ---------------------------------------------------------------------------
-        // Create pipeline
-        // ---------------------------------------------------------------------------
-
-        pso_desc.set_render_pass(m_skybox.rp);
-
-        m_skybox.pipeline = dw::vk::GraphicsPipeline::create(vk_backend, pso_desc);
+        GraphicsPipelineDesc pso_desc;
+
+        pso_desc.vertex_shader      = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/skybox.vert.spv");
+        pso_desc.fragment_shader    = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/skybox.frag.spv");
+        pso_desc.vertex_bindings    = { { 0, sizeof(SkyboxVertex), VK_VERTEX_INPUT_RATE_VERTEX } };
+        pso_desc.vertex_attributes  = { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+                                       { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SkyboxVertex, normal) },
+                                       { 2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SkyboxVertex, texcoord) } };
+        pso_desc.cull_mode          = VK_CULL_MODE_NONE;
+        pso_desc.front_face         = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        pso_desc.depth_test_enable  = VK_TRUE;
+        pso_desc.depth_write_enable = VK_FALSE;
+        pso_desc.depth_compare_op   = VK_COMPARE_OP_LESS_OR_EQUAL;
+        pso_desc.pipeline_layout    = m_skybox.pipeline_layout;
+        pso_desc.render_pass        = m_skybox.rp;
+
+        m_skybox.pipeline = m_common_resources->pipeline_cache->create_graphics_pipeline(pso_desc);
     }
 
-    // Visualize Probe Grid
-
     // Probe Visualization
     {
-        // ---------------------------------------------------------------------------
-        // Create shader modules
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_probe_visualization.vert.spv");
-        dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_probe_visualization.frag.spv");
-
-        dw::vk::GraphicsPipeline::Desc pso_desc;
-
-        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
-            .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
-
-        // ---------------------------------------------------------------------------
-        // Create vertex input state
-        // ---------------------------------------------------------------------------
-
-        pso_desc.set_vertex_input_state(m_common_resources->meshes[0]->vertex_input_state_desc());
-
-        // ---------------------------------------------------------------------------
-        // Create pipeline input assembly state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
-
-        input_assembly_state_desc.set_primitive_restart_enable(false)
-            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-        pso_desc.set_input_assembly_state(input_assembly_state_desc);
-
-        // ---------------------------------------------------------------------------
-        // Create viewport state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ViewportStateDesc vp_desc;
-
-        vp_desc.add_viewport(0.0f, 0.0f, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 0.0f, 1.0f)
-            .add_scissor(0, 0, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height);
-
-        pso_desc.set_viewport_state(vp_desc);
-
-        // ---------------------------------------------------------------------------
-        // Create rasterization state
-        // ---------------------------------------------------------------------------
-
-        dw::vk::RasterizationStateDesc rs_state;
-
-        rs_state.set_depth_clamp(VK_FALSE)
-            .set_rasterizer_discard_enable(VK_FALSE)
-            .set_polygon_mode(VK_POLYGON_MODE_FILL)
-            .set_line_width(1.0f)
-            .set_cull_mode(VK_CULL_MODE_BACK_BIT)
-            .set_front_face(VK_FRONT_FACE_CLOCKWISE)
-            .set_depth_bias(VK_FALSE);
-
-        pso_desc.set_rasterization_state(rs_state);
-
-        // ---------------------------------------------------------------------------
-        // Create multisample state
-        // ---------------------------------------------------------------------------
+        dw::vk::PipelineLayout::Desc pl_desc;
 
-        dw::vk::MultisampleStateDesc ms_state;
+        pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout)
+            .add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(VisualizeProbeGridPushConstants));
 
-        ms_state.set_sample_shading_enable(VK_FALSE)
-            .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
+        m_visualize_probe_grid.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
 
-        pso_desc.set_multisample_state(ms_state);
+        GraphicsPipelineDesc pso_desc;
 
-        // ---------------------------------------------------------------------------
-        // Create depth stencil state
-        // ---------------------------------------------------------------------------
+        pso_desc.vertex_shader      = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_probe_visualization.vert.spv");
+        pso_desc.fragment_shader    = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_probe_visualization.frag.spv");
+        pso_desc.cull_mode          = VK_CULL_MODE_BACK_BIT;
+        pso_desc.front_face         = VK_FRONT_FACE_CLOCKWISE;
+        pso_desc.depth_test_enable  = VK_TRUE;
+        pso_desc.depth_write_enable = VK_TRUE;
+        pso_desc.depth_compare_op   = VK_COMPARE_OP_LESS;
+        pso_desc.pipeline_layout    = m_visualize_probe_grid.pipeline_layout;
+        pso_desc.render_pass        = m_skybox.rp;
 
-        dw::vk::DepthStencilStateDesc ds_state;
+        // The probe sphere is a regular dw::Mesh so it always uses the full vertex layout.
+        pso_desc.add_mesh_vertex_input();
 
-        ds_state.set_depth_test_enable(VK_TRUE)
-            .set_depth_write_enable(VK_TRUE)
-            .set_depth_compare_op(VK_COMPARE_OP_LESS)
-            .set_depth_bounds_test_enable(VK_FALSE)
-            .set_stencil_test_enable(VK_FALSE);
+        m_visualize_probe_grid.pipeline = m_common_resources->pipeline_cache->create_graphics_pipeline(pso_desc);
+    }
+}
 
-        pso_desc.set_depth_stencil_state(ds_state);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        // ---------------------------------------------------------------------------
-        // Create color blend state
-        // ---------------------------------------------------------------------------
+void DeferredShading::cull_lights(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Light Culling", cmd_buf);
 
-        dw::vk::ColorBlendAttachmentStateDesc blend_att_desc;
+    auto vk_backend = m_backend.lock();
 
-        blend_att_desc.set_color_write_mask(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)
-            .set_blend_enable(VK_FALSE);
+    const uint32_t frame_idx = vk_backend->current_frame_idx();
 
-        dw::vk::ColorBlendStateDesc blend_state;
+    // The statistics were copied out by the last frame that used this frame index, which has finished by now.
+    m_light_culling.overflowed_tiles = *(const uint32_t*)m_light_culling.stats_readback_buffer[frame_idx]->mapped_ptr();
 
-        blend_state.set_logic_op_enable(VK_FALSE)
-            .set_logic_op(VK_LOGIC_OP_COPY)
-            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
-            .add_attachment(blend_att_desc);
+    // The shading of the previous frame read the lists, and its copy read the statistics.
+    pipeline_barrier(cmd_buf, { memory_barrier(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT) }, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-        pso_desc.set_color_blend_state(blend_state);
+    vkCmdFillBuffer(cmd_buf->handle(), m_light_culling.stats_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
 
-        // ---------------------------------------------------------------------------
-        // Create pipeline layout
-        // ---------------------------------------------------------------------------
+    pipeline_barrier(cmd_buf, { memory_barrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT) }, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-        dw::vk::PipelineLayout::Desc pl_desc;
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_light_culling.pipeline->handle());
 
-        pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout)
-            .add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout)
-            .add_push_constant_range(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(VisualizeProbeGridPushConstants));
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * frame_idx;
 
-        m_visualize_probe_grid.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
+    VkDescriptorSet descriptor_sets[] = {
+        m_light_culling.ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_common_resources->point_lights->ds()->handle(),
+        m_common_resources->per_frame_ds->handle()
+    };
 
-        pso_desc.set_pipeline_layout(m_visualize_probe_grid.pipeline_layout);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_light_culling.pipeline_layout->handle(), 0, 4, descriptor_sets, 1, &dynamic_offset);
 
-        // ---------------------------------------------------------------------------
-        // Create dynamic state
-        // ---------------------------------------------------------------------------
+    vkCmdDispatch(cmd_buf->handle(), m_light_culling.num_tiles_x, m_light_culling.num_tiles_y, 1);
 
-        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
-            .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+    pipeline_barrier(cmd_buf, { memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT) }, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-        // ---------------------------------------------------------------------------
-        // Create pipeline
-        // ---------------------------------------------------------------------------
+    VkBufferCopy region;
+    DW_ZERO_MEMORY(region);
 
-        pso_desc.set_render_pass(m_skybox.rp);
+    region.size = sizeof(uint32_t);
 
-        m_visualize_probe_grid.pipeline = dw::vk::GraphicsPipeline::create(vk_backend, pso_desc);
-    }
+    vkCmdCopyBuffer(cmd_buf->handle(), m_light_culling.stats_buffer->handle(), m_light_culling.stats_readback_buffer[frame_idx]->handle(), 1, &region);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -918,10 +845,11 @@ void DeferredShading::create_pipeline()
 void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
                                      RayTracedAO*               ao,
                                      RayTracedShadows*          shadows,
+                                     PointLightShadows*         point_light_shadows,
                                      RayTracedReflections*      reflections,
                                      DDGI*                      ddgi)
 {
-    DW_SCOPED_SAMPLE("Opaque", cmd_buf);
+    HR_SCOPED_SAMPLE("Opaque", cmd_buf);
 
     auto vk_backend = m_backend.lock();
 
@@ -971,6 +899,7 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
     push_constants.ao          = (float)m_shading.use_ray_traced_ao;
     push_constants.reflections = (float)m_shading.use_ray_traced_reflections;
     push_constants.gi          = (float)m_shading.use_ddgi;
+    push_constants.restir      = shadows->restir_active() ? 1 : 0;
 
     vkCmdPushConstants(cmd_buf->handle(), m_shading.pipeline_layout->handle(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -983,10 +912,14 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
         reflections->output_ds()->handle(),
         ddgi->output_ds()->handle(),
         m_common_resources->per_frame_ds->handle(),
-        m_common_resources->current_skybox_ds->handle()
+        m_common_resources->current_skybox_ds->handle(),
+        m_common_resources->point_lights->ds()->handle(),
+        point_light_shadows->output_ds()->handle(),
+        m_light_culling.ds->handle(),
+        shadows->reservoir_ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.pipeline_layout->handle(), 0, 11, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDraw(cmd_buf->handle(), 3, 1, 0, 0);
 
@@ -997,7 +930,7 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
 
 void DeferredShading::render_skybox(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi)
 {
-    DW_SCOPED_SAMPLE("Skybox", cmd_buf);
+    HR_SCOPED_SAMPLE("Skybox", cmd_buf);
 
     auto vk_backend = m_backend.lock();
 
@@ -1036,7 +969,7 @@ void DeferredShading::render_skybox(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* dd
     render_probes(cmd_buf, ddgi);
 
     {
-        DW_SCOPED_SAMPLE("Skybox", cmd_buf);
+        HR_SCOPED_SAMPLE("Skybox", cmd_buf);
 
         vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_skybox.pipeline->handle());
         vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_skybox.pipeline_layout->handle(), 0, 1, &m_common_resources->current_skybox_ds->handle(), 0, nullptr);
@@ -1064,7 +997,7 @@ void DeferredShading::render_probes(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* dd
 {
     if (m_visualize_probe_grid.enabled)
     {
-        DW_SCOPED_SAMPLE("DDGI Visualize Probe Grid", cmd_buf);
+        HR_SCOPED_SAMPLE("DDGI Visualize Probe Grid", cmd_buf);
 
         auto vk_backend = m_backend.lock();
 
@@ -5,11 +5,13 @@
 #include <cubemap_sh_projection.h>
 #include <cubemap_prefilter.h>
 #include <mesh.h>
+#include "pipeline_cache.h"
 
 struct CommonResources;
 class GBuffer;
 class RayTracedAO;
 class RayTracedShadows;
+class PointLightShadows;
 class RayTracedReflections;
 class DDGI;
 
@@ -22,24 +24,28 @@ public:
     void render(dw::vk::CommandBuffer::Ptr cmd_buf,
                 RayTracedAO*               ao,
                 RayTracedShadows*          shadows,
+                PointLightShadows*         point_light_shadows,
                 RayTracedReflections*      reflections,
                 DDGI*                      ddhgi);
 
     dw::vk::DescriptorSet::Ptr output_ds();
     dw::vk::Image::Ptr         output_image();
 
-    inline bool  use_ray_traced_ao() { return m_shading.use_ray_traced_ao; }
-    inline bool  use_ray_traced_shadows() { return m_shading.use_ray_traced_shadows; }
-    inline bool  use_ray_traced_reflections() { return m_shading.use_ray_traced_reflections; }
-    inline bool  use_ddgi() { return m_shading.use_ddgi; }
-    inline bool  visualize_probe_grid() { return m_visualize_probe_grid.enabled; }
-    inline float probe_visualization_scale() { return m_visualize_probe_grid.scale; }
-    inline void  set_use_ray_traced_ao(bool value) { m_shading.use_ray_traced_ao = value; }
-    inline void  set_use_ray_traced_shadows(bool value) { m_shading.use_ray_traced_shadows = value; }
-    inline void  set_use_ray_traced_reflections(bool value) { m_shading.use_ray_traced_reflections = value; }
-    inline void  set_use_ddgi(bool value) { m_shading.use_ddgi = value; }
-    inline void  set_visualize_probe_grid(bool value) { m_visualize_probe_grid.enabled = value; }
-    inline void  set_probe_visualization_scale(float value) { m_visualize_probe_grid.scale = value; }
+    inline bool     use_ray_traced_ao() { return m_shading.use_ray_traced_ao; }
+    inline bool     use_ray_traced_shadows() { return m_shading.use_ray_traced_shadows; }
+    inline bool     use_ray_traced_reflections() { return m_shading.use_ray_traced_reflections; }
+    inline bool     use_ddgi() { return m_shading.use_ddgi; }
+    inline bool     visualize_probe_grid() { return m_visualize_probe_grid.enabled; }
+    // Tiles that reached more lights than they can hold, as of the last frame whose statistics were read back.
+    inline uint32_t overflowed_light_tiles() { return m_light_culling.overflowed_tiles; }
+    inline uint32_t num_light_tiles() { return m_light_culling.num_tiles_x * m_light_culling.num_tiles_y; }
+    inline float    probe_visualization_scale() { return m_visualize_probe_grid.scale; }
+    inline void     set_use_ray_traced_ao(bool value) { m_shading.use_ray_traced_ao = value; }
+    inline void     set_use_ray_traced_shadows(bool value) { m_shading.use_ray_traced_shadows = value; }
+    inline void     set_use_ray_traced_reflections(bool value) { m_shading.use_ray_traced_reflections = value; }
+    inline void     set_use_ddgi(bool value) { m_shading.use_ddgi = value; }
+    inline void     set_visualize_probe_grid(bool value) { m_visualize_probe_grid.enabled = value; }
+    inline void     set_probe_visualization_scale(float value) { m_visualize_probe_grid.scale = value; }
 
 private:
     void load_sphere_mesh();
@@ -50,9 +56,11 @@ private:
     void create_render_pass();
     void create_framebuffer();
     void create_pipeline();
+    void cull_lights(dw::vk::CommandBuffer::Ptr cmd_buf);
     void render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
                         RayTracedAO*               ao,
                         RayTracedShadows*          shadows,
+                        PointLightShadows*         point_light_shadows,
                         RayTracedReflections*      reflections,
                         DDGI*                      ddgi);
     void render_skybox(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
@@ -84,15 +92,30 @@ private:
         dw::vk::Framebuffer::Ptr      fbo;
         dw::vk::Image::Ptr            image;
         dw::vk::ImageView::Ptr        view;
-        dw::vk::GraphicsPipeline::Ptr pipeline;
+        Pipeline::Ptr                 pipeline;
         dw::vk::PipelineLayout::Ptr   pipeline_layout;
         dw::vk::DescriptorSet::Ptr    read_ds;
     };
 
+    // Bins the point lights into 16x16 screen tiles, see tiled_lights.glsl.
+    struct LightCulling
+    {
+        uint32_t                         num_tiles_x;
+        uint32_t                         num_tiles_y;
+        uint32_t                         overflowed_tiles = 0;
+        dw::vk::Buffer::Ptr              buffer;
+        dw::vk::Buffer::Ptr              stats_buffer;
+        dw::vk::Buffer::Ptr              stats_readback_buffer[dw::vk::Backend::kMaxFramesInFlight];
+        dw::vk::DescriptorSetLayout::Ptr ds_layout;
+        dw::vk::DescriptorSet::Ptr       ds;
+        Pipeline::Ptr                    pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+    };
+
     struct Skybox
     {
         dw::vk::Buffer::Ptr           cube_vbo;
-        dw::vk::GraphicsPipeline::Ptr pipeline;
+        Pipeline::Ptr                 pipeline;
         dw::vk::PipelineLayout::Ptr   pipeline_layout;
         dw::vk::RenderPass::Ptr       rp;
         dw::vk::Framebuffer::Ptr      fbo[2];
@@ -103,7 +126,7 @@ private:
         bool                          enabled = false;
         float                         scale   = 1.0f;
         dw::Mesh::Ptr                 sphere_mesh;
-        dw::vk::GraphicsPipeline::Ptr pipeline;
+        Pipeline::Ptr                 pipeline;
         dw::vk::PipelineLayout::Ptr   pipeline_layout;
     };
 
@@ -113,6 +136,7 @@ private:
     CommonResources*               m_common_resources;
     GBuffer*                       m_g_buffer;
     Shading                        m_shading;
+    LightCulling                   m_light_culling;
     Skybox                         m_skybox;
     VisualizeProbeGrid             m_visualize_probe_grid;
 };
\ No newline at end of file
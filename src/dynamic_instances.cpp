@@ -0,0 +1,66 @@
+#include "dynamic_instances.h"
+#include <logger.h>
+#include <algorithm>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DynamicInstances::DynamicInstances(std::weak_ptr<dw::vk::Backend> backend) :
+    m_backend(backend)
+{
+    m_prev_transforms_buffer = dw::vk::Buffer::create(backend.lock(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, prev_transforms_size() * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    m_prev_transforms_buffer->set_name("Previous Instance Transforms");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DynamicInstances::~DynamicInstances()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Nothing has moved yet at this point, so the transforms the scene holds are the ones the previous frame was rendered with. A
+// scene that was just switched to starts without motion.
+void DynamicInstances::begin_frame(Scene::Ptr scene)
+{
+    const auto& instances = scene->instances();
+
+    if (scene != m_scene && instances.size() > kMaxInstances)
+        DW_LOG_ERROR("(DynamicInstances) Scene has more than " + std::to_string(kMaxInstances) + " instances, the hit shaders only see the first ones.");
+
+    m_scene = scene;
+    m_prev_transforms.resize(instances.size());
+
+    for (uint32_t i = 0; i < instances.size(); i++)
+        m_prev_transforms[i] = instances[i].transform;
+
+    auto     backend = m_backend.lock();
+    uint8_t* ptr     = (uint8_t*)m_prev_transforms_buffer->mapped_ptr();
+
+    memcpy(ptr + prev_transforms_offset(backend->current_frame_idx()), m_prev_transforms.data(), sizeof(glm::mat4) * std::min(uint32_t(m_prev_transforms.size()), kMaxInstances));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The TLAS picks the new transform up through TlasUpdater, which refits it.
+void DynamicInstances::set_transform(uint32_t instance_idx, const glm::mat4& transform)
+{
+    m_scene->instances()[instance_idx].transform = transform;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::mat4 DynamicInstances::prev_transform(uint32_t instance_idx)
+{
+    return m_prev_transforms[instance_idx];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool DynamicInstances::is_moving(uint32_t instance_idx)
+{
+    return m_prev_transforms[instance_idx] != m_scene->instances()[instance_idx].transform;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
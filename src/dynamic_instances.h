@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vk.h>
+#include <memory>
+#include <vector>
+#include "scene.h"
+
+// Moves the instances of the current scene and remembers where they were during the previous frame, which the motion vectors
+// and the temporal passes need to follow moving geometry:
+//
+//   m_common_resources->dynamic_instances->begin_frame(m_common_resources->current_scene());
+//   m_common_resources->dynamic_instances->set_transform(bunny_idx, transform);
+//
+// begin_frame() takes the snapshot, so it has to be called before any transform of the frame changes. The previous transforms
+// are also copied into a storage buffer indexed like the Instance buffer of the scene (gl_InstanceCustomIndexEXT), which the
+// G-Buffer exposes to the ray tracing hit shaders.
+class DynamicInstances
+{
+public:
+    static const uint32_t kMaxInstances = 1024;
+
+public:
+    DynamicInstances(std::weak_ptr<dw::vk::Backend> backend);
+    ~DynamicInstances();
+
+    void      begin_frame(Scene::Ptr scene);
+    void      set_transform(uint32_t instance_idx, const glm::mat4& transform);
+    glm::mat4 prev_transform(uint32_t instance_idx);
+    bool      is_moving(uint32_t instance_idx);
+
+    inline dw::vk::Buffer::Ptr prev_transforms_buffer() { return m_prev_transforms_buffer; }
+    inline VkDeviceSize        prev_transforms_size() { return sizeof(glm::mat4) * kMaxInstances; }
+    inline VkDeviceSize        prev_transforms_offset(uint32_t frame_idx) { return prev_transforms_size() * frame_idx; }
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    Scene::Ptr                     m_scene;
+    std::vector<glm::mat4>         m_prev_transforms;
+    dw::vk::Buffer::Ptr            m_prev_transforms_buffer;
+};
@@ -0,0 +1,220 @@
+#include "frame_graph.h"
+#include "utilities.h"
+#include <logger.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct AccessInfo
+{
+    VkImageLayout layout;
+    VkAccessFlags access;
+    bool          write;
+};
+
+static const AccessInfo kAccessInfos[] = {
+    { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, false },
+    { VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, false },
+    { VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, true },
+    { VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true },
+    { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, false },
+    { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, true }
+};
+
+static const VkAccessFlags kWriteAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+// Effects may record on different threads, so the counters are shared.
+static std::atomic<uint32_t> g_num_pipeline_barriers(0);
+static std::atomic<uint32_t> g_num_image_barriers(0);
+static std::atomic<uint32_t> g_num_skipped_accesses(0);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FrameGraph::Stats FrameGraph::frame_stats()
+{
+    Stats stats;
+
+    stats.pipeline_barriers = g_num_pipeline_barriers.load();
+    stats.image_barriers    = g_num_image_barriers.load();
+    stats.skipped_accesses  = g_num_skipped_accesses.load();
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::reset_frame_stats()
+{
+    g_num_pipeline_barriers.store(0);
+    g_num_image_barriers.store(0);
+    g_num_skipped_accesses.store(0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::read(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage)
+{
+    use(image, access, stage, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::write(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage, bool discard)
+{
+    use(image, access, stage, discard);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::export_image(dw::vk::Image::Ptr image, VkPipelineStageFlags consumer_stage)
+{
+    use(image, ACCESS_SAMPLED, consumer_stage, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::alias(dw::vk::Image::Ptr image)
+{
+    ImageState& state = m_images[image->handle()];
+
+    // Any earlier work on the queue may have used the memory for a different image, the next write has to wait for all of it.
+    state.layout       = VK_IMAGE_LAYOUT_UNDEFINED;
+    state.write_access = kWriteAccessMask;
+    state.write_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    state.read_stages  = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::memory_dependency(VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+    m_src_stages |= src_stage;
+    m_dst_stages |= dst_stage;
+    m_memory_src_access |= src_access;
+    m_memory_dst_access |= dst_access;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::barrier(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    for (auto image : m_pending_images)
+        m_images[image].pending_idx = -1;
+
+    m_pending_images.clear();
+
+    if (m_image_barriers.empty() && m_memory_dst_access == 0)
+        return;
+
+    // Nothing touched the images since they were created (or since the last frame graph reset).
+    if (m_src_stages == 0)
+        m_src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+    std::vector<VkMemoryBarrier> memory_barriers;
+
+    if (m_memory_dst_access != 0)
+        memory_barriers.push_back(memory_barrier(m_memory_src_access, m_memory_dst_access));
+
+    pipeline_barrier(cmd_buf, memory_barriers, m_image_barriers, m_src_stages, m_dst_stages);
+
+    g_num_pipeline_barriers++;
+    g_num_image_barriers += m_image_barriers.size();
+
+    m_image_barriers.clear();
+    m_src_stages        = 0;
+    m_dst_stages        = 0;
+    m_memory_src_access = 0;
+    m_memory_dst_access = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::reset()
+{
+    m_images.clear();
+    m_image_barriers.clear();
+    m_pending_images.clear();
+    m_src_stages        = 0;
+    m_dst_stages        = 0;
+    m_memory_src_access = 0;
+    m_memory_dst_access = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameGraph::use(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage, bool discard)
+{
+    const AccessInfo& info  = kAccessInfos[access];
+    ImageState&       state = m_images[image->handle()];
+
+    const bool layout_change = state.layout != info.layout;
+    bool       hazard        = layout_change;
+
+    if (info.write)
+        hazard = hazard || state.write_stages != 0 || state.read_stages != 0;
+    else
+        hazard = hazard || (state.write_stages != 0 && (state.read_stages & stage) != stage);
+
+    if (!hazard)
+    {
+        state.read_stages |= info.write ? 0 : stage;
+        g_num_skipped_accesses++;
+        return;
+    }
+
+    if (state.pending_idx != -1)
+    {
+        // Already transitioned for another access in the same pass, which is fine as long as both agree on the layout.
+        VkImageMemoryBarrier& pending = m_image_barriers[state.pending_idx];
+
+        if (pending.newLayout != info.layout)
+        {
+            DW_LOG_ERROR("(FrameGraph) Conflicting layouts for the same image within a single pass.");
+            return;
+        }
+
+        pending.dstAccessMask |= info.access;
+        m_dst_stages |= stage;
+    }
+    else
+    {
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+        VkImageMemoryBarrier image_barrier = image_memory_barrier(image,
+                                                                  discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout,
+                                                                  info.layout,
+                                                                  subresource_range,
+                                                                  state.write_access,
+                                                                  info.access);
+
+        image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+        state.pending_idx = m_image_barriers.size();
+
+        m_image_barriers.push_back(image_barrier);
+        m_pending_images.push_back(image->handle());
+
+        m_src_stages |= state.write_stages | state.read_stages;
+        m_dst_stages |= stage;
+    }
+
+    state.layout = info.layout;
+
+    if (info.write)
+    {
+        state.write_access = info.access & kWriteAccessMask;
+        state.write_stages = stage;
+        state.read_stages  = 0;
+    }
+    else if (layout_change)
+    {
+        // Later reads from other stages still have to wait for the layout transition.
+        state.write_access = 0;
+        state.write_stages = stage;
+        state.read_stages  = stage;
+    }
+    else
+        state.read_stages |= stage;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
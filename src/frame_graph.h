@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vk.h>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+// Tracks the layout and the last accesses of the images owned by an effect, and derives the barriers between its passes from
+// the accesses they declare:
+//
+//   m_frame_graph.write(m_a_trous.image[write_idx], FrameGraph::ACCESS_STORAGE_WRITE);
+//   m_frame_graph.read(m_a_trous.image[read_idx], FrameGraph::ACCESS_SAMPLED);
+//   m_frame_graph.barrier(cmd_buf);
+//
+// Everything declared before a call to barrier() is merged into a single vkCmdPipelineBarrier, accesses that are already
+// synchronized don't emit anything and the stage masks only cover the stages that actually touched the image. Transitions are
+// issued lazily by the next pass that needs them, so an image written in one pass and sampled in the next only changes layout once.
+//
+// Images shared with other effects are expected in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL between effects, use export_image()
+// for the outputs at the end of render(). All tracked images are color images. Buffers aren't tracked, dependencies on them are
+// declared with memory_dependency() and folded into the same barrier.
+//
+// Transient images share their memory with other images (see TransientAllocator), call alias() before the discarding write that
+// starts their lifetime each frame.
+class FrameGraph
+{
+public:
+    enum Access
+    {
+        ACCESS_SAMPLED,
+        ACCESS_STORAGE_READ,
+        ACCESS_STORAGE_WRITE,
+        ACCESS_STORAGE_READ_WRITE,
+        ACCESS_TRANSFER_SRC,
+        ACCESS_TRANSFER_DST
+    };
+
+    struct Stats
+    {
+        uint32_t pipeline_barriers = 0;
+        uint32_t image_barriers    = 0;
+        uint32_t skipped_accesses  = 0;
+    };
+
+public:
+    static Stats frame_stats();
+    static void  reset_frame_stats();
+
+    void read(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    void write(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, bool discard = false);
+    void export_image(dw::vk::Image::Ptr image, VkPipelineStageFlags consumer_stage);
+    void alias(dw::vk::Image::Ptr image);
+    void memory_dependency(VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+    void barrier(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void reset();
+
+private:
+    struct ImageState
+    {
+        VkImageLayout        layout       = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkAccessFlags        write_access = 0;
+        VkPipelineStageFlags write_stages = 0;
+        VkPipelineStageFlags read_stages  = 0;
+        int32_t              pending_idx  = -1;
+    };
+
+    void use(dw::vk::Image::Ptr image, Access access, VkPipelineStageFlags stage, bool discard);
+
+private:
+    std::unordered_map<VkImage, ImageState> m_images;
+    std::vector<VkImageMemoryBarrier>       m_image_barriers;
+    std::vector<VkImage>                    m_pending_images;
+    VkPipelineStageFlags                    m_src_stages        = 0;
+    VkPipelineStageFlags                    m_dst_stages        = 0;
+    VkAccessFlags                           m_memory_src_access = 0;
+    VkAccessFlags                           m_memory_dst_access = 0;
+};
@@ -1,28 +1,150 @@
 #include "g_buffer.h"
 #include "common_resources.h"
+#include "pass_timings.h"
+#include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
+#include <logger.h>
+#include <imgui.h>
+
+#define GBUFFER_MIP_LEVELS 3 // Full, half and quarter resolution, the scales the effects can trace at.
+#define GBUFFER_INITIAL_DRAWS 1024 // The draw motion buffer grows past this when a scene needs more.
+#define GBUFFER_CULL_NUM_THREADS 64
+#define GBUFFER_HIZ_NUM_THREADS 8
+#define GBUFFER_CULL_PHASE_EARLY 0
+#define GBUFFER_CULL_PHASE_LATE 1
+#define GBUFFER_CULL_NUM_STATS 4
+#define GBUFFER_RESOLVE_NUM_THREADS 8
+#define GBUFFER_INVALID_ID 0xFFFFFFFF
+#define GBUFFER_DOWNSAMPLE_NUM_THREADS 8
+#define GBUFFER_DOWNSAMPLE_FOOTPRINT 4
+
+// Must match G_BUFFER_3_FORMAT in g_buffer_common.glsl.
+#if defined(COMPACT_G_BUFFER)
+#define GBUFFER_3_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+#define GBUFFER_3_BYTES_PER_PIXEL 4
+#define GBUFFER_LAYOUT_NAME "Compact"
+#define GBUFFER_3_CLEAR_ALPHA 0.0f // Upper half of the mesh ID.
+#define GBUFFER_MAX_DRAWS 65536 // The mesh ID is stored in 16 bits.
+#else
+#define GBUFFER_3_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+#define GBUFFER_3_BYTES_PER_PIXEL 8
+#define GBUFFER_LAYOUT_NAME "Default"
+#define GBUFFER_3_CLEAR_ALPHA -1.0f // Linear Z of the sky.
+#define GBUFFER_MAX_DRAWS 2048 // The mesh ID is stored in a half float, which holds every integer up to 2048 exactly.
+#endif
+
+#define GBUFFER_BYTES_PER_PIXEL (4 + 8 + GBUFFER_3_BYTES_PER_PIXEL)
+
+// Matches the structures in g_buffer_cull.comp.
+struct DrawCandidate
+{
+    glm::vec4 aabb_min;
+    glm::vec4 aabb_max;
+    uint32_t  index_count;
+    uint32_t  first_index;
+    int32_t   vertex_offset;
+    uint32_t  instance_idx;
+    uint32_t  material_idx;
+    uint32_t  batch_idx;
+    uint32_t  batch_offset;
+    uint32_t  padding;
+};
 
-#define GBUFFER_MIP_LEVELS 9
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::mat4 prev_model;
+    glm::mat4 motion;
+};
 
-struct GBufferPushConstants
+struct DrawData
 {
     glm::mat4 model;
     glm::mat4 prev_model;
-    uint32_t  material_index;
+    uint32_t  material_idx;
     uint32_t  mesh_id;
+    uint32_t  instance_idx;
+    uint32_t  padding;
 };
 
+struct CullPushConstants
+{
+    glm::vec4 frustum_planes[6];
+    glm::vec2 hiz_size;
+    uint32_t  num_draws;
+    uint32_t  num_batches;
+    uint32_t  phase;
+    uint32_t  occlusion_culling;
+};
+
+// Planes of the frustum of a view projection matrix, pointing inwards. The near plane assumes a [-1, 1] depth range, which is
+// conservative for [0, 1].
+static void extract_frustum_planes(const glm::mat4& view_proj, glm::vec4* planes)
+{
+    const glm::mat4 m = glm::transpose(view_proj);
+
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+}
+
+static uint32_t previous_power_of_two(uint32_t x)
+{
+    uint32_t result = 1;
+
+    while (result * 2 <= x)
+        result *= 2;
+
+    return result;
+}
+
 GBuffer::GBuffer(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, uint32_t input_width, uint32_t input_height) :
     m_backend(backend), m_common_resources(common_resources), m_input_width(input_width), m_input_height(input_height)
 {
+    auto vk_backend = backend.lock();
+
+    VkPhysicalDeviceVulkan12Features features_12;
+    DW_ZERO_MEMORY(features_12);
+
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features;
+    DW_ZERO_MEMORY(features);
+
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features_12;
+
+    vkGetPhysicalDeviceFeatures2(vk_backend->physical_device(), &features);
+
+    m_draw_indirect_count = features_12.drawIndirectCount == VK_TRUE;
+    m_multi_draw_indirect = features.features.multiDrawIndirect == VK_TRUE;
+
+    // Without the count the culled draws are left as zero sized draws in the arguments and every candidate is issued.
+    if (!m_draw_indirect_count)
+        DW_LOG_INFO(m_multi_draw_indirect ? "(GBuffer) drawIndirectCount isn't supported, falling back to vkCmdDrawIndexedIndirect." : "(GBuffer) Neither drawIndirectCount nor multiDrawIndirect are supported, falling back to one vkCmdDrawIndexedIndirect per draw.");
+
     create_images();
+    create_buffers();
     create_descriptor_set_layouts();
     create_descriptor_sets();
     write_descriptor_sets();
     create_render_pass();
     create_framebuffer();
     create_pipeline();
+    create_cull_pipeline();
+    create_hiz_pipeline();
+    create_resolve_pipeline();
+    create_downsample_pipeline();
+
+    char buffer[512];
+
+    snprintf(buffer, sizeof(buffer), "(GBuffer) %s layout, %u bytes per pixel, %.1f MB for %ux%u including the lower levels and the previous frame.", GBUFFER_LAYOUT_NAME, GBUFFER_BYTES_PER_PIXEL, double(m_memory_size) / (1024.0 * 1024.0), m_input_width, m_input_height);
+
+    DW_LOG_INFO(buffer);
 }
 
 GBuffer::~GBuffer()
@@ -31,7 +153,7 @@ GBuffer::~GBuffer()
 
 void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("G-Buffer", cmd_buf);
+    HR_SCOPED_SAMPLE("G-Buffer", cmd_buf);
 
     // Transition history G-Buffer to shader read only during the first frame
     if (m_common_resources->first_frame)
@@ -59,44 +181,480 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             subresource_range);
 
-        subresource_range.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
         dw::vk::utilities::set_image_layout(
             cmd_buf->handle(),
-            m_depth[!m_common_resources->ping_pong]->handle(),
+            m_depth_mips[!m_common_resources->ping_pong]->handle(),
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             subresource_range);
+
+        // The HiZ stays in the general layout, it is written and sampled by compute shaders only.
+        subresource_range.levelCount = m_hiz_mip_levels;
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_hiz_image->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
     }
 
-    VkClearValue clear_values[4];
+    SceneDraws& draws = m_scene_draws[m_common_resources->current_scene()->id()];
+
+    // Draw what was visible during the previous frame.
+    cull(cmd_buf, draws, GBUFFER_CULL_PHASE_EARLY);
+
+    begin_render_pass(cmd_buf, m_visibility_buffer ? m_visibility_rp : m_rp);
+    draw(cmd_buf, draws, GBUFFER_CULL_PHASE_EARLY);
+    vkCmdEndRenderPass(cmd_buf->handle());
+
+    // Test everything else against the depth of those draws.
+    if (m_occlusion_culling)
+        build_hiz(cmd_buf);
+
+    cull(cmd_buf, draws, GBUFFER_CULL_PHASE_LATE);
+
+    begin_render_pass(cmd_buf, m_visibility_buffer ? m_visibility_late_rp : m_late_rp);
+    draw(cmd_buf, draws, GBUFFER_CULL_PHASE_LATE);
+    vkCmdEndRenderPass(cmd_buf->handle());
+
+    if (m_visibility_buffer)
+        resolve(cmd_buf, draws);
+
+    downsample_gbuffer(cmd_buf);
+}
+
+void GBuffer::gui()
+{
+    ImGui::Checkbox("Visibility Buffer", &m_visibility_buffer);
+    ImGui::Checkbox("Occlusion Culling", &m_occlusion_culling);
+
+    const uint32_t drawn  = m_culling_stats.drawn_early + m_culling_stats.drawn_late;
+    const uint32_t culled = m_culling_stats.frustum_culled + m_culling_stats.occlusion_culled;
+
+    ImGui::Text("Drawn: %u (Early: %u, Late: %u)", drawn, m_culling_stats.drawn_early, m_culling_stats.drawn_late);
+    ImGui::Text("Culled: %u (Frustum: %u, Occlusion: %u)", culled, m_culling_stats.frustum_culled, m_culling_stats.occlusion_culled);
+    ImGui::Text("Layout: %s (%u bytes per pixel, %.1f MB)", GBUFFER_LAYOUT_NAME, GBUFFER_BYTES_PER_PIXEL, double(m_memory_size) / (1024.0 * 1024.0));
+}
+
+void GBuffer::update(Scene::Ptr scene)
+{
+    scene_draws(scene);
+}
+
+GBuffer::SceneDraws& GBuffer::scene_draws(Scene::Ptr scene)
+{
+    const auto& instances = scene->instances();
+
+    SceneDraws& draws = m_scene_draws[scene->id()];
+
+    bool changed = !draws.candidates || draws.meshes.size() != instances.size();
+
+    for (uint32_t i = 0; i < instances.size() && !changed; i++)
+        changed = draws.meshes[i] != instances[i].mesh.lock().get();
+
+    if (changed)
+    {
+        // Frames in flight may still be drawing with the old buffers.
+        if (draws.candidates)
+            m_backend.lock()->wait_idle();
+
+        build_scene_draws(scene, draws);
+    }
+
+    return draws;
+}
+
+void GBuffer::build_scene_draws(Scene::Ptr scene, SceneDraws& draws)
+{
+    auto vk_backend = m_backend.lock();
+
+    const auto&    instances     = scene->instances();
+    const uint32_t num_instances = std::min(uint32_t(instances.size()), DynamicInstances::kMaxInstances);
+
+    draws.meshes.resize(instances.size());
+    draws.batches.clear();
+
+    for (uint32_t i = 0; i < instances.size(); i++)
+        draws.meshes[i] = instances[i].mesh.lock().get();
+
+    std::vector<DrawCandidate> candidates;
+
+    // The submeshes of all instances of a mesh go into the same batch.
+    for (uint32_t i = 0; i < num_instances; i++)
+    {
+        Mesh::Ptr mesh = instances[i].mesh.lock();
+
+        if (!mesh)
+            continue;
+
+        bool batched = false;
+
+        for (const auto& batch : draws.batches)
+            batched = batched || batch.mesh == mesh;
+
+        if (batched)
+            continue;
+
+        DrawBatch batch;
+
+        batch.mesh       = mesh;
+        batch.first_draw = candidates.size();
+
+        for (uint32_t instance_idx = i; instance_idx < num_instances; instance_idx++)
+        {
+            if (instances[instance_idx].mesh.lock() != mesh)
+                continue;
+
+            for (const auto& submesh : mesh->sub_meshes())
+            {
+                DrawCandidate candidate;
+
+                candidate.aabb_min      = glm::vec4(submesh.min_extents, 0.0f);
+                candidate.aabb_max      = glm::vec4(submesh.max_extents, 0.0f);
+                candidate.index_count   = submesh.index_count;
+                candidate.first_index   = submesh.base_index;
+                candidate.vertex_offset = 0;
+                candidate.instance_idx  = instance_idx;
+                candidate.material_idx  = scene->material_index(mesh->material(submesh.mat_idx)->id());
+                candidate.batch_idx     = draws.batches.size();
+                candidate.batch_offset  = batch.first_draw;
+                candidate.padding       = 0;
+
+                candidates.push_back(candidate);
+            }
+        }
+
+        batch.num_draws = candidates.size() - batch.first_draw;
+
+        draws.batches.push_back(batch);
+    }
+
+    // The buffers grow with the scene, the mesh ID written into the G-Buffer is what limits the number of draws.
+    if (candidates.size() > GBUFFER_MAX_DRAWS)
+    {
+#if defined(COMPACT_G_BUFFER)
+        DW_LOG_ERROR("(GBuffer) Scene has " + std::to_string(candidates.size()) + " submeshes, the 16-bit mesh IDs of the compact layout only hold " + std::to_string(GBUFFER_MAX_DRAWS) + ". The rest won't be drawn.");
+#else
+        DW_LOG_ERROR("(GBuffer) Scene has " + std::to_string(candidates.size()) + " submeshes, the half float mesh IDs of the default layout only hold " + std::to_string(GBUFFER_MAX_DRAWS) + ". The rest won't be drawn, build with HYBRID_RENDERING_COMPACT_G_BUFFER for up to 65536.");
+#endif
+
+        candidates.resize(GBUFFER_MAX_DRAWS);
+
+        for (auto& batch : draws.batches)
+        {
+            uint32_t last_draw = std::min(batch.first_draw + batch.num_draws, uint32_t(GBUFFER_MAX_DRAWS));
+
+            batch.first_draw = std::min(batch.first_draw, uint32_t(GBUFFER_MAX_DRAWS));
+            batch.num_draws  = last_draw - batch.first_draw;
+        }
+    }
+
+    draws.num_draws = candidates.size();
+
+    reserve_draw_motion(draws.num_draws);
+
+    const size_t num_draws   = std::max(size_t(1), candidates.size());
+    const size_t num_batches = std::max(size_t(1), draws.batches.size());
+
+    draws.visibility = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * num_draws, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    draws.visibility->set_name("G-Buffer Draw Visibility");
+
+    draws.reset_visibility = true;
+
+    draws.candidates = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(DrawCandidate) * num_draws, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, candidates.empty() ? nullptr : candidates.data());
+    draws.candidates->set_name("G-Buffer Draw Candidates");
 
-    clear_values[0].color.float32[0] = 0.0f;
-    clear_values[0].color.float32[1] = 0.0f;
-    clear_values[0].color.float32[2] = 0.0f;
-    clear_values[0].color.float32[3] = 0.0f;
+    for (uint32_t frame_idx = 0; frame_idx < dw::vk::Backend::kMaxFramesInFlight; frame_idx++)
+    {
+        draws.draw_args[frame_idx] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDrawIndexedIndirectCommand) * num_draws * 2, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        draws.draw_args[frame_idx]->set_name("G-Buffer Draw Args " + std::to_string(frame_idx));
+
+        draws.draw_data[frame_idx] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(DrawData) * num_draws * 2, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        draws.draw_data[frame_idx]->set_name("G-Buffer Draw Data " + std::to_string(frame_idx));
+
+        draws.draw_counts[frame_idx] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * num_batches * 2, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        draws.draw_counts[frame_idx]->set_name("G-Buffer Draw Counts " + std::to_string(frame_idx));
+
+        draws.ds[frame_idx] = vk_backend->allocate_descriptor_set(m_draw_ds_layout);
+
+        dw::vk::Buffer::Ptr buffers[] = {
+            draws.candidates,
+            m_instance_data[frame_idx],
+            draws.draw_args[frame_idx],
+            draws.draw_data[frame_idx],
+            draws.draw_counts[frame_idx],
+            draws.visibility,
+            m_stats_buffer[frame_idx]
+        };
+
+        VkDescriptorBufferInfo buffer_info[7];
+        VkWriteDescriptorSet   write_data[8];
+
+        for (int i = 0; i < 7; i++)
+        {
+            buffer_info[i].buffer = buffers[i]->handle();
+            buffer_info[i].offset = 0;
+            buffer_info[i].range  = VK_WHOLE_SIZE;
+
+            DW_ZERO_MEMORY(write_data[i]);
+
+            write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i].descriptorCount = 1;
+            write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[i].pBufferInfo     = &buffer_info[i];
+            write_data[i].dstBinding      = i;
+            write_data[i].dstSet          = draws.ds[frame_idx]->handle();
+        }
+
+        VkDescriptorImageInfo image_info;
+
+        image_info.sampler     = vk_backend->nearest_sampler()->handle();
+        image_info.imageView   = m_hiz_view->handle();
+        image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        DW_ZERO_MEMORY(write_data[7]);
+
+        write_data[7].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[7].descriptorCount = 1;
+        write_data[7].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[7].pImageInfo      = &image_info;
+        write_data[7].dstBinding      = 7;
+        write_data[7].dstSet          = draws.ds[frame_idx]->handle();
+
+        vkUpdateDescriptorSets(vk_backend->device(), 8, &write_data[0], 0, nullptr);
+    }
+}
+
+void GBuffer::cull(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws, uint32_t phase)
+{
+    HR_SCOPED_SAMPLE(phase == GBUFFER_CULL_PHASE_EARLY ? "Early Cull" : "Late Cull", cmd_buf);
+
+    auto           vk_backend = m_backend.lock();
+    const uint32_t frame_idx  = vk_backend->current_frame_idx();
+
+    if (phase == GBUFFER_CULL_PHASE_EARLY)
+    {
+        // The only per frame work on the CPU, one entry per instance.
+        const auto&    instances     = m_common_resources->current_scene()->instances();
+        const uint32_t num_instances = std::min(uint32_t(instances.size()), DynamicInstances::kMaxInstances);
+
+        InstanceData* instance_data = (InstanceData*)m_instance_data[frame_idx]->mapped_ptr();
+
+        for (uint32_t i = 0; i < num_instances; i++)
+        {
+            const glm::mat4 prev_transform = m_common_resources->dynamic_instances->prev_transform(i);
+
+            instance_data[i].model      = instances[i].transform;
+            instance_data[i].prev_model = prev_transform;
+            instance_data[i].motion     = prev_transform == instances[i].transform ? glm::mat4(1.0f) : prev_transform * glm::inverse(instances[i].transform);
+        }
+
+        // The statistics were written by the last frame that used this frame index, which has finished by now.
+        const uint32_t* stats = (const uint32_t*)m_stats_buffer[frame_idx]->mapped_ptr();
+
+        m_culling_stats.drawn_early      = stats[0];
+        m_culling_stats.drawn_late       = stats[1];
+        m_culling_stats.frustum_culled   = stats[2];
+        m_culling_stats.occlusion_culled = stats[3];
+
+        vkCmdFillBuffer(cmd_buf->handle(), draws.draw_counts[frame_idx]->handle(), 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(cmd_buf->handle(), m_stats_buffer[frame_idx]->handle(), 0, VK_WHOLE_SIZE, 0);
+
+        // Without drawIndirectCount every argument of a batch is drawn, the ones the culling pass doesn't write have to draw nothing.
+        if (!m_draw_indirect_count)
+        {
+            vkCmdFillBuffer(cmd_buf->handle(), draws.draw_args[frame_idx]->handle(), 0, VK_WHOLE_SIZE, 0);
+            m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        }
+
+        // Nothing was visible in a scene that is rendered for the first time, the late phase draws all of it.
+        if (draws.reset_visibility)
+        {
+            vkCmdFillBuffer(cmd_buf->handle(), draws.visibility->handle(), 0, VK_WHOLE_SIZE, 0);
+            draws.reset_visibility = false;
+        }
+
+        m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        m_frame_graph.barrier(cmd_buf);
+    }
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline->handle());
+
+    CullPushConstants push_constants;
+
+    extract_frustum_planes(m_common_resources->projection * m_common_resources->view, push_constants.frustum_planes);
+    push_constants.hiz_size          = glm::vec2(float(m_hiz_width), float(m_hiz_height));
+    push_constants.num_draws         = draws.num_draws;
+    push_constants.num_batches       = std::max(uint32_t(1), uint32_t(draws.batches.size()));
+    push_constants.phase             = phase;
+    push_constants.occlusion_culling = m_occlusion_culling ? 1 : 0;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_cull_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * frame_idx;
+
+    VkDescriptorSet descriptor_sets[] = {
+        draws.ds[frame_idx]->handle(),
+        output_ds()->handle(),
+        m_common_resources->per_frame_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(draws.num_draws) / float(GBUFFER_CULL_NUM_THREADS))), 1, 1);
+
+    // The draws are consumed by the G-Buffer pass, the draw motion by the reprojection passes later in the frame.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                    VK_ACCESS_SHADER_WRITE_BIT,
+                                    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    if (phase == GBUFFER_CULL_PHASE_LATE)
+        m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+    m_frame_graph.barrier(cmd_buf);
+}
 
-    clear_values[1].color.float32[0] = 0.0f;
-    clear_values[1].color.float32[1] = 0.0f;
-    clear_values[1].color.float32[2] = 0.0f;
-    clear_values[1].color.float32[3] = 0.0f;
+void GBuffer::draw(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws, uint32_t phase)
+{
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_visibility_buffer ? m_visibility_pipeline->handle() : m_pipeline->handle());
+
+    auto           vk_backend     = m_backend.lock();
+    const uint32_t frame_idx      = vk_backend->current_frame_idx();
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * frame_idx;
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set(),
+        m_common_resources->per_frame_ds->handle(),
+        draws.ds[frame_idx]->handle(),
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->descriptor_set(m_common_resources->current_scene())->handle()
+#endif
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout->handle(), 0, sizeof(descriptor_sets) / sizeof(VkDescriptorSet), descriptor_sets, 1, &dynamic_offset);
+
+    const uint32_t draw_base  = phase * draws.num_draws;
+    const uint32_t batch_base = phase * std::max(uint32_t(1), uint32_t(draws.batches.size()));
+
+    for (uint32_t batch_idx = 0; batch_idx < draws.batches.size(); batch_idx++)
+    {
+        const DrawBatch& batch = draws.batches[batch_idx];
+
+#if !defined(COMPACT_VERTICES)
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &batch.mesh->vertex_buffer()->handle(), &offset);
+#endif
+        vkCmdBindIndexBuffer(cmd_buf->handle(), batch.mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+        const VkDeviceSize args_offset = sizeof(VkDrawIndexedIndirectCommand) * (draw_base + batch.first_draw);
+
+        if (m_draw_indirect_count)
+        {
+            vkCmdDrawIndexedIndirectCount(cmd_buf->handle(),
+                                          draws.draw_args[frame_idx]->handle(),
+                                          args_offset,
+                                          draws.draw_counts[frame_idx]->handle(),
+                                          sizeof(uint32_t) * (batch_base + batch_idx),
+                                          batch.num_draws,
+                                          sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else if (m_multi_draw_indirect)
+            vkCmdDrawIndexedIndirect(cmd_buf->handle(), draws.draw_args[frame_idx]->handle(), args_offset, batch.num_draws, sizeof(VkDrawIndexedIndirectCommand));
+        else
+        {
+            for (uint32_t i = 0; i < batch.num_draws; i++)
+                vkCmdDrawIndexedIndirect(cmd_buf->handle(), draws.draw_args[frame_idx]->handle(), args_offset + sizeof(VkDrawIndexedIndirectCommand) * i, 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+}
+
+void GBuffer::resolve(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws)
+{
+    HR_SCOPED_SAMPLE("Resolve", cmd_buf);
+
+    auto           vk_backend     = m_backend.lock();
+    const uint32_t frame_idx      = vk_backend->current_frame_idx();
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * frame_idx;
+    const uint32_t ping_pong      = static_cast<uint32_t>(m_common_resources->ping_pong);
+
+    dw::vk::Image::Ptr images[] = { m_image_1[ping_pong], m_image_2[ping_pong], m_image_3[ping_pong] };
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // Every pixel is written, nothing of the previous contents is kept.
+    for (auto& image : images)
+        dw::vk::utilities::set_image_layout(cmd_buf->handle(), image->handle(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range);
 
-    clear_values[2].color.float32[0] = 0.0f;
-    clear_values[2].color.float32[1] = 0.0f;
-    clear_values[2].color.float32[2] = 0.0f;
-    clear_values[2].color.float32[3] = -1.0f;
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_resolve_pipeline->handle());
 
-    clear_values[3].depthStencil.depth = 1.0f;
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set(),
+        m_common_resources->per_frame_ds->handle(),
+        draws.ds[frame_idx]->handle(),
+        m_resolve_ds[ping_pong]->handle(),
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->descriptor_set(m_common_resources->current_scene())->handle()
+#endif
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_resolve_pipeline_layout->handle(), 0, sizeof(descriptor_sets) / sizeof(VkDescriptorSet), descriptor_sets, 1, &dynamic_offset);
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_input_width) / float(GBUFFER_RESOLVE_NUM_THREADS))), static_cast<uint32_t>(ceil(float(m_input_height) / float(GBUFFER_RESOLVE_NUM_THREADS))), 1);
+
+    // Leave them where the render pass would have, ready for the downsampling.
+    for (auto& image : images)
+        dw::vk::utilities::set_image_layout(cmd_buf->handle(), image->handle(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range);
+}
+
+void GBuffer::begin_render_pass(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::RenderPass::Ptr rp)
+{
+    // Ignored by the late render pass, which loads what the early one drew.
+    VkClearValue clear_values[4];
 
     VkRenderPassBeginInfo info    = {};
     info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    info.renderPass               = m_rp->handle();
-    info.framebuffer              = m_fbo[m_common_resources->ping_pong]->handle();
+    info.renderPass               = rp->handle();
     info.renderArea.extent.width  = m_input_width;
     info.renderArea.extent.height = m_input_height;
-    info.clearValueCount          = 4;
     info.pClearValues             = &clear_values[0];
 
+    if (m_visibility_buffer)
+    {
+        clear_values[0].color.uint32[0] = GBUFFER_INVALID_ID;
+        clear_values[0].color.uint32[1] = GBUFFER_INVALID_ID;
+        clear_values[0].color.uint32[2] = 0;
+        clear_values[0].color.uint32[3] = 0;
+
+        clear_values[1].depthStencil.depth = 1.0f;
+
+        info.framebuffer     = m_visibility_fbo[m_common_resources->ping_pong]->handle();
+        info.clearValueCount = 2;
+    }
+    else
+    {
+        clear_values[0].color.float32[0] = 0.0f;
+        clear_values[0].color.float32[1] = 0.0f;
+        clear_values[0].color.float32[2] = 0.0f;
+        clear_values[0].color.float32[3] = 0.0f;
+
+        clear_values[1].color.float32[0] = 0.0f;
+        clear_values[1].color.float32[1] = 0.0f;
+        clear_values[1].color.float32[2] = 0.0f;
+        clear_values[1].color.float32[3] = 0.0f;
+
+        clear_values[2].color.float32[0] = 0.0f;
+        clear_values[2].color.float32[1] = 0.0f;
+        clear_values[2].color.float32[2] = 0.0f;
+        clear_values[2].color.float32[3] = GBUFFER_3_CLEAR_ALPHA;
+
+        clear_values[3].depthStencil.depth = 1.0f;
+
+        info.framebuffer     = m_fbo[m_common_resources->ping_pong]->handle();
+        info.clearValueCount = 4;
+    }
+
     vkCmdBeginRenderPass(cmd_buf->handle(), &info, VK_SUBPASS_CONTENTS_INLINE);
 
     VkViewport vp;
@@ -118,61 +676,29 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
     scissor_rect.offset.y      = 0;
 
     vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
+}
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline->handle());
-
-    auto           vk_backend     = m_backend.lock();
-    const uint32_t dynamic_offset = m_common_resources->ubo_size * vk_backend->current_frame_idx();
-
-    VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_common_resources->per_frame_ds->handle()
-    };
-
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout->handle(), 0, 2, descriptor_sets, 1, &dynamic_offset);
-
-    uint32_t mesh_id = 0;
+void GBuffer::build_hiz(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("HiZ", cmd_buf);
 
-    const auto& instances = m_common_resources->current_scene()->instances();
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_hiz_pipeline->handle());
 
-    for (uint32_t instance_idx = 0; instance_idx < instances.size(); instance_idx++)
+    // Every level keeps the farthest depth of the level above it, starting from the depth buffer of the early phase.
+    for (uint32_t mip_idx = 0; mip_idx < m_hiz_mip_levels; mip_idx++)
     {
-        const auto& instance = instances[instance_idx];
+        const uint32_t width  = std::max(1u, m_hiz_width >> mip_idx);
+        const uint32_t height = std::max(1u, m_hiz_height >> mip_idx);
 
-        if (!instance.mesh.expired())
-        {
-            const auto& mesh      = instance.mesh.lock();
-            const auto& submeshes = mesh->sub_meshes();
-
-            VkDeviceSize offset = 0;
-            vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &mesh->vertex_buffer()->handle(), &offset);
-            vkCmdBindIndexBuffer(cmd_buf->handle(), mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+        VkDescriptorSet descriptor_set = m_hiz_ds[static_cast<uint32_t>(m_common_resources->ping_pong)][mip_idx]->handle();
 
-            for (uint32_t submesh_idx = 0; submesh_idx < submeshes.size(); submesh_idx++)
-            {
-                auto& submesh = submeshes[submesh_idx];
-                auto& mat     = mesh->material(submesh.mat_idx);
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_hiz_pipeline_layout->handle(), 0, 1, &descriptor_set, 0, nullptr);
 
-                GBufferPushConstants push_constants;
+        vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(width) / float(GBUFFER_HIZ_NUM_THREADS))), static_cast<uint32_t>(ceil(float(height) / float(GBUFFER_HIZ_NUM_THREADS))), 1);
 
-                push_constants.model          = instance.transform;
-                push_constants.prev_model     = instance.transform;
-                push_constants.material_index = m_common_resources->current_scene()->material_index(mat->id());
-                push_constants.mesh_id        = mesh_id;
-
-                vkCmdPushConstants(cmd_buf->handle(), m_pipeline_layout->handle(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
-
-                // Issue draw call.
-                vkCmdDrawIndexed(cmd_buf->handle(), submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
-
-                mesh_id++;
-            }
-        }
+        m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        m_frame_graph.barrier(cmd_buf);
     }
-
-    vkCmdEndRenderPass(cmd_buf->handle());
-
-    downsample_gbuffer(cmd_buf);
 }
 
 dw::vk::DescriptorSetLayout::Ptr GBuffer::ds_layout()
@@ -182,12 +708,12 @@ dw::vk::DescriptorSetLayout::Ptr GBuffer::ds_layout()
 
 dw::vk::DescriptorSet::Ptr GBuffer::output_ds()
 {
-    return m_ds[static_cast<uint32_t>(m_common_resources->ping_pong)];
+    return m_ds[m_backend.lock()->current_frame_idx()][static_cast<uint32_t>(m_common_resources->ping_pong)];
 }
 
 dw::vk::DescriptorSet::Ptr GBuffer::history_ds()
 {
-    return m_ds[static_cast<uint32_t>(!m_common_resources->ping_pong)];
+    return m_ds[m_backend.lock()->current_frame_idx()][static_cast<uint32_t>(!m_common_resources->ping_pong)];
 }
 
 dw::vk::ImageView::Ptr GBuffer::depth_fbo_image_view(uint32_t idx)
@@ -195,14 +721,64 @@ dw::vk::ImageView::Ptr GBuffer::depth_fbo_image_view(uint32_t idx)
     return m_depth_fbo_view[idx];
 }
 
+void GBuffer::shared_images(std::vector<AsyncCompute::SharedImage>& images)
+{
+    // Both the current and the history G-Buffer are read by the ray traced effects.
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        images.push_back({ m_image_1[i], VK_IMAGE_ASPECT_COLOR_BIT });
+        images.push_back({ m_image_2[i], VK_IMAGE_ASPECT_COLOR_BIT });
+        images.push_back({ m_image_3[i], VK_IMAGE_ASPECT_COLOR_BIT });
+        images.push_back({ m_depth_mips[i], VK_IMAGE_ASPECT_COLOR_BIT });
+    }
+}
+
+void GBuffer::shared_buffers(std::vector<dw::vk::Buffer::Ptr>& buffers)
+{
+    // Written by the culling pass, read by the reprojection of the ray traced effects.
+    buffers.push_back(m_draw_motion_buffer);
+}
+
 void GBuffer::downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Downsample", cmd_buf);
+    HR_SCOPED_SAMPLE("Downsample", cmd_buf);
+
+    const uint32_t ping_pong = static_cast<uint32_t>(m_common_resources->ping_pong);
+
+    // The first level of the G-Buffer images is already sampled, everything the pass writes is overwritten entirely.
+    VkImageSubresourceRange lower_levels = { VK_IMAGE_ASPECT_COLOR_BIT, 1, GBUFFER_MIP_LEVELS - 1, 0, 1 };
+    VkImageSubresourceRange all_levels   = { VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS, 0, 1 };
 
-    m_image_1[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_image_2[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_image_3[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_depth[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT, VK_FILTER_NEAREST);
+    std::vector<VkImageMemoryBarrier> image_barriers = {
+        image_memory_barrier(m_image_1[ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, lower_levels, 0, VK_ACCESS_SHADER_WRITE_BIT),
+        image_memory_barrier(m_image_2[ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, lower_levels, 0, VK_ACCESS_SHADER_WRITE_BIT),
+        image_memory_barrier(m_image_3[ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, lower_levels, 0, VK_ACCESS_SHADER_WRITE_BIT),
+        image_memory_barrier(m_depth_mips[ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, all_levels, 0, VK_ACCESS_SHADER_WRITE_BIT)
+    };
+
+    // The images were read as the history G-Buffer of the previous frame.
+    pipeline_barrier(cmd_buf, {}, image_barriers, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_downsample_pipeline->handle());
+
+    VkDescriptorSet descriptor_set = m_downsample_ds[ping_pong]->handle();
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_downsample_pipeline_layout->handle(), 0, 1, &descriptor_set, 0, nullptr);
+
+    // Every thread writes all the levels of its footprint, one dispatch covers the whole G-Buffer.
+    const uint32_t texels_per_group = GBUFFER_DOWNSAMPLE_NUM_THREADS * GBUFFER_DOWNSAMPLE_FOOTPRINT;
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_input_width) / float(texels_per_group))), static_cast<uint32_t>(ceil(float(m_input_height) / float(texels_per_group))), 1);
+
+    for (auto& barrier : image_barriers)
+    {
+        barrier.oldLayout     = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    pipeline_barrier(cmd_buf, {}, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
 }
 
 void GBuffer::create_images()
@@ -211,18 +787,21 @@ void GBuffer::create_images()
 
     for (int i = 0; i < 2; i++)
     {
-        m_image_1[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_1[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_1[i]->set_name("G-Buffer 1 Image " + std::to_string(i));
 
-        m_image_2[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_2[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_2[i]->set_name("G-Buffer 2 Image " + std::to_string(i));
 
-        m_image_3[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_3[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, GBUFFER_3_FORMAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_3[i]->set_name("G-Buffer 3 Image " + std::to_string(i));
 
-        m_depth[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, vk_backend->swap_chain_depth_format(), VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_depth[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, 1, 1, vk_backend->swap_chain_depth_format(), VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_depth[i]->set_name("G-Buffer Depth Image " + std::to_string(i));
 
+        m_depth_mips[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_depth_mips[i]->set_name("G-Buffer Depth Mips Image " + std::to_string(i));
+
         m_image_1_view[i] = dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
         m_image_1_view[i]->set_name("G-Buffer 1 Image View " + std::to_string(i));
 
@@ -232,8 +811,8 @@ void GBuffer::create_images()
         m_image_3_view[i] = dw::vk::ImageView::create(vk_backend, m_image_3[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
         m_image_3_view[i]->set_name("G-Buffer 3 Image View " + std::to_string(i));
 
-        m_depth_view[i] = dw::vk::ImageView::create(vk_backend, m_depth[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, 0, GBUFFER_MIP_LEVELS);
-        m_depth_view[i]->set_name("G-Buffer Depth Image View " + std::to_string(i));
+        m_depth_mips_view[i] = dw::vk::ImageView::create(vk_backend, m_depth_mips[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
+        m_depth_mips_view[i]->set_name("G-Buffer Depth Mips Image View " + std::to_string(i));
 
         m_image_1_fbo_view[i] = dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_image_1_fbo_view[i]->set_name("G-Buffer 1 FBO Image View " + std::to_string(i));
@@ -246,9 +825,92 @@ void GBuffer::create_images()
 
         m_depth_fbo_view[i] = dw::vk::ImageView::create(vk_backend, m_depth[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
         m_depth_fbo_view[i]->set_name("G-Buffer Depth FBO Image View " + std::to_string(i));
+
+        // Written by the downsampling pass.
+        for (uint32_t mip_idx = 0; mip_idx < GBUFFER_MIP_LEVELS; mip_idx++)
+        {
+            m_image_1_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip_idx, 1));
+            m_image_2_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_2[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip_idx, 1));
+            m_image_3_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_3[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip_idx, 1));
+            m_depth_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_depth_mips[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip_idx, 1));
+
+            m_memory_size += VkDeviceSize(std::max(m_input_width >> mip_idx, 1u)) * std::max(m_input_height >> mip_idx, 1u) * GBUFFER_BYTES_PER_PIXEL;
+        }
+    }
+
+    // Only the visibility buffer mode rasterizes into it, the resolve pass writes the G-Buffer images from it.
+    m_visibility_image = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, 1, 1, VK_FORMAT_R32G32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
+    m_visibility_image->set_name("G-Buffer Visibility Image");
+
+    m_visibility_view = dw::vk::ImageView::create(vk_backend, m_visibility_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+    m_visibility_view->set_name("G-Buffer Visibility Image View");
+
+    // Power of two levels keep the texels of every level aligned with the ones of the level above it.
+    m_hiz_width      = previous_power_of_two(m_input_width);
+    m_hiz_height     = previous_power_of_two(m_input_height);
+    m_hiz_mip_levels = static_cast<uint32_t>(floor(log2(float(std::max(m_hiz_width, m_hiz_height))))) + 1;
+
+    m_hiz_image = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_hiz_width, m_hiz_height, 1, m_hiz_mip_levels, 1, VK_FORMAT_R32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+    m_hiz_image->set_name("G-Buffer HiZ Image");
+
+    m_hiz_view = dw::vk::ImageView::create(vk_backend, m_hiz_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, m_hiz_mip_levels);
+    m_hiz_view->set_name("G-Buffer HiZ Image View");
+
+    m_hiz_mip_views.resize(m_hiz_mip_levels);
+
+    for (uint32_t i = 0; i < m_hiz_mip_levels; i++)
+    {
+        m_hiz_mip_views[i] = dw::vk::ImageView::create(vk_backend, m_hiz_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+        m_hiz_mip_views[i]->set_name("G-Buffer HiZ Mip " + std::to_string(i) + " Image View");
+    }
+}
+
+void GBuffer::create_buffers()
+{
+    auto vk_backend = m_backend.lock();
+
+    // Written by the culling pass.
+    m_draw_motion_capacity = GBUFFER_INITIAL_DRAWS;
+    m_draw_motion_buffer   = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, draw_motion_size() * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_draw_motion_buffer->set_name("G-Buffer Draw Motion");
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        m_instance_data[i] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(InstanceData) * DynamicInstances::kMaxInstances, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_instance_data[i]->set_name("G-Buffer Instance Data " + std::to_string(i));
+
+        m_stats_buffer[i] = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * GBUFFER_CULL_NUM_STATS, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_stats_buffer[i]->set_name("G-Buffer Culling Stats " + std::to_string(i));
     }
 }
 
+void GBuffer::reserve_draw_motion(uint32_t num_draws)
+{
+    if (num_draws <= m_draw_motion_capacity)
+        return;
+
+    auto vk_backend = m_backend.lock();
+
+    // Frames in flight may still read the old buffer.
+    vk_backend->wait_idle();
+
+    m_draw_motion_capacity = std::min(std::max(num_draws, m_draw_motion_capacity * 2), uint32_t(GBUFFER_MAX_DRAWS));
+    m_draw_motion_buffer   = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, draw_motion_size() * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_draw_motion_buffer->set_name("G-Buffer Draw Motion");
+
+    write_descriptor_sets();
+}
+
+VkDeviceSize GBuffer::draw_motion_size()
+{
+    return sizeof(glm::mat4) * m_draw_motion_capacity;
+}
+
+VkDeviceSize GBuffer::draw_motion_offset(uint32_t frame_idx)
+{
+    return draw_motion_size() * frame_idx;
+}
+
 void GBuffer::create_descriptor_set_layouts()
 {
     dw::vk::DescriptorSetLayout::Desc desc;
@@ -257,148 +919,328 @@ void GBuffer::create_descriptor_set_layouts()
     desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
     desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
     desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+    desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+    desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
 
     auto vk_backend = m_backend.lock();
     m_ds_layout     = dw::vk::DescriptorSetLayout::create(vk_backend, desc);
     m_ds_layout->set_name("G-Buffer DS Layout");
+
+    dw::vk::DescriptorSetLayout::Desc draw_desc;
+
+    draw_desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    draw_desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    draw_desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    draw_desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    draw_desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    draw_desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    draw_desc.add_binding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    draw_desc.add_binding(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_draw_ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, draw_desc);
+    m_draw_ds_layout->set_name("G-Buffer Draw DS Layout");
+
+    dw::vk::DescriptorSetLayout::Desc hiz_desc;
+
+    hiz_desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    hiz_desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_hiz_ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, hiz_desc);
+    m_hiz_ds_layout->set_name("G-Buffer HiZ DS Layout");
+
+    dw::vk::DescriptorSetLayout::Desc resolve_desc;
+
+    resolve_desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    resolve_desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    resolve_desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    resolve_desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_resolve_ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, resolve_desc);
+    m_resolve_ds_layout->set_name("G-Buffer Resolve DS Layout");
+
+    dw::vk::DescriptorSetLayout::Desc downsample_desc;
+
+    downsample_desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    downsample_desc.add_binding(7, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_downsample_ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, downsample_desc);
+    m_downsample_ds_layout->set_name("G-Buffer Downsample DS Layout");
 }
 
 void GBuffer::create_descriptor_sets()
 {
     auto vk_backend = m_backend.lock();
 
+    // One set per frame in flight, the motion buffers are rewritten every frame.
+    for (int frame_idx = 0; frame_idx < dw::vk::Backend::kMaxFramesInFlight; frame_idx++)
+    {
+        for (int i = 0; i < 2; i++)
+            m_ds[frame_idx][i] = vk_backend->allocate_descriptor_set(m_ds_layout);
+    }
+
     for (int i = 0; i < 2; i++)
-        m_ds[i] = vk_backend->allocate_descriptor_set(m_ds_layout);
+    {
+        m_resolve_ds[i]    = vk_backend->allocate_descriptor_set(m_resolve_ds_layout);
+        m_downsample_ds[i] = vk_backend->allocate_descriptor_set(m_downsample_ds_layout);
+        m_hiz_ds[i].resize(m_hiz_mip_levels);
+
+        for (uint32_t mip_idx = 0; mip_idx < m_hiz_mip_levels; mip_idx++)
+            m_hiz_ds[i][mip_idx] = vk_backend->allocate_descriptor_set(m_hiz_ds_layout);
+    }
 }
 
 void GBuffer::write_descriptor_sets()
 {
     auto vk_backend = m_backend.lock();
 
+    for (int frame_idx = 0; frame_idx < dw::vk::Backend::kMaxFramesInFlight; frame_idx++)
+    {
+        VkDescriptorBufferInfo buffer_info[2];
+
+        buffer_info[0].buffer = m_draw_motion_buffer->handle();
+        buffer_info[0].offset = draw_motion_offset(frame_idx);
+        buffer_info[0].range  = draw_motion_size();
+
+        buffer_info[1].buffer = m_common_resources->dynamic_instances->prev_transforms_buffer()->handle();
+        buffer_info[1].offset = m_common_resources->dynamic_instances->prev_transforms_offset(frame_idx);
+        buffer_info[1].range  = m_common_resources->dynamic_instances->prev_transforms_size();
+
+        for (int i = 0; i < 2; i++)
+        {
+            VkDescriptorImageInfo image_info[4];
+
+            image_info[0].sampler     = vk_backend->nearest_sampler()->handle();
+            image_info[0].imageView   = m_image_1_view[i]->handle();
+            image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[1].sampler     = vk_backend->nearest_sampler()->handle();
+            image_info[1].imageView   = m_image_2_view[i]->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[2].sampler     = vk_backend->nearest_sampler()->handle();
+            image_info[2].imageView   = m_image_3_view[i]->handle();
+            image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[3].sampler     = vk_backend->nearest_sampler()->handle();
+            image_info[3].imageView   = m_depth_mips_view[i]->handle();
+            image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write_data[6];
+
+            for (int j = 0; j < 6; j++)
+            {
+                DW_ZERO_MEMORY(write_data[j]);
+
+                write_data[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[j].descriptorCount = 1;
+                write_data[j].dstBinding      = j;
+                write_data[j].dstSet          = m_ds[frame_idx][i]->handle();
+
+                if (j < 4)
+                {
+                    write_data[j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                    write_data[j].pImageInfo     = &image_info[j];
+                }
+                else
+                {
+                    write_data[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                    write_data[j].pBufferInfo    = &buffer_info[j - 4];
+                }
+            }
+
+            vkUpdateDescriptorSets(vk_backend->device(), 6, &write_data[0], 0, nullptr);
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (uint32_t mip_idx = 0; mip_idx < m_hiz_mip_levels; mip_idx++)
+        {
+            VkDescriptorImageInfo image_info[2];
+
+            // The early render pass leaves the depth buffer in a read only layout.
+            image_info[0].sampler     = vk_backend->nearest_sampler()->handle();
+            image_info[0].imageView   = mip_idx == 0 ? m_depth_fbo_view[i]->handle() : m_hiz_mip_views[mip_idx - 1]->handle();
+            image_info[0].imageLayout = mip_idx == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+            image_info[1].sampler     = VK_NULL_HANDLE;
+            image_info[1].imageView   = m_hiz_mip_views[mip_idx]->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet write_data[2];
+
+            for (int j = 0; j < 2; j++)
+            {
+                DW_ZERO_MEMORY(write_data[j]);
+
+                write_data[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[j].descriptorCount = 1;
+                write_data[j].descriptorType  = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                write_data[j].pImageInfo      = &image_info[j];
+                write_data[j].dstBinding      = j;
+                write_data[j].dstSet          = m_hiz_ds[i][mip_idx]->handle();
+            }
+
+            vkUpdateDescriptorSets(vk_backend->device(), 2, &write_data[0], 0, nullptr);
+        }
+    }
+
+    // The resolve pass writes the first level of the G-Buffer images, the downsampling fills the rest like in the default mode.
     for (int i = 0; i < 2; i++)
     {
         VkDescriptorImageInfo image_info[4];
 
         image_info[0].sampler     = vk_backend->nearest_sampler()->handle();
-        image_info[0].imageView   = m_image_1_view[i]->handle();
+        image_info[0].imageView   = m_visibility_view->handle();
         image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-        image_info[1].sampler     = vk_backend->nearest_sampler()->handle();
-        image_info[1].imageView   = m_image_2_view[i]->handle();
-        image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        image_info[2].sampler     = vk_backend->nearest_sampler()->handle();
-        image_info[2].imageView   = m_image_3_view[i]->handle();
-        image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        dw::vk::ImageView::Ptr storage_views[] = { m_image_1_fbo_view[i], m_image_2_fbo_view[i], m_image_3_fbo_view[i] };
 
-        image_info[3].sampler     = vk_backend->nearest_sampler()->handle();
-        image_info[3].imageView   = m_depth_view[i]->handle();
-        image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        for (int j = 1; j < 4; j++)
+        {
+            image_info[j].sampler     = VK_NULL_HANDLE;
+            image_info[j].imageView   = storage_views[j - 1]->handle();
+            image_info[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
 
         VkWriteDescriptorSet write_data[4];
-        DW_ZERO_MEMORY(write_data[0]);
-        DW_ZERO_MEMORY(write_data[1]);
-        DW_ZERO_MEMORY(write_data[2]);
-        DW_ZERO_MEMORY(write_data[3]);
-
-        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[0].descriptorCount = 1;
-        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[0].pImageInfo      = &image_info[0];
-        write_data[0].dstBinding      = 0;
-        write_data[0].dstSet          = m_ds[i]->handle();
-
-        write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[1].descriptorCount = 1;
-        write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[1].pImageInfo      = &image_info[1];
-        write_data[1].dstBinding      = 1;
-        write_data[1].dstSet          = m_ds[i]->handle();
-
-        write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[2].descriptorCount = 1;
-        write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[2].pImageInfo      = &image_info[2];
-        write_data[2].dstBinding      = 2;
-        write_data[2].dstSet          = m_ds[i]->handle();
-
-        write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[3].descriptorCount = 1;
-        write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[3].pImageInfo      = &image_info[3];
-        write_data[3].dstBinding      = 3;
-        write_data[3].dstSet          = m_ds[i]->handle();
+
+        for (int j = 0; j < 4; j++)
+        {
+            DW_ZERO_MEMORY(write_data[j]);
+
+            write_data[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[j].descriptorCount = 1;
+            write_data[j].descriptorType  = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data[j].pImageInfo      = &image_info[j];
+            write_data[j].dstBinding      = j;
+            write_data[j].dstSet          = m_resolve_ds[i]->handle();
+        }
 
         vkUpdateDescriptorSets(vk_backend->device(), 4, &write_data[0], 0, nullptr);
     }
-}
 
+    // The downsampling pass reads the first level and writes every other one, the first level of the depth is a copy.
+    for (int i = 0; i < 2; i++)
+    {
+        VkDescriptorImageInfo sampled_info[4];
+
+        dw::vk::ImageView::Ptr sampled_views[] = { m_image_1_fbo_view[i], m_image_2_fbo_view[i], m_image_3_fbo_view[i], m_depth_fbo_view[i] };
+
+        for (int j = 0; j < 4; j++)
+        {
+            sampled_info[j].sampler     = vk_backend->nearest_sampler()->handle();
+            sampled_info[j].imageView   = sampled_views[j]->handle();
+            sampled_info[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+
+        std::vector<dw::vk::ImageView::Ptr>* storage_views[] = { &m_image_1_mip_views[i], &m_image_2_mip_views[i], &m_image_3_mip_views[i], &m_depth_mip_views[i] };
+        std::vector<VkDescriptorImageInfo>   storage_info[4];
+
+        for (int j = 0; j < 4; j++)
+        {
+            // Only the depth needs its first level.
+            for (uint32_t mip_idx = j == 3 ? 0 : 1; mip_idx < GBUFFER_MIP_LEVELS; mip_idx++)
+            {
+                VkDescriptorImageInfo info;
+
+                info.sampler     = VK_NULL_HANDLE;
+                info.imageView   = (*storage_views[j])[mip_idx]->handle();
+                info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+                storage_info[j].push_back(info);
+            }
+        }
+
+        VkWriteDescriptorSet write_data[8];
+
+        for (int j = 0; j < 8; j++)
+        {
+            DW_ZERO_MEMORY(write_data[j]);
+
+            write_data[j].sType      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[j].dstBinding = j;
+            write_data[j].dstSet     = m_downsample_ds[i]->handle();
+
+            if (j < 4)
+            {
+                write_data[j].descriptorCount = 1;
+                write_data[j].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write_data[j].pImageInfo      = &sampled_info[j];
+            }
+            else
+            {
+                write_data[j].descriptorCount = storage_info[j - 4].size();
+                write_data[j].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                write_data[j].pImageInfo      = storage_info[j - 4].data();
+            }
+        }
+
+        vkUpdateDescriptorSets(vk_backend->device(), 8, &write_data[0], 0, nullptr);
+    }
+}
 void GBuffer::create_render_pass()
 {
-    auto vk_backend = m_backend.lock();
-
-    std::vector<VkAttachmentDescription> attachments(4);
-
-    // GBuffer1 attachment
-    attachments[0].format         = VK_FORMAT_R8G8B8A8_UNORM;
-    attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
-    attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[0].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-
-    // GBuffer2 attachment
-    attachments[1].format         = VK_FORMAT_R16G16B16A16_SFLOAT;
-    attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
-    attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[1].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-
-    // GBuffer3 attachment
-    attachments[2].format         = VK_FORMAT_R16G16B16A16_SFLOAT;
-    attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
-    attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[2].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    // The early render pass clears its attachments and leaves them attached while the HiZ is built from its depth, the late
+    // render pass then loads them. Both are compatible, so they share the framebuffers and the pipeline.
+    m_rp      = build_render_pass({ VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R16G16B16A16_SFLOAT, GBUFFER_3_FORMAT }, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+    m_late_rp = build_render_pass({ VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R16G16B16A16_SFLOAT, GBUFFER_3_FORMAT }, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true);
+
+    // The visibility buffer is read by the resolve pass.
+    m_visibility_rp      = build_render_pass({ VK_FORMAT_R32G32_UINT }, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+    m_visibility_late_rp = build_render_pass({ VK_FORMAT_R32G32_UINT }, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true);
+}
 
-    // Depth attachment
-    attachments[3].format         = vk_backend->swap_chain_depth_format();
-    attachments[3].samples        = VK_SAMPLE_COUNT_1_BIT;
-    attachments[3].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[3].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[3].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+dw::vk::RenderPass::Ptr GBuffer::build_render_pass(const std::vector<VkFormat>& color_formats, VkImageLayout color_final_layout, bool late)
+{
+    auto vk_backend = m_backend.lock();
 
-    VkAttachmentReference gbuffer_references[3];
+    const uint32_t num_color_attachments = color_formats.size();
 
-    gbuffer_references[0].attachment = 0;
-    gbuffer_references[0].layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    std::vector<VkAttachmentDescription> attachments(num_color_attachments + 1);
+    std::vector<VkAttachmentReference>   color_references(num_color_attachments);
 
-    gbuffer_references[1].attachment = 1;
-    gbuffer_references[1].layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // Color attachments
+    for (uint32_t i = 0; i < num_color_attachments; i++)
+    {
+        attachments[i].format         = color_formats[i];
+        attachments[i].samples        = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp         = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[i].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[i].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout  = late ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[i].finalLayout    = late ? color_final_layout : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        color_references[i].attachment = i;
+        color_references[i].layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
 
-    gbuffer_references[2].attachment = 2;
-    gbuffer_references[2].layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // Depth attachment
+    attachments[num_color_attachments].format         = vk_backend->swap_chain_depth_format();
+    attachments[num_color_attachments].samples        = VK_SAMPLE_COUNT_1_BIT;
+    attachments[num_color_attachments].loadOp         = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[num_color_attachments].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[num_color_attachments].stencilLoadOp  = late ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[num_color_attachments].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[num_color_attachments].initialLayout  = late ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[num_color_attachments].finalLayout    = late ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
     VkAttachmentReference depth_reference;
-    depth_reference.attachment = 3;
+    depth_reference.attachment = num_color_attachments;
     depth_reference.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     std::vector<VkSubpassDescription> subpass_description(1);
 
     subpass_description[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass_description[0].colorAttachmentCount    = 3;
-    subpass_description[0].pColorAttachments       = gbuffer_references;
+    subpass_description[0].colorAttachmentCount    = num_color_attachments;
+    subpass_description[0].pColorAttachments       = color_references.data();
     subpass_description[0].pDepthStencilAttachment = &depth_reference;
     subpass_description[0].inputAttachmentCount    = 0;
     subpass_description[0].pInputAttachments       = nullptr;
@@ -409,23 +1251,47 @@ void GBuffer::create_render_pass()
     // Subpass dependencies for layout transitions
     std::vector<VkSubpassDependency> dependencies(2);
 
-    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
-    dependencies[0].dstSubpass      = 0;
-    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependencies[0].srcAccessMask   = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    dependencies[1].srcSubpass      = 0;
-    dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
-    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    if (late)
+    {
+        // Continue where the early render pass left off, after the HiZ is done reading the depth buffer.
+        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass      = 0;
+        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+        // Read by the downsampling pass or the resolve pass.
+        dependencies[1].srcSubpass      = 0;
+        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[1].dependencyFlags = 0;
+    }
+    else
+    {
+        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass      = 0;
+        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+        // The HiZ reads the depth buffer.
+        dependencies[1].srcSubpass      = 0;
+        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].srcAccessMask   = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[1].dependencyFlags = 0;
+    }
 
-    m_rp = dw::vk::RenderPass::create(vk_backend, attachments, subpass_description, dependencies);
+    return dw::vk::RenderPass::create(vk_backend, attachments, subpass_description, dependencies);
 }
 
 void GBuffer::create_framebuffer()
@@ -433,140 +1299,123 @@ void GBuffer::create_framebuffer()
     auto vk_backend = m_backend.lock();
 
     for (int i = 0; i < 2; i++)
-        m_fbo[i] = dw::vk::Framebuffer::create(vk_backend, m_rp, { m_image_1_fbo_view[i], m_image_2_fbo_view[i], m_image_3_fbo_view[i], m_depth_fbo_view[i] }, m_input_width, m_input_height, 1);
+    {
+        m_fbo[i]            = dw::vk::Framebuffer::create(vk_backend, m_rp, { m_image_1_fbo_view[i], m_image_2_fbo_view[i], m_image_3_fbo_view[i], m_depth_fbo_view[i] }, m_input_width, m_input_height, 1);
+        m_visibility_fbo[i] = dw::vk::Framebuffer::create(vk_backend, m_visibility_rp, { m_visibility_view, m_depth_fbo_view[i] }, m_input_width, m_input_height, 1);
+    }
 }
 
 void GBuffer::create_pipeline()
 {
     auto vk_backend = m_backend.lock();
 
-    // ---------------------------------------------------------------------------
-    // Create shader modules
-    // ---------------------------------------------------------------------------
-
-    dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer.vert.spv");
-    dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer.frag.spv");
-
-    dw::vk::GraphicsPipeline::Desc pso_desc;
-
-    pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
-        .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
-
-    // ---------------------------------------------------------------------------
-    // Create vertex input state
-    // ---------------------------------------------------------------------------
-
-    pso_desc.set_vertex_input_state(m_common_resources->meshes[0]->vertex_input_state_desc());
-
-    // ---------------------------------------------------------------------------
-    // Create pipeline input assembly state
-    // ---------------------------------------------------------------------------
-
-    dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
-
-    input_assembly_state_desc.set_primitive_restart_enable(false)
-        .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-    pso_desc.set_input_assembly_state(input_assembly_state_desc);
-
-    // ---------------------------------------------------------------------------
-    // Create viewport state
-    // ---------------------------------------------------------------------------
+    dw::vk::PipelineLayout::Desc pl_desc;
 
-    dw::vk::ViewportStateDesc vp_desc;
+    pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout())
+        .add_descriptor_set_layout(m_common_resources->per_frame_ds_layout)
+        .add_descriptor_set_layout(m_draw_ds_layout);
 
-    vp_desc.add_viewport(0.0f, 0.0f, m_input_width, m_input_height, 0.0f, 1.0f)
-        .add_scissor(0, 0, m_input_width, m_input_height);
+#if defined(COMPACT_VERTICES)
+    pl_desc.add_descriptor_set_layout(m_common_resources->compact_vertices->ds_layout());
+#endif
 
-    pso_desc.set_viewport_state(vp_desc);
+    m_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
 
-    // ---------------------------------------------------------------------------
-    // Create rasterization state
-    // ---------------------------------------------------------------------------
+    m_pipeline            = build_pipeline("shaders/g_buffer.frag.spv", m_rp, 3);
+    m_visibility_pipeline = build_pipeline("shaders/g_buffer_visibility.frag.spv", m_visibility_rp, 1);
+}
 
-    dw::vk::RasterizationStateDesc rs_state;
+Pipeline::Ptr GBuffer::build_pipeline(const std::string& fs_path, dw::vk::RenderPass::Ptr rp, uint32_t num_color_attachments)
+{
+    auto vk_backend = m_backend.lock();
 
-    rs_state.set_depth_clamp(VK_FALSE)
-        .set_rasterizer_discard_enable(VK_FALSE)
-        .set_polygon_mode(VK_POLYGON_MODE_FILL)
-        .set_line_width(1.0f)
-        .set_cull_mode(VK_CULL_MODE_BACK_BIT)
-        .set_front_face(VK_FRONT_FACE_CLOCKWISE)
-        .set_depth_bias(VK_FALSE);
+    GraphicsPipelineDesc pso_desc;
+
+    pso_desc.vertex_shader         = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer.vert.spv");
+    pso_desc.fragment_shader       = dw::vk::ShaderModule::create_from_file(vk_backend, fs_path);
+    pso_desc.cull_mode             = VK_CULL_MODE_BACK_BIT;
+    pso_desc.front_face            = VK_FRONT_FACE_CLOCKWISE;
+    pso_desc.depth_test_enable     = VK_TRUE;
+    pso_desc.depth_write_enable    = VK_TRUE;
+    pso_desc.depth_compare_op      = VK_COMPARE_OP_LESS;
+    pso_desc.num_color_attachments = num_color_attachments;
+    pso_desc.pipeline_layout       = m_pipeline_layout;
+    pso_desc.render_pass           = rp;
+
+#if !defined(COMPACT_VERTICES)
+    // With compact vertices the vertex shader pulls the vertices from the compact buffers itself.
+    pso_desc.add_mesh_vertex_input();
+#endif
+
+    return m_common_resources->pipeline_cache->create_graphics_pipeline(pso_desc);
+}
 
-    pso_desc.set_rasterization_state(rs_state);
+void GBuffer::create_cull_pipeline()
+{
+    auto vk_backend = m_backend.lock();
 
-    // ---------------------------------------------------------------------------
-    // Create multisample state
-    // ---------------------------------------------------------------------------
+    dw::vk::PipelineLayout::Desc desc;
 
-    dw::vk::MultisampleStateDesc ms_state;
+    desc.add_descriptor_set_layout(m_draw_ds_layout);
+    desc.add_descriptor_set_layout(m_ds_layout);
+    desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+    desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants));
 
-    ms_state.set_sample_shading_enable(VK_FALSE)
-        .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
+    m_cull_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
 
-    pso_desc.set_multisample_state(ms_state);
+    dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer_cull.comp.spv");
 
-    // ---------------------------------------------------------------------------
-    // Create depth stencil state
-    // ---------------------------------------------------------------------------
+    m_cull_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_cull_pipeline_layout);
+}
 
-    dw::vk::DepthStencilStateDesc ds_state;
+void GBuffer::create_hiz_pipeline()
+{
+    auto vk_backend = m_backend.lock();
 
-    ds_state.set_depth_test_enable(VK_TRUE)
-        .set_depth_write_enable(VK_TRUE)
-        .set_depth_compare_op(VK_COMPARE_OP_LESS)
-        .set_depth_bounds_test_enable(VK_FALSE)
-        .set_stencil_test_enable(VK_FALSE);
+    dw::vk::PipelineLayout::Desc desc;
 
-    pso_desc.set_depth_stencil_state(ds_state);
+    desc.add_descriptor_set_layout(m_hiz_ds_layout);
 
-    // ---------------------------------------------------------------------------
-    // Create color blend state
-    // ---------------------------------------------------------------------------
+    m_hiz_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
 
-    dw::vk::ColorBlendAttachmentStateDesc blend_att_desc;
+    dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer_hiz.comp.spv");
 
-    blend_att_desc.set_color_write_mask(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)
-        .set_blend_enable(VK_FALSE);
+    m_hiz_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_hiz_pipeline_layout);
+}
 
-    dw::vk::ColorBlendStateDesc blend_state;
+void GBuffer::create_resolve_pipeline()
+{
+    auto vk_backend = m_backend.lock();
 
-    blend_state.set_logic_op_enable(VK_FALSE)
-        .set_logic_op(VK_LOGIC_OP_COPY)
-        .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
-        .add_attachment(blend_att_desc)
-        .add_attachment(blend_att_desc)
-        .add_attachment(blend_att_desc);
+    dw::vk::PipelineLayout::Desc desc;
 
-    pso_desc.set_color_blend_state(blend_state);
+    desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+    desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+    desc.add_descriptor_set_layout(m_draw_ds_layout);
+    desc.add_descriptor_set_layout(m_resolve_ds_layout);
 
-    // ---------------------------------------------------------------------------
-    // Create pipeline layout
-    // ---------------------------------------------------------------------------
+#if defined(COMPACT_VERTICES)
+    desc.add_descriptor_set_layout(m_common_resources->compact_vertices->ds_layout());
+#endif
 
-    dw::vk::PipelineLayout::Desc pl_desc;
+    m_resolve_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
 
-    pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout())
-        .add_descriptor_set_layout(m_common_resources->per_frame_ds_layout)
-        .add_push_constant_range(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants));
+    dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer_resolve.comp.spv");
 
-    m_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
+    m_resolve_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_resolve_pipeline_layout);
+}
 
-    pso_desc.set_pipeline_layout(m_pipeline_layout);
+void GBuffer::create_downsample_pipeline()
+{
+    auto vk_backend = m_backend.lock();
 
-    // ---------------------------------------------------------------------------
-    // Create dynamic state
-    // ---------------------------------------------------------------------------
+    dw::vk::PipelineLayout::Desc desc;
 
-    pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
-        .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+    desc.add_descriptor_set_layout(m_downsample_ds_layout);
 
-    // ---------------------------------------------------------------------------
-    // Create pipeline
-    // ---------------------------------------------------------------------------
+    m_downsample_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
 
-    pso_desc.set_render_pass(m_rp);
+    dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/g_buffer_downsample.comp.spv");
 
-    m_pipeline = dw::vk::GraphicsPipeline::create(vk_backend, pso_desc);
-}
\ No newline at end of file
+    m_downsample_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_downsample_pipeline_layout);
+}
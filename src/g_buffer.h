@@ -1,53 +1,186 @@
 #pragma once
 
 #include <vk.h>
+#include <unordered_map>
+#include "async_compute.h"
+#include "frame_graph.h"
+#include "pipeline_cache.h"
+#include "scene.h"
 
 struct CommonResources;
 
+// Fills the G-Buffer from draws that are generated on the GPU. A compute pass culls every submesh of every instance against the
+// view frustum and appends the visible ones to the indirect arguments of the mesh they belong to, which are then drawn with a
+// single vkCmdDrawIndexedIndirectCount() per mesh. The CPU only writes the instance transforms each frame, its cost doesn't
+// depend on the number of submeshes.
+//
+// Occluded submeshes are culled in two phases. The early phase draws what was visible during the previous frame, a hierarchical
+// depth buffer (HiZ) is built from the result, and the late phase tests everything else against it and draws what became visible.
+//
+// In the visibility buffer mode both phases only rasterize the mesh and primitive ID of every pixel, and a compute pass resolves
+// them into the same G-Buffer images afterwards, so the effects reading them don't know which mode is active.
+//
+// The half and quarter resolution levels the effects trace at are filled by a single compute pass. The depth they sample lives in
+// a color copy of the depth buffer (m_depth_mips), since depth attachments can't be written by compute shaders.
+//
+// Building with HYBRID_RENDERING_COMPACT_G_BUFFER packs roughness, metallic and the mesh ID of the third image into 8 bits per
+// channel and rebuilds linear Z from the depth instead, see g_buffer_common.glsl for both layouts.
 class GBuffer
 {
+public:
+    struct CullingStats
+    {
+        uint32_t drawn_early      = 0;
+        uint32_t drawn_late       = 0;
+        uint32_t frustum_culled   = 0;
+        uint32_t occlusion_culled = 0;
+    };
+
 public:
     GBuffer(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, uint32_t input_width, uint32_t input_height);
     ~GBuffer();
 
+    // Builds the draws of the scene the first time it is rendered or when its instances point to different meshes, and grows the
+    // buffers they need. Has to run before any pass is recorded, growing a buffer rewrites the descriptor sets of the G-Buffer.
+    void update(Scene::Ptr scene);
     void render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void gui();
 
     dw::vk::DescriptorSetLayout::Ptr ds_layout();
     dw::vk::DescriptorSet::Ptr       output_ds();
     dw::vk::DescriptorSet::Ptr       history_ds();
     dw::vk::ImageView::Ptr           depth_fbo_image_view(uint32_t idx);
+    void                             shared_images(std::vector<AsyncCompute::SharedImage>& images);
+    void                             shared_buffers(std::vector<dw::vk::Buffer::Ptr>& buffers);
+
+    inline CullingStats culling_stats() { return m_culling_stats; }
+    inline VkDeviceSize memory_size() { return m_memory_size; }
+    inline bool         occlusion_culling() { return m_occlusion_culling; }
+    inline void         set_occlusion_culling(bool enabled) { m_occlusion_culling = enabled; }
+    inline bool         visibility_buffer() { return m_visibility_buffer; }
+    inline void         set_visibility_buffer(bool enabled) { m_visibility_buffer = enabled; }
 
 private:
-    void create_images();
-    void create_descriptor_set_layouts();
-    void create_descriptor_sets();
-    void write_descriptor_sets();
-    void create_render_pass();
-    void create_framebuffer();
-    void create_pipeline();
-    void downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf);
+    // Submeshes drawn with the same vertex and index buffers, their draws occupy a contiguous range of the indirect arguments.
+    struct DrawBatch
+    {
+        Mesh::Ptr     mesh;
+        uint32_t      first_draw;
+        uint32_t      num_draws;
+    };
+
+    // Everything the culling pass needs for one scene, built the first time the scene is rendered and again whenever its
+    // instances point to different meshes. The arguments, draw data and counts hold the early phase followed by the late one.
+    struct SceneDraws
+    {
+        std::vector<const Mesh*>     meshes;
+        std::vector<DrawBatch>       batches;
+        uint32_t                     num_draws        = 0;
+        bool                         reset_visibility = true;
+        dw::vk::Buffer::Ptr          candidates;
+        dw::vk::Buffer::Ptr          visibility;
+        dw::vk::Buffer::Ptr          draw_args[dw::vk::Backend::kMaxFramesInFlight];
+        dw::vk::Buffer::Ptr          draw_data[dw::vk::Backend::kMaxFramesInFlight];
+        dw::vk::Buffer::Ptr          draw_counts[dw::vk::Backend::kMaxFramesInFlight];
+        dw::vk::DescriptorSet::Ptr   ds[dw::vk::Backend::kMaxFramesInFlight];
+    };
+
+private:
+    SceneDraws& scene_draws(Scene::Ptr scene);
+    void        build_scene_draws(Scene::Ptr scene, SceneDraws& draws);
+    void        cull(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws, uint32_t phase);
+    void        draw(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws, uint32_t phase);
+    void        begin_render_pass(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::RenderPass::Ptr rp);
+    void        build_hiz(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void        resolve(dw::vk::CommandBuffer::Ptr cmd_buf, SceneDraws& draws);
+
+    void         create_images();
+    void         create_buffers();
+    void         reserve_draw_motion(uint32_t num_draws);
+    VkDeviceSize draw_motion_size();
+    VkDeviceSize draw_motion_offset(uint32_t frame_idx);
+    void         create_descriptor_set_layouts();
+    void         create_descriptor_sets();
+    void         write_descriptor_sets();
+    void         create_render_pass();
+    void         create_framebuffer();
+    void         create_pipeline();
+    void         create_cull_pipeline();
+    void         create_hiz_pipeline();
+    void         create_resolve_pipeline();
+    void         create_downsample_pipeline();
+
+    dw::vk::RenderPass::Ptr       build_render_pass(const std::vector<VkFormat>& color_formats, VkImageLayout color_final_layout, bool late);
+    Pipeline::Ptr                 build_pipeline(const std::string& fs_path, dw::vk::RenderPass::Ptr rp, uint32_t num_color_attachments);
+    void         downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf);
 
 private:
     std::weak_ptr<dw::vk::Backend>   m_backend;
     CommonResources*                 m_common_resources;
     uint32_t                         m_input_width;
     uint32_t                         m_input_height;
-    dw::vk::Image::Ptr               m_image_1[2]; // RGB: Albedo, A: Metallic
-    dw::vk::Image::Ptr               m_image_2[2]; // RG: Normal, BA: Motion Vector
-    dw::vk::Image::Ptr               m_image_3[2]; // R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+    dw::vk::Image::Ptr               m_image_1[2]; // See g_buffer_common.glsl
+    dw::vk::Image::Ptr               m_image_2[2];
+    dw::vk::Image::Ptr               m_image_3[2];
     dw::vk::Image::Ptr               m_depth[2];
+    dw::vk::Image::Ptr               m_depth_mips[2]; // R: Depth
     dw::vk::ImageView::Ptr           m_image_1_view[2];
     dw::vk::ImageView::Ptr           m_image_2_view[2];
     dw::vk::ImageView::Ptr           m_image_3_view[2];
-    dw::vk::ImageView::Ptr           m_depth_view[2];
+    dw::vk::ImageView::Ptr           m_depth_mips_view[2];
     dw::vk::ImageView::Ptr           m_image_1_fbo_view[2];
     dw::vk::ImageView::Ptr           m_image_2_fbo_view[2];
     dw::vk::ImageView::Ptr           m_image_3_fbo_view[2];
     dw::vk::ImageView::Ptr           m_depth_fbo_view[2];
     dw::vk::Framebuffer::Ptr         m_fbo[2];
     dw::vk::RenderPass::Ptr          m_rp;
-    dw::vk::GraphicsPipeline::Ptr    m_pipeline;
+    dw::vk::RenderPass::Ptr          m_late_rp;
+    Pipeline::Ptr                    m_pipeline;
     dw::vk::PipelineLayout::Ptr      m_pipeline_layout;
     dw::vk::DescriptorSetLayout::Ptr m_ds_layout;
-    dw::vk::DescriptorSet::Ptr       m_ds[2];
+    dw::vk::Buffer::Ptr              m_draw_motion_buffer;
+    uint32_t                         m_draw_motion_capacity = 0;
+    dw::vk::DescriptorSet::Ptr       m_ds[dw::vk::Backend::kMaxFramesInFlight][2];
+    dw::vk::DescriptorSetLayout::Ptr m_draw_ds_layout;
+    dw::vk::Buffer::Ptr              m_instance_data[dw::vk::Backend::kMaxFramesInFlight];
+    Pipeline::Ptr                    m_cull_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_cull_pipeline_layout;
+    dw::vk::Buffer::Ptr              m_stats_buffer[dw::vk::Backend::kMaxFramesInFlight];
+    dw::vk::Image::Ptr               m_hiz_image;
+    dw::vk::ImageView::Ptr           m_hiz_view;
+    dw::vk::DescriptorSetLayout::Ptr m_hiz_ds_layout;
+    Pipeline::Ptr                    m_hiz_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_hiz_pipeline_layout;
+    uint32_t                         m_hiz_width;
+    uint32_t                         m_hiz_height;
+    uint32_t                         m_hiz_mip_levels;
+    VkDeviceSize                     m_memory_size = 0; // Both frames of the three G-Buffer images, including their lower levels.
+    dw::vk::Image::Ptr               m_visibility_image; // RG: Mesh ID, Primitive ID
+    dw::vk::ImageView::Ptr           m_visibility_view;
+    dw::vk::Framebuffer::Ptr         m_visibility_fbo[2];
+    dw::vk::RenderPass::Ptr          m_visibility_rp;
+    dw::vk::RenderPass::Ptr          m_visibility_late_rp;
+    Pipeline::Ptr                    m_visibility_pipeline;
+    dw::vk::DescriptorSetLayout::Ptr m_resolve_ds_layout;
+    dw::vk::DescriptorSet::Ptr       m_resolve_ds[2];
+    Pipeline::Ptr                    m_resolve_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_resolve_pipeline_layout;
+    dw::vk::DescriptorSetLayout::Ptr m_downsample_ds_layout;
+    dw::vk::DescriptorSet::Ptr       m_downsample_ds[2];
+    Pipeline::Ptr                    m_downsample_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_downsample_pipeline_layout;
+    bool                             m_occlusion_culling = true;
+    bool                             m_visibility_buffer = false;
+    bool                             m_draw_indirect_count = true;
+    bool                             m_multi_draw_indirect = true;
+    CullingStats                     m_culling_stats;
+    FrameGraph                       m_frame_graph;
+
+    std::vector<dw::vk::ImageView::Ptr>      m_hiz_mip_views;
+    std::vector<dw::vk::DescriptorSet::Ptr>  m_hiz_ds[2]; // One per level, the first level reads the depth buffer.
+    std::vector<dw::vk::ImageView::Ptr>      m_image_1_mip_views[2];
+    std::vector<dw::vk::ImageView::Ptr>      m_image_2_mip_views[2];
+    std::vector<dw::vk::ImageView::Ptr>      m_image_3_mip_views[2];
+    std::vector<dw::vk::ImageView::Ptr>      m_depth_mip_views[2];
+    std::unordered_map<uint32_t, SceneDraws> m_scene_draws;
 };
\ No newline at end of file
@@ -6,22 +6,41 @@
 #include "g_buffer.h"
 #include "deferred_shading.h"
 #include "ray_traced_shadows.h"
+#include "point_light_shadows.h"
 #include "ray_traced_ao.h"
 #include "ray_traced_reflections.h"
 #include "ddgi.h"
 #include "tone_map.h"
 #include "temporal_aa.h"
 #include "utilities.h"
+#include "pass_timings.h"
+#include "benchmark.h"
+#include "parallel_recorder.h"
+#include "async_compute.h"
+#include "frame_graph.h"
+#include "asset_loader.h"
+#include "mesh_loader.h"
+#include "scene_cache.h"
+#include "blas_cache.h"
+#include "tlas_updater.h"
+#include <chrono>
+#include <future>
 
 #define NUM_PILLARS 6
+#define BUNNY_INSTANCE_IDX (NUM_PILLARS * 2 + 1)
 #define CAMERA_NEAR_PLANE 1.0f
 #define CAMERA_FAR_PLANE 1000.0f
+#define ENVIRONMENT_MAP_SIZE 1024
+#define ENVIRONMENT_MAP_MIP_LEVELS 5
+#define ENVIRONMENT_MAP_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT // Half floats cover the range of the HDR images at half the size of full floats.
+#define ENVIRONMENT_MAP_BYTES_PER_PIXEL 8
 
 const std::vector<std::string> environment_map_images = { "textures/Arches_E_PineTree_3k.hdr", "textures/BasketballCourt_3k.hdr", "textures/Etnies_Park_Center_3k.hdr", "textures/LA_Downtown_Helipad_GoldenHour_3k.hdr" };
 const std::vector<std::string> environment_types      = { "None", "Procedural Sky", "Arches Pine Tree", "Basketball Court", "Etnies Park Central", "LA Downtown Helipad" };
 const std::vector<std::string> visualization_types    = { "Final", "Shadows", "Ambient Occlusion", "Reflections", "Global Illumination" };
 const std::vector<std::string> scene_types            = { "Pillars", "Reflections Test", "Sponza", "Pica Pica" };
 const std::vector<std::string> ray_trace_scales       = { "Full-Res", "Half-Res", "Quarter-Res" };
+const std::vector<std::string> scene_mesh_paths       = { "mesh/pillar.gltf", "mesh/bunny.gltf", "mesh/ground.gltf", "mesh/reflections_test.gltf", "mesh/sponza.obj", "scene.gltf" };
 
 struct Light
 {
@@ -85,6 +104,8 @@ struct UBO
     glm::vec4 current_prev_jitter;
     DW_ALIGNED(16)
     Light light;
+    DW_ALIGNED(16)
+    glm::mat4 prev_view_proj_inverse;
 };
 
 class HybridRendering : public dw::Application
@@ -92,45 +113,303 @@ class HybridRendering : public dw::Application
 public:
     friend class GBuffer;
 
+    inline bool headless() { return m_headless; }
+
+    // Needs to run before the window is created since it can override the resolution.
+    bool parse_command_line(int argc, const char* argv[])
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg   = argv[i];
+            const char* value = (i + 1) < argc ? argv[i + 1] : nullptr;
+
+            if (arg == "--headless")
+                m_headless = true;
+            else if (arg == "--parallel-recording")
+                m_parallel_recording = true;
+            else if (arg == "--async-compute")
+                m_async_compute_enabled = true;
+            else if (arg == "--no-pass-culling")
+                m_pass_culling = false;
+            else if (arg == "--no-transient-aliasing")
+                m_transient_aliasing = false;
+            else if (arg == "--cold-pipeline-cache")
+                m_cold_pipeline_cache = true;
+            else if (arg == "--no-scene-cache")
+                m_scene_cache_enabled = false;
+            else if (arg == "--scene-cache-benchmark")
+                m_scene_cache_benchmark = true;
+            else if (arg == "--no-blas-cache")
+                m_blas_cache_enabled = false;
+            else if (arg == "--animate-instances")
+                m_instance_animation = true;
+            else if (arg == "--visibility-buffer")
+                m_visibility_buffer = true;
+            else if (value && arg == "--frames")
+            {
+                m_frames = std::max(1, atoi(value));
+                i++;
+            }
+            else if (value && arg == "--benchmark")
+            {
+                m_benchmark             = true;
+                m_benchmark_script_path = value;
+                i++;
+            }
+            else if (value && arg == "--warmup")
+            {
+                m_benchmark_warmup_frames = std::max(0, atoi(value));
+                i++;
+            }
+            else if (value && arg == "--fixed-delta")
+            {
+                m_benchmark_fixed_delta = std::max(0.001f, float(atof(value)));
+                i++;
+            }
+            else if (value && arg == "--width")
+            {
+                m_initial_width = std::max(1, atoi(value));
+                i++;
+            }
+            else if (value && arg == "--height")
+            {
+                m_initial_height = std::max(1, atoi(value));
+                i++;
+            }
+            else if (value && arg == "--scene")
+            {
+                int32_t idx = find_option(scene_types, value);
+
+                if (idx == -1)
+                {
+                    DW_LOG_ERROR("Unknown scene: " + std::string(value));
+                    return false;
+                }
+
+                m_initial_scene_type = (SceneType)idx;
+                i++;
+            }
+            else if (value && arg == "--environment")
+            {
+                int32_t idx = find_option(environment_types, value);
+
+                if (idx == -1)
+                {
+                    DW_LOG_ERROR("Unknown environment: " + std::string(value));
+                    return false;
+                }
+
+                m_initial_environment_type = (EnvironmentType)idx;
+                i++;
+            }
+            else if (value && arg == "--output")
+            {
+                m_output_image_path = value;
+                i++;
+            }
+            else if (value && arg == "--pipeline-cache")
+            {
+                m_pipeline_cache_path = value;
+                i++;
+            }
+            else if (value && arg == "--timings")
+            {
+                m_output_timings_path = value;
+                i++;
+            }
+            else if (value && arg == "--timings-history")
+            {
+                m_timings_history = std::max(1, atoi(value));
+                i++;
+            }
+            else
+            {
+                DW_LOG_ERROR("Unknown or incomplete argument: " + arg);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The framework's run loop opens a window on the display and acquires a swapchain image every frame, neither of which works on
+    // display-less farm and CI nodes. Headless runs create the device on GLFW's null platform, whose surface comes from
+    // VK_EXT_headless_surface, and drive init/update/shutdown directly so that the swapchain is never acquired or presented.
+    int run_headless(int argc, const char* argv[])
+    {
+#if defined(GLFW_PLATFORM_NULL)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+        DW_LOG_ERROR("GLFW was built without the null platform, headless mode needs a display.");
+#endif
+
+        if (!glfwInit())
+        {
+            DW_LOG_ERROR("Failed to initialize GLFW");
+            return 1;
+        }
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        GLFWwindow* window = glfwCreateWindow(m_initial_width, m_initial_height, "Hybrid Rendering", nullptr, nullptr);
+
+        if (!window)
+        {
+            DW_LOG_ERROR("Failed to create headless window");
+            glfwTerminate();
+            return 1;
+        }
+
+        m_vk_backend = dw::vk::Backend::create(window, false, false, false, true);
+
+        if (!m_vk_backend)
+        {
+            DW_LOG_ERROR("Failed to create headless Vulkan device");
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            return 1;
+        }
+
+        m_width         = m_initial_width;
+        m_height        = m_initial_height;
+        m_delta         = 1000.0f / 60.0f;
+        m_delta_seconds = m_delta / 1000.0f;
+
+        int result = 0;
+
+        if (init(argc, argv))
+        {
+            // Every frame is flushed before the next one is recorded, so there is no frame pacing to do here.
+            while (!m_headless_exit)
+                update(m_delta);
+        }
+        else
+            result = 1;
+
+        m_vk_backend->wait_idle();
+
+        if (m_common_resources)
+            shutdown();
+
+        m_vk_backend.reset();
+
+        glfwDestroyWindow(window);
+        glfwTerminate();
+
+        return result;
+    }
+
 protected:
     bool init(int argc, const char* argv[]) override
     {
+        if (m_benchmark && !m_benchmark_script.load(m_benchmark_script_path))
+            return false;
+
+        auto startup_begin = std::chrono::high_resolution_clock::now();
+
         m_common_resources = std::unique_ptr<CommonResources>(new CommonResources());
 
+        // Has to exist before the first pipeline is created.
+        m_common_resources->pipeline_cache = std::unique_ptr<PipelineCache>(new PipelineCache(m_vk_backend, m_pipeline_cache_path, !m_cold_pipeline_cache));
+
+        m_common_resources->current_scene_type       = m_initial_scene_type;
+        m_common_resources->current_environment_type = m_initial_environment_type;
+
         if (!create_uniform_buffer())
             return false;
 
-        // Load mesh.
-        if (!load_mesh())
-        {
-            DW_LOG_INFO("Failed to load mesh");
+        m_asset_loader = std::unique_ptr<AssetLoader>(new AssetLoader(m_vk_backend, std::max(2u, std::thread::hardware_concurrency()) - 1));
+        m_mesh_loader  = std::unique_ptr<MeshLoader>(new MeshLoader(m_vk_backend, m_asset_loader.get()));
+        m_scene_cache  = std::unique_ptr<SceneCache>(new SceneCache(m_mesh_loader.get(), m_scene_cache_enabled));
+        m_blas_cache   = std::unique_ptr<BlasCache>(new BlasCache(m_vk_backend, m_blas_cache_enabled));
+
+#if defined(COMPACT_VERTICES)
+        // Encodes the meshes of every scene as it is loaded.
+        m_common_resources->compact_vertices = std::unique_ptr<CompactVertices>(new CompactVertices(m_vk_backend));
+#endif
+
+        // The image files are decoded on the asset loader's workers while the scene loads on this thread.
+        m_common_resources->blue_noise         = std::unique_ptr<BlueNoise>(new BlueNoise(m_vk_backend, m_asset_loader.get()));
+        m_common_resources->blue_noise_image_1 = m_asset_loader->load_image("texture/LDR_RGBA_0.png");
+        m_common_resources->blue_noise_view_1  = dw::vk::ImageView::create(m_vk_backend, m_common_resources->blue_noise_image_1, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_common_resources->blue_noise_image_2 = m_asset_loader->load_image("texture/LDR_RGBA_1.png");
+        m_common_resources->blue_noise_view_2  = dw::vk::ImageView::create(m_vk_backend, m_common_resources->blue_noise_image_2, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        create_environment_resources();
+
+        // Only the initial scene is loaded up front, the others are loaded the first time they are selected.
+        m_common_resources->scenes.resize(SCENE_TYPE_COUNT);
+
+        m_requested_scene_type = m_common_resources->current_scene_type;
+
+        begin_scene_load(m_common_resources->current_scene_type);
+
+        if (!finish_scene_load())
             return false;
-        }
+
+        if (m_scene_cache_benchmark)
+            m_scene_cache->benchmark(scene_mesh_paths, 3);
 
         m_common_resources->brdf_preintegrate_lut = std::unique_ptr<dw::BRDFIntegrateLUT>(new dw::BRDFIntegrateLUT(m_vk_backend));
-        m_common_resources->blue_noise            = std::unique_ptr<BlueNoise>(new BlueNoise(m_vk_backend));
-        m_common_resources->blue_noise_image_1    = dw::vk::Image::create_from_file(m_vk_backend, "texture/LDR_RGBA_0.png");
-        m_common_resources->blue_noise_view_1     = dw::vk::ImageView::create(m_vk_backend, m_common_resources->blue_noise_image_1, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-        m_common_resources->blue_noise_image_2    = dw::vk::Image::create_from_file(m_vk_backend, "texture/LDR_RGBA_1.png");
-        m_common_resources->blue_noise_view_2     = dw::vk::ImageView::create(m_vk_backend, m_common_resources->blue_noise_image_2, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        create_environment_resources();
+        m_asset_loader->flush();
+
         create_descriptor_set_layouts();
         create_descriptor_sets();
         write_descriptor_sets();
+        update_environments();
+
+        m_common_resources->transient_allocator = std::unique_ptr<TransientAllocator>(new TransientAllocator(m_vk_backend, m_transient_aliasing));
+
+        // The effects place their transient images depending on the queue they run on.
+        m_async_compute = std::unique_ptr<AsyncCompute>(new AsyncCompute(m_vk_backend));
+
+        if (m_async_compute_enabled && !m_async_compute->supported())
+            DW_LOG_ERROR("Async compute requested but not supported, falling back to the graphics queue.");
+
+        m_common_resources->async_compute = m_async_compute_enabled && m_async_compute->supported();
+
+        if (m_common_resources->async_compute && m_parallel_recording)
+            DW_LOG_INFO("Parallel recording is ignored while async compute is on, the async passes are recorded on the main thread.");
+
+        m_common_resources->dynamic_instances = std::unique_ptr<DynamicInstances>(new DynamicInstances(m_vk_backend));
+        m_common_resources->point_lights      = std::unique_ptr<PointLights>(new PointLights(m_vk_backend));
 
         m_g_buffer               = std::unique_ptr<GBuffer>(new GBuffer(m_vk_backend, m_common_resources.get(), m_width, m_height));
         m_ray_traced_shadows     = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
+        m_point_light_shadows    = std::unique_ptr<PointLightShadows>(new PointLightShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ray_traced_ao          = std::unique_ptr<RayTracedAO>(new RayTracedAO(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ray_traced_reflections = std::unique_ptr<RayTracedReflections>(new RayTracedReflections(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ddgi                   = std::unique_ptr<DDGI>(new DDGI(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_deferred_shading       = std::unique_ptr<DeferredShading>(new DeferredShading(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_temporal_aa            = std::unique_ptr<TemporalAA>(new TemporalAA(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
-        m_tone_map               = std::unique_ptr<ToneMap>(new ToneMap(m_vk_backend, m_common_resources.get()));
+        m_tone_map               = std::unique_ptr<ToneMap>(new ToneMap(m_vk_backend, m_common_resources.get(), m_headless));
+
+        m_g_buffer->set_visibility_buffer(m_visibility_buffer);
+
+        m_common_resources->transient_allocator->log_stats();
+
+        // Benchmark stats cover every recorded frame of a scene, so the history has to be large enough to hold them all.
+        m_pass_timings = std::unique_ptr<PassTimings>(new PassTimings(m_vk_backend, m_benchmark ? std::max(m_timings_history, m_frames) : m_timings_history));
+        m_pass_timings->set_framework_samples(!m_headless);
+        PassTimings::set_active(m_pass_timings.get());
+
+        // The main thread records alongside the workers.
+        m_parallel_recorder = std::unique_ptr<ParallelRecorder>(new ParallelRecorder(m_vk_backend, std::min(3u, std::max(1u, std::thread::hardware_concurrency()) - 1)));
 
         set_active_scene();
         create_camera();
 
+        auto   startup_end = std::chrono::high_resolution_clock::now();
+        double startup_ms  = std::chrono::duration<double, std::milli>(startup_end - startup_begin).count();
+
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "Startup took %.1f ms (%s pipeline cache, %.1f KB loaded).", startup_ms, m_common_resources->pipeline_cache->warm() ? "warm" : "cold", float(m_common_resources->pipeline_cache->loaded_size()) / 1024.0f);
+        DW_LOG_INFO(buffer);
+
         return true;
     }
 
@@ -147,10 +426,26 @@ protected:
 
         vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
 
+        m_pass_timings->begin_frame(cmd_buf);
+
+        if (m_benchmark)
+            update_benchmark();
+
+        std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs;
+
         {
-            DW_SCOPED_SAMPLE("Update", cmd_buf);
+            // Keeps the results of each scene apart when benchmarking.
+            PassTimings::Scope scene_scope(m_benchmark ? m_pass_timings.get() : nullptr, scene_types[m_common_resources->current_scene_type], cmd_buf);
+            PassTimings::Scope update_scope(m_pass_timings.get(), "Update", cmd_buf);
+
+            if (!m_headless)
+                debug_gui();
+
+            update_scenes();
+            update_environments();
 
-            debug_gui();
+            // After the scene selection of the frame is final, before anything gets a chance to move.
+            m_common_resources->dynamic_instances->begin_frame(m_common_resources->current_scene());
 
             // Update camera.
             update_camera();
@@ -158,31 +453,59 @@ protected:
             // Update light.
             update_light_animation();
 
+            // Update point lights.
+            m_common_resources->point_lights->update(m_delta_seconds);
+
+            // Update instances.
+            update_instance_animation();
+
             // Update uniforms.
             update_uniforms(cmd_buf);
 
-            m_common_resources->current_scene()->build_tlas(cmd_buf);
+            {
+                HR_SCOPED_SAMPLE("Build TLAS", cmd_buf);
+                m_tlas_updater.update(m_common_resources->current_scene(), cmd_buf);
+            }
+
+            m_g_buffer->update(m_common_resources->current_scene());
 
             update_ibl(cmd_buf);
 
+            update_active_passes();
+            update_transient_images();
+
             // Render.
-            m_g_buffer->render(cmd_buf);
-            m_ray_traced_shadows->render(cmd_buf);
-            m_ray_traced_ao->render(cmd_buf);
-            m_ddgi->render(cmd_buf);
-            m_ray_traced_reflections->render(cmd_buf, m_ddgi.get());
-            m_deferred_shading->render(cmd_buf,
-                                       m_ray_traced_ao.get(),
-                                       m_ray_traced_shadows.get(),
-                                       m_ray_traced_reflections.get(),
-                                       m_ddgi.get());
-            m_temporal_aa->render(cmd_buf,
-                                  m_deferred_shading.get(),
-                                  m_ray_traced_ao.get(),
-                                  m_ray_traced_shadows.get(),
-                                  m_ray_traced_reflections.get(),
-                                  m_ddgi.get(),
-                                  m_delta_seconds);
+            const bool async_compute = m_async_compute_enabled && m_async_compute->supported();
+
+            m_common_resources->async_compute = async_compute;
+
+            if (async_compute)
+            {
+                // Everything up to here gets submitted along with the G-Buffer.
+                cmd_buf = record_passes_async(cmd_buf);
+            }
+            else if (m_parallel_recording)
+            {
+                vkEndCommandBuffer(cmd_buf->handle());
+                cmd_bufs.push_back(cmd_buf);
+
+                record_passes_parallel(cmd_bufs);
+
+                // Everything after the passes goes into a fresh command buffer at the end of the batch.
+                cmd_buf = m_vk_backend->allocate_graphics_command_buffer(true);
+            }
+            else
+                record_passes(cmd_buf);
+
+            std::function<void(dw::vk::CommandBuffer::Ptr)> gui_callback;
+
+            if (!m_headless)
+            {
+                gui_callback = [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                    render_gui(cmd_buf);
+                };
+            }
+
             m_tone_map->render(cmd_buf,
                                m_temporal_aa.get(),
                                m_deferred_shading.get(),
@@ -190,14 +513,39 @@ protected:
                                m_ray_traced_shadows.get(),
                                m_ray_traced_reflections.get(),
                                m_ddgi.get(),
-                               [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
-                                   render_gui(cmd_buf);
-                               });
+                               gui_callback);
+
+            if (async_compute)
+                m_async_compute->release_outputs(cmd_buf);
+
+            if (m_headless && is_last_frame())
+                m_tone_map->copy_to_readback_buffer(cmd_buf);
+
+            update_scope.end(cmd_buf);
+            scene_scope.end(cmd_buf);
         }
 
+        // Every pass has been recorded at this point, parallel or not.
+        m_barrier_stats = FrameGraph::frame_stats();
+        FrameGraph::reset_frame_stats();
+
         vkEndCommandBuffer(cmd_buf->handle());
+        cmd_bufs.push_back(cmd_buf);
+
+        if (m_headless)
+            m_vk_backend->flush_graphics(cmd_bufs);
+        else
+            submit_and_present(cmd_bufs);
 
-        submit_and_present({ cmd_buf });
+        if (is_last_frame())
+        {
+            write_output();
+
+            if (m_headless)
+                m_headless_exit = true;
+            else
+                request_exit();
+        }
 
         m_common_resources->num_frames++;
 
@@ -205,17 +553,228 @@ protected:
             m_common_resources->first_frame = false;
 
         m_common_resources->ping_pong = !m_common_resources->ping_pong;
+
+        if (m_benchmark)
+            m_benchmark_frame++;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_active_passes()
+    {
+        // Works backwards from what ends up on screen: either the final shading with its toggles, or a single effect.
+        const VisualizationType visualization = m_common_resources->current_visualization_type;
+        const bool              final_image   = visualization == VISUALIZATION_TYPE_FINAL;
+
+        bool shadows     = final_image ? m_deferred_shading->use_ray_traced_shadows() : visualization == VISUALIZATION_TYPE_SHADOWS;
+        bool ao          = final_image ? m_deferred_shading->use_ray_traced_ao() : visualization == VISUALIZATION_TYPE_AMBIENT_OCCLUSION;
+        bool reflections = final_image ? m_deferred_shading->use_ray_traced_reflections() : visualization == VISUALIZATION_TYPE_REFLECTIONS;
+        bool gi          = final_image ? m_deferred_shading->use_ddgi() : visualization == VISUALIZATION_TYPE_GLOBAL_ILLUIMINATION;
+        bool probes      = gi || (reflections && m_ray_traced_reflections->sample_gi()) || m_deferred_shading->visualize_probe_grid();
+
+        if (!m_pass_culling)
+            shadows = ao = reflections = gi = probes = true;
+
+        m_ray_traced_shadows->set_active(shadows);
+        // With ReSTIR the shadow rays of the sun pass already cover the point lights.
+        m_point_light_shadows->set_active(shadows && !m_ray_traced_shadows->restir());
+        m_ray_traced_ao->set_active(ao);
+        m_ray_traced_reflections->set_active(reflections);
+        m_ddgi->set_active(probes, gi);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_passes(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        m_g_buffer->render(cmd_buf);
+        m_ray_traced_shadows->render(cmd_buf);
+        m_point_light_shadows->render(cmd_buf);
+        m_ray_traced_ao->render(cmd_buf);
+        m_ddgi->render(cmd_buf);
+        m_ray_traced_reflections->render(cmd_buf, m_ddgi.get());
+        m_deferred_shading->render(cmd_buf,
+                                   m_ray_traced_ao.get(),
+                                   m_ray_traced_shadows.get(),
+                                   m_point_light_shadows.get(),
+                                   m_ray_traced_reflections.get(),
+                                   m_ddgi.get());
+        m_temporal_aa->render(cmd_buf,
+                              m_deferred_shading.get(),
+                              m_ray_traced_ao.get(),
+                              m_ray_traced_shadows.get(),
+                              m_ray_traced_reflections.get(),
+                              m_ddgi.get(),
+                              m_delta_seconds);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    dw::vk::CommandBuffer::Ptr record_passes_async(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        // Reflections and the DDGI probe sampling read the G-Buffer. If the compute queue has a queue family of its own it owns the
+        // G-Buffer while shadows and AO run, so only the DDGI probe update can overlap with them.
+        const bool overlap_g_buffer_reads = !m_async_compute->ownership_transfer();
+
+        std::vector<AsyncCompute::SharedImage> g_buffer_images;
+        m_g_buffer->shared_images(g_buffer_images);
+
+        std::vector<dw::vk::Buffer::Ptr> g_buffer_buffers;
+        m_g_buffer->shared_buffers(g_buffer_buffers);
+
+        m_async_compute->begin_frame(cmd_buf);
+
+        m_g_buffer->render(cmd_buf);
+
+        m_async_compute->submit_graphics(cmd_buf, g_buffer_images, g_buffer_buffers);
+
+        dw::vk::CommandBuffer::Ptr compute_cmd_buf = m_async_compute->begin_compute();
+
+        m_ray_traced_shadows->render(compute_cmd_buf);
+        m_point_light_shadows->render(compute_cmd_buf);
+        m_ray_traced_ao->render(compute_cmd_buf);
+
+        m_async_compute->submit_compute(compute_cmd_buf, { { m_ray_traced_shadows->output_image(), VK_IMAGE_ASPECT_COLOR_BIT }, { m_ray_traced_shadows->reservoir_image(), VK_IMAGE_ASPECT_COLOR_BIT }, { m_point_light_shadows->output_image(), VK_IMAGE_ASPECT_COLOR_BIT }, { m_ray_traced_ao->output_image(), VK_IMAGE_ASPECT_COLOR_BIT } });
+
+        dw::vk::CommandBuffer::Ptr overlap_cmd_buf = m_vk_backend->allocate_graphics_command_buffer(true);
+
+        m_async_compute->begin_overlap(overlap_cmd_buf);
+
+        if (overlap_g_buffer_reads)
+        {
+            m_ddgi->render(overlap_cmd_buf);
+            m_ray_traced_reflections->render(overlap_cmd_buf, m_ddgi.get());
+        }
+        else
+        {
+            HR_SCOPED_SAMPLE("DDGI Probe Update", overlap_cmd_buf);
+            m_ddgi->update_probes(overlap_cmd_buf);
+        }
+
+        m_async_compute->submit_overlap(overlap_cmd_buf);
+        m_async_compute->wait_for_compute();
+
+        cmd_buf = m_vk_backend->allocate_graphics_command_buffer(true);
+
+        if (!overlap_g_buffer_reads)
+        {
+            {
+                HR_SCOPED_SAMPLE("DDGI Sample Probes", cmd_buf);
+                m_ddgi->sample_probes(cmd_buf);
+            }
+
+            m_ray_traced_reflections->render(cmd_buf, m_ddgi.get());
+        }
+
+        m_deferred_shading->render(cmd_buf,
+                                   m_ray_traced_ao.get(),
+                                   m_ray_traced_shadows.get(),
+                                   m_point_light_shadows.get(),
+                                   m_ray_traced_reflections.get(),
+                                   m_ddgi.get());
+        m_temporal_aa->render(cmd_buf,
+                              m_deferred_shading.get(),
+                              m_ray_traced_ao.get(),
+                              m_ray_traced_shadows.get(),
+                              m_ray_traced_reflections.get(),
+                              m_ddgi.get(),
+                              m_delta_seconds);
+
+        return cmd_buf;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_transient_images()
+    {
+        bool recreated = false;
+
+        recreated |= m_ray_traced_shadows->update_transient_images();
+        recreated |= m_ray_traced_ao->update_transient_images();
+        recreated |= m_ray_traced_reflections->update_transient_images();
+
+        // The outputs released to the compute queue at the end of the last frame may be gone.
+        if (recreated)
+        {
+            m_async_compute->reset();
+            m_common_resources->transient_allocator->log_stats();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void recreate_async_passes()
+    {
+        // The history of both passes is owned by the queue they last ran on, start over instead of transferring it.
+        m_vk_backend->wait_idle();
+        m_async_compute->reset();
+
+        // Transient images are only shared between passes on the same queue.
+        m_common_resources->async_compute = m_async_compute_enabled && m_async_compute->supported();
+
+        RayTraceScale shadows_scale = m_ray_traced_shadows->scale();
+        RayTraceScale ao_scale      = m_ray_traced_ao->scale();
+
+        m_ray_traced_shadows.reset();
+        m_point_light_shadows.reset();
+        m_ray_traced_ao.reset();
+
+        m_ray_traced_shadows  = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), shadows_scale));
+        m_point_light_shadows = std::unique_ptr<PointLightShadows>(new PointLightShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), shadows_scale));
+        m_ray_traced_ao       = std::unique_ptr<RayTracedAO>(new RayTracedAO(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), ao_scale));
+
+        m_common_resources->transient_allocator->log_stats();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_passes_parallel(std::vector<dw::vk::CommandBuffer::Ptr>& cmd_bufs)
+    {
+        // Passes pick their descriptor sets based on state that earlier passes update while recording (e.g. the DDGI
+        // ping-pong index, the A-Trous read index), so they are recorded in dependent waves. Submission order is unchanged.
+        const std::vector<std::vector<ParallelRecorder::RecordFunc>> waves = {
+            { [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_g_buffer->render(cmd_buf); },
+              [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ray_traced_shadows->render(cmd_buf); },
+              [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_point_light_shadows->render(cmd_buf); },
+              [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ray_traced_ao->render(cmd_buf); },
+              [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ddgi->render(cmd_buf); } },
+            { [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ray_traced_reflections->render(cmd_buf, m_ddgi.get()); } },
+            { [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_deferred_shading->render(cmd_buf, m_ray_traced_ao.get(), m_ray_traced_shadows.get(), m_point_light_shadows.get(), m_ray_traced_reflections.get(), m_ddgi.get()); },
+              [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_temporal_aa->render(cmd_buf, m_deferred_shading.get(), m_ray_traced_ao.get(), m_ray_traced_shadows.get(), m_ray_traced_reflections.get(), m_ddgi.get(), m_delta_seconds); } }
+        };
+
+        m_parallel_recorder->begin_frame();
+
+        for (const auto& wave : waves)
+        {
+            std::vector<dw::vk::CommandBuffer::Ptr> wave_cmd_bufs = m_parallel_recorder->record(wave);
+            cmd_bufs.insert(cmd_bufs.end(), wave_cmd_bufs.begin(), wave_cmd_bufs.end());
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void shutdown() override
     {
+        m_common_resources->pipeline_cache->save();
+
+        // A scene that is still being parsed reads through the scene cache.
+        m_loading_meshes.clear();
+
+        m_asset_loader.reset();
+        m_scene_cache.reset();
+        m_blas_cache.reset();
+        m_mesh_loader.reset();
+        m_equirectangular_to_cubemap.reset();
+        m_async_compute.reset();
+        m_parallel_recorder.reset();
+        m_pass_timings.reset();
         m_tone_map.reset();
         m_temporal_aa.reset();
         m_deferred_shading.reset();
         m_g_buffer.reset();
         m_ray_traced_shadows.reset();
+        m_point_light_shadows.reset();
         m_ray_traced_ao.reset();
         m_ray_traced_reflections.reset();
         m_ddgi.reset();
@@ -286,8 +845,8 @@ protected:
         // Set custom settings here...
         dw::AppSettings settings;
 
-        settings.width       = 1920;
-        settings.height      = 1080;
+        settings.width       = m_initial_width;
+        settings.height      = m_initial_height;
         settings.title       = "Hybrid Rendering (c) Dihara Wijetunga";
         settings.ray_tracing = true;
         settings.resizable   = false;
@@ -476,76 +1035,7 @@ private:
         int num_environment_map_images = environment_map_images.size() + 2;
 
         for (int i = 0; i < num_environment_map_images; i++)
-        {
-            VkDescriptorImageInfo image_info[4];
-
-            image_info[0].sampler = m_vk_backend->bilinear_sampler()->handle();
-            if (i == ENVIRONMENT_TYPE_NONE)
-                image_info[0].imageView = m_common_resources->blank_cubemap_image_view->handle();
-            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-                image_info[0].imageView = m_common_resources->sky_environment->hosek_wilkie_sky_model->image_view()->handle();
-            else
-                image_info[0].imageView = m_common_resources->hdr_environments[i - 2]->image_view->handle();
-            image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_info[1].sampler = m_vk_backend->trilinear_sampler()->handle();
-            if (i == ENVIRONMENT_TYPE_NONE)
-                image_info[1].imageView = m_common_resources->blank_sh_image_view->handle();
-            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-                image_info[1].imageView = m_common_resources->sky_environment->cubemap_sh_projection->image_view()->handle();
-            else
-                image_info[1].imageView = m_common_resources->hdr_environments[i - 2]->cubemap_sh_projection->image_view()->handle();
-            image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_info[2].sampler = m_vk_backend->trilinear_sampler()->handle();
-            if (i == ENVIRONMENT_TYPE_NONE)
-                image_info[2].imageView = m_common_resources->blank_cubemap_image_view->handle();
-            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-                image_info[2].imageView = m_common_resources->sky_environment->cubemap_prefilter->image_view()->handle();
-            else
-                image_info[2].imageView = m_common_resources->hdr_environments[i - 2]->cubemap_prefilter->image_view()->handle();
-            image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_info[3].sampler     = m_vk_backend->bilinear_sampler()->handle();
-            image_info[3].imageView   = m_common_resources->brdf_preintegrate_lut->image_view()->handle();
-            image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            VkWriteDescriptorSet write_data[4];
-            DW_ZERO_MEMORY(write_data[0]);
-            DW_ZERO_MEMORY(write_data[1]);
-            DW_ZERO_MEMORY(write_data[2]);
-            DW_ZERO_MEMORY(write_data[3]);
-
-            write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[0].descriptorCount = 1;
-            write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[0].pImageInfo      = &image_info[0];
-            write_data[0].dstBinding      = 0;
-            write_data[0].dstSet          = m_common_resources->skybox_ds[i]->handle();
-
-            write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[1].descriptorCount = 1;
-            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[1].pImageInfo      = &image_info[1];
-            write_data[1].dstBinding      = 1;
-            write_data[1].dstSet          = m_common_resources->skybox_ds[i]->handle();
-
-            write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[2].descriptorCount = 1;
-            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[2].pImageInfo      = &image_info[2];
-            write_data[2].dstBinding      = 2;
-            write_data[2].dstSet          = m_common_resources->skybox_ds[i]->handle();
-
-            write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[3].descriptorCount = 1;
-            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[3].pImageInfo      = &image_info[3];
-            write_data[3].dstBinding      = 3;
-            write_data[3].dstSet          = m_common_resources->skybox_ds[i]->handle();
-
-            vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
-        }
+            write_skybox_descriptor_set(i);
 
         m_common_resources->current_skybox_ds = m_common_resources->skybox_ds[m_common_resources->current_environment_type];
 
@@ -588,6 +1078,87 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    // HDR environments that haven't been loaded yet point to the blank images, the set is rewritten once they are resident.
+    void write_skybox_descriptor_set(int i)
+    {
+        VkDescriptorImageInfo image_info[4];
+
+        image_info[0].sampler = m_vk_backend->bilinear_sampler()->handle();
+        if (i == ENVIRONMENT_TYPE_NONE)
+            image_info[0].imageView = m_common_resources->blank_cubemap_image_view->handle();
+        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+            image_info[0].imageView = m_common_resources->sky_environment->hosek_wilkie_sky_model->image_view()->handle();
+        else if (m_common_resources->hdr_environments[i - 2])
+            image_info[0].imageView = m_common_resources->hdr_environments[i - 2]->image_view->handle();
+        else
+            image_info[0].imageView = m_common_resources->blank_cubemap_image_view->handle();
+        image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        image_info[1].sampler = m_vk_backend->trilinear_sampler()->handle();
+        if (i == ENVIRONMENT_TYPE_NONE)
+            image_info[1].imageView = m_common_resources->blank_sh_image_view->handle();
+        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+            image_info[1].imageView = m_common_resources->sky_environment->cubemap_sh_projection->image_view()->handle();
+        else if (m_common_resources->hdr_environments[i - 2])
+            image_info[1].imageView = m_common_resources->hdr_environments[i - 2]->cubemap_sh_projection->image_view()->handle();
+        else
+            image_info[1].imageView = m_common_resources->blank_sh_image_view->handle();
+        image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        image_info[2].sampler = m_vk_backend->trilinear_sampler()->handle();
+        if (i == ENVIRONMENT_TYPE_NONE)
+            image_info[2].imageView = m_common_resources->blank_cubemap_image_view->handle();
+        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+            image_info[2].imageView = m_common_resources->sky_environment->cubemap_prefilter->image_view()->handle();
+        else if (m_common_resources->hdr_environments[i - 2])
+            image_info[2].imageView = m_common_resources->hdr_environments[i - 2]->cubemap_prefilter->image_view()->handle();
+        else
+            image_info[2].imageView = m_common_resources->blank_cubemap_image_view->handle();
+        image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        image_info[3].sampler     = m_vk_backend->bilinear_sampler()->handle();
+        image_info[3].imageView   = m_common_resources->brdf_preintegrate_lut->image_view()->handle();
+        image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write_data[4];
+        DW_ZERO_MEMORY(write_data[0]);
+        DW_ZERO_MEMORY(write_data[1]);
+        DW_ZERO_MEMORY(write_data[2]);
+        DW_ZERO_MEMORY(write_data[3]);
+
+        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[0].descriptorCount = 1;
+        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[0].pImageInfo      = &image_info[0];
+        write_data[0].dstBinding      = 0;
+        write_data[0].dstSet          = m_common_resources->skybox_ds[i]->handle();
+
+        write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[1].descriptorCount = 1;
+        write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[1].pImageInfo      = &image_info[1];
+        write_data[1].dstBinding      = 1;
+        write_data[1].dstSet          = m_common_resources->skybox_ds[i]->handle();
+
+        write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[2].descriptorCount = 1;
+        write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[2].pImageInfo      = &image_info[2];
+        write_data[2].dstBinding      = 2;
+        write_data[2].dstSet          = m_common_resources->skybox_ds[i]->handle();
+
+        write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[3].descriptorCount = 1;
+        write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[3].pImageInfo      = &image_info[3];
+        write_data[3].dstBinding      = 3;
+        write_data[3].dstSet          = m_common_resources->skybox_ds[i]->handle();
+
+        vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
     void create_environment_resources()
     {
         // Create procedural sky
@@ -646,88 +1217,299 @@ private:
             uploader.submit();
         }
 
-        // Load environment maps
-        std::unique_ptr<dw::EquirectangularToCubemap> equirectangular_to_cubemap = std::unique_ptr<dw::EquirectangularToCubemap>(new dw::EquirectangularToCubemap(m_vk_backend, VK_FORMAT_R32G32B32A32_SFLOAT));
+        // Environment maps are decoded in the background the first time they are selected.
+        m_equirectangular_to_cubemap = std::unique_ptr<dw::EquirectangularToCubemap>(new dw::EquirectangularToCubemap(m_vk_backend, ENVIRONMENT_MAP_FORMAT));
 
         m_common_resources->hdr_environments.resize(environment_map_images.size());
+        m_environment_inputs.resize(environment_map_images.size());
 
-        for (int i = 0; i < environment_map_images.size(); i++)
-        {
-            std::shared_ptr<HDREnvironment> environment = std::shared_ptr<HDREnvironment>(new HDREnvironment());
+        select_environment(m_common_resources->current_environment_type);
+    }
 
-            auto input_image = dw::vk::Image::create_from_file(m_vk_backend, environment_map_images[i], true);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-            environment->image                 = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, 1024, 1024, 1, 5, 6, VK_FORMAT_R32G32B32A32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, nullptr, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
-            environment->image_view            = dw::vk::ImageView::create(m_vk_backend, environment->image, VK_IMAGE_VIEW_TYPE_CUBE, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 6);
-            environment->cubemap_sh_projection = std::unique_ptr<dw::CubemapSHProjection>(new dw::CubemapSHProjection(m_vk_backend, environment->image));
-            environment->cubemap_prefilter     = std::unique_ptr<dw::CubemapPrefiler>(new dw::CubemapPrefiler(m_vk_backend, environment->image));
+    bool is_environment_resident(EnvironmentType type)
+    {
+        return type < ENVIRONMENT_TYPE_ARCHES_PINE_TREE || m_common_resources->hdr_environments[type - ENVIRONMENT_TYPE_ARCHES_PINE_TREE];
+    }
 
-            equirectangular_to_cubemap->convert(input_image, environment->image);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-            auto cmd_buf = m_vk_backend->allocate_graphics_command_buffer(true);
+    // The current environment stays active until the selected one is resident, see update_environments().
+    void select_environment(EnvironmentType type)
+    {
+        m_requested_environment_type = type;
 
-            environment->image->generate_mipmaps(cmd_buf);
-            environment->cubemap_sh_projection->update(cmd_buf);
-            environment->cubemap_prefilter->update(cmd_buf);
+        if (is_environment_resident(type))
+            return;
 
-            vkEndCommandBuffer(cmd_buf->handle());
+        int32_t idx = type - ENVIRONMENT_TYPE_ARCHES_PINE_TREE;
 
-            m_vk_backend->flush_graphics({ cmd_buf });
+        if (!m_environment_inputs[idx])
+            m_environment_inputs[idx] = m_asset_loader->load_image(environment_map_images[idx], true, true);
 
-            m_common_resources->hdr_environments[i] = environment;
-        }
+        if (!m_environment_inputs[idx])
+            reject_environment(type);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool load_mesh()
+    // Keeps the current environment when the requested one can't be loaded. Only the startup environment can fail before anything
+    // was resident, that one falls back to the procedural sky.
+    void reject_environment(EnvironmentType type)
     {
-        m_common_resources->scenes.reserve(SCENE_TYPE_COUNT);
+        DW_LOG_ERROR("(Environment) Failed to load " + environment_types[type] + ", keeping the current environment.");
 
+        if (!is_environment_resident(m_common_resources->current_environment_type))
         {
-            std::vector<dw::RayTracedScene::Instance> instances;
+            m_common_resources->current_environment_type = ENVIRONMENT_TYPE_PROCEDURAL_SKY;
+
+            if (!m_common_resources->skybox_ds.empty())
+                m_common_resources->current_skybox_ds = m_common_resources->skybox_ds[m_common_resources->current_environment_type];
+        }
+
+        m_requested_environment_type = m_common_resources->current_environment_type;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-            dw::Mesh::Ptr pillar = dw::Mesh::load(m_vk_backend, "mesh/pillar.gltf");
+    void update_environments()
+    {
+        m_asset_loader->flush(false);
 
-            if (!pillar)
+        for (int i = 0; i < m_environment_inputs.size(); i++)
+        {
+            if (m_environment_inputs[i] && !m_asset_loader->is_pending(m_environment_inputs[i]))
             {
-                DW_LOG_ERROR("Failed to load mesh");
-                return false;
+                // Environments that were picked and then replaced before they finished loading are dropped.
+                if (i + ENVIRONMENT_TYPE_ARCHES_PINE_TREE == m_requested_environment_type && m_asset_loader->failed(m_environment_inputs[i]))
+                    reject_environment(m_requested_environment_type);
+                else if (i + ENVIRONMENT_TYPE_ARCHES_PINE_TREE == m_requested_environment_type)
+                {
+                    create_hdr_environment(i, m_environment_inputs[i]);
+                    write_skybox_descriptor_set(i + ENVIRONMENT_TYPE_ARCHES_PINE_TREE);
+                }
+
+                m_environment_inputs[i].reset();
             }
+        }
 
-            pillar->initialize_for_ray_tracing(m_vk_backend);
+        if (m_requested_environment_type != m_common_resources->current_environment_type && is_environment_resident(m_requested_environment_type))
+        {
+            EnvironmentType previous_type = m_common_resources->current_environment_type;
 
-            m_common_resources->meshes.push_back(pillar);
+            m_common_resources->current_environment_type = m_requested_environment_type;
+            m_common_resources->current_skybox_ds        = m_common_resources->skybox_ds[m_common_resources->current_environment_type];
 
-            dw::Mesh::Ptr bunny = dw::Mesh::load(m_vk_backend, "mesh/bunny.gltf");
+            evict_hdr_environment(previous_type);
+        }
+    }
 
-            if (!bunny)
-            {
-                DW_LOG_ERROR("Failed to load mesh");
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Only the active HDR environment stays resident, the others are loaded again the next time they are selected.
+    void evict_hdr_environment(EnvironmentType type)
+    {
+        if (type < ENVIRONMENT_TYPE_ARCHES_PINE_TREE)
+            return;
+
+        int32_t idx = type - ENVIRONMENT_TYPE_ARCHES_PINE_TREE;
+
+        if (!m_common_resources->hdr_environments[idx])
+            return;
+
+        // Frames in flight may still sample it.
+        m_vk_backend->wait_idle();
+
+        m_common_resources->hdr_environments[idx].reset();
+        write_skybox_descriptor_set(type);
+
+        char buffer[512];
+
+        snprintf(buffer, sizeof(buffer), "(Environment) Evicted %s, %.1f MB cubemap released.", environment_types[type].c_str(), double(environment_map_size()) / (1024.0 * 1024.0));
+
+        DW_LOG_INFO(buffer);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Size of the cubemap and its mip chain, the prefiltered and SH images are owned by the framework and not included.
+    static VkDeviceSize environment_map_size()
+    {
+        VkDeviceSize size = 0;
+
+        for (uint32_t mip_idx = 0; mip_idx < ENVIRONMENT_MAP_MIP_LEVELS; mip_idx++)
+            size += VkDeviceSize(ENVIRONMENT_MAP_SIZE >> mip_idx) * (ENVIRONMENT_MAP_SIZE >> mip_idx) * 6 * ENVIRONMENT_MAP_BYTES_PER_PIXEL;
+
+        return size;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_hdr_environment(int i, dw::vk::Image::Ptr input_image)
+    {
+        std::shared_ptr<HDREnvironment> environment = std::shared_ptr<HDREnvironment>(new HDREnvironment());
+
+        environment->image                 = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, ENVIRONMENT_MAP_SIZE, ENVIRONMENT_MAP_SIZE, 1, ENVIRONMENT_MAP_MIP_LEVELS, 6, ENVIRONMENT_MAP_FORMAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, nullptr, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+        environment->image_view            = dw::vk::ImageView::create(m_vk_backend, environment->image, VK_IMAGE_VIEW_TYPE_CUBE, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 6);
+        environment->cubemap_sh_projection = std::unique_ptr<dw::CubemapSHProjection>(new dw::CubemapSHProjection(m_vk_backend, environment->image));
+        environment->cubemap_prefilter     = std::unique_ptr<dw::CubemapPrefiler>(new dw::CubemapPrefiler(m_vk_backend, environment->image));
+
+        m_equirectangular_to_cubemap->convert(input_image, environment->image);
+
+        auto cmd_buf = m_vk_backend->allocate_graphics_command_buffer(true);
+
+        environment->image->generate_mipmaps(cmd_buf);
+        environment->cubemap_sh_projection->update(cmd_buf);
+        environment->cubemap_prefilter->update(cmd_buf);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_vk_backend->flush_graphics({ cmd_buf });
+
+        m_common_resources->hdr_environments[i] = environment;
+
+        char buffer[512];
+
+        snprintf(buffer, sizeof(buffer), "(Environment) Loaded %s, %.1f MB cubemap.", environment_types[i + ENVIRONMENT_TYPE_ARCHES_PINE_TREE].c_str(), double(environment_map_size()) / (1024.0 * 1024.0));
+
+        DW_LOG_INFO(buffer);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Takes the data read by begin_scene_load(), everything from here on needs the Vulkan backend and runs on the main thread.
+    Mesh::Ptr load_mesh(const std::string& path, const MeshData& data)
+    {
+        Mesh::Ptr mesh = m_mesh_loader->create_mesh(data);
+
+        if (!mesh)
+        {
+            DW_LOG_ERROR("Failed to load mesh: " + path);
+            return nullptr;
+        }
+
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->add_mesh(mesh, data);
+#endif
+
+        m_blas_cache->initialize(mesh, path, m_scene_cache->hash(path));
+
+        m_common_resources->meshes.push_back(mesh);
+
+        return mesh;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    std::vector<std::string> scene_meshes(SceneType type)
+    {
+        if (type == SCENE_TYPE_PILLARS)
+            return { "mesh/pillar.gltf", "mesh/bunny.gltf", "mesh/ground.gltf" };
+        else if (type == SCENE_TYPE_REFLECTIONS_TEST)
+            return { "mesh/reflections_test.gltf" };
+        else if (type == SCENE_TYPE_SPONZA)
+            return { "mesh/sponza.obj" };
+        else
+            return { "scene.gltf" };
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Parsing the mesh files (or mapping their cooked copies) is the slow part of loading a scene and doesn't touch Vulkan, so each
+    // mesh is read on its own thread while frames keep being rendered. The texture files are decoded by the asset loader's workers.
+    void begin_scene_load(SceneType type)
+    {
+        m_loading_scene_type = type;
+        m_loading_begin      = std::chrono::high_resolution_clock::now();
+        m_loading_mesh_paths = scene_meshes(type);
+
+        m_loading_mesh_data.clear();
+        m_loading_mesh_data.resize(m_loading_mesh_paths.size());
+        m_loading_meshes.clear();
+
+        for (uint32_t i = 0; i < m_loading_mesh_paths.size(); i++)
+            m_loading_meshes.push_back(std::async(std::launch::async, [this, i]() { return m_scene_cache->read(m_loading_mesh_paths[i], m_loading_mesh_data[i]); }));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool is_scene_load_ready()
+    {
+        for (auto& mesh : m_loading_meshes)
+        {
+            if (mesh.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
                 return false;
-            }
+        }
 
-            bunny->initialize_for_ray_tracing(m_vk_backend);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-            m_common_resources->meshes.push_back(bunny);
+    // Waits for the meshes of the scene load in flight and creates their buffers, acceleration structures and the scene itself.
+    // The textures of the scene have to be resident before it's rendered, so they are flushed here as well.
+    bool finish_scene_load()
+    {
+        SceneType type    = m_loading_scene_type;
+        bool      success = true;
 
-            dw::Mesh::Ptr ground = dw::Mesh::load(m_vk_backend, "mesh/ground.gltf");
+        std::vector<Mesh::Ptr> meshes;
 
-            if (!ground)
+        for (uint32_t i = 0; i < m_loading_meshes.size(); i++)
+        {
+            if (!m_loading_meshes[i].get())
             {
-                DW_LOG_ERROR("Failed to load mesh");
-                return false;
+                DW_LOG_ERROR("Failed to load mesh: " + m_loading_mesh_paths[i]);
+                success = false;
             }
+            else if (success)
+            {
+                Mesh::Ptr mesh = load_mesh(m_loading_mesh_paths[i], m_loading_mesh_data[i]);
 
-            ground->initialize_for_ray_tracing(m_vk_backend);
+                success = mesh != nullptr;
+                meshes.push_back(mesh);
+            }
+        }
+
+        m_loading_scene_type = SCENE_TYPE_COUNT;
+        m_loading_meshes.clear();
+        m_loading_mesh_data.clear();
+
+        if (!success || !load_scene(type, meshes))
+        {
+            DW_LOG_ERROR("Failed to load " + scene_types[type]);
+            return false;
+        }
+
+        m_asset_loader->flush();
 
-            m_common_resources->meshes.push_back(ground);
+        double load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_loading_begin).count();
+
+        DW_LOG_INFO("Loaded " + scene_types[type] + " in " + std::to_string(int32_t(load_ms)) + " ms.");
+        m_blas_cache->log_stats();
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The meshes are in the order scene_meshes() returns their paths.
+    bool load_scene(SceneType type, const std::vector<Mesh::Ptr>& meshes)
+    {
+        std::vector<Scene::Instance> instances;
+
+        if (type == SCENE_TYPE_PILLARS)
+        {
+            Mesh::Ptr pillar = meshes[0];
+            Mesh::Ptr bunny  = meshes[1];
+            Mesh::Ptr ground = meshes[2];
 
             float segment_length = (ground->max_extents().z - ground->min_extents().z) / (NUM_PILLARS + 1);
 
             for (uint32_t i = 0; i < NUM_PILLARS; i++)
             {
-                dw::RayTracedScene::Instance pillar_instance;
+                Scene::Instance pillar_instance;
 
                 pillar_instance.mesh      = pillar;
                 pillar_instance.transform = glm::mat4(1.0f);
@@ -741,7 +1523,7 @@ private:
 
             for (uint32_t i = 0; i < NUM_PILLARS; i++)
             {
-                dw::RayTracedScene::Instance pillar_instance;
+                Scene::Instance pillar_instance;
 
                 pillar_instance.mesh      = pillar;
                 pillar_instance.transform = glm::mat4(1.0f);
@@ -753,14 +1535,14 @@ private:
                 instances.push_back(pillar_instance);
             }
 
-            dw::RayTracedScene::Instance ground_instance;
+            Scene::Instance ground_instance;
 
             ground_instance.mesh      = ground;
             ground_instance.transform = glm::mat4(1.0f);
 
             instances.push_back(ground_instance);
 
-            dw::RayTracedScene::Instance bunny_instance;
+            Scene::Instance bunny_instance;
 
             bunny_instance.mesh = bunny;
 
@@ -771,86 +1553,95 @@ private:
             bunny_instance.transform = T * R * S;
 
             instances.push_back(bunny_instance);
-
-            m_common_resources->scenes.push_back(dw::RayTracedScene::create(m_vk_backend, instances));
         }
-
+        else if (type == SCENE_TYPE_REFLECTIONS_TEST)
         {
-            std::vector<dw::RayTracedScene::Instance> instances;
+            Mesh::Ptr reflections_test = meshes[0];
 
-            dw::Mesh::Ptr reflections_test = dw::Mesh::load(m_vk_backend, "mesh/reflections_test.gltf");
-
-            if (!reflections_test)
-            {
-                DW_LOG_ERROR("Failed to load mesh");
-                return false;
-            }
-
-            reflections_test->initialize_for_ray_tracing(m_vk_backend);
-
-            m_common_resources->meshes.push_back(reflections_test);
-
-            dw::RayTracedScene::Instance reflections_test_instance;
+            Scene::Instance reflections_test_instance;
 
             reflections_test_instance.mesh      = reflections_test;
             reflections_test_instance.transform = glm::mat4(1.0f);
 
             instances.push_back(reflections_test_instance);
-
-            m_common_resources->scenes.push_back(dw::RayTracedScene::create(m_vk_backend, instances));
         }
+        else if (type == SCENE_TYPE_SPONZA)
+        {
+            Mesh::Ptr sponza = meshes[0];
+
+            Scene::Instance sponza_instance;
 
+            sponza_instance.mesh      = sponza;
+            sponza_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
+
+            instances.push_back(sponza_instance);
+        }
+        else if (type == SCENE_TYPE_PICA_PICA)
         {
-            std::vector<dw::RayTracedScene::Instance> instances;
+            Mesh::Ptr pica_pica = meshes[0];
 
-            dw::Mesh::Ptr sponza = dw::Mesh::load(m_vk_backend, "mesh/sponza.obj");
+            Scene::Instance pica_pica_instance;
 
-            if (!sponza)
-            {
-                DW_LOG_ERROR("Failed to load mesh");
-                return false;
-            }
+            pica_pica_instance.mesh      = pica_pica;
+            pica_pica_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f));
 
-            sponza->initialize_for_ray_tracing(m_vk_backend);
+            instances.push_back(pica_pica_instance);
+        }
 
-            m_common_resources->meshes.push_back(sponza);
+        m_common_resources->scenes[type] = Scene::create(m_vk_backend, instances);
 
-            dw::RayTracedScene::Instance sponza_instance;
+        if (!m_common_resources->scenes[type])
+            return false;
 
-            sponza_instance.mesh      = sponza;
-            sponza_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->descriptor_set(m_common_resources->scenes[type]);
+#endif
 
-            instances.push_back(sponza_instance);
+        return true;
+    }
 
-            m_common_resources->scenes.push_back(dw::RayTracedScene::create(m_vk_backend, instances));
-        }
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        {
-            std::vector<dw::RayTracedScene::Instance> instances;
+    // The current scene stays active until the selected one is loaded, see update_scenes().
+    void select_scene(SceneType type)
+    {
+        m_requested_scene_type = type;
+    }
 
-            dw::Mesh::Ptr pica_pica = dw::Mesh::load(m_vk_backend, "scene.gltf");
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-            if (!pica_pica)
+    // Scenes that weren't selected before are parsed in the background, the mesh uploads go through the graphics queue so they are
+    // made once the parsing is done. With wait set it returns once the requested scene is active (or failed to load), which the
+    // benchmark relies on.
+    void update_scenes(bool wait = false)
+    {
+        while (true)
+        {
+            if (m_loading_scene_type != SCENE_TYPE_COUNT && (wait || is_scene_load_ready()))
             {
-                DW_LOG_ERROR("Failed to load mesh");
-                return false;
-            }
-
-            pica_pica->initialize_for_ray_tracing(m_vk_backend);
+                SceneType type = m_loading_scene_type;
 
-            m_common_resources->meshes.push_back(pica_pica);
+                // A scene that fails to load leaves the current one active.
+                if (!finish_scene_load() && type == m_requested_scene_type)
+                    m_requested_scene_type = m_common_resources->current_scene_type;
+            }
 
-            dw::RayTracedScene::Instance pica_pica_instance;
+            if (m_requested_scene_type == m_common_resources->current_scene_type)
+                return;
 
-            pica_pica_instance.mesh      = pica_pica;
-            pica_pica_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f));
+            if (m_common_resources->scenes[m_requested_scene_type])
+            {
+                m_common_resources->current_scene_type = m_requested_scene_type;
+                set_active_scene();
+                return;
+            }
 
-            instances.push_back(pica_pica_instance);
+            if (m_loading_scene_type == SCENE_TYPE_COUNT)
+                begin_scene_load(m_requested_scene_type);
 
-            m_common_resources->scenes.push_back(dw::RayTracedScene::create(m_vk_backend, instances));
+            if (!wait)
+                return;
         }
-
-        return true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -874,17 +1665,19 @@ private:
             {
                 if (ImGui::CollapsingHeader("Settings", ImGuiTreeNodeFlags_DefaultOpen))
                 {
-                    if (ImGui::BeginCombo("Scene", scene_types[m_common_resources->current_scene_type].c_str()))
+                    std::string scene_preview = scene_types[m_requested_scene_type];
+
+                    if (m_requested_scene_type != m_common_resources->current_scene_type)
+                        scene_preview += " (Loading...)";
+
+                    if (ImGui::BeginCombo("Scene", scene_preview.c_str()))
                     {
                         for (uint32_t i = 0; i < scene_types.size(); i++)
                         {
-                            const bool is_selected = (i == m_common_resources->current_scene_type);
+                            const bool is_selected = (i == m_requested_scene_type);
 
                             if (ImGui::Selectable(scene_types[i].c_str(), is_selected))
-                            {
-                                m_common_resources->current_scene_type = (SceneType)i;
-                                set_active_scene();
-                            }
+                                select_scene((SceneType)i);
 
                             if (is_selected)
                                 ImGui::SetItemDefaultFocus();
@@ -892,17 +1685,19 @@ private:
                         ImGui::EndCombo();
                     }
 
-                    if (ImGui::BeginCombo("Environment", environment_types[m_common_resources->current_environment_type].c_str()))
+                    std::string environment_preview = environment_types[m_requested_environment_type];
+
+                    if (!is_environment_resident(m_requested_environment_type))
+                        environment_preview += " (Loading...)";
+
+                    if (ImGui::BeginCombo("Environment", environment_preview.c_str()))
                     {
                         for (uint32_t i = 0; i < environment_types.size(); i++)
                         {
-                            const bool is_selected = (i == m_common_resources->current_environment_type);
+                            const bool is_selected = (i == m_requested_environment_type);
 
                             if (ImGui::Selectable(environment_types[i].c_str(), is_selected))
-                            {
-                                m_common_resources->current_environment_type = (EnvironmentType)i;
-                                m_common_resources->current_skybox_ds        = m_common_resources->skybox_ds[m_common_resources->current_environment_type];
-                            }
+                                select_environment((EnvironmentType)i);
 
                             if (is_selected)
                                 ImGui::SetItemDefaultFocus();
@@ -990,6 +1785,23 @@ private:
                     }
 
                     m_tone_map->gui();
+
+                    ImGui::Checkbox("Pass Culling", &m_pass_culling);
+
+                    // The async path splits the frame over several submissions of its own, which are recorded on this thread.
+                    if (m_async_compute_enabled && m_async_compute->supported())
+                        ImGui::TextDisabled("Parallel Recording: Off while Async Compute is on");
+                    else
+                        ImGui::Checkbox("Parallel Recording", &m_parallel_recording);
+
+                    if (m_async_compute->supported())
+                    {
+                        if (ImGui::Checkbox("Async Compute", &m_async_compute_enabled))
+                            recreate_async_passes();
+
+                        if (m_async_compute_enabled)
+                            m_async_compute->gui();
+                    }
                 }
                 if (ImGui::CollapsingHeader("Light", ImGuiTreeNodeFlags_DefaultOpen))
                 {
@@ -999,6 +1811,15 @@ private:
                     ImGui::InputFloat3("Direction", &m_light_direction.x);
                     ImGui::Checkbox("Animation", &m_light_animation);
                 }
+                if (ImGui::CollapsingHeader("Instances"))
+                    ImGui::Checkbox("Animation", &m_instance_animation);
+                if (ImGui::CollapsingHeader("G-Buffer"))
+                {
+                    m_g_buffer->gui();
+#if defined(COMPACT_VERTICES)
+                    m_common_resources->compact_vertices->gui();
+#endif
+                }
                 if (ImGui::CollapsingHeader("Ray Traced Shadows", ImGuiTreeNodeFlags_DefaultOpen))
                 {
                     ImGui::PushID("Ray Traced Shadows");
@@ -1015,7 +1836,9 @@ private:
                             {
                                 m_vk_backend->wait_idle();
                                 m_ray_traced_shadows.reset();
-                                m_ray_traced_shadows = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
+                                m_point_light_shadows.reset();
+                                m_ray_traced_shadows  = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
+                                m_point_light_shadows = std::unique_ptr<PointLightShadows>(new PointLightShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
                             }
 
                             if (is_selected)
@@ -1031,6 +1854,16 @@ private:
 
                     ImGui::PopID();
                 }
+                if (ImGui::CollapsingHeader("Point Lights"))
+                {
+                    ImGui::PushID("Point Lights");
+
+                    m_common_resources->point_lights->gui();
+                    ImGui::Text("Overflowed Light Tiles: %u / %u", m_deferred_shading->overflowed_light_tiles(), m_deferred_shading->num_light_tiles());
+                    m_point_light_shadows->gui();
+
+                    ImGui::PopID();
+                }
                 if (ImGui::CollapsingHeader("Ray Traced Reflections", ImGuiTreeNodeFlags_DefaultOpen))
                 {
                     ImGui::PushID("Ray Traced Reflections");
@@ -1138,6 +1971,25 @@ private:
                     m_temporal_aa->gui();
                 if (ImGui::CollapsingHeader("Profiler", ImGuiTreeNodeFlags_DefaultOpen))
                     dw::profiler::ui();
+                if (ImGui::CollapsingHeader("Frame Timings"))
+                {
+                    if (ImGui::Button("Dump JSON"))
+                    {
+                        if (m_pass_timings->write_json(m_output_timings_path))
+                            DW_LOG_INFO("Wrote pass timings to " + m_output_timings_path);
+                    }
+
+                    m_pass_timings->gui();
+
+                    ImGui::Separator();
+                    ImGui::Text("Pipeline Barriers: %u", m_barrier_stats.pipeline_barriers);
+                    ImGui::Text("Image Barriers: %u", m_barrier_stats.image_barriers);
+                    ImGui::Text("Skipped Accesses: %u", m_barrier_stats.skipped_accesses);
+                    ImGui::Separator();
+                    m_tlas_updater.gui();
+                }
+                if (ImGui::CollapsingHeader("Transient Memory"))
+                    m_common_resources->transient_allocator->gui();
 
                 ImGui::End();
             }
@@ -1148,7 +2000,7 @@ private:
 
     void update_uniforms(dw::vk::CommandBuffer::Ptr cmd_buf)
     {
-        DW_SCOPED_SAMPLE("Update Uniforms", cmd_buf);
+        HR_SCOPED_SAMPLE("Update Uniforms", cmd_buf);
 
         glm::mat4 current_jitter = glm::translate(glm::mat4(1.0f), glm::vec3(m_temporal_aa->current_jitter(), 0.0f));
 
@@ -1157,13 +2009,14 @@ private:
         m_common_resources->prev_view_projection = m_main_camera->m_prev_view_projection;
         m_common_resources->position             = m_main_camera->m_position;
 
-        m_ubo_data.proj_inverse        = glm::inverse(m_common_resources->projection);
-        m_ubo_data.view_inverse        = glm::inverse(m_common_resources->view);
-        m_ubo_data.view_proj           = m_common_resources->projection * m_common_resources->view;
-        m_ubo_data.view_proj_inverse   = glm::inverse(m_ubo_data.view_proj);
-        m_ubo_data.prev_view_proj      = m_common_resources->first_frame ? m_common_resources->prev_view_projection : current_jitter * m_common_resources->prev_view_projection;
-        m_ubo_data.cam_pos             = glm::vec4(m_common_resources->position, float(m_deferred_shading->use_ray_traced_ao()));
-        m_ubo_data.current_prev_jitter = glm::vec4(m_temporal_aa->current_jitter(), m_temporal_aa->prev_jitter());
+        m_ubo_data.proj_inverse           = glm::inverse(m_common_resources->projection);
+        m_ubo_data.view_inverse           = glm::inverse(m_common_resources->view);
+        m_ubo_data.view_proj              = m_common_resources->projection * m_common_resources->view;
+        m_ubo_data.view_proj_inverse      = glm::inverse(m_ubo_data.view_proj);
+        m_ubo_data.prev_view_proj         = m_common_resources->first_frame ? m_common_resources->prev_view_projection : current_jitter * m_common_resources->prev_view_projection;
+        m_ubo_data.prev_view_proj_inverse = glm::inverse(m_ubo_data.prev_view_proj);
+        m_ubo_data.cam_pos                = glm::vec4(m_common_resources->position, float(m_deferred_shading->use_ray_traced_ao()));
+        m_ubo_data.current_prev_jitter    = glm::vec4(m_temporal_aa->current_jitter(), m_temporal_aa->prev_jitter());
 
         set_light_radius(m_ubo_data.light, m_light_radius);
         set_light_direction(m_ubo_data.light, m_light_direction);
@@ -1186,7 +2039,7 @@ private:
             m_common_resources->sky_environment->hosek_wilkie_sky_model->update(cmd_buf, m_light_direction);
 
             {
-                DW_SCOPED_SAMPLE("Generate Skybox Mipmap", cmd_buf);
+                HR_SCOPED_SAMPLE("Generate Skybox Mipmap", cmd_buf);
                 m_common_resources->sky_environment->hosek_wilkie_sky_model->image()->generate_mipmaps(cmd_buf);
             }
 
@@ -1199,7 +2052,7 @@ private:
 
     void update_light_animation()
     {
-        if (m_light_animation)
+        if (m_light_animation && !m_benchmark)
         {
             double time = glfwGetTime() * 0.5f;
 
@@ -1212,40 +2065,152 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    // Moves the bunny of the pillars scene around in a circle. Driven by the frame delta so benchmark runs stay deterministic.
+    void update_instance_animation()
+    {
+        if (!m_instance_animation || m_common_resources->current_scene_type != SCENE_TYPE_PILLARS)
+            return;
+
+        m_instance_animation_time += m_delta_seconds;
+
+        float angle = m_instance_animation_time * 0.5f;
+
+        glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f));
+        glm::mat4 R = glm::rotate(glm::mat4(1.0f), glm::radians(135.0f) - angle, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(sinf(angle) * 5.0f, -0.5f, cosf(angle) * 5.0f));
+
+        m_common_resources->dynamic_instances->set_transform(BUNNY_INSTANCE_IDX, T * R * S);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
     void update_camera()
     {
         m_temporal_aa->update();
 
         dw::Camera* current = m_main_camera.get();
 
-        float forward_delta = m_heading_speed * m_delta;
-        float right_delta   = m_sideways_speed * m_delta;
+        // The benchmark drives the camera directly from its keyframes.
+        if (!m_benchmark)
+        {
+            float forward_delta = m_heading_speed * m_delta;
+            float right_delta   = m_sideways_speed * m_delta;
 
-        current->set_translation_delta(current->m_forward, forward_delta);
-        current->set_translation_delta(current->m_right, right_delta);
+            current->set_translation_delta(current->m_forward, forward_delta);
+            current->set_translation_delta(current->m_right, right_delta);
 
-        m_camera_x = m_mouse_delta_x * m_camera_sensitivity;
-        m_camera_y = m_mouse_delta_y * m_camera_sensitivity;
+            m_camera_x = m_mouse_delta_x * m_camera_sensitivity;
+            m_camera_y = m_mouse_delta_y * m_camera_sensitivity;
 
-        if (m_mouse_look)
-        {
-            // Activate Mouse Look
-            current->set_rotatation_delta(glm::vec3((float)(m_camera_y),
-                                                    (float)(m_camera_x),
-                                                    (float)(0.0f)));
+            if (m_mouse_look)
+            {
+                // Activate Mouse Look
+                current->set_rotatation_delta(glm::vec3((float)(m_camera_y),
+                                                        (float)(m_camera_x),
+                                                        (float)(0.0f)));
+            }
+            else
+            {
+                current->set_rotatation_delta(glm::vec3((float)(0),
+                                                        (float)(0),
+                                                        (float)(0)));
+            }
+
+            current->update();
         }
+
+        m_common_resources->frame_time    = m_delta_seconds;
+        m_common_resources->camera_delta  = m_main_camera->m_position - m_common_resources->prev_position;
+        m_common_resources->prev_position = m_main_camera->m_position;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool is_last_frame()
+    {
+        if (m_benchmark)
+            return m_benchmark_scene == SCENE_TYPE_COUNT - 1 && m_benchmark_frame == m_benchmark_warmup_frames + m_frames - 1;
         else
+            return m_headless && m_common_resources->num_frames == m_frames - 1;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void write_output()
+    {
+        if (m_headless)
         {
-            current->set_rotatation_delta(glm::vec3((float)(0),
-                                                    (float)(0),
-                                                    (float)(0)));
+            if (write_ppm(m_output_image_path, m_tone_map->width(), m_tone_map->height(), m_tone_map->readback_data()))
+                DW_LOG_INFO("Wrote image to " + m_output_image_path);
         }
 
-        current->update();
+        m_vk_backend->wait_idle();
+        m_pass_timings->resolve();
+
+        const std::string csv_ext = ".csv";
 
-        m_common_resources->frame_time    = m_delta_seconds;
-        m_common_resources->camera_delta  = m_main_camera->m_position - m_common_resources->prev_position;
-        m_common_resources->prev_position = m_main_camera->m_position;
+        bool is_csv = m_output_timings_path.size() >= csv_ext.size() && m_output_timings_path.compare(m_output_timings_path.size() - csv_ext.size(), csv_ext.size(), csv_ext) == 0;
+
+        if (is_csv ? m_pass_timings->write_csv(m_output_timings_path) : m_pass_timings->write_json(m_output_timings_path))
+            DW_LOG_INFO("Wrote pass timings to " + m_output_timings_path);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_benchmark()
+    {
+        // Advance to the next scene once the current one has rendered all of its frames.
+        if (m_benchmark_frame == m_benchmark_warmup_frames + m_frames)
+        {
+            m_benchmark_scene = (SceneType)(m_benchmark_scene + 1);
+            m_benchmark_frame = 0;
+        }
+
+        if (m_benchmark_frame == 0)
+        {
+            select_scene(m_benchmark_scene);
+            update_scenes(true);
+        }
+
+        // Warmup frames hold the first keyframe so that the temporal history and the probe grid can converge before recording.
+        bool  recording = m_benchmark_frame >= m_benchmark_warmup_frames;
+        float time      = recording ? float(m_benchmark_frame - m_benchmark_warmup_frames) * m_benchmark_fixed_delta / 1000.0f : 0.0f;
+
+        m_pass_timings->set_recording(recording);
+
+        m_delta         = m_benchmark_fixed_delta;
+        m_delta_seconds = m_benchmark_fixed_delta / 1000.0f;
+
+        BenchmarkKeyframe keyframe;
+
+        if (!m_benchmark_script.evaluate(scene_types[m_benchmark_scene], time, keyframe))
+        {
+            keyframe.position        = glm::vec3(0.0f, 35.0f, 125.0f);
+            keyframe.target          = keyframe.position + glm::vec3(0.0f, 0.0f, -1.0f);
+            keyframe.light_direction = glm::normalize(glm::vec3(0.568f, 0.707f, -0.421f));
+        }
+
+        dw::Camera* current = m_main_camera.get();
+
+        current->m_position = keyframe.position;
+        current->m_forward  = glm::normalize(keyframe.target - keyframe.position);
+        current->m_right    = glm::normalize(glm::cross(current->m_forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        current->m_view     = glm::lookAt(keyframe.position, keyframe.target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        m_light_direction = keyframe.light_direction;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    static int32_t find_option(const std::vector<std::string>& options, const std::string& value)
+    {
+        for (uint32_t i = 0; i < options.size(); i++)
+        {
+            if (options[i] == value || std::to_string(i) == value)
+                return (int32_t)i;
+        }
+
+        return -1;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1289,11 +2254,32 @@ private:
     std::unique_ptr<GBuffer>              m_g_buffer;
     std::unique_ptr<DeferredShading>      m_deferred_shading;
     std::unique_ptr<RayTracedShadows>     m_ray_traced_shadows;
+    std::unique_ptr<PointLightShadows>    m_point_light_shadows;
     std::unique_ptr<RayTracedAO>          m_ray_traced_ao;
     std::unique_ptr<RayTracedReflections> m_ray_traced_reflections;
     std::unique_ptr<DDGI>                 m_ddgi;
     std::unique_ptr<TemporalAA>           m_temporal_aa;
     std::unique_ptr<ToneMap>              m_tone_map;
+    std::unique_ptr<PassTimings>          m_pass_timings;
+    std::unique_ptr<ParallelRecorder>     m_parallel_recorder;
+    std::unique_ptr<AsyncCompute>         m_async_compute;
+    FrameGraph::Stats                     m_barrier_stats;
+    TlasUpdater                           m_tlas_updater;
+
+    // Assets.
+    std::unique_ptr<AssetLoader>                   m_asset_loader;
+    std::unique_ptr<MeshLoader>                    m_mesh_loader;
+    std::unique_ptr<SceneCache>                    m_scene_cache;
+    std::unique_ptr<BlasCache>                     m_blas_cache;
+    std::unique_ptr<dw::EquirectangularToCubemap>  m_equirectangular_to_cubemap;
+    std::vector<dw::vk::Image::Ptr>                m_environment_inputs;
+    EnvironmentType                                m_requested_environment_type = ENVIRONMENT_TYPE_PROCEDURAL_SKY;
+    SceneType                                      m_requested_scene_type       = SCENE_TYPE_PILLARS;
+    SceneType                                      m_loading_scene_type         = SCENE_TYPE_COUNT;
+    std::vector<std::string>                       m_loading_mesh_paths;
+    std::vector<MeshData>                          m_loading_mesh_data;
+    std::vector<std::future<bool>>                 m_loading_meshes;
+    std::chrono::high_resolution_clock::time_point m_loading_begin;
 
     // Camera.
     std::unique_ptr<dw::Camera> m_main_camera;
@@ -1316,8 +2302,56 @@ private:
     float     m_light_intensity = 1.0f;
     bool      m_light_animation = false;
 
+    // Instances.
+    bool  m_instance_animation      = false;
+    float m_instance_animation_time = 0.0f;
+
+    // G-Buffer.
+    bool m_visibility_buffer = false;
+
     // Uniforms.
     UBO m_ubo_data;
+
+    // Command line.
+    bool            m_headless                 = false;
+    bool            m_headless_exit            = false;
+    bool            m_parallel_recording       = false;
+    bool            m_async_compute_enabled    = false;
+    bool            m_pass_culling             = true;
+    bool            m_transient_aliasing       = true;
+    bool            m_cold_pipeline_cache      = false;
+    bool            m_scene_cache_enabled      = true;
+    bool            m_scene_cache_benchmark    = false;
+    bool            m_blas_cache_enabled       = true;
+    int32_t         m_frames                   = 100;
+    int32_t         m_initial_width            = 1920;
+    int32_t         m_initial_height           = 1080;
+    SceneType       m_initial_scene_type       = SCENE_TYPE_PILLARS;
+    EnvironmentType m_initial_environment_type = ENVIRONMENT_TYPE_PROCEDURAL_SKY;
+    std::string     m_output_image_path        = "hybrid_rendering.ppm";
+    std::string     m_output_timings_path      = "hybrid_rendering_timings.json";
+    std::string     m_pipeline_cache_path      = "hybrid_rendering_pipeline_cache.bin";
+    int32_t         m_timings_history          = 512;
+
+    // Benchmark.
+    bool            m_benchmark               = false;
+    std::string     m_benchmark_script_path;
+    BenchmarkScript m_benchmark_script;
+    SceneType       m_benchmark_scene         = SCENE_TYPE_PILLARS;
+    int32_t         m_benchmark_frame         = 0;
+    int32_t         m_benchmark_warmup_frames = 30;
+    float           m_benchmark_fixed_delta   = 1000.0f / 60.0f;
 };
 
-DW_DECLARE_MAIN(HybridRendering)
\ No newline at end of file
+int main(int argc, const char* argv[])
+{
+    HybridRendering app;
+
+    if (!app.parse_command_line(argc, argv))
+        return 1;
+
+    if (app.headless())
+        return app.run_headless(argc, argv);
+
+    return app.run(argc, argv);
+}
\ No newline at end of file
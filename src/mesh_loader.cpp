@@ -0,0 +1,262 @@
+#include "mesh_loader.h"
+#include "asset_loader.h"
+#include <logger.h>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <algorithm>
+#include <ctype.h>
+#include <float.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Embedded textures aren't supported, materials fall back to their constant values for them.
+static std::string texture_path(const aiMaterial* material, aiTextureType type, const std::string& directory)
+{
+    aiString path;
+
+    if (material->GetTextureCount(type) == 0 || material->GetTexture(type, 0, &path) != AI_SUCCESS || path.length == 0 || path.data[0] == '*')
+        return "";
+
+    std::string result = directory + path.C_Str();
+
+    std::replace(result.begin(), result.end(), '\\', '/');
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static MaterialDesc read_material(const aiMaterial* material, const std::string& directory, bool gltf)
+{
+    MaterialDesc desc;
+
+    aiString  name;
+    aiColor4D color;
+
+    if (material->Get(AI_MATKEY_NAME, name) == AI_SUCCESS)
+        desc.name = name.C_Str();
+
+    if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS)
+        desc.albedo = glm::vec4(color.r, color.g, color.b, color.a);
+
+    if (material->Get(AI_MATKEY_COLOR_EMISSIVE, color) == AI_SUCCESS)
+        desc.emissive = glm::vec4(color.r, color.g, color.b, 0.0f);
+
+    desc.textures[MATERIAL_TEXTURE_ALBEDO]   = texture_path(material, aiTextureType_DIFFUSE, directory);
+    desc.textures[MATERIAL_TEXTURE_NORMAL]   = texture_path(material, aiTextureType_NORMALS, directory);
+    desc.textures[MATERIAL_TEXTURE_EMISSIVE] = texture_path(material, aiTextureType_EMISSIVE, directory);
+
+    // OBJ files keep their normal maps in map_bump.
+    if (desc.textures[MATERIAL_TEXTURE_NORMAL].empty())
+        desc.textures[MATERIAL_TEXTURE_NORMAL] = texture_path(material, aiTextureType_HEIGHT, directory);
+
+    if (gltf)
+    {
+        // Roughness is stored in the green channel of the metallicRoughness texture and metallic in the blue one. Older versions
+        // of Assimp only expose the texture as the unknown type.
+        std::string metallic_roughness = texture_path(material, aiTextureType_UNKNOWN, directory);
+
+#if defined(AI_MATKEY_ROUGHNESS_FACTOR)
+        if (metallic_roughness.empty())
+            metallic_roughness = texture_path(material, aiTextureType_DIFFUSE_ROUGHNESS, directory);
+
+        material->Get(AI_MATKEY_ROUGHNESS_FACTOR, desc.roughness);
+        material->Get(AI_MATKEY_METALLIC_FACTOR, desc.metallic);
+#endif
+
+        desc.textures[MATERIAL_TEXTURE_ROUGHNESS] = metallic_roughness;
+        desc.textures[MATERIAL_TEXTURE_METALLIC]  = metallic_roughness;
+        desc.roughness_channel                    = 1;
+        desc.metallic_channel                     = 2;
+    }
+    else
+    {
+        // The PBR version of Sponza stores roughness in map_Ns and metallic in map_Ka.
+        desc.textures[MATERIAL_TEXTURE_ROUGHNESS] = texture_path(material, aiTextureType_SHININESS, directory);
+        desc.textures[MATERIAL_TEXTURE_METALLIC]  = texture_path(material, aiTextureType_AMBIENT, directory);
+        desc.roughness_channel                    = 0;
+        desc.metallic_channel                     = 0;
+    }
+
+    return desc;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MeshLoader::MeshLoader(std::weak_ptr<dw::vk::Backend> backend, AssetLoader* asset_loader) :
+    m_backend(backend), m_asset_loader(asset_loader)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MeshLoader::~MeshLoader()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Mesh::Ptr MeshLoader::load(const std::string& path)
+{
+    MeshData data;
+
+    if (!read(path, data))
+        return nullptr;
+
+    return create_mesh(data);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// All meshes of the file are merged into one vertex and index buffer with a submesh each.
+bool MeshLoader::read(const std::string& path, MeshData& data)
+{
+    Assimp::Importer importer;
+
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
+
+    if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || scene->mNumMeshes == 0)
+    {
+        DW_LOG_ERROR("(MeshLoader) Failed to import " + path + ": " + importer.GetErrorString());
+        return false;
+    }
+
+    const size_t      separator = path.find_last_of("/\\");
+    const std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    data             = MeshData();
+    data.path        = path;
+    data.min_extents = glm::vec3(FLT_MAX);
+    data.max_extents = glm::vec3(-FLT_MAX);
+
+    uint32_t num_vertices = 0;
+    uint32_t num_indices  = 0;
+
+    for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+    {
+        num_vertices += scene->mMeshes[i]->mNumVertices;
+        num_indices += scene->mMeshes[i]->mNumFaces * 3;
+    }
+
+    data.vertices.reserve(num_vertices);
+    data.indices.reserve(num_indices);
+
+    for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+    {
+        const aiMesh*  mesh        = scene->mMeshes[i];
+        const uint32_t base_vertex = data.vertices.size();
+
+        SubMesh sub_mesh;
+
+        sub_mesh.mat_idx     = mesh->mMaterialIndex;
+        sub_mesh.base_index  = data.indices.size();
+        sub_mesh.min_extents = glm::vec3(FLT_MAX);
+        sub_mesh.max_extents = glm::vec3(-FLT_MAX);
+
+        for (uint32_t j = 0; j < mesh->mNumVertices; j++)
+        {
+            Vertex vertex;
+
+            vertex.position  = glm::vec4(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z, 1.0f);
+            vertex.tex_coord = mesh->HasTextureCoords(0) ? glm::vec4(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y, 0.0f, 0.0f) : glm::vec4(0.0f);
+            vertex.normal    = mesh->HasNormals() ? glm::vec4(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z, 0.0f) : glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+
+            if (mesh->HasTangentsAndBitangents())
+            {
+                vertex.tangent   = glm::vec4(mesh->mTangents[j].x, mesh->mTangents[j].y, mesh->mTangents[j].z, 0.0f);
+                vertex.bitangent = glm::vec4(mesh->mBitangents[j].x, mesh->mBitangents[j].y, mesh->mBitangents[j].z, 0.0f);
+            }
+            else
+            {
+                vertex.tangent   = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+                vertex.bitangent = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+            }
+
+            sub_mesh.min_extents = glm::min(sub_mesh.min_extents, glm::vec3(vertex.position));
+            sub_mesh.max_extents = glm::max(sub_mesh.max_extents, glm::vec3(vertex.position));
+
+            data.vertices.push_back(vertex);
+        }
+
+        // Triangulation leaves points and lines alone.
+        for (uint32_t j = 0; j < mesh->mNumFaces; j++)
+        {
+            if (mesh->mFaces[j].mNumIndices != 3)
+                continue;
+
+            for (uint32_t k = 0; k < 3; k++)
+                data.indices.push_back(base_vertex + mesh->mFaces[j].mIndices[k]);
+        }
+
+        sub_mesh.index_count = data.indices.size() - sub_mesh.base_index;
+
+        if (sub_mesh.index_count == 0)
+            continue;
+
+        data.min_extents = glm::min(data.min_extents, sub_mesh.min_extents);
+        data.max_extents = glm::max(data.max_extents, sub_mesh.max_extents);
+
+        data.sub_meshes.push_back(sub_mesh);
+    }
+
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++)
+        data.materials.push_back(read_material(scene->mMaterials[i], directory, extension == "gltf" || extension == "glb"));
+
+    return !data.sub_meshes.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Textures shared between meshes, like the metallicRoughness texture of a glTF, are only loaded once. Albedo and emissive
+// textures are sampled as sRGB.
+Mesh::Ptr MeshLoader::create_mesh(const MeshData& data)
+{
+    auto backend = m_backend.lock();
+
+    std::vector<Material::Ptr> materials;
+
+    for (const auto& desc : data.materials)
+    {
+        std::vector<dw::vk::Image::Ptr>     images(MATERIAL_TEXTURE_COUNT);
+        std::vector<dw::vk::ImageView::Ptr> image_views(MATERIAL_TEXTURE_COUNT);
+
+        for (uint32_t i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+        {
+            if (desc.textures[i].empty())
+                continue;
+
+            const bool        srgb = i == MATERIAL_TEXTURE_ALBEDO || i == MATERIAL_TEXTURE_EMISSIVE;
+            const std::string key  = desc.textures[i] + (srgb ? ":srgb" : "");
+
+            auto it = m_textures.find(key);
+
+            if (it == m_textures.end())
+            {
+                Texture texture;
+
+                texture.image = m_asset_loader->load_image(desc.textures[i], false, false, srgb, true);
+
+                if (texture.image)
+                    texture.image_view = dw::vk::ImageView::create(backend, texture.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+                it = m_textures.insert({ key, texture }).first;
+            }
+
+            images[i]      = it->second.image;
+            image_views[i] = it->second.image_view;
+        }
+
+        materials.push_back(Material::create(desc, images, image_views));
+    }
+
+    if (materials.empty())
+        materials.push_back(Material::create(MaterialDesc(), {}, {}));
+
+    return Mesh::create(backend, data, materials);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
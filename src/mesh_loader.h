@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vk.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "scene.h"
+
+class AssetLoader;
+
+// Imports meshes through Assimp and creates their buffers and materials:
+//
+//   Mesh::Ptr sponza = m_mesh_loader->load("mesh/sponza.obj");
+//
+// All meshes of a file are merged into one vertex and index buffer with a submesh each, the vertices are stored in the layout
+// scene_descriptor_set.glsl reads them in. Textures are referenced by path and decoded by the asset loader's workers.
+//
+// read() only touches the CPU side and can run on several threads at once, create_mesh() creates the buffers and queues the
+// textures on the asset loader, which have to be flushed before the mesh is rendered. create_mesh() belongs to the thread that
+// owns the loader.
+class MeshLoader
+{
+public:
+    MeshLoader(std::weak_ptr<dw::vk::Backend> backend, AssetLoader* asset_loader);
+    ~MeshLoader();
+
+    Mesh::Ptr load(const std::string& path);
+    bool      read(const std::string& path, MeshData& data);
+    Mesh::Ptr create_mesh(const MeshData& data);
+
+private:
+    struct Texture
+    {
+        dw::vk::Image::Ptr     image;
+        dw::vk::ImageView::Ptr image_view;
+    };
+
+private:
+    std::weak_ptr<dw::vk::Backend>           m_backend;
+    AssetLoader*                             m_asset_loader;
+    std::unordered_map<std::string, Texture> m_textures;
+};
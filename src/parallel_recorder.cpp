@@ -0,0 +1,162 @@
+#include "parallel_recorder.h"
+#include "pass_timings.h"
+#include <macros.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ParallelRecorder::ParallelRecorder(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers) :
+    m_backend(backend), m_next_pass(0)
+{
+    auto vk_backend = backend.lock();
+
+    // Slot 0 belongs to the calling thread, which records alongside the workers.
+    m_thread_data.resize(num_workers + 1);
+
+    for (auto& thread_data : m_thread_data)
+    {
+        for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+            thread_data.command_pool[i] = dw::vk::CommandPool::create(vk_backend, vk_backend->queue_infos().graphics_queue_index);
+    }
+
+    for (uint32_t i = 0; i < num_workers; i++)
+        m_workers.push_back(std::thread(&ParallelRecorder::worker, this, i + 1));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ParallelRecorder::~ParallelRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+
+    m_work_cv.notify_all();
+
+    for (auto& thread : m_workers)
+        thread.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ParallelRecorder::begin_frame()
+{
+    auto vk_backend = m_backend.lock();
+
+    m_frame_idx = vk_backend->current_frame_idx();
+
+    // Every command buffer allocated for this frame slot has retired, so the pools can be recycled wholesale.
+    for (auto& thread_data : m_thread_data)
+    {
+        vkResetCommandPool(vk_backend->device(), thread_data.command_pool[m_frame_idx]->handle(), 0);
+        thread_data.num_allocated = 0;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<dw::vk::CommandBuffer::Ptr> ParallelRecorder::record(const std::vector<RecordFunc>& passes)
+{
+    PassTimings* timings = PassTimings::active();
+
+    m_results.assign(passes.size(), nullptr);
+    m_base_path = timings ? timings->current_path() : std::string();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_passes       = &passes;
+        m_num_finished = 0;
+        m_next_pass.store(0);
+        m_batch_id++;
+    }
+
+    m_work_cv.notify_all();
+
+    execute(0);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]() { return m_num_finished == m_workers.size(); });
+
+        m_passes = nullptr;
+    }
+
+    return m_results;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ParallelRecorder::worker(uint32_t thread_idx)
+{
+    uint64_t last_batch_id = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_work_cv.wait(lock, [this, last_batch_id]() { return m_shutdown || m_batch_id != last_batch_id; });
+
+            if (m_shutdown)
+                return;
+
+            last_batch_id = m_batch_id;
+        }
+
+        execute(thread_idx);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_num_finished++;
+        }
+
+        m_done_cv.notify_one();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ParallelRecorder::execute(uint32_t thread_idx)
+{
+    PassTimings* timings = PassTimings::active();
+
+    // Nest the worker's scopes under whatever scope the main thread had open when the batch was kicked off.
+    if (timings && thread_idx != 0)
+        timings->set_thread_path(m_base_path);
+
+    uint32_t pass_idx;
+
+    while ((pass_idx = m_next_pass.fetch_add(1)) < m_passes->size())
+    {
+        dw::vk::CommandBuffer::Ptr cmd_buf = allocate(thread_idx);
+
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
+
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+        (*m_passes)[pass_idx](cmd_buf);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_results[pass_idx] = cmd_buf;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::CommandBuffer::Ptr ParallelRecorder::allocate(uint32_t thread_idx)
+{
+    ThreadData&                              thread_data     = m_thread_data[thread_idx];
+    std::vector<dw::vk::CommandBuffer::Ptr>& command_buffers = thread_data.command_buffers[m_frame_idx];
+
+    if (thread_data.num_allocated == command_buffers.size())
+        command_buffers.push_back(dw::vk::CommandBuffer::create(m_backend.lock(), thread_data.command_pool[m_frame_idx]));
+
+    return command_buffers[thread_data.num_allocated++];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
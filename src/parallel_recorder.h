@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vk.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Records a batch of passes in parallel, each into its own primary command buffer allocated from a command pool owned by the
+// recording thread. The returned command buffers are meant to be submitted in order in a single batch, which keeps the
+// barriers between passes valid. Primary rather than secondary command buffers are used since most passes begin their own
+// render pass, which is not allowed inside a secondary command buffer.
+class ParallelRecorder
+{
+public:
+    using RecordFunc = std::function<void(dw::vk::CommandBuffer::Ptr)>;
+
+public:
+    ParallelRecorder(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers);
+    ~ParallelRecorder();
+
+    void                                    begin_frame();
+    std::vector<dw::vk::CommandBuffer::Ptr> record(const std::vector<RecordFunc>& passes);
+
+    inline uint32_t num_workers() { return m_workers.size(); }
+
+private:
+    struct ThreadData
+    {
+        dw::vk::CommandPool::Ptr                command_pool[dw::vk::Backend::kMaxFramesInFlight];
+        std::vector<dw::vk::CommandBuffer::Ptr> command_buffers[dw::vk::Backend::kMaxFramesInFlight];
+        uint32_t                                num_allocated = 0;
+    };
+
+    void                       worker(uint32_t thread_idx);
+    void                       execute(uint32_t thread_idx);
+    dw::vk::CommandBuffer::Ptr allocate(uint32_t thread_idx);
+
+private:
+    std::weak_ptr<dw::vk::Backend>          m_backend;
+    uint32_t                                m_frame_idx = 0;
+    std::vector<std::thread>                m_workers;
+    std::vector<ThreadData>                 m_thread_data;
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_work_cv;
+    std::condition_variable                 m_done_cv;
+    uint64_t                                m_batch_id = 0;
+    bool                                    m_shutdown = false;
+    const std::vector<RecordFunc>*          m_passes   = nullptr;
+    std::vector<dw::vk::CommandBuffer::Ptr> m_results;
+    std::string                             m_base_path;
+    std::atomic<uint32_t>                   m_next_pass;
+    uint32_t                                m_num_finished = 0;
+};
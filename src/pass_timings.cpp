@@ -0,0 +1,653 @@
+#include "pass_timings.h"
+#include "utilities.h"
+#include <logger.h>
+#include <macros.h>
+#include <imgui.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t kMaxPasses = 1024;
+
+static PassTimings* g_active_pass_timings = nullptr;
+
+// Scope stack of the calling thread.
+struct ThreadScopes
+{
+    std::string                                                 path;
+    std::vector<uint32_t>                                       open_records;
+    std::vector<std::chrono::high_resolution_clock::time_point> start_times;
+};
+
+static thread_local ThreadScopes t_scopes;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double percentile(const std::vector<double>& sorted_samples, double p)
+{
+    // Nearest-rank.
+    size_t rank = (size_t)std::ceil(p * double(sorted_samples.size()));
+
+    return sorted_samples[std::max(rank, (size_t)1) - 1];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings::Scope::Scope(PassTimings* timings, const std::string& name, dw::vk::CommandBuffer::Ptr cmd_buf) :
+    timings(timings), name(name), cmd_buf(cmd_buf)
+{
+    if (timings)
+    {
+        // The framework profiler keeps a single sample stack, so it can only be fed from the main thread.
+        framework_sample = timings->framework_samples() && std::this_thread::get_id() == timings->main_thread_id();
+
+        if (framework_sample)
+            dw::profiler::begin_sample(name, cmd_buf);
+
+        timings->begin_scope(cmd_buf, name);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings::Scope::~Scope()
+{
+    end(cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::Scope::end(dw::vk::CommandBuffer::Ptr end_cmd_buf)
+{
+    if (timings)
+    {
+        timings->end_scope(end_cmd_buf);
+
+        if (framework_sample)
+            dw::profiler::end_sample(name, end_cmd_buf);
+
+        timings = nullptr;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings* PassTimings::active()
+{
+    return g_active_pass_timings;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::set_active(PassTimings* timings)
+{
+    g_active_pass_timings = timings;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings::PassTimings(std::weak_ptr<dw::vk::Backend> backend, uint32_t history_size, uint32_t max_scopes) :
+    m_backend(backend), m_history_size(std::max(history_size, 1u)), m_max_scopes(max_scopes), m_main_thread_id(std::this_thread::get_id()), m_num_passes(0)
+{
+    auto vk_backend = backend.lock();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk_backend->physical_device(), &properties);
+
+    m_timestamp_period        = properties.limits.timestampPeriod;
+    m_graphics_timestamp_mask = timestamp_mask(vk_backend->physical_device(), vk_backend->queue_infos().graphics_queue_index);
+    m_compute_timestamp_mask  = timestamp_mask(vk_backend->physical_device(), vk_backend->queue_infos().compute_queue_index);
+
+    if (m_compute_timestamp_mask == 0)
+        DW_LOG_INFO("(PassTimings) The compute queue doesn't support timestamps, async compute scopes only report CPU times.");
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        VkQueryPoolCreateInfo info;
+        DW_ZERO_MEMORY(info);
+
+        info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        info.queryCount = m_max_scopes * 2;
+
+        vkCreateQueryPool(vk_backend->device(), &info, nullptr, &m_frames[i].query_pool);
+
+        if (m_compute_timestamp_mask != 0)
+            vkCreateQueryPool(vk_backend->device(), &info, nullptr, &m_frames[i].compute_query_pool);
+    }
+
+    // Sized up front so that readers on other threads never observe a reallocation.
+    m_passes.resize(kMaxPasses);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings::~PassTimings()
+{
+    auto vk_backend = m_backend.lock();
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        vkDestroyQueryPool(vk_backend->device(), m_frames[i].query_pool, nullptr);
+
+        if (m_frames[i].compute_query_pool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(vk_backend->device(), m_frames[i].compute_query_pool, nullptr);
+    }
+
+    if (g_active_pass_timings == this)
+        g_active_pass_timings = nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    auto vk_backend = m_backend.lock();
+
+    m_current_frame = vk_backend->current_frame_idx();
+
+    // The fence for this frame slot has already been waited on, so its queries are available.
+    resolve_frame(m_current_frame, false);
+
+    m_frames[m_current_frame].recording = m_recording;
+
+    t_scopes.path.clear();
+    t_scopes.open_records.clear();
+    t_scopes.start_times.clear();
+
+    m_compute_cmd_buf = VK_NULL_HANDLE;
+
+    vkCmdResetQueryPool(cmd_buf->handle(), m_frames[m_current_frame].query_pool, 0, m_max_scopes * 2);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::begin_compute(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    // Scopes recorded into this command buffer from now on run on the compute queue, so their pool is reset on that queue too.
+    m_compute_cmd_buf = cmd_buf->handle();
+
+    if (m_compute_timestamp_mask != 0)
+        vkCmdResetQueryPool(cmd_buf->handle(), m_frames[m_current_frame].compute_query_pool, 0, m_max_scopes * 2);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::begin_scope(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name)
+{
+    t_scopes.path = t_scopes.path.empty() ? name : t_scopes.path + "/" + name;
+
+    const bool  compute    = cmd_buf->handle() == m_compute_cmd_buf;
+    const bool  timestamps = (compute ? m_compute_timestamp_mask : m_graphics_timestamp_mask) != 0;
+    VkQueryPool query_pool = compute ? m_frames[m_current_frame].compute_query_pool : m_frames[m_current_frame].query_pool;
+
+    uint32_t record_idx  = UINT32_MAX;
+    uint32_t begin_query = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_record_mutex);
+
+        Frame&   frame    = m_frames[m_current_frame];
+        uint32_t pass_idx = find_or_add_pass(t_scopes.path);
+
+        if (frame.records.size() < m_max_scopes && pass_idx != UINT32_MAX)
+        {
+            Record record;
+
+            record.pass_idx    = pass_idx;
+            record.begin_query = 0;
+            record.end_query   = 0;
+            record.cpu_ms      = 0.0f;
+            record.compute     = compute;
+            record.timestamps  = timestamps;
+            record.closed      = false;
+
+            if (timestamps)
+                record.begin_query = compute ? frame.num_compute_queries++ : frame.num_queries++;
+
+            record_idx  = frame.records.size();
+            begin_query = record.begin_query;
+
+            frame.records.push_back(record);
+        }
+    }
+
+    t_scopes.open_records.push_back(record_idx);
+    t_scopes.start_times.push_back(std::chrono::high_resolution_clock::now());
+
+    if (record_idx == UINT32_MAX)
+    {
+        DW_LOG_ERROR("(PassTimings) Too many scopes, dropping: " + t_scopes.path);
+        return;
+    }
+
+    if (timestamps)
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, begin_query);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::end_scope(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (t_scopes.open_records.empty())
+        return;
+
+    uint32_t record_idx = t_scopes.open_records.back();
+    auto     start_time = t_scopes.start_times.back();
+
+    t_scopes.open_records.pop_back();
+    t_scopes.start_times.pop_back();
+
+    size_t separator = t_scopes.path.find_last_of('/');
+    t_scopes.path    = separator == std::string::npos ? std::string() : t_scopes.path.substr(0, separator);
+
+    if (record_idx == UINT32_MAX)
+        return;
+
+    float cpu_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+    uint32_t end_query  = 0;
+    bool     compute    = false;
+    bool     timestamps = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_record_mutex);
+
+        Frame&  frame  = m_frames[m_current_frame];
+        Record& record = frame.records[record_idx];
+
+        compute    = record.compute;
+        timestamps = record.timestamps;
+
+        if (timestamps)
+            end_query = compute ? frame.num_compute_queries++ : frame.num_queries++;
+
+        record.end_query = end_query;
+        record.cpu_ms    = cpu_ms;
+        record.closed    = true;
+    }
+
+    if (timestamps)
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, compute ? m_frames[m_current_frame].compute_query_pool : m_frames[m_current_frame].query_pool, end_query);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string PassTimings::current_path()
+{
+    return t_scopes.path;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::set_thread_path(const std::string& path)
+{
+    t_scopes.path = path;
+    t_scopes.open_records.clear();
+    t_scopes.start_times.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::add_sample(const std::string& name, float gpu_ms)
+{
+    // For GPU times that are measured outside of a scope, e.g. the overlap between two queues.
+    if (!m_recording)
+        return;
+
+    uint32_t pass_idx;
+
+    {
+        std::lock_guard<std::mutex> lock(m_record_mutex);
+        pass_idx = find_or_add_pass(name);
+    }
+
+    if (pass_idx != UINT32_MAX)
+        push_sample(m_passes[pass_idx]->gpu, gpu_ms);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::resolve()
+{
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        resolve_frame(i, true);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::clear()
+{
+    uint32_t num = m_num_passes.load(std::memory_order_acquire);
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        m_passes[i]->gpu.cleared_idx.store(m_passes[i]->gpu.write_idx.load(std::memory_order_relaxed), std::memory_order_release);
+        m_passes[i]->cpu.cleared_idx.store(m_passes[i]->cpu.write_idx.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::gui()
+{
+    ImGui::Text("Last %u frames", m_history_size);
+
+    ImGui::Columns(6, "PassTimings");
+    ImGui::Separator();
+    ImGui::Text("Scope");
+    ImGui::NextColumn();
+    ImGui::Text("CPU Mean");
+    ImGui::NextColumn();
+    ImGui::Text("GPU Mean");
+    ImGui::NextColumn();
+    ImGui::Text("P95");
+    ImGui::NextColumn();
+    ImGui::Text("P99");
+    ImGui::NextColumn();
+    ImGui::Text("Max");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    uint32_t num = num_passes();
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        Stats pass_stats = stats(i);
+
+        ImGui::Text("%s", m_passes[i]->name.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", stats(i, TIMING_CPU).mean);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", pass_stats.mean);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", pass_stats.p95);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", pass_stats.p99);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", pass_stats.max);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::Separator();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t PassTimings::num_passes()
+{
+    return m_num_passes.load(std::memory_order_acquire);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+const std::string& PassTimings::pass_name(uint32_t idx)
+{
+    return m_passes[idx]->name;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PassTimings::Stats PassTimings::stats(uint32_t idx, TimingType type)
+{
+    Stats pass_stats;
+
+    std::vector<double> samples;
+    snapshot(type == TIMING_GPU ? m_passes[idx]->gpu : m_passes[idx]->cpu, samples);
+
+    if (samples.empty())
+        return pass_stats;
+
+    pass_stats.last = samples.back();
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+
+    for (double sample : samples)
+        sum += sample;
+
+    pass_stats.count = samples.size();
+    pass_stats.min   = samples.front();
+    pass_stats.mean  = sum / double(samples.size());
+    pass_stats.p50   = percentile(samples, 0.5);
+    pass_stats.p95   = percentile(samples, 0.95);
+    pass_stats.p99   = percentile(samples, 0.99);
+    pass_stats.max   = samples.back();
+
+    return pass_stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PassTimings::stats(const std::string& name, Stats& stats, TimingType type)
+{
+    uint32_t num = num_passes();
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        if (m_passes[i]->name == name)
+        {
+            stats = this->stats(i, type);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string PassTimings::to_json()
+{
+    std::stringstream ss;
+
+    uint32_t num = num_passes();
+
+    auto write_stats = [&ss](const Stats& stats) {
+        ss << "{ \"frames\": " << stats.count
+           << ", \"last_ms\": " << stats.last
+           << ", \"min_ms\": " << stats.min
+           << ", \"mean_ms\": " << stats.mean
+           << ", \"p50_ms\": " << stats.p50
+           << ", \"p95_ms\": " << stats.p95
+           << ", \"p99_ms\": " << stats.p99
+           << ", \"max_ms\": " << stats.max << " }";
+    };
+
+    ss << "{\n    \"history_size\": " << m_history_size << ",\n    \"passes\": [\n";
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        ss << "        { \"name\": \"" << m_passes[i]->name << "\", \"gpu\": ";
+        write_stats(stats(i, TIMING_GPU));
+        ss << ", \"cpu\": ";
+        write_stats(stats(i, TIMING_CPU));
+        ss << " }" << (i == num - 1 ? "\n" : ",\n");
+    }
+
+    ss << "    ]\n}\n";
+
+    return ss.str();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PassTimings::write_json(const std::string& path)
+{
+    std::ofstream file(path);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("(PassTimings) Failed to open file for writing: " + path);
+        return false;
+    }
+
+    file << to_json();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PassTimings::write_csv(const std::string& path)
+{
+    std::ofstream file(path);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("(PassTimings) Failed to open file for writing: " + path);
+        return false;
+    }
+
+    file << "name,timing,frames,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+
+    uint32_t num = num_passes();
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        for (uint32_t type = 0; type < 2; type++)
+        {
+            Stats pass_stats = stats(i, (TimingType)type);
+
+            file << "\"" << m_passes[i]->name << "\"," << (type == TIMING_GPU ? "gpu" : "cpu") << "," << pass_stats.count << "," << pass_stats.min << "," << pass_stats.mean << "," << pass_stats.p50 << "," << pass_stats.p95 << "," << pass_stats.p99 << "," << pass_stats.max << "\n";
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t PassTimings::find_or_add_pass(const std::string& name)
+{
+    uint32_t num = m_num_passes.load(std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        if (m_passes[i]->name == name)
+            return i;
+    }
+
+    if (num == kMaxPasses)
+        return UINT32_MAX;
+
+    std::unique_ptr<Pass> pass(new Pass());
+
+    pass->name = name;
+
+    init_ring(pass->gpu);
+    init_ring(pass->cpu);
+
+    m_passes[num] = std::move(pass);
+
+    // Publish only once the pass is fully constructed.
+    m_num_passes.store(num + 1, std::memory_order_release);
+
+    return num;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::resolve_frame(uint32_t frame_idx, bool wait)
+{
+    Frame& frame = m_frames[frame_idx];
+
+    if (frame.recording && !frame.records.empty())
+    {
+        std::vector<uint64_t> timestamps;
+        std::vector<uint64_t> compute_timestamps;
+
+        bool graphics_valid = read_queries(frame.query_pool, frame.num_queries, wait, timestamps);
+        bool compute_valid  = read_queries(frame.compute_query_pool, frame.num_compute_queries, wait, compute_timestamps);
+
+        for (const auto& record : frame.records)
+        {
+            if (!record.closed || !record.timestamps || !(record.compute ? compute_valid : graphics_valid))
+                continue;
+
+            const std::vector<uint64_t>& values = record.compute ? compute_timestamps : timestamps;
+            const uint64_t               mask   = record.compute ? m_compute_timestamp_mask : m_graphics_timestamp_mask;
+
+            double ms = double((values[record.end_query] - values[record.begin_query]) & mask) * double(m_timestamp_period) / 1000000.0;
+            push_sample(m_passes[record.pass_idx]->gpu, float(ms));
+        }
+
+        for (const auto& record : frame.records)
+        {
+            if (record.closed)
+                push_sample(m_passes[record.pass_idx]->cpu, record.cpu_ms);
+        }
+    }
+
+    frame.num_queries         = 0;
+    frame.num_compute_queries = 0;
+    frame.records.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PassTimings::read_queries(VkQueryPool query_pool, uint32_t count, bool wait, std::vector<uint64_t>& timestamps)
+{
+    if (query_pool == VK_NULL_HANDLE || count == 0)
+        return false;
+
+    auto vk_backend = m_backend.lock();
+
+    timestamps.resize(count);
+
+    VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT;
+
+    if (wait)
+        flags |= VK_QUERY_RESULT_WAIT_BIT;
+
+    return vkGetQueryPoolResults(vk_backend->device(), query_pool, 0, count, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), flags) == VK_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::init_ring(Ring& ring)
+{
+    ring.samples = std::unique_ptr<std::atomic<float>[]>(new std::atomic<float>[m_history_size]);
+    ring.write_idx.store(0, std::memory_order_relaxed);
+    ring.cleared_idx.store(0, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::push_sample(Ring& ring, float ms)
+{
+    // Single writer: store the sample first, then publish it by advancing the write index.
+    uint64_t idx = ring.write_idx.load(std::memory_order_relaxed);
+
+    ring.samples[idx % m_history_size].store(ms, std::memory_order_relaxed);
+    ring.write_idx.store(idx + 1, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PassTimings::snapshot(Ring& ring, std::vector<double>& samples)
+{
+    uint64_t end   = ring.write_idx.load(std::memory_order_acquire);
+    uint64_t begin = std::max(ring.cleared_idx.load(std::memory_order_acquire), end > m_history_size ? end - m_history_size : 0);
+
+    std::vector<float> values(end - begin);
+
+    for (uint64_t i = begin; i < end; i++)
+        values[i - begin] = ring.samples[i % m_history_size].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Any slot the writer has lapped while we were copying may hold a newer sample, so drop those from the front.
+    uint64_t end_after   = ring.write_idx.load(std::memory_order_relaxed);
+    uint64_t first_valid = end_after > m_history_size ? end_after - m_history_size : 0;
+    uint64_t skip        = first_valid > begin ? std::min(first_valid - begin, end - begin) : 0;
+
+    samples.assign(values.begin() + skip, values.end());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
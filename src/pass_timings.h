@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vk.h>
+#include <profiler.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GPU timestamp queries and CPU recording times around every sample scope, resolved once the frame that recorded them has
+// retired. Scopes nest, so results are keyed by their full path (e.g. "Update/Ray Traced Shadows/A-Trous Filter").
+//
+// The last N results of each scope are kept in a ring buffer that is written by the render thread only and can be read from
+// any other thread without locking, so telemetry can poll stats() or to_json() while the renderer keeps running.
+//
+// Scopes may be opened from worker threads that record their own command buffers; each thread keeps its own scope stack and
+// should call set_thread_path() with the path of the scope it is recording under.
+//
+// Scopes recorded into the async compute command buffer write into a query pool of their own that is reset on the compute
+// queue, see begin_compute(). Queue families without timestamp support only report CPU times.
+class PassTimings
+{
+public:
+    enum TimingType
+    {
+        TIMING_GPU,
+        TIMING_CPU
+    };
+
+    struct Scope
+    {
+        Scope(PassTimings* timings, const std::string& name, dw::vk::CommandBuffer::Ptr cmd_buf);
+        ~Scope();
+
+        // Closes the scope early on a different command buffer, i.e. the last one submitted for the frame.
+        void end(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+        PassTimings*               timings;
+        std::string                name;
+        dw::vk::CommandBuffer::Ptr cmd_buf;
+        bool                       framework_sample = false;
+    };
+
+    struct Stats
+    {
+        uint32_t count = 0;
+        double   last  = 0.0;
+        double   min   = 0.0;
+        double   mean  = 0.0;
+        double   p50   = 0.0;
+        double   p95   = 0.0;
+        double   p99   = 0.0;
+        double   max   = 0.0;
+    };
+
+public:
+    static PassTimings* active();
+    static void         set_active(PassTimings* timings);
+
+    PassTimings(std::weak_ptr<dw::vk::Backend> backend, uint32_t history_size = 512, uint32_t max_scopes = 128);
+    ~PassTimings();
+
+    void        begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void        begin_compute(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void        begin_scope(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name);
+    void        end_scope(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void        resolve();
+    void        clear();
+    void        gui();
+    std::string current_path();
+    void        set_thread_path(const std::string& path);
+    void        add_sample(const std::string& name, float gpu_ms);
+
+    // Safe to call from any thread.
+    uint32_t           num_passes();
+    const std::string& pass_name(uint32_t idx);
+    Stats              stats(uint32_t idx, TimingType type = TIMING_GPU);
+    bool               stats(const std::string& name, Stats& stats, TimingType type = TIMING_GPU);
+    std::string        to_json();
+    bool               write_json(const std::string& path);
+    bool               write_csv(const std::string& path);
+
+    inline uint32_t        history_size() { return m_history_size; }
+    inline bool            recording() { return m_recording; }
+    inline void            set_recording(bool recording) { m_recording = recording; }
+    inline std::thread::id main_thread_id() { return m_main_thread_id; }
+    inline bool            framework_samples() { return m_framework_samples; }
+
+    // The framework profiler is only set up by the framework's run loop, headless runs have to turn it off.
+    inline void set_framework_samples(bool enabled) { m_framework_samples = enabled; }
+
+private:
+    struct Ring
+    {
+        std::unique_ptr<std::atomic<float>[]> samples;
+        std::atomic<uint64_t>                 write_idx;
+        std::atomic<uint64_t>                 cleared_idx;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        Ring        gpu;
+        Ring        cpu;
+    };
+
+    struct Record
+    {
+        uint32_t pass_idx;
+        uint32_t begin_query;
+        uint32_t end_query;
+        float    cpu_ms;
+        bool     compute;
+        bool     timestamps;
+        bool     closed;
+    };
+
+    struct Frame
+    {
+        VkQueryPool         query_pool          = VK_NULL_HANDLE;
+        VkQueryPool         compute_query_pool  = VK_NULL_HANDLE;
+        uint32_t            num_queries         = 0;
+        uint32_t            num_compute_queries = 0;
+        bool                recording           = false;
+        std::vector<Record> records;
+    };
+
+    uint32_t find_or_add_pass(const std::string& name);
+    bool     read_queries(VkQueryPool query_pool, uint32_t count, bool wait, std::vector<uint64_t>& timestamps);
+    void     resolve_frame(uint32_t frame_idx, bool wait);
+    void     init_ring(Ring& ring);
+    void     push_sample(Ring& ring, float ms);
+    void     snapshot(Ring& ring, std::vector<double>& samples);
+
+private:
+    std::weak_ptr<dw::vk::Backend>     m_backend;
+    uint32_t                           m_history_size;
+    uint32_t                           m_max_scopes;
+    uint32_t                           m_current_frame = 0;
+    float                              m_timestamp_period;
+    uint64_t                           m_graphics_timestamp_mask = 0;
+    uint64_t                           m_compute_timestamp_mask  = 0;
+    VkCommandBuffer                    m_compute_cmd_buf         = VK_NULL_HANDLE;
+    bool                               m_recording         = true;
+    bool                               m_framework_samples = true;
+    std::thread::id                    m_main_thread_id;
+    std::mutex                         m_record_mutex;
+    Frame                              m_frames[dw::vk::Backend::kMaxFramesInFlight];
+    std::vector<std::unique_ptr<Pass>> m_passes;
+    std::atomic<uint32_t>              m_num_passes;
+};
+
+// Replacement for DW_SCOPED_SAMPLE that also feeds the active PassTimings instance. The framework profiler only sees scopes
+// recorded on the main thread.
+#define HR_SCOPED_SAMPLE(name, cmd_buf) PassTimings::Scope hr_pass_timings_scope(PassTimings::active(), name, cmd_buf)
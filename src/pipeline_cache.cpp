@@ -0,0 +1,436 @@
+#include "pipeline_cache.h"
+#include <macros.h>
+#include <logger.h>
+#include <fstream>
+#include <string.h>
+
+static const uint32_t kPipelineCacheMagic   = 0x43505248; // "HRPC"
+static const uint32_t kPipelineCacheVersion = 1;
+
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t  pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PipelineCache::PipelineCache(std::weak_ptr<dw::vk::Backend> backend, const std::string& path, bool load_from_disk) :
+    m_backend(backend), m_path(path)
+{
+    auto vk_backend = backend.lock();
+
+    vkGetPhysicalDeviceProperties(vk_backend->physical_device(), &m_properties);
+
+    std::vector<char> data;
+
+    m_warm        = load_from_disk && load(data);
+    m_loaded_size = data.size();
+
+    VkPipelineCacheCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = data.size();
+    info.pInitialData    = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(vk_backend->device(), &info, nullptr, &m_cache) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to create pipeline cache.");
+        m_cache = VK_NULL_HANDLE;
+        m_warm  = false;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PipelineCache::~PipelineCache()
+{
+    auto backend = m_backend.lock();
+
+    if (m_cache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(backend->device(), m_cache, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PipelineCache::save()
+{
+    auto backend = m_backend.lock();
+
+    if (m_cache == VK_NULL_HANDLE)
+        return false;
+
+    size_t data_size = 0;
+
+    if (vkGetPipelineCacheData(backend->device(), m_cache, &data_size, nullptr) != VK_SUCCESS)
+        return false;
+
+    std::vector<char> data(data_size);
+
+    if (vkGetPipelineCacheData(backend->device(), m_cache, &data_size, data.data()) != VK_SUCCESS)
+        return false;
+
+    PipelineCacheFileHeader header;
+
+    header.magic          = kPipelineCacheMagic;
+    header.version        = kPipelineCacheVersion;
+    header.vendor_id      = m_properties.vendorID;
+    header.device_id      = m_properties.deviceID;
+    header.driver_version = m_properties.driverVersion;
+    header.data_size      = data_size;
+
+    memcpy(header.pipeline_cache_uuid, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::ofstream file(m_path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to open " + m_path + " for writing.");
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(data.data(), data_size);
+
+    DW_LOG_INFO("(PipelineCache) Wrote " + std::to_string(data_size / 1024) + " KB to " + m_path);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PipelineCache::load(std::vector<char>& data)
+{
+    std::ifstream file(m_path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        DW_LOG_INFO("(PipelineCache) No pipeline cache found at " + m_path + ", starting cold.");
+        return false;
+    }
+
+    PipelineCacheFileHeader header;
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kPipelineCacheMagic || header.version != kPipelineCacheVersion)
+    {
+        DW_LOG_INFO("(PipelineCache) Ignoring invalid pipeline cache " + m_path);
+        return false;
+    }
+
+    // The driver would reject a foreign cache too, but only after it has been read and handed over.
+    if (header.vendor_id != m_properties.vendorID || header.device_id != m_properties.deviceID || header.driver_version != m_properties.driverVersion || memcmp(header.pipeline_cache_uuid, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        DW_LOG_INFO("(PipelineCache) Pipeline cache was written by a different device or driver, starting cold.");
+        return false;
+    }
+
+    data.resize(header.data_size);
+
+    if (!file.read(data.data(), header.data_size))
+    {
+        DW_LOG_INFO("(PipelineCache) Truncated pipeline cache " + m_path + ", starting cold.");
+        data.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::Ptr PipelineCache::create_compute_pipeline(dw::vk::ShaderModule::Ptr module, dw::vk::PipelineLayout::Ptr layout)
+{
+    auto backend = m_backend.lock();
+
+    VkComputePipelineCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module = module->handle();
+    info.stage.pName  = "main";
+    info.layout       = layout->handle();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(backend->device(), m_cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to create compute pipeline.");
+        throw std::runtime_error("(PipelineCache) Failed to create compute pipeline.");
+    }
+
+    return std::make_shared<Pipeline>(backend, pipeline);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::Ptr PipelineCache::create_graphics_pipeline(const GraphicsPipelineDesc& desc)
+{
+    auto backend = m_backend.lock();
+
+    VkPipelineShaderStageCreateInfo stages[2];
+    DW_ZERO_MEMORY(stages[0]);
+    DW_ZERO_MEMORY(stages[1]);
+
+    stages[0].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage  = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = desc.vertex_shader->handle();
+    stages[0].pName  = "main";
+
+    stages[1].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = desc.fragment_shader->handle();
+    stages[1].pName  = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_state;
+    DW_ZERO_MEMORY(vertex_input_state);
+
+    vertex_input_state.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_state.vertexBindingDescriptionCount   = desc.vertex_bindings.size();
+    vertex_input_state.pVertexBindingDescriptions      = desc.vertex_bindings.data();
+    vertex_input_state.vertexAttributeDescriptionCount = desc.vertex_attributes.size();
+    vertex_input_state.pVertexAttributeDescriptions    = desc.vertex_attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state;
+    DW_ZERO_MEMORY(input_assembly_state);
+
+    input_assembly_state.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_state;
+    DW_ZERO_MEMORY(viewport_state);
+
+    viewport_state.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount  = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterization_state;
+    DW_ZERO_MEMORY(rasterization_state);
+
+    rasterization_state.sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization_state.cullMode    = desc.cull_mode;
+    rasterization_state.frontFace   = desc.front_face;
+    rasterization_state.lineWidth   = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample_state;
+    DW_ZERO_MEMORY(multisample_state);
+
+    multisample_state.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state;
+    DW_ZERO_MEMORY(depth_stencil_state);
+
+    depth_stencil_state.sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state.depthTestEnable  = desc.depth_test_enable;
+    depth_stencil_state.depthWriteEnable = desc.depth_write_enable;
+    depth_stencil_state.depthCompareOp   = desc.depth_compare_op;
+
+    VkPipelineColorBlendAttachmentState blend_attachment;
+    DW_ZERO_MEMORY(blend_attachment);
+
+    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    std::vector<VkPipelineColorBlendAttachmentState> blend_attachments(desc.num_color_attachments, blend_attachment);
+
+    VkPipelineColorBlendStateCreateInfo color_blend_state;
+    DW_ZERO_MEMORY(color_blend_state);
+
+    color_blend_state.sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_state.logicOp         = VK_LOGIC_OP_COPY;
+    color_blend_state.attachmentCount = blend_attachments.size();
+    color_blend_state.pAttachments    = blend_attachments.data();
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state;
+    DW_ZERO_MEMORY(dynamic_state);
+
+    dynamic_state.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates    = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount          = 2;
+    info.pStages             = stages;
+    info.pVertexInputState   = &vertex_input_state;
+    info.pInputAssemblyState = &input_assembly_state;
+    info.pViewportState      = &viewport_state;
+    info.pRasterizationState = &rasterization_state;
+    info.pMultisampleState   = &multisample_state;
+    info.pDepthStencilState  = &depth_stencil_state;
+    info.pColorBlendState    = &color_blend_state;
+    info.pDynamicState       = &dynamic_state;
+    info.layout              = desc.pipeline_layout->handle();
+    info.renderPass          = desc.render_pass->handle();
+    info.subpass             = 0;
+    info.basePipelineIndex   = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    if (vkCreateGraphicsPipelines(backend->device(), m_cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to create graphics pipeline.");
+        throw std::runtime_error("(PipelineCache) Failed to create graphics pipeline.");
+    }
+
+    return std::make_shared<Pipeline>(backend, pipeline);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::Ptr PipelineCache::create_post_process_pipeline(const std::string& vs_path, const std::string& fs_path, dw::vk::PipelineLayout::Ptr layout, dw::vk::RenderPass::Ptr render_pass)
+{
+    auto backend = m_backend.lock();
+
+    // Full screen triangle generated from the vertex index.
+    GraphicsPipelineDesc desc;
+
+    desc.vertex_shader   = dw::vk::ShaderModule::create_from_file(backend, vs_path);
+    desc.fragment_shader = dw::vk::ShaderModule::create_from_file(backend, fs_path);
+    desc.pipeline_layout = layout;
+    desc.render_pass     = render_pass;
+
+    return create_graphics_pipeline(desc);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::Ptr PipelineCache::create_ray_tracing_pipeline(dw::vk::ShaderModule::Ptr rgen, dw::vk::ShaderModule::Ptr rmiss, dw::vk::ShaderModule::Ptr rchit, dw::vk::PipelineLayout::Ptr layout, uint32_t max_recursion_depth)
+{
+    auto backend = m_backend.lock();
+
+    enum Group
+    {
+        GROUP_RAY_GEN,
+        GROUP_MISS,
+        GROUP_HIT,
+        GROUP_COUNT
+    };
+
+    VkShaderStageFlagBits     stage_flags[GROUP_COUNT] = { VK_SHADER_STAGE_RAYGEN_BIT_KHR, VK_SHADER_STAGE_MISS_BIT_KHR, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR };
+    dw::vk::ShaderModule::Ptr modules[GROUP_COUNT]     = { rgen, rmiss, rchit };
+
+    VkPipelineShaderStageCreateInfo      stages[GROUP_COUNT];
+    VkRayTracingShaderGroupCreateInfoKHR groups[GROUP_COUNT];
+
+    for (uint32_t i = 0; i < GROUP_COUNT; i++)
+    {
+        DW_ZERO_MEMORY(stages[i]);
+        DW_ZERO_MEMORY(groups[i]);
+
+        stages[i].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[i].stage  = stage_flags[i];
+        stages[i].module = modules[i]->handle();
+        stages[i].pName  = "main";
+
+        groups[i].sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+        groups[i].type               = i == GROUP_HIT ? VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR : VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+        groups[i].generalShader      = i == GROUP_HIT ? VK_SHADER_UNUSED_KHR : i;
+        groups[i].closestHitShader   = i == GROUP_HIT ? i : VK_SHADER_UNUSED_KHR;
+        groups[i].anyHitShader       = VK_SHADER_UNUSED_KHR;
+        groups[i].intersectionShader = VK_SHADER_UNUSED_KHR;
+    }
+
+    VkRayTracingPipelineCreateInfoKHR info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType                        = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
+    info.stageCount                   = GROUP_COUNT;
+    info.pStages                      = stages;
+    info.groupCount                   = GROUP_COUNT;
+    info.pGroups                      = groups;
+    info.maxPipelineRayRecursionDepth = max_recursion_depth;
+    info.layout                       = layout->handle();
+    info.basePipelineIndex            = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    if (vkCreateRayTracingPipelinesKHR(backend->device(), VK_NULL_HANDLE, m_cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to create ray tracing pipeline.");
+        throw std::runtime_error("(PipelineCache) Failed to create ray tracing pipeline.");
+    }
+
+    Pipeline::Ptr result = std::make_shared<Pipeline>(backend, pipeline);
+
+    // Every group starts on a base alignment boundary so that the passes can use the aligned handle size as the stride.
+    auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
+
+    const uint32_t     handle_size = rt_pipeline_props.shaderGroupHandleSize;
+    const VkDeviceSize group_size  = dw::vk::utilities::aligned_size(handle_size, rt_pipeline_props.shaderGroupBaseAlignment);
+
+    std::vector<uint8_t> handles(handle_size * GROUP_COUNT);
+
+    if (vkGetRayTracingShaderGroupHandlesKHR(backend->device(), pipeline, 0, GROUP_COUNT, handles.size(), handles.data()) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(PipelineCache) Failed to get shader group handles.");
+        throw std::runtime_error("(PipelineCache) Failed to get shader group handles.");
+    }
+
+    // The ray gen region has to start on a base alignment boundary as well, which the allocator doesn't guarantee for the device
+    // address of the buffer. It gets one alignment worth of slack and the table starts at the first aligned address in it.
+    const VkDeviceSize base_alignment = rt_pipeline_props.shaderGroupBaseAlignment;
+
+    result->m_sbt_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, group_size * GROUP_COUNT + base_alignment, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    const VkDeviceAddress address = result->m_sbt_buffer->device_address();
+
+    result->m_ray_gen_group_offset = (base_alignment - address % base_alignment) % base_alignment;
+    result->m_miss_group_offset    = result->m_ray_gen_group_offset + group_size * GROUP_MISS;
+    result->m_hit_group_offset     = result->m_ray_gen_group_offset + group_size * GROUP_HIT;
+
+    uint8_t* sbt = (uint8_t*)result->m_sbt_buffer->mapped_ptr() + result->m_ray_gen_group_offset;
+
+    for (uint32_t i = 0; i < GROUP_COUNT; i++)
+        memcpy(sbt + group_size * i, handles.data() + handle_size * i, handle_size);
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::Pipeline(std::weak_ptr<dw::vk::Backend> backend, VkPipeline pipeline) :
+    m_backend(backend), m_pipeline(pipeline)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Pipeline::~Pipeline()
+{
+    auto backend = m_backend.lock();
+
+    if (backend && m_pipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(backend->device(), m_pipeline, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GraphicsPipelineDesc& GraphicsPipelineDesc::add_mesh_vertex_input()
+{
+    const uint32_t stride = sizeof(float) * 4;
+
+    vertex_bindings.push_back({ 0, stride * 5, VK_VERTEX_INPUT_RATE_VERTEX });
+
+    vertex_attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+    vertex_attributes.push_back({ 1, 0, VK_FORMAT_R32G32_SFLOAT, stride });
+    vertex_attributes.push_back({ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, stride * 2 });
+    vertex_attributes.push_back({ 3, 0, VK_FORMAT_R32G32B32_SFLOAT, stride * 3 });
+    vertex_attributes.push_back({ 4, 0, VK_FORMAT_R32G32B32_SFLOAT, stride * 4 });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
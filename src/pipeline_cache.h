@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vk.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Pipeline created through the shared VkPipelineCache. The framework's pipeline factories always pass VK_NULL_HANDLE as the cache, so
+// the renderer creates its pipelines with the factories of PipelineCache instead and only takes the layouts and shader modules from
+// the framework.
+class Pipeline
+{
+public:
+    using Ptr = std::shared_ptr<Pipeline>;
+
+    Pipeline(std::weak_ptr<dw::vk::Backend> backend, VkPipeline pipeline);
+    ~Pipeline();
+
+    inline VkPipeline handle() { return m_pipeline; }
+
+    // Ray tracing pipelines only. The table holds the ray gen group, followed by the miss group and the hit group. The offsets are
+    // relative to the device address of the buffer, the ray gen group doesn't necessarily start at the beginning of it.
+    inline dw::vk::Buffer::Ptr shader_binding_table_buffer() { return m_sbt_buffer; }
+    inline VkDeviceSize        ray_gen_group_offset() { return m_ray_gen_group_offset; }
+    inline VkDeviceSize        miss_group_offset() { return m_miss_group_offset; }
+    inline VkDeviceSize        hit_group_offset() { return m_hit_group_offset; }
+
+private:
+    friend class PipelineCache;
+
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    VkPipeline                     m_pipeline = VK_NULL_HANDLE;
+    dw::vk::Buffer::Ptr            m_sbt_buffer;
+    VkDeviceSize                   m_ray_gen_group_offset = 0;
+    VkDeviceSize                   m_miss_group_offset    = 0;
+    VkDeviceSize                   m_hit_group_offset     = 0;
+};
+
+// Fixed function state of a graphics pipeline. Viewport and scissor are always dynamic and every color attachment is written
+// without blending.
+struct GraphicsPipelineDesc
+{
+    dw::vk::ShaderModule::Ptr                      vertex_shader;
+    dw::vk::ShaderModule::Ptr                      fragment_shader;
+    std::vector<VkVertexInputBindingDescription>   vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkCullModeFlags                                cull_mode             = VK_CULL_MODE_NONE;
+    VkFrontFace                                    front_face            = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkBool32                                       depth_test_enable     = VK_FALSE;
+    VkBool32                                       depth_write_enable    = VK_FALSE;
+    VkCompareOp                                    depth_compare_op      = VK_COMPARE_OP_LESS;
+    uint32_t                                       num_color_attachments = 1;
+    dw::vk::PipelineLayout::Ptr                    pipeline_layout;
+    dw::vk::RenderPass::Ptr                        render_pass;
+
+    // Adds the vertex layout of Vertex (scene.h), which is five vec4s.
+    GraphicsPipelineDesc& add_mesh_vertex_input();
+};
+
+// VkPipelineCache shared by every pipeline the renderer creates and persisted between runs. The file starts with a header that
+// identifies the device and the driver that wrote it, a cache written by any other device or driver version is discarded and
+// the pipelines are compiled from scratch.
+class PipelineCache
+{
+public:
+    PipelineCache(std::weak_ptr<dw::vk::Backend> backend, const std::string& path, bool load_from_disk = true);
+    ~PipelineCache();
+
+    bool save();
+
+    Pipeline::Ptr create_compute_pipeline(dw::vk::ShaderModule::Ptr module, dw::vk::PipelineLayout::Ptr layout);
+    Pipeline::Ptr create_graphics_pipeline(const GraphicsPipelineDesc& desc);
+    Pipeline::Ptr create_post_process_pipeline(const std::string& vs_path, const std::string& fs_path, dw::vk::PipelineLayout::Ptr layout, dw::vk::RenderPass::Ptr render_pass);
+    Pipeline::Ptr create_ray_tracing_pipeline(dw::vk::ShaderModule::Ptr rgen, dw::vk::ShaderModule::Ptr rmiss, dw::vk::ShaderModule::Ptr rchit, dw::vk::PipelineLayout::Ptr layout, uint32_t max_recursion_depth = 1);
+
+    inline VkPipelineCache handle() { return m_cache; }
+    inline bool            warm() { return m_warm; }
+    inline size_t          loaded_size() { return m_loaded_size; }
+
+private:
+    bool load(std::vector<char>& data);
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    std::string                    m_path;
+    VkPipelineCache                m_cache       = VK_NULL_HANDLE;
+    bool                           m_warm        = false;
+    size_t                         m_loaded_size = 0;
+    VkPhysicalDeviceProperties     m_properties;
+};
@@ -0,0 +1,583 @@
+#include "point_light_shadows.h"
+#include "point_lights.h"
+#include "g_buffer.h"
+#include "utilities.h"
+#include "pass_timings.h"
+#include <profiler.h>
+#include <macros.h>
+#include <imgui.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t RAY_MASK_SIZE_X = 8;
+static const uint32_t RAY_MASK_SIZE_Y = 4;
+
+static const uint32_t DENOISE_NUM_THREADS_X = 8;
+static const uint32_t DENOISE_NUM_THREADS_Y = 8;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct CullPushConstants
+{
+    int32_t g_buffer_mip;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct RayTracePushConstants
+{
+    float    bias;
+    uint32_t num_frames;
+    int32_t  g_buffer_mip;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct DenoisePushConstants
+{
+    glm::vec4 z_buffer_params;
+    float     alpha;
+    int32_t   g_buffer_mip;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PointLightShadows::PointLightShadows(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
+    m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
+{
+    auto vk_backend = m_backend.lock();
+
+    float scale_divisor = powf(2.0f, float(scale));
+
+    m_width  = vk_backend->swap_chain_extents().width / scale_divisor;
+    m_height = vk_backend->swap_chain_extents().height / scale_divisor;
+
+    m_g_buffer_mip = static_cast<uint32_t>(scale);
+
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+    create_pipelines();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PointLightShadows::~PointLightShadows()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::render(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Point Light Shadows", cmd_buf);
+
+    const uint32_t num_lights = m_common_resources->point_lights->num_shadowed_lights();
+
+    // The layers of the lights that were just added hold no history.
+    if (num_lights != m_last_num_lights)
+        m_first_frame = true;
+
+    m_last_num_lights = num_lights;
+
+    if (m_active && num_lights > 0)
+    {
+        clear_images(cmd_buf);
+        cull(cmd_buf);
+        ray_trace(cmd_buf);
+        denoise(cmd_buf, num_lights);
+    }
+    else
+    {
+        // Nothing consumes the output, restart the history once something does again.
+        m_first_frame = true;
+    }
+
+    // Consumers keep the output bound even while it is unused, so it still has to be in a valid layout.
+    m_frame_graph.export_image(output_image(), m_common_resources->consumer_stage());
+    m_frame_graph.barrier(cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::gui()
+{
+    ImGui::InputFloat("Bias", &m_ray_trace.bias);
+    ImGui::SliderFloat("Alpha", &m_denoise.alpha, 0.01f, 1.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr PointLightShadows::output_ds()
+{
+    return m_denoise.read_ds[m_common_resources->ping_pong];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::Image::Ptr PointLightShadows::output_image()
+{
+    return m_denoise.image[m_common_resources->ping_pong];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::create_images()
+{
+    auto backend = m_backend.lock();
+
+    const uint32_t num_tiles_x = static_cast<uint32_t>(ceil(float(m_width) / float(RAY_MASK_SIZE_X)));
+    const uint32_t num_tiles_y = static_cast<uint32_t>(ceil(float(m_height) / float(RAY_MASK_SIZE_Y)));
+
+    // Cull
+    {
+        m_cull.light_mask_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, num_tiles_x, num_tiles_y, 1, 1, 1, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_cull.light_mask_image->set_name("Point Light Shadows Light Mask");
+
+        m_cull.light_mask_view = dw::vk::ImageView::create(backend, m_cull.light_mask_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_cull.light_mask_view->set_name("Point Light Shadows Light Mask");
+    }
+
+    // Ray Trace
+    {
+        m_ray_trace.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, num_tiles_x, num_tiles_y, 1, 1, PointLights::kMaxShadowedLights, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_ray_trace.image->set_name("Point Light Shadows Ray Trace");
+
+        m_ray_trace.view = dw::vk::ImageView::create(backend, m_ray_trace.image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, PointLights::kMaxShadowedLights);
+        m_ray_trace.view->set_name("Point Light Shadows Ray Trace");
+    }
+
+    // Denoise
+    for (int i = 0; i < 2; i++)
+    {
+        m_denoise.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, PointLights::kMaxShadowedLights, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_denoise.image[i]->set_name("Point Light Shadows Denoise " + std::to_string(i));
+
+        m_denoise.view[i] = dw::vk::ImageView::create(backend, m_denoise.image[i], VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, PointLights::kMaxShadowedLights);
+        m_denoise.view[i]->set_name("Point Light Shadows Denoise " + std::to_string(i));
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::create_buffers()
+{
+    auto backend = m_backend.lock();
+
+    // At most one work item per light for every ray mask. The group counts and the number of items are reset with a fill before
+    // every cull, see shadows_point_tiles.glsl.
+    const uint32_t num_ray_masks  = m_cull.light_mask_image->width() * m_cull.light_mask_image->height();
+    uint32_t       default_args[] = { 0, 0, 1, 0 };
+
+    m_cull.work_items_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::uvec2) * num_ray_masks * PointLights::kMaxShadowedLights, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_cull.work_items_buffer->set_name("Point Light Shadows Work Items");
+
+    m_cull.dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * 4, VMA_MEMORY_USAGE_GPU_ONLY, 0, default_args);
+    m_cull.dispatch_args_buffer->set_name("Point Light Shadows Dispatch Args");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Tiles
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_cull.tiles_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+
+        m_cull.tiles_ds = backend->allocate_descriptor_set(m_cull.tiles_ds_layout);
+        m_cull.tiles_ds->set_name("Point Light Shadows Tiles");
+    }
+
+    // Ray Trace
+    {
+        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_ray_trace.write_ds->set_name("Point Light Shadows Ray Trace Write");
+    }
+
+    // Denoise
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_denoise.input_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+
+        m_denoise.input_ds = backend->allocate_descriptor_set(m_denoise.input_ds_layout);
+        m_denoise.input_ds->set_name("Point Light Shadows Denoise Input");
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_denoise.write_ds[i] = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_denoise.write_ds[i]->set_name("Point Light Shadows Denoise Write " + std::to_string(i));
+
+        m_denoise.read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_denoise.read_ds[i]->set_name("Point Light Shadows Denoise Read " + std::to_string(i));
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::write_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Tiles
+    {
+        VkDescriptorImageInfo image_info;
+
+        image_info.sampler     = VK_NULL_HANDLE;
+        image_info.imageView   = m_cull.light_mask_view->handle();
+        image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        dw::vk::Buffer::Ptr buffers[] = {
+            m_cull.work_items_buffer,
+            m_cull.dispatch_args_buffer
+        };
+
+        VkDescriptorBufferInfo buffer_info[2];
+        VkWriteDescriptorSet   write_data[3];
+
+        DW_ZERO_MEMORY(write_data[0]);
+
+        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[0].descriptorCount = 1;
+        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data[0].pImageInfo      = &image_info;
+        write_data[0].dstBinding      = 0;
+        write_data[0].dstSet          = m_cull.tiles_ds->handle();
+
+        for (int i = 0; i < 2; i++)
+        {
+            buffer_info[i].buffer = buffers[i]->handle();
+            buffer_info[i].offset = 0;
+            buffer_info[i].range  = VK_WHOLE_SIZE;
+
+            DW_ZERO_MEMORY(write_data[i + 1]);
+
+            write_data[i + 1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i + 1].descriptorCount = 1;
+            write_data[i + 1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[i + 1].pBufferInfo     = &buffer_info[i];
+            write_data[i + 1].dstBinding      = i + 1;
+            write_data[i + 1].dstSet          = m_cull.tiles_ds->handle();
+        }
+
+        vkUpdateDescriptorSets(backend->device(), 3, &write_data[0], 0, nullptr);
+    }
+
+    // Ray Trace Write
+    {
+        VkDescriptorImageInfo storage_image_info;
+
+        storage_image_info.sampler     = VK_NULL_HANDLE;
+        storage_image_info.imageView   = m_ray_trace.view->handle();
+        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet write_data;
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data.pImageInfo      = &storage_image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_ray_trace.write_ds->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
+
+    // Denoise Input
+    {
+        dw::vk::ImageView::Ptr views[] = {
+            m_ray_trace.view,
+            m_cull.light_mask_view
+        };
+
+        VkDescriptorImageInfo image_info[2];
+        VkWriteDescriptorSet  write_data[2];
+
+        for (int i = 0; i < 2; i++)
+        {
+            image_info[i].sampler     = backend->nearest_sampler()->handle();
+            image_info[i].imageView   = views[i]->handle();
+            image_info[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            DW_ZERO_MEMORY(write_data[i]);
+
+            write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i].descriptorCount = 1;
+            write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[i].pImageInfo      = &image_info[i];
+            write_data[i].dstBinding      = i;
+            write_data[i].dstSet          = m_denoise.input_ds->handle();
+        }
+
+        vkUpdateDescriptorSets(backend->device(), 2, &write_data[0], 0, nullptr);
+    }
+
+    // Denoise Write and Read
+    for (int i = 0; i < 2; i++)
+    {
+        VkDescriptorImageInfo storage_image_info;
+
+        storage_image_info.sampler     = VK_NULL_HANDLE;
+        storage_image_info.imageView   = m_denoise.view[i]->handle();
+        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        // Bilinear, the deferred pass reads it at full resolution whatever the scale.
+        VkDescriptorImageInfo sampler_image_info;
+
+        sampler_image_info.sampler     = backend->bilinear_sampler()->handle();
+        sampler_image_info.imageView   = m_denoise.view[i]->handle();
+        sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write_data[2];
+
+        DW_ZERO_MEMORY(write_data[0]);
+
+        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[0].descriptorCount = 1;
+        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data[0].pImageInfo      = &storage_image_info;
+        write_data[0].dstBinding      = 0;
+        write_data[0].dstSet          = m_denoise.write_ds[i]->handle();
+
+        DW_ZERO_MEMORY(write_data[1]);
+
+        write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[1].descriptorCount = 1;
+        write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[1].pImageInfo      = &sampler_image_info;
+        write_data[1].dstBinding      = 0;
+        write_data[1].dstSet          = m_denoise.read_ds[i]->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 2, &write_data[0], 0, nullptr);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::create_pipelines()
+{
+    auto backend = m_backend.lock();
+
+    // Cull
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_cull.tiles_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants));
+
+        m_cull.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_cull.pipeline_layout->set_name("Point Light Shadows Cull Pipeline Layout");
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_point_cull.comp.spv");
+
+        m_cull.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_cull.pipeline_layout);
+    }
+
+    // Ray Trace
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+        desc.add_descriptor_set_layout(m_cull.tiles_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
+
+        m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_ray_trace.pipeline_layout->set_name("Point Light Shadows Ray Trace Pipeline Layout");
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_point_ray_trace.comp.spv");
+
+        m_ray_trace.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_ray_trace.pipeline_layout);
+    }
+
+    // Denoise
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_denoise.input_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants));
+
+        m_denoise.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_denoise.pipeline_layout->set_name("Point Light Shadows Denoise Pipeline Layout");
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_point_denoise.comp.spv");
+
+        m_denoise.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_denoise.pipeline_layout);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (m_first_frame)
+    {
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, PointLights::kMaxShadowedLights };
+
+        VkClearColorValue color;
+
+        // Fully visible, so the first frames fade in from unshadowed lighting rather than from black.
+        color.float32[0] = 1.0f;
+        color.float32[1] = 1.0f;
+        color.float32[2] = 1.0f;
+        color.float32[3] = 1.0f;
+
+        dw::vk::Image::Ptr history_image = m_denoise.image[!m_common_resources->ping_pong];
+
+        m_frame_graph.write(history_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.barrier(cmd_buf);
+
+        vkCmdClearColorImage(cmd_buf->handle(), history_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+
+        m_first_frame = false;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::cull(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Cull", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    // The ray trace of the previous frame read the work items and the dispatch args.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    m_frame_graph.barrier(cmd_buf);
+
+    // Group counts X and Y, then the number of items. Z stays at 1.
+    vkCmdFillBuffer(cmd_buf->handle(), m_cull.dispatch_args_buffer->handle(), 0, sizeof(uint32_t) * 2, 0);
+    vkCmdFillBuffer(cmd_buf->handle(), m_cull.dispatch_args_buffer->handle(), sizeof(uint32_t) * 3, sizeof(uint32_t), 0);
+
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    m_frame_graph.write(m_cull.light_mask_image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline->handle());
+
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_cull.tiles_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_common_resources->point_lights->ds()->handle(),
+        m_common_resources->per_frame_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline_layout->handle(), 0, 4, descriptor_sets, 1, &dynamic_offset);
+
+    CullPushConstants push_constants;
+
+    push_constants.g_buffer_mip = m_g_buffer_mip;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_cull.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    vkCmdDispatch(cmd_buf->handle(), m_cull.light_mask_image->width(), m_cull.light_mask_image->height(), 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    // Only the masks of the work items are written, the denoiser ignores the rest through the light mask.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    m_frame_graph.write(m_ray_trace.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
+
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set(),
+        m_ray_trace.write_ds->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle(),
+        m_common_resources->point_lights->ds()->handle(),
+        m_cull.tiles_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
+
+    RayTracePushConstants push_constants;
+
+    push_constants.bias         = m_ray_trace.bias;
+    push_constants.num_frames   = m_common_resources->num_frames;
+    push_constants.g_buffer_mip = m_g_buffer_mip;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    vkCmdDispatchIndirect(cmd_buf->handle(), m_cull.dispatch_args_buffer->handle(), 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLightShadows::denoise(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t num_lights)
+{
+    HR_SCOPED_SAMPLE("Denoise", cmd_buf);
+
+    m_frame_graph.write(m_denoise.image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_denoise.image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_ray_trace.image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_cull.light_mask_image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_denoise.pipeline->handle());
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_denoise.write_ds[m_common_resources->ping_pong]->handle(),
+        m_denoise.input_ds->handle(),
+        m_denoise.read_ds[!m_common_resources->ping_pong]->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_g_buffer->history_ds()->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_denoise.pipeline_layout->handle(), 0, 5, descriptor_sets, 0, nullptr);
+
+    DenoisePushConstants push_constants;
+
+    push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+    push_constants.alpha           = m_denoise.alpha;
+    push_constants.g_buffer_mip    = m_g_buffer_mip;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_denoise.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    // Every shadowed light in one dispatch, Z selects the layer.
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(DENOISE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(DENOISE_NUM_THREADS_Y))), num_lights);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common_resources.h"
+#include "frame_graph.h"
+
+class GBuffer;
+
+// Ray traced shadows of the first PointLights::kMaxShadowedLights point lights. Every light gets one layer of 8x4 ray masks and one
+// layer of the denoised output:
+//
+//   1. Cull      - Classifies every ray mask against the lights and appends one work item per light that reaches it.
+//   2. Ray Trace - One indirect 8x4 group per work item, so tiles outside the range of every light cost no rays.
+//   3. Denoise   - A spatial filter and a temporal blend over all the lights in a single dispatch.
+//
+// output_ds() binds the denoised visibility as a sampler2DArray, indexed by the light.
+class PointLightShadows
+{
+public:
+    PointLightShadows(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale = RAY_TRACE_SCALE_FULL_RES);
+    ~PointLightShadows();
+
+    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       gui();
+    dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
+
+    inline uint32_t      width() { return m_width; }
+    inline uint32_t      height() { return m_height; }
+    inline RayTraceScale scale() { return m_scale; }
+    inline void          set_active(bool value) { m_active = value; }
+
+private:
+    void create_images();
+    void create_buffers();
+    void create_descriptor_sets();
+    void write_descriptor_sets();
+    void create_pipelines();
+    void clear_images(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void cull(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void denoise(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t num_lights);
+
+private:
+    struct Cull
+    {
+        Pipeline::Ptr                    pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+        dw::vk::Image::Ptr               light_mask_image;
+        dw::vk::ImageView::Ptr           light_mask_view;
+        dw::vk::Buffer::Ptr              work_items_buffer;
+        dw::vk::Buffer::Ptr              dispatch_args_buffer;
+        dw::vk::DescriptorSetLayout::Ptr tiles_ds_layout;
+        dw::vk::DescriptorSet::Ptr       tiles_ds;
+    };
+
+    struct RayTrace
+    {
+        float                        bias = 0.5f;
+        Pipeline::Ptr                pipeline;
+        dw::vk::PipelineLayout::Ptr  pipeline_layout;
+        dw::vk::Image::Ptr           image;
+        dw::vk::ImageView::Ptr       view;
+        dw::vk::DescriptorSet::Ptr   write_ds;
+    };
+
+    struct Denoise
+    {
+        float                            alpha = 0.1f;
+        Pipeline::Ptr                    pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+        dw::vk::DescriptorSetLayout::Ptr input_ds_layout;
+        dw::vk::DescriptorSet::Ptr       input_ds;
+        dw::vk::Image::Ptr               image[2];
+        dw::vk::ImageView::Ptr           view[2];
+        dw::vk::DescriptorSet::Ptr       write_ds[2];
+        dw::vk::DescriptorSet::Ptr       read_ds[2];
+    };
+
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    CommonResources*               m_common_resources;
+    GBuffer*                       m_g_buffer;
+    RayTraceScale                  m_scale;
+    uint32_t                       m_g_buffer_mip = 0;
+    uint32_t                       m_width;
+    uint32_t                       m_height;
+    uint32_t                       m_last_num_lights = 0;
+    bool                           m_first_frame     = true;
+    bool                           m_active          = true;
+    Cull                           m_cull;
+    RayTrace                       m_ray_trace;
+    Denoise                        m_denoise;
+    FrameGraph                     m_frame_graph;
+};
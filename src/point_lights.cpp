@@ -0,0 +1,149 @@
+#include "point_lights.h"
+#include <macros.h>
+#include <imgui.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Fully saturated color of the given hue, in the range [0, 1].
+static glm::vec3 hue_to_rgb(float hue)
+{
+    glm::vec3 rgb = glm::abs(glm::fract(glm::vec3(hue) + glm::vec3(1.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - glm::vec3(3.0f)) - glm::vec3(1.0f);
+    return glm::clamp(rgb, glm::vec3(0.0f), glm::vec3(1.0f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PointLights::PointLights(std::weak_ptr<dw::vk::Backend> backend) :
+    m_backend(backend)
+{
+    auto vk_backend = backend.lock();
+
+    m_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frame_offset(dw::vk::Backend::kMaxFramesInFlight), VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    m_buffer->set_name("Point Lights");
+
+    dw::vk::DescriptorSetLayout::Desc desc;
+
+    desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+
+    m_ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, desc);
+    m_ds_layout->set_name("Point Lights DS Layout");
+
+    // One set per frame in flight, the list is rewritten every frame.
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        m_ds[i] = vk_backend->allocate_descriptor_set(m_ds_layout);
+        m_ds[i]->set_name("Point Lights " + std::to_string(i));
+
+        VkDescriptorBufferInfo buffer_info;
+
+        buffer_info.buffer = m_buffer->handle();
+        buffer_info.offset = frame_offset(i);
+        buffer_info.range  = buffer_size();
+
+        VkWriteDescriptorSet write_data;
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data.pBufferInfo     = &buffer_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_ds[i]->handle();
+
+        vkUpdateDescriptorSets(vk_backend->device(), 1, &write_data, 0, nullptr);
+    }
+
+    m_lights.reserve(kMaxLights);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PointLights::~PointLights()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLights::update(float delta_seconds)
+{
+    if (m_animation)
+        m_time += delta_seconds;
+
+    place_lights();
+
+    Header header;
+
+    header.num_lights          = uint32_t(m_lights.size());
+    header.num_shadowed_lights = num_shadowed_lights();
+    header.padding[0]          = 0;
+    header.padding[1]          = 0;
+
+    auto     backend = m_backend.lock();
+    uint8_t* ptr     = (uint8_t*)m_buffer->mapped_ptr() + frame_offset(backend->current_frame_idx());
+
+    memcpy(ptr, &header, sizeof(Header));
+    memcpy(ptr + sizeof(Header), m_lights.data(), sizeof(Light) * m_lights.size());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PointLights::gui()
+{
+    ImGui::SliderInt("Count", &m_num_lights, 0, kMaxLights);
+    ImGui::InputFloat3("Center", &m_center.x);
+    ImGui::InputFloat("Spread", &m_spread);
+    ImGui::InputFloat("Intensity", &m_intensity);
+    ImGui::InputFloat("Range", &m_range);
+    ImGui::SliderFloat("Radius", &m_radius, 0.0f, 1.0f);
+    ImGui::Checkbox("Animation", &m_animation);
+    ImGui::Text("Shadowed Lights: %u", num_shadowed_lights());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr PointLights::ds()
+{
+    return m_ds[m_backend.lock()->current_frame_idx()];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VkDeviceSize PointLights::buffer_size()
+{
+    return sizeof(Header) + sizeof(Light) * kMaxLights;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// 256 bytes is the largest minStorageBufferOffsetAlignment a device may require.
+VkDeviceSize PointLights::frame_offset(uint32_t frame_idx)
+{
+    return ((buffer_size() + 255) & ~VkDeviceSize(255)) * frame_idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Sunflower spiral, every light covers about the same area of the disk whatever the count. The first lights are the ones closest
+// to the center, so the shadowed lights stay in the middle of the scene.
+void PointLights::place_lights()
+{
+    const float golden_angle = 2.39996323f;
+    const float range        = std::max(m_range, 0.01f);
+
+    m_lights.resize(std::max(std::min(m_num_lights, int32_t(kMaxLights)), 0));
+
+    for (uint32_t i = 0; i < m_lights.size(); i++)
+    {
+        float distance = m_spread * sqrtf((float(i) + 0.5f) / float(m_lights.size()));
+        float angle    = float(i) * golden_angle + m_time * 0.5f;
+
+        glm::vec3 position = m_center + glm::vec3(cosf(angle) * distance, 0.0f, sinf(angle) * distance);
+        glm::vec3 color    = hue_to_rgb(fmodf(float(i) * 0.618034f, 1.0f)) * 0.75f + glm::vec3(0.25f);
+
+        m_lights[i].position_radius = glm::vec4(position, m_radius);
+        m_lights[i].color_range     = glm::vec4(color * m_intensity, range);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
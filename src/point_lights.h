@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vk.h>
+#include <algorithm>
+#include <vector>
+
+// Point lights of the scene, uploaded every frame into a storage buffer that the shaders read through point_lights.glsl:
+//
+//   m_common_resources->point_lights->update(delta_seconds);
+//   m_common_resources->point_lights->ds()
+//
+// Like the per-frame uniforms, every frame in flight has its own copy of the list and its own descriptor set, so update() has to
+// run before anything that binds ds() is recorded. The first kMaxShadowedLights lights cast ray traced shadows (see PointLightShadows),
+// the rest only add their direct lighting.
+//
+// The lights are placed procedurally on a spiral above the center of the scene, the GUI controls how many there are and how far
+// they spread.
+class PointLights
+{
+public:
+    static const uint32_t kMaxLights         = 1024;
+    static const uint32_t kMaxShadowedLights = 8;
+
+    // Matches PointLight in point_lights.glsl.
+    struct Light
+    {
+        glm::vec4 position_radius;
+        glm::vec4 color_range;
+    };
+
+public:
+    PointLights(std::weak_ptr<dw::vk::Backend> backend);
+    ~PointLights();
+
+    void                       update(float delta_seconds);
+    void                       gui();
+    dw::vk::DescriptorSet::Ptr ds();
+
+    inline dw::vk::DescriptorSetLayout::Ptr ds_layout() { return m_ds_layout; }
+    inline uint32_t                         num_lights() { return uint32_t(m_lights.size()); }
+    inline uint32_t                         num_shadowed_lights() { return std::min(num_lights(), uint32_t(kMaxShadowedLights)); }
+
+private:
+    // Matches the members of PointLights_t in point_lights.glsl that come before the lights.
+    struct Header
+    {
+        uint32_t num_lights;
+        uint32_t num_shadowed_lights;
+        uint32_t padding[2];
+    };
+
+private:
+    VkDeviceSize buffer_size();
+    VkDeviceSize frame_offset(uint32_t frame_idx);
+    void         place_lights();
+
+private:
+    std::weak_ptr<dw::vk::Backend>   m_backend;
+    dw::vk::Buffer::Ptr              m_buffer;
+    dw::vk::DescriptorSetLayout::Ptr m_ds_layout;
+    dw::vk::DescriptorSet::Ptr       m_ds[dw::vk::Backend::kMaxFramesInFlight];
+    std::vector<Light>               m_lights;
+    int32_t                          m_num_lights = 4;
+    glm::vec3                        m_center     = glm::vec3(0.0f, 5.0f, 0.0f);
+    float                            m_spread     = 20.0f;
+    float                            m_intensity  = 50.0f;
+    float                            m_range      = 15.0f;
+    float                            m_radius     = 0.1f;
+    bool                             m_animation  = false;
+    float                            m_time       = 0.0f;
+};
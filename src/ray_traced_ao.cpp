@@ -1,6 +1,7 @@
 #include "ray_traced_ao.h"
 #include "g_buffer.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <profiler.h>
 #include <macros.h>
 #include <imgui.h>
@@ -53,8 +54,9 @@ struct BilateralBlurPushConstants
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
-    float   power;
+    glm::vec4 z_buffer_params;
+    int32_t   g_buffer_mip;
+    float     power;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -107,18 +109,37 @@ RayTracedAO::~RayTracedAO()
 
 void RayTracedAO::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Ambient Occlusion", cmd_buf);
-
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf);
+    HR_SCOPED_SAMPLE("Ambient Occlusion", cmd_buf);
 
-    if (m_denoise)
+    if (m_active)
     {
-        denoise(cmd_buf);
+        // The stages that run depend on the output, any other switch leaves the history stale.
+        if (m_current_output != m_last_output || m_denoise != m_last_denoise)
+            m_first_frame = true;
+
+        m_last_output  = m_current_output;
+        m_last_denoise = m_denoise;
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
+        clear_images(cmd_buf);
+        ray_trace(cmd_buf);
+
+        if (m_denoise && m_current_output != OUTPUT_RAY_TRACE)
+        {
+            denoise(cmd_buf);
+
+            if (m_current_output == OUTPUT_UPSAMPLE && m_scale != RAY_TRACE_SCALE_FULL_RES)
+                upsample(cmd_buf);
+        }
     }
+    else
+    {
+        // Nothing consumes the output, restart the history once something does again.
+        m_first_frame = true;
+    }
+
+    // Consumers keep the output bound even while it is unused, so it still has to be in a valid layout.
+    m_frame_graph.export_image(output_image(), m_common_resources->consumer_stage());
+    m_frame_graph.barrier(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -164,6 +185,50 @@ dw::vk::DescriptorSet::Ptr RayTracedAO::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+dw::vk::Image::Ptr RayTracedAO::output_image()
+{
+    if (m_denoise)
+    {
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_ray_trace.image;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_temporal_accumulation.color_image[m_common_resources->ping_pong];
+        else if (m_current_output == OUTPUT_BILATERAL_BLUR)
+            return m_bilateral_blur.image[1];
+        else if (m_current_output == OUTPUT_DISOCCLUSION_BLUR)
+            return m_disocclusion_blur.image;
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_disocclusion_blur.image;
+            else
+                return m_upsample.image;
+        }
+    }
+    else
+        return m_ray_trace.image;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RayTracedAO::update_transient_images()
+{
+    // The selected output decides how long the transient images have to stay alive.
+    if (m_current_output == m_transient_output)
+        return false;
+
+    m_backend.lock()->wait_idle();
+
+    create_transient_images();
+    write_descriptor_sets();
+
+    m_frame_graph.reset();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedAO::create_images()
 {
     auto backend = m_backend.lock();
@@ -193,35 +258,72 @@ void RayTracedAO::create_images()
         m_temporal_accumulation.history_length_view[i]->set_name("AO Denoise Reprojection History " + std::to_string(i));
     }
 
-    // Disocclusion Blur
-    {
-        m_disocclusion_blur.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_disocclusion_blur.image->set_name("AO Disocclusion Blur");
+    create_transient_images();
+}
 
-        m_disocclusion_blur.image_view = dw::vk::ImageView::create(backend, m_disocclusion_blur.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-        m_disocclusion_blur.image_view->set_name("AO Disocclusion Blur");
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedAO::create_transient_images()
+{
+    auto backend = m_backend.lock();
+
+    TransientAllocator*       allocator = m_common_resources->transient_allocator.get();
+    TransientAllocator::Queue queue     = m_common_resources->async_queue();
+
+    // Release the previous images first so that their memory can be reused right away.
+    for (int i = 0; i < 2; i++)
+    {
+        m_bilateral_blur.image_view[i].reset();
+        m_bilateral_blur.image[i].reset();
     }
 
+    m_disocclusion_blur.image_view.reset();
+    m_disocclusion_blur.image.reset();
+    m_upsample.image_view.reset();
+    m_upsample.image.reset();
+
+    const bool disocclusion_output = m_current_output == OUTPUT_DISOCCLUSION_BLUR || (m_current_output == OUTPUT_UPSAMPLE && m_scale == RAY_TRACE_SCALE_FULL_RES);
+
     // Bilateral Blur
     for (int i = 0; i < 2; i++)
     {
-        m_bilateral_blur.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        // The vertical pass only feeds the horizontal one.
+        TransientAllocator::Pass last_pass = TransientAllocator::PASS_AO_BILATERAL_BLUR;
+
+        if (i == 1)
+            last_pass = m_current_output == OUTPUT_BILATERAL_BLUR ? TransientAllocator::PASS_END_OF_FRAME : TransientAllocator::PASS_AO_DISOCCLUSION_BLUR;
+
+        m_bilateral_blur.image[i] = allocator->create_image(m_width, m_height, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, queue, TransientAllocator::PASS_AO_BILATERAL_BLUR, last_pass);
         m_bilateral_blur.image[i]->set_name("AO Denoise Blur " + std::to_string(i));
 
         m_bilateral_blur.image_view[i] = dw::vk::ImageView::create(backend, m_bilateral_blur.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_bilateral_blur.image_view[i]->set_name("AO Denoise Blur " + std::to_string(i));
     }
 
+    // Disocclusion Blur
+    {
+        TransientAllocator::Pass last_pass = disocclusion_output ? TransientAllocator::PASS_END_OF_FRAME : TransientAllocator::PASS_AO_UPSAMPLE;
+
+        m_disocclusion_blur.image = allocator->create_image(m_width, m_height, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, queue, TransientAllocator::PASS_AO_DISOCCLUSION_BLUR, last_pass);
+        m_disocclusion_blur.image->set_name("AO Disocclusion Blur");
+
+        m_disocclusion_blur.image_view = dw::vk::ImageView::create(backend, m_disocclusion_blur.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_disocclusion_blur.image_view->set_name("AO Disocclusion Blur");
+    }
+
     // Upsample
     {
-        auto vk_backend = m_backend.lock();
+        // Never written at full resolution.
+        TransientAllocator::Pass last_pass = m_scale == RAY_TRACE_SCALE_FULL_RES ? TransientAllocator::PASS_AO_UPSAMPLE : TransientAllocator::PASS_END_OF_FRAME;
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_upsample.image = allocator->create_image(backend->swap_chain_extents().width, backend->swap_chain_extents().height, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, queue, TransientAllocator::PASS_AO_UPSAMPLE, last_pass);
         m_upsample.image->set_name("AO Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("AO Upsample");
     }
+
+    m_transient_output = m_current_output;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -723,12 +825,7 @@ void RayTracedAO::create_pipeline()
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
         m_ray_trace.pipeline_layout->set_name("AO Ray Trace Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc desc;
-
-        desc.set_shader_stage(shader_module, "main");
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
-
-        m_ray_trace.pipeline = dw::vk::ComputePipeline::create(backend, desc);
+        m_ray_trace.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(shader_module, m_ray_trace.pipeline_layout);
     }
 
     // Temporal Reprojection
@@ -750,12 +847,7 @@ void RayTracedAO::create_pipeline()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_reprojection.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_temporal_accumulation.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_temporal_accumulation.pipeline_layout);
     }
 
     // Disocclusion Blur
@@ -774,12 +866,7 @@ void RayTracedAO::create_pipeline()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_disocclusion_blur.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_disocclusion_blur.layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_disocclusion_blur.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_disocclusion_blur.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_disocclusion_blur.layout);
     }
 
     // Bilateral Blur
@@ -798,12 +885,7 @@ void RayTracedAO::create_pipeline()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_bilateral_blur.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_bilateral_blur.layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_bilateral_blur.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_bilateral_blur.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_bilateral_blur.layout);
     }
 
     // Upsample
@@ -821,12 +903,7 @@ void RayTracedAO::create_pipeline()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_upsample.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_upsample.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_upsample.layout);
     }
 }
 
@@ -845,36 +922,12 @@ void RayTracedAO::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
         color.float32[2] = 0.0f;
         color.float32[3] = 0.0f;
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        m_frame_graph.write(m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_temporal_accumulation.color_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.barrier(cmd_buf);
+
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
 
         m_first_frame = false;
     }
@@ -884,21 +937,13 @@ void RayTracedAO::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
 
 void RayTracedAO::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    HR_SCOPED_SAMPLE("Ray Trace", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    m_frame_graph.memory_dependency(m_common_resources->consumer_stage(), VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    m_frame_graph.write(m_ray_trace.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
 
@@ -914,7 +959,7 @@ void RayTracedAO::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
     VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_common_resources->current_scene()->descriptor_set(),
         m_ray_trace.write_ds->handle(),
         m_common_resources->per_frame_ds->handle(),
         m_g_buffer->output_ds()->handle(),
@@ -924,47 +969,43 @@ void RayTracedAO::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
     vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedAO::denoise(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Denoise", cmd_buf);
+    HR_SCOPED_SAMPLE("Denoise", cmd_buf);
 
     temporal_accumulation(cmd_buf);
+
+    if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+        return;
+
     bilateral_blur(cmd_buf);
-    disocclusion_blur(cmd_buf);
+
+    if (m_current_output != OUTPUT_BILATERAL_BLUR)
+        disocclusion_blur(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedAO::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Upsample", cmd_buf);
+    HR_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    m_frame_graph.alias(m_upsample.image);
+    m_frame_graph.write(m_upsample.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_disocclusion_blur.image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
 
     UpsamplePushConstants push_constants;
 
-    push_constants.g_buffer_mip = m_g_buffer_mip;
-    push_constants.power        = m_upsample.power;
+    push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+    push_constants.g_buffer_mip    = m_g_buffer_mip;
+    push_constants.power           = m_upsample.power;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -980,37 +1021,22 @@ void RayTracedAO::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedAO::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
+    HR_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.color_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    m_frame_graph.write(m_temporal_accumulation.color_image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.write(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_ray_trace.image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.color_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline->handle());
 
@@ -1039,35 +1065,19 @@ void RayTracedAO::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 8;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(NUM_THREADS_Y))), 1);
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.color_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedAO::disocclusion_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Disocclusion Blur", cmd_buf);
+    HR_SCOPED_SAMPLE("Disocclusion Blur", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_disocclusion_blur.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    m_frame_graph.alias(m_disocclusion_blur.image);
+    m_frame_graph.write(m_disocclusion_blur.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_bilateral_blur.image[1], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_disocclusion_blur.pipeline->handle());
 
@@ -1094,36 +1104,26 @@ void RayTracedAO::disocclusion_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_disocclusion_blur.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_disocclusion_blur.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_disocclusion_blur.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedAO::bilateral_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Bilateral Blur", cmd_buf);
+    HR_SCOPED_SAMPLE("Bilateral Blur", cmd_buf);
 
     const int NUM_THREADS_X = 8;
     const int NUM_THREADS_Y = 8;
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
     // Vertical
     {
-        DW_SCOPED_SAMPLE("Vertical", cmd_buf);
+        HR_SCOPED_SAMPLE("Vertical", cmd_buf);
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[0]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
+        m_frame_graph.alias(m_bilateral_blur.image[0]);
+        m_frame_graph.write(m_bilateral_blur.image[0], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+        m_frame_graph.read(m_temporal_accumulation.color_image[m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+        m_frame_graph.read(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+        m_frame_graph.barrier(cmd_buf);
 
         vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.pipeline->handle());
 
@@ -1146,25 +1146,16 @@ void RayTracedAO::bilateral_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
         vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.layout->handle(), 0, 4, descriptor_sets, 0, nullptr);
 
         vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_bilateral_blur.image[0]->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_bilateral_blur.image[0]->height()) / float(NUM_THREADS_Y))), 1);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[0]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
     }
 
     // Horizontal
     {
-        DW_SCOPED_SAMPLE("Horizontal", cmd_buf);
+        HR_SCOPED_SAMPLE("Horizontal", cmd_buf);
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[1]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
+        m_frame_graph.alias(m_bilateral_blur.image[1]);
+        m_frame_graph.write(m_bilateral_blur.image[1], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+        m_frame_graph.read(m_bilateral_blur.image[0], FrameGraph::ACCESS_SAMPLED);
+        m_frame_graph.barrier(cmd_buf);
 
         vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.pipeline->handle());
 
@@ -1187,13 +1178,6 @@ void RayTracedAO::bilateral_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
         vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.layout->handle(), 0, 4, descriptor_sets, 0, nullptr);
 
         vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_bilateral_blur.image[0]->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_bilateral_blur.image[0]->height()) / float(NUM_THREADS_Y))), 1);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[1]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
     }
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common_resources.h"
+#include "frame_graph.h"
 
 class GBuffer;
 
@@ -27,15 +28,19 @@ public:
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
+    bool                       update_transient_images();
 
     inline uint32_t      width() { return m_width; }
     inline uint32_t      height() { return m_height; }
     inline RayTraceScale scale() { return m_scale; }
     inline OutputType    current_output() { return m_current_output; }
     inline void          set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline void          set_active(bool value) { m_active = value; }
 
 private:
     void create_images();
+    void create_transient_images();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_pipeline();
@@ -52,7 +57,7 @@ private:
     {
         float                        ray_length = 7.0f;
         float                        bias       = 0.3f;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       view;
@@ -64,7 +69,7 @@ private:
     struct TemporalAccumulation
     {
         float                            alpha = 0.01f;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        Pipeline::Ptr                    pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
         dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
@@ -83,7 +88,7 @@ private:
         int32_t                      blur_radius = 2;
         int32_t                      threshold   = 15;
         dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       image_view;
         dw::vk::DescriptorSet::Ptr   read_ds;
@@ -94,7 +99,7 @@ private:
     {
         int32_t                      blur_radius = 5;
         dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::Image::Ptr           image[2];
         dw::vk::ImageView::Ptr       image_view[2];
         dw::vk::DescriptorSet::Ptr   read_ds[2];
@@ -105,7 +110,7 @@ private:
     {
         float                        power = 1.2f;
         dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       image_view;
         dw::vk::DescriptorSet::Ptr   read_ds;
@@ -120,11 +125,16 @@ private:
     OutputType                     m_current_output = OUTPUT_UPSAMPLE;
     uint32_t                       m_width;
     uint32_t                       m_height;
-    bool                           m_denoise     = true;
-    bool                           m_first_frame = true;
+    bool                           m_denoise          = true;
+    bool                           m_first_frame      = true;
+    bool                           m_active           = true;
+    bool                           m_last_denoise     = true;
+    OutputType                     m_last_output      = OUTPUT_UPSAMPLE;
+    OutputType                     m_transient_output = OUTPUT_UPSAMPLE;
     RayTrace                       m_ray_trace;
     TemporalAccumulation           m_temporal_accumulation;
     DisocclusionBlur               m_disocclusion_blur;
     BilateralBlur                  m_bilateral_blur;
     Upsample                       m_upsample;
+    FrameGraph                     m_frame_graph;
 };
\ No newline at end of file
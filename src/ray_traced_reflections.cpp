@@ -2,6 +2,7 @@
 #include "g_buffer.h"
 #include "ddgi.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <profiler.h>
 #include <macros.h>
 #include <imgui.h>
@@ -33,19 +34,21 @@ struct TemporalAccumulationPushConstants
 
 struct ATrousFilterPushConstants
 {
-    int     radius;
-    int     step_size;
-    float   phi_color;
-    float   phi_normal;
-    float   sigma_depth;
-    int32_t g_buffer_mip;
+    glm::vec4 z_buffer_params;
+    int       radius;
+    int       step_size;
+    float     phi_color;
+    float     phi_normal;
+    float     sigma_depth;
+    int32_t   g_buffer_mip;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
+    glm::vec4 z_buffer_params;
+    int32_t   g_buffer_mip;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -96,19 +99,42 @@ RayTracedReflections::~RayTracedReflections()
 
 void RayTracedReflections::render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi)
 {
-    DW_SCOPED_SAMPLE("Ray Traced Reflections", cmd_buf);
+    HR_SCOPED_SAMPLE("Ray Traced Reflections", cmd_buf);
 
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf, ddgi);
-
-    if (m_denoise)
+    if (m_active)
     {
-        temporal_accumulation(cmd_buf);
-        a_trous_filter(cmd_buf);
+        // The stages that run depend on the output, any other switch leaves the history stale.
+        if (m_current_output != m_last_output || m_denoise != m_last_denoise)
+            m_first_frame = true;
+
+        m_last_output  = m_current_output;
+        m_last_denoise = m_denoise;
+
+        clear_images(cmd_buf);
+        ray_trace(cmd_buf, ddgi);
+
+        if (m_denoise && m_current_output != OUTPUT_RAY_TRACE)
+        {
+            temporal_accumulation(cmd_buf);
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
+            if (m_current_output != OUTPUT_TEMPORAL_ACCUMULATION)
+            {
+                a_trous_filter(cmd_buf);
+
+                if (m_current_output == OUTPUT_UPSAMPLE && m_scale != RAY_TRACE_SCALE_FULL_RES)
+                    upsample(cmd_buf);
+            }
+        }
+    }
+    else
+    {
+        // Nothing consumes the output, restart the history once something does again.
+        m_first_frame = true;
     }
+
+    // Consumers keep the output bound even while it is unused, so it still has to be in a valid layout.
+    m_frame_graph.export_image(output_image(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    m_frame_graph.barrier(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -154,6 +180,48 @@ dw::vk::DescriptorSet::Ptr RayTracedReflections::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+dw::vk::Image::Ptr RayTracedReflections::output_image()
+{
+    if (m_denoise)
+    {
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_ray_trace.image;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_temporal_accumulation.current_output_image[m_common_resources->ping_pong];
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_a_trous.image[m_a_trous.read_idx];
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_a_trous.image[m_a_trous.read_idx];
+            else
+                return m_upsample.image;
+        }
+    }
+    else
+        return m_ray_trace.image;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RayTracedReflections::update_transient_images()
+{
+    // The selected output decides how long the transient images have to stay alive.
+    if (m_current_output == m_transient_output)
+        return false;
+
+    m_backend.lock()->wait_idle();
+
+    create_transient_images();
+    write_descriptor_sets();
+
+    m_frame_graph.reset();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedReflections::create_images()
 {
     auto backend = m_backend.lock();
@@ -191,10 +259,40 @@ void RayTracedReflections::create_images()
         m_temporal_accumulation.prev_view->set_name("Reflections Previous Reprojection");
     }
 
+    create_transient_images();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::create_transient_images()
+{
+    auto backend = m_backend.lock();
+
+    TransientAllocator* allocator = m_common_resources->transient_allocator.get();
+
+    // Release the previous images first so that their memory can be reused right away.
+    for (int i = 0; i < 2; i++)
+    {
+        m_a_trous.view[i].reset();
+        m_a_trous.image[i].reset();
+    }
+
+    m_upsample.image_view.reset();
+    m_upsample.image.reset();
+
+    // Same as for the shadows, only the image written by the last iteration outlives the filter.
+    const int32_t final_idx      = m_a_trous.filter_iterations % 2;
+    const bool    a_trous_output = m_current_output == OUTPUT_ATROUS || (m_current_output == OUTPUT_UPSAMPLE && m_scale == RAY_TRACE_SCALE_FULL_RES);
+
     // A-Trous Filter
     for (int i = 0; i < 2; i++)
     {
-        m_a_trous.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        TransientAllocator::Pass last_pass = TransientAllocator::PASS_REFLECTIONS_A_TROUS;
+
+        if (i == final_idx)
+            last_pass = a_trous_output ? TransientAllocator::PASS_END_OF_FRAME : TransientAllocator::PASS_REFLECTIONS_UPSAMPLE;
+
+        m_a_trous.image[i] = allocator->create_image(m_width, m_height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, TransientAllocator::QUEUE_GRAPHICS, TransientAllocator::PASS_REFLECTIONS_A_TROUS, last_pass);
         m_a_trous.image[i]->set_name("A-Trous Filter " + std::to_string(i));
 
         m_a_trous.view[i] = dw::vk::ImageView::create(backend, m_a_trous.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -203,14 +301,17 @@ void RayTracedReflections::create_images()
 
     // Upsample
     {
-        auto vk_backend = m_backend.lock();
+        // Never written at full resolution.
+        TransientAllocator::Pass last_pass = m_scale == RAY_TRACE_SCALE_FULL_RES ? TransientAllocator::PASS_REFLECTIONS_UPSAMPLE : TransientAllocator::PASS_END_OF_FRAME;
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_upsample.image = allocator->create_image(backend->swap_chain_extents().width, backend->swap_chain_extents().height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, TransientAllocator::QUEUE_GRAPHICS, TransientAllocator::PASS_REFLECTIONS_UPSAMPLE, last_pass);
         m_upsample.image->set_name("Reflections Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("Reflections Upsample");
     }
+
+    m_transient_output = m_current_output;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -665,19 +766,6 @@ void RayTracedReflections::create_pipelines()
         dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rchit.spv");
         dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rmiss.spv");
 
-        dw::vk::ShaderBindingTable::Desc sbt_desc;
-
-        sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
-        sbt_desc.add_miss_group(rmiss, "main");
-
-        m_ray_trace.sbt = dw::vk::ShaderBindingTable::create(backend, sbt_desc);
-
-        dw::vk::RayTracingPipeline::Desc desc;
-
-        desc.set_max_pipeline_ray_recursion_depth(1);
-        desc.set_shader_binding_table(m_ray_trace.sbt);
-
         // ---------------------------------------------------------------------------
         // Create pipeline layout
         // ---------------------------------------------------------------------------
@@ -691,13 +779,14 @@ void RayTracedReflections::create_pipelines()
         pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+#if defined(COMPACT_VERTICES)
+        pl_desc.add_descriptor_set_layout(m_common_resources->compact_vertices->ds_layout());
+#endif
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
 
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
-
-        m_ray_trace.pipeline = dw::vk::RayTracingPipeline::create(backend, desc);
+        m_ray_trace.pipeline = m_common_resources->pipeline_cache->create_ray_tracing_pipeline(rgen, rmiss, rchit, m_ray_trace.pipeline_layout);
     }
 
     // Reprojection
@@ -718,12 +807,7 @@ void RayTracedReflections::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_reprojection.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_temporal_accumulation.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_temporal_accumulation.pipeline_layout);
     }
 
     // A-Trous Filter
@@ -741,12 +825,7 @@ void RayTracedReflections::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_atrous.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_a_trous.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_a_trous.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_a_trous.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_a_trous.pipeline_layout);
     }
 
     // Upsample
@@ -764,12 +843,7 @@ void RayTracedReflections::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_upsample.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_upsample.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_upsample.layout);
     }
 }
 
@@ -788,51 +862,14 @@ void RayTracedReflections::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
         color.float32[2] = 0.0f;
         color.float32[3] = 0.0f;
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        m_frame_graph.write(m_temporal_accumulation.prev_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.barrier(cmd_buf);
+
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
 
         m_first_frame = false;
     }
@@ -842,21 +879,13 @@ void RayTracedReflections::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
 
 void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi)
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    HR_SCOPED_SAMPLE("Ray Trace", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_READ_BIT);
+    m_frame_graph.write(m_ray_trace.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, true);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline->handle());
 
@@ -877,62 +906,50 @@ void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* d
     };
 
     VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_common_resources->current_scene()->descriptor_set(),
         m_ray_trace.write_ds->handle(),
         m_common_resources->per_frame_ds->handle(),
         m_g_buffer->output_ds()->handle(),
         m_common_resources->current_skybox_ds->handle(),
         m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle(),
-        ddgi->current_read_ds()->handle()
+        ddgi->current_read_ds()->handle(),
+#if defined(COMPACT_VERTICES)
+        m_common_resources->compact_vertices->descriptor_set(m_common_resources->current_scene())->handle()
+#endif
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, 7, descriptor_sets, 2, dynamic_offsets);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, sizeof(descriptor_sets) / sizeof(VkDescriptorSet), descriptor_sets, 2, dynamic_offsets);
 
     auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
 
     VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
     VkDeviceSize group_stride = group_size;
 
-    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->miss_group_offset(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->hit_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->ray_gen_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->miss_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.pipeline->hit_group_offset(), group_stride, group_size };
     const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
 
     uint32_t rt_image_width  = m_width;
     uint32_t rt_image_height = m_height;
 
     vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, rt_image_width, rt_image_height, 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedReflections::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
+    HR_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    m_frame_graph.write(m_temporal_accumulation.current_output_image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.write(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_ray_trace.image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.blur_as_input ? m_temporal_accumulation.prev_image : m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     const uint32_t NUM_THREADS = 32;
 
@@ -962,76 +979,43 @@ void RayTracedReflections::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_
     vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 6, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(NUM_THREADS))), static_cast<uint32_t>(ceil(float(m_height) / float(NUM_THREADS))), 1);
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedReflections::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
+    HR_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
 
     const uint32_t NUM_THREADS = 32;
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline->handle());
 
     bool    ping_pong = false;
     int32_t read_idx  = 0;
     int32_t write_idx = 1;
 
+    m_frame_graph.alias(m_a_trous.image[0]);
+    m_frame_graph.alias(m_a_trous.image[1]);
+
     for (int i = 0; i < m_a_trous.filter_iterations; i++)
     {
         read_idx  = (int32_t)ping_pong;
         write_idx = (int32_t)!ping_pong;
 
-        if (i == 0)
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-        else
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[read_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
+        m_frame_graph.write(m_a_trous.image[write_idx], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+        m_frame_graph.read(i == 0 ? m_temporal_accumulation.current_output_image[m_common_resources->ping_pong] : m_a_trous.image[read_idx], FrameGraph::ACCESS_SAMPLED);
+        m_frame_graph.barrier(cmd_buf);
 
         ATrousFilterPushConstants push_constants;
 
-        push_constants.radius       = m_a_trous.radius;
-        push_constants.step_size    = 1 << i;
-        push_constants.phi_color    = m_a_trous.phi_color;
-        push_constants.phi_normal   = m_a_trous.phi_normal;
-        push_constants.g_buffer_mip = m_g_buffer_mip;
-        push_constants.sigma_depth  = m_a_trous.sigma_depth;
+        push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+        push_constants.radius          = m_a_trous.radius;
+        push_constants.step_size       = 1 << i;
+        push_constants.phi_color       = m_a_trous.phi_color;
+        push_constants.phi_normal      = m_a_trous.phi_normal;
+        push_constants.g_buffer_mip    = m_g_buffer_mip;
+        push_constants.sigma_depth     = m_a_trous.sigma_depth;
 
         vkCmdPushConstants(cmd_buf->handle(), m_a_trous.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1049,19 +1033,9 @@ void RayTracedReflections::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
 
         if (m_a_trous.feedback_iteration == i && m_temporal_accumulation.blur_as_input)
         {
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_GENERAL,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                subresource_range);
+            m_frame_graph.read(m_a_trous.image[write_idx], FrameGraph::ACCESS_TRANSFER_SRC, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            m_frame_graph.write(m_temporal_accumulation.prev_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+            m_frame_graph.barrier(cmd_buf);
 
             VkImageCopy image_copy_region {};
             image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1081,56 +1055,29 @@ void RayTracedReflections::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                 1,
                 &image_copy_region);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_GENERAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                subresource_range);
         }
     }
 
     m_a_trous.read_idx = write_idx;
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedReflections::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Upsample", cmd_buf);
+    HR_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    m_frame_graph.alias(m_upsample.image);
+    m_frame_graph.write(m_upsample.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_a_trous.image[m_a_trous.read_idx], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
 
     UpsamplePushConstants push_constants;
 
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+    push_constants.g_buffer_mip    = m_g_buffer_mip;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1146,13 +1093,6 @@ void RayTracedReflections::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common_resources.h"
+#include "frame_graph.h"
 
 class GBuffer;
 class DDGI;
@@ -27,15 +28,20 @@ public:
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
+    bool                       update_transient_images();
 
     inline uint32_t                         width() { return m_width; }
     inline uint32_t                         height() { return m_height; }
     inline RayTraceScale                    scale() { return m_scale; }
     inline RayTracedReflections::OutputType current_output() { return m_current_output; }
     inline void                             set_current_output(RayTracedReflections::OutputType output_type) { m_current_output = output_type; }
+    inline bool                             sample_gi() { return m_ray_trace.sample_gi; }
+    inline void                             set_active(bool value) { m_active = value; }
 
 private:
     void create_images();
+    void create_transient_images();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_pipelines();
@@ -54,11 +60,10 @@ private:
         float                           trim         = 0.8f;
         dw::vk::DescriptorSet::Ptr      write_ds;
         dw::vk::DescriptorSet::Ptr      read_ds;
-        dw::vk::RayTracingPipeline::Ptr pipeline;
+        Pipeline::Ptr                   pipeline;
         dw::vk::PipelineLayout::Ptr     pipeline_layout;
         dw::vk::Image::Ptr              image;
         dw::vk::ImageView::Ptr          view;
-        dw::vk::ShaderBindingTable::Ptr sbt;
     };
 
     struct TemporalAccumulation
@@ -66,7 +71,7 @@ private:
         float                            alpha         = 0.01f;
         float                            moments_alpha = 0.2f;
         bool                             blur_as_input = false;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        Pipeline::Ptr                    pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
         dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
@@ -91,7 +96,7 @@ private:
         int32_t                      filter_iterations  = 4;
         int32_t                      feedback_iteration = 1;
         int32_t                      read_idx           = 0;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
         dw::vk::Image::Ptr           image[2];
         dw::vk::ImageView::Ptr       view[2];
@@ -102,7 +107,7 @@ private:
     struct Upsample
     {
         dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       image_view;
         dw::vk::DescriptorSet::Ptr   read_ds;
@@ -117,10 +122,15 @@ private:
     uint32_t                       m_g_buffer_mip = 0;
     uint32_t                       m_width;
     uint32_t                       m_height;
-    bool                           m_denoise     = true;
-    bool                           m_first_frame = true;
+    bool                           m_denoise          = true;
+    bool                           m_first_frame      = true;
+    bool                           m_active           = true;
+    bool                           m_last_denoise     = true;
+    OutputType                     m_last_output      = OUTPUT_UPSAMPLE;
+    OutputType                     m_transient_output = OUTPUT_UPSAMPLE;
     RayTrace                       m_ray_trace;
     TemporalAccumulation           m_temporal_accumulation;
     ATrous                         m_a_trous;
     Upsample                       m_upsample;
+    FrameGraph                     m_frame_graph;
 };
\ No newline at end of file
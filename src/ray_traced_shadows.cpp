@@ -1,6 +1,7 @@
 #include "ray_traced_shadows.h"
 #include "g_buffer.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <profiler.h>
 #include <macros.h>
 #include <imgui.h>
@@ -13,6 +14,37 @@ static const int RAY_TRACE_NUM_THREADS_Y = 4;
 static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_X = 8;
 static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_Y = 8;
 
+static const uint32_t RESTIR_NUM_THREADS_X = 8;
+static const uint32_t RESTIR_NUM_THREADS_Y = 8;
+
+enum RayTraceMode
+{
+    RAY_TRACE_MODE_ALL,
+    RAY_TRACE_MODE_TILES,
+    RAY_TRACE_MODE_STABLE
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct TemporalResamplingPushConstants
+{
+    uint32_t num_frames;
+    int32_t  g_buffer_mip;
+    uint32_t num_candidates;
+    uint32_t max_history;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct SpatialResamplingPushConstants
+{
+    glm::vec4 z_buffer_params;
+    uint32_t  num_frames;
+    int32_t   g_buffer_mip;
+    uint32_t  num_samples;
+    float     radius;
+};
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct RayTracePushConstants
@@ -20,34 +52,42 @@ struct RayTracePushConstants
     float    bias;
     uint32_t num_frames;
     int32_t  g_buffer_mip;
+    uint32_t mode;
+    uint32_t restir;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct TemporalAccumulationPushConstants
 {
-    float   alpha;
-    float   moments_alpha;
-    int32_t g_buffer_mip;
+    float    alpha;
+    float    moments_alpha;
+    int32_t  g_buffer_mip;
+    uint32_t num_frames;
+    uint32_t stable_frames;
+    uint32_t refresh_interval;
+    uint32_t camera_moved;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct ATrousFilterPushConstants
 {
-    int     radius;
-    int     step_size;
-    float   phi_visibility;
-    float   phi_normal;
-    float   sigma_depth;
-    int32_t g_buffer_mip;
+    glm::vec4 z_buffer_params;
+    int       radius;
+    int       step_size;
+    float     phi_visibility;
+    float     phi_normal;
+    float     sigma_depth;
+    int32_t   g_buffer_mip;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
+    glm::vec4 z_buffer_params;
+    int32_t   g_buffer_mip;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -99,20 +139,58 @@ RayTracedShadows::~RayTracedShadows()
 
 void RayTracedShadows::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Ray Traced Shadows", cmd_buf);
-
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf);
+    HR_SCOPED_SAMPLE("Ray Traced Shadows", cmd_buf);
 
-    if (m_denoise)
+    if (m_active)
     {
-        reset_args(cmd_buf);
-        temporal_accumulation(cmd_buf);
-        a_trous_filter(cmd_buf);
+        // The stages that run depend on the output, any other switch leaves the history stale.
+        if (m_current_output != m_last_output || m_denoise != m_last_denoise || m_restir.enabled != m_last_restir)
+            m_first_frame = true;
+
+        m_last_output  = m_current_output;
+        m_last_denoise = m_denoise;
+        m_last_restir  = m_restir.enabled;
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
+        // The tile state is cleared along with the history, the first frame traces every tile.
+        if (m_first_frame)
+            m_tiles_classified = false;
+
+        clear_images(cmd_buf);
+
+        if (m_restir.enabled)
+        {
+            temporal_resampling(cmd_buf);
+            spatial_resampling(cmd_buf);
+        }
+
+        ray_trace(cmd_buf);
+
+        if (m_denoise && m_current_output != OUTPUT_RAY_TRACE)
+        {
+            reset_args(cmd_buf);
+            temporal_accumulation(cmd_buf);
+
+            if (m_current_output != OUTPUT_TEMPORAL_ACCUMULATION)
+            {
+                a_trous_filter(cmd_buf);
+
+                if (m_current_output == OUTPUT_UPSAMPLE && m_scale != RAY_TRACE_SCALE_FULL_RES)
+                    upsample(cmd_buf);
+            }
+        }
+        else
+            m_tiles_classified = false;
     }
+    else
+    {
+        // Nothing consumes the output, restart the history once something does again.
+        m_first_frame = true;
+    }
+
+    // Consumers keep the output bound even while it is unused, so it still has to be in a valid layout.
+    m_frame_graph.export_image(output_image(), m_common_resources->consumer_stage());
+    m_frame_graph.export_image(reservoir_image(), m_common_resources->consumer_stage());
+    m_frame_graph.barrier(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -121,6 +199,27 @@ void RayTracedShadows::gui()
 {
     ImGui::Checkbox("Denoise", &m_denoise);
     ImGui::InputFloat("Bias", &m_ray_trace.bias);
+    ImGui::Checkbox("ReSTIR", &m_restir.enabled);
+
+    if (m_restir.enabled)
+    {
+        ImGui::SliderInt("Candidates", &m_restir.num_candidates, 1, 32);
+        ImGui::SliderInt("Max History", &m_restir.max_history, 1, 30);
+        ImGui::SliderInt("Spatial Samples", &m_restir.spatial_samples, 0, 8);
+        ImGui::SliderFloat("Spatial Radius", &m_restir.spatial_radius, 1.0f, 32.0f);
+    }
+    else
+    {
+        // The light of a pixel changes every frame, a stable mask can't keep its visibility.
+        ImGui::Checkbox("Adaptive Ray Budget", &m_ray_trace.adaptive);
+
+        if (m_ray_trace.adaptive)
+        {
+            ImGui::SliderInt("Stable Frames", &m_ray_trace.stable_frames, 1, 32);
+            ImGui::SliderInt("Refresh Interval", &m_ray_trace.refresh_interval, 2, 32);
+        }
+    }
+
     ImGui::InputFloat("Alpha", &m_temporal_accumulation.alpha);
     ImGui::InputFloat("Alpha Moments", &m_temporal_accumulation.moments_alpha);
     ImGui::InputFloat("Phi Visibility", &m_a_trous.phi_visibility);
@@ -154,17 +253,98 @@ dw::vk::DescriptorSet::Ptr RayTracedShadows::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+dw::vk::Image::Ptr RayTracedShadows::output_image()
+{
+    if (m_denoise)
+    {
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_ray_trace.image;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_temporal_accumulation.current_output_image;
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_a_trous.image[m_a_trous.read_idx];
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_a_trous.image[m_a_trous.read_idx];
+            else
+                return m_upsample.image;
+        }
+    }
+    else
+        return m_ray_trace.image;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr RayTracedShadows::reservoir_ds()
+{
+    return m_restir.read_ds[m_common_resources->ping_pong];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::Image::Ptr RayTracedShadows::reservoir_image()
+{
+    return m_restir.image[m_common_resources->ping_pong];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RayTracedShadows::update_transient_images()
+{
+    // The selected output decides how long the transient images have to stay alive.
+    if (m_current_output == m_transient_output)
+        return false;
+
+    m_backend.lock()->wait_idle();
+
+    create_transient_images();
+    write_descriptor_sets();
+
+    m_frame_graph.reset();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedShadows::create_images()
 {
     auto backend = m_backend.lock();
 
     // Ray Trace
     {
-        m_ray_trace.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1, 1, 1, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        // The second channel holds the extra ray of the masks in a penumbra.
+        m_ray_trace.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1, 1, 1, VK_FORMAT_R32G32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_ray_trace.image->set_name("Shadows Ray Trace");
 
         m_ray_trace.view = dw::vk::ImageView::create(backend, m_ray_trace.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_ray_trace.view->set_name("Shadows Ray Trace");
+
+        m_ray_trace.tile_state_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.image->width(), m_ray_trace.image->height(), 1, 1, 1, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_ray_trace.tile_state_image->set_name("Shadows Tile State");
+
+        m_ray_trace.tile_state_view = dw::vk::ImageView::create(backend, m_ray_trace.tile_state_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_ray_trace.tile_state_view->set_name("Shadows Tile State");
+    }
+
+    // ReSTIR
+    {
+        m_restir.temporal_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_restir.temporal_image->set_name("Shadows ReSTIR Temporal");
+
+        m_restir.temporal_view = dw::vk::ImageView::create(backend, m_restir.temporal_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_restir.temporal_view->set_name("Shadows ReSTIR Temporal");
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_restir.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+            m_restir.image[i]->set_name("Shadows ReSTIR Reservoirs " + std::to_string(i));
+
+            m_restir.view[i] = dw::vk::ImageView::create(backend, m_restir.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+            m_restir.view[i]->set_name("Shadows ReSTIR Reservoirs " + std::to_string(i));
+        }
     }
 
     // Reprojection
@@ -191,10 +371,42 @@ void RayTracedShadows::create_images()
         m_temporal_accumulation.prev_view->set_name("Shadows Previous Reprojection");
     }
 
+    create_transient_images();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedShadows::create_transient_images()
+{
+    auto backend = m_backend.lock();
+
+    TransientAllocator*       allocator = m_common_resources->transient_allocator.get();
+    TransientAllocator::Queue queue     = m_common_resources->async_queue();
+
+    // Release the previous images first so that their memory can be reused right away.
+    for (int i = 0; i < 2; i++)
+    {
+        m_a_trous.view[i].reset();
+        m_a_trous.image[i].reset();
+    }
+
+    m_upsample.image_view.reset();
+    m_upsample.image.reset();
+
+    // The image written by the last iteration is read by the upsample pass or consumed as the output, the other one only lives
+    // within the filter.
+    const int32_t final_idx      = m_a_trous.filter_iterations % 2;
+    const bool    a_trous_output = m_current_output == OUTPUT_ATROUS || (m_current_output == OUTPUT_UPSAMPLE && m_scale == RAY_TRACE_SCALE_FULL_RES);
+
     // A-Trous Filter
     for (int i = 0; i < 2; i++)
     {
-        m_a_trous.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        TransientAllocator::Pass last_pass = TransientAllocator::PASS_SHADOWS_A_TROUS;
+
+        if (i == final_idx)
+            last_pass = a_trous_output ? TransientAllocator::PASS_END_OF_FRAME : TransientAllocator::PASS_SHADOWS_UPSAMPLE;
+
+        m_a_trous.image[i] = allocator->create_image(m_width, m_height, VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, queue, TransientAllocator::PASS_SHADOWS_A_TROUS, last_pass);
         m_a_trous.image[i]->set_name("A-Trous Filter " + std::to_string(i));
 
         m_a_trous.view[i] = dw::vk::ImageView::create(backend, m_a_trous.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -203,14 +415,17 @@ void RayTracedShadows::create_images()
 
     // Upsample
     {
-        auto vk_backend = m_backend.lock();
+        // Never written at full resolution.
+        TransientAllocator::Pass last_pass = m_scale == RAY_TRACE_SCALE_FULL_RES ? TransientAllocator::PASS_SHADOWS_UPSAMPLE : TransientAllocator::PASS_END_OF_FRAME;
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_upsample.image = allocator->create_image(backend->swap_chain_extents().width, backend->swap_chain_extents().height, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, queue, TransientAllocator::PASS_SHADOWS_UPSAMPLE, last_pass);
         m_upsample.image->set_name("Shadows Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("Shadows Upsample");
     }
+
+    m_transient_output = m_current_output;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -226,6 +441,16 @@ void RayTracedShadows::create_buffers()
 
     m_temporal_accumulation.uniform_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec4) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
     m_temporal_accumulation.uniform_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0, default_args);
+
+    // One entry per ray mask in either list, the args are followed by the number of tiles.
+    const uint32_t num_ray_masks       = m_ray_trace.image->width() * m_ray_trace.image->height();
+    uint32_t       default_tile_args[] = { 0, 1, 1, 0 };
+
+    m_ray_trace.tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * num_ray_masks, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_ray_trace.dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(uint32_t) * 4, VMA_MEMORY_USAGE_GPU_ONLY, 0, default_tile_args);
+
+    m_ray_trace.stable_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * num_ray_masks, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_ray_trace.stable_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(uint32_t) * 4, VMA_MEMORY_USAGE_GPU_ONLY, 0, default_tile_args);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -243,6 +468,40 @@ void RayTracedShadows::create_descriptor_sets()
         m_ray_trace.read_ds->set_name("Shadows Ray Trace Read");
     }
 
+    // ReSTIR
+    {
+        m_restir.temporal_write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_restir.temporal_write_ds->set_name("Shadows ReSTIR Temporal Write");
+
+        m_restir.temporal_read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_restir.temporal_read_ds->set_name("Shadows ReSTIR Temporal Read");
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_restir.write_ds[i] = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+            m_restir.write_ds[i]->set_name("Shadows ReSTIR Reservoirs Write " + std::to_string(i));
+
+            m_restir.read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+            m_restir.read_ds[i]->set_name("Shadows ReSTIR Reservoirs Read " + std::to_string(i));
+        }
+    }
+
+    // Tiles
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_ray_trace.tiles_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+
+        m_ray_trace.tiles_ds = backend->allocate_descriptor_set(m_ray_trace.tiles_ds_layout);
+        m_ray_trace.tiles_ds->set_name("Shadows Tiles");
+    }
+
     // Reprojection
     {
         dw::vk::DescriptorSetLayout::Desc desc;
@@ -369,6 +628,51 @@ void RayTracedShadows::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
+    // ReSTIR Write and Read
+    {
+        dw::vk::ImageView::Ptr     views[]     = { m_restir.temporal_view, m_restir.view[0], m_restir.view[1] };
+        dw::vk::DescriptorSet::Ptr write_dss[] = { m_restir.temporal_write_ds, m_restir.write_ds[0], m_restir.write_ds[1] };
+        dw::vk::DescriptorSet::Ptr read_dss[]  = { m_restir.temporal_read_ds, m_restir.read_ds[0], m_restir.read_ds[1] };
+
+        for (int i = 0; i < 3; i++)
+        {
+            VkDescriptorImageInfo storage_image_info;
+
+            storage_image_info.sampler     = VK_NULL_HANDLE;
+            storage_image_info.imageView   = views[i]->handle();
+            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            // Integer reservoirs can't be filtered, every reader fetches them.
+            VkDescriptorImageInfo sampler_image_info;
+
+            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+            sampler_image_info.imageView   = views[i]->handle();
+            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write_data[2];
+
+            DW_ZERO_MEMORY(write_data[0]);
+
+            write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[0].descriptorCount = 1;
+            write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data[0].pImageInfo      = &storage_image_info;
+            write_data[0].dstBinding      = 0;
+            write_data[0].dstSet          = write_dss[i]->handle();
+
+            DW_ZERO_MEMORY(write_data[1]);
+
+            write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[1].descriptorCount = 1;
+            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[1].pImageInfo      = &sampler_image_info;
+            write_data[1].dstBinding      = 0;
+            write_data[1].dstSet          = read_dss[i]->handle();
+
+            vkUpdateDescriptorSets(backend->device(), 2, &write_data[0], 0, nullptr);
+        }
+    }
+
     // Reprojection Output Only Read
     {
         std::vector<VkDescriptorImageInfo> image_infos;
@@ -400,6 +704,52 @@ void RayTracedShadows::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
+    // Tiles
+    {
+        VkDescriptorImageInfo image_info;
+
+        image_info.sampler     = VK_NULL_HANDLE;
+        image_info.imageView   = m_ray_trace.tile_state_view->handle();
+        image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        dw::vk::Buffer::Ptr buffers[] = {
+            m_ray_trace.tile_coords_buffer,
+            m_ray_trace.dispatch_args_buffer,
+            m_ray_trace.stable_tile_coords_buffer,
+            m_ray_trace.stable_dispatch_args_buffer
+        };
+
+        VkDescriptorBufferInfo buffer_info[4];
+        VkWriteDescriptorSet   write_data[5];
+
+        DW_ZERO_MEMORY(write_data[0]);
+
+        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data[0].descriptorCount = 1;
+        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data[0].pImageInfo      = &image_info;
+        write_data[0].dstBinding      = 0;
+        write_data[0].dstSet          = m_ray_trace.tiles_ds->handle();
+
+        for (int i = 0; i < 4; i++)
+        {
+            buffer_info[i].buffer = buffers[i]->handle();
+            buffer_info[i].offset = 0;
+            buffer_info[i].range  = VK_WHOLE_SIZE;
+
+            DW_ZERO_MEMORY(write_data[i + 1]);
+
+            write_data[i + 1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i + 1].descriptorCount = 1;
+            write_data[i + 1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[i + 1].pBufferInfo     = &buffer_info[i];
+            write_data[i + 1].dstBinding      = i + 1;
+            write_data[i + 1].dstSet          = m_ray_trace.tiles_ds->handle();
+        }
+
+        vkUpdateDescriptorSets(backend->device(), 5, &write_data[0], 0, nullptr);
+    }
+
     // Reprojection Current Write
     for (int i = 0; i < 2; i++)
     {
@@ -783,18 +1133,57 @@ void RayTracedShadows::create_pipelines()
         pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         pl_desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
         pl_desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_ray_trace.tiles_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
 
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
         m_ray_trace.pipeline_layout->set_name("Ray Trace Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc desc;
+        m_ray_trace.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(shader_module, m_ray_trace.pipeline_layout);
+    }
 
-        desc.set_shader_stage(shader_module, "main");
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
+    // ReSTIR Temporal
+    {
+        dw::vk::PipelineLayout::Desc desc;
 
-        m_ray_trace.pipeline = dw::vk::ComputePipeline::create(backend, desc);
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalResamplingPushConstants));
+
+        m_restir.temporal_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_restir.temporal_pipeline_layout->set_name("Shadows ReSTIR Temporal Pipeline Layout");
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_restir_temporal.comp.spv");
+
+        m_restir.temporal_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_restir.temporal_pipeline_layout);
+    }
+
+    // ReSTIR Spatial
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->point_lights->ds_layout());
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpatialResamplingPushConstants));
+
+        m_restir.spatial_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_restir.spatial_pipeline_layout->set_name("Shadows ReSTIR Spatial Pipeline Layout");
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_restir_spatial.comp.spv");
+
+        m_restir.spatial_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_restir.spatial_pipeline_layout);
     }
 
     // Reset Args
@@ -802,18 +1191,14 @@ void RayTracedShadows::create_pipelines()
         dw::vk::PipelineLayout::Desc desc;
 
         desc.add_descriptor_set_layout(m_temporal_accumulation.write_ds_layout);
+        desc.add_descriptor_set_layout(m_ray_trace.tiles_ds_layout);
 
         m_reset_args.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_reset_args.pipeline_layout->set_name("Reset Args Pipeline Layout");
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_reset_args.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_reset_args.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_reset_args.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_reset_args.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_reset_args.pipeline_layout);
     }
 
     // Reprojection
@@ -826,6 +1211,7 @@ void RayTracedShadows::create_pipelines()
         desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
         desc.add_descriptor_set_layout(m_temporal_accumulation.read_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_ray_trace.tiles_ds_layout);
 
         desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalAccumulationPushConstants));
 
@@ -834,12 +1220,7 @@ void RayTracedShadows::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_reprojection.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_temporal_accumulation.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_temporal_accumulation.pipeline_layout);
     }
 
     // Copy Uniform Tiles
@@ -854,12 +1235,7 @@ void RayTracedShadows::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_copy_uniform_tiles.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_copy_uniform_tiles.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_copy_uniform_tiles.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_copy_uniform_tiles.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_copy_uniform_tiles.pipeline_layout);
     }
 
     // A-Trous Filter
@@ -877,12 +1253,7 @@ void RayTracedShadows::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_atrous.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_a_trous.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_a_trous.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_a_trous.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_a_trous.pipeline_layout);
     }
 
     // Upsample
@@ -900,12 +1271,7 @@ void RayTracedShadows::create_pipelines()
 
         dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_upsample.comp.spv");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_upsample.pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_upsample.layout);
     }
 }
 
@@ -924,36 +1290,18 @@ void RayTracedShadows::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
         color.float32[2] = 0.0f;
         color.float32[3] = 0.0f;
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        m_frame_graph.write(m_temporal_accumulation.prev_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_ray_trace.tile_state_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.write(m_restir.image[!m_common_resources->ping_pong], FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+        m_frame_graph.barrier(cmd_buf);
+
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_ray_trace.tile_state_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
+
+        // Reservoirs that have seen no candidates.
+        vkCmdClearColorImage(cmd_buf->handle(), m_restir.image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &subresource_range);
 
         m_first_frame = false;
     }
@@ -961,69 +1309,175 @@ void RayTracedShadows::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedShadows::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedShadows::temporal_resampling(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    HR_SCOPED_SAMPLE("Temporal Resampling", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    m_frame_graph.write(m_restir.temporal_image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_restir.image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_restir.temporal_pipeline->handle());
+
+    TemporalResamplingPushConstants push_constants;
+
+    push_constants.num_frames     = m_common_resources->num_frames;
+    push_constants.g_buffer_mip   = m_g_buffer_mip;
+    push_constants.num_candidates = static_cast<uint32_t>(std::max(m_restir.num_candidates, 1));
+    push_constants.max_history    = static_cast<uint32_t>(std::max(m_restir.max_history, 1));
 
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+    vkCmdPushConstants(cmd_buf->handle(), m_restir.temporal_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_restir.temporal_write_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_g_buffer->history_ds()->handle(),
+        m_restir.read_ds[!m_common_resources->ping_pong]->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_common_resources->point_lights->ds()->handle()
     };
 
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_restir.temporal_pipeline_layout->handle(), 0, 6, descriptor_sets, 1, &dynamic_offset);
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RESTIR_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RESTIR_NUM_THREADS_Y))), 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedShadows::spatial_resampling(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Spatial Resampling", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    m_frame_graph.write(m_restir.image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_restir.temporal_image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_restir.spatial_pipeline->handle());
+
+    SpatialResamplingPushConstants push_constants;
+
+    push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+    push_constants.num_frames      = m_common_resources->num_frames;
+    push_constants.g_buffer_mip    = m_g_buffer_mip;
+    push_constants.num_samples     = static_cast<uint32_t>(std::max(m_restir.spatial_samples, 0));
+    push_constants.radius          = m_restir.spatial_radius;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_restir.spatial_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_restir.write_ds[m_common_resources->ping_pong]->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_restir.temporal_read_ds->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_common_resources->point_lights->ds()->handle()
     };
 
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_restir.spatial_pipeline_layout->handle(), 0, 5, descriptor_sets, 1, &dynamic_offset);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RESTIR_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RESTIR_NUM_THREADS_Y))), 1);
+}
 
-    RayTracePushConstants push_constants;
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    push_constants.bias         = m_ray_trace.bias;
-    push_constants.num_frames   = m_common_resources->num_frames;
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+void RayTracedShadows::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Ray Trace", cmd_buf);
 
-    vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+    auto backend = m_backend.lock();
+
+    // Only trust the tile lists if the reprojection pass classified every mask during the previous frame. With ReSTIR the light of
+    // a pixel changes from frame to frame, so the visibility of a stable mask can't be kept, and neither can it once the camera
+    // moves and every mask covers a different surface.
+    const bool adaptive = m_ray_trace.adaptive && m_tiles_classified && !m_restir.enabled && m_common_resources->camera_delta == glm::vec3(0.0f);
+
+    m_frame_graph.memory_dependency(m_common_resources->consumer_stage(), VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    if (adaptive)
+        m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    m_frame_graph.write(m_ray_trace.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_ray_trace.tile_state_image, FrameGraph::ACCESS_STORAGE_READ);
+
+    if (m_restir.enabled)
+        m_frame_graph.read(m_restir.image[m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+
+    m_frame_graph.barrier(cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
 
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
     VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_common_resources->current_scene()->descriptor_set(),
         m_ray_trace.write_ds->handle(),
         m_common_resources->per_frame_ds->handle(),
         m_g_buffer->output_ds()->handle(),
-        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle()
+        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle(),
+        m_ray_trace.tiles_ds->handle(),
+        m_restir.read_ds[m_common_resources->ping_pong]->handle(),
+        m_common_resources->point_lights->ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 8, descriptor_sets, 1, &dynamic_offset);
 
-    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1);
+    RayTracePushConstants push_constants;
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
+    push_constants.bias         = m_ray_trace.bias;
+    push_constants.num_frames   = m_common_resources->num_frames;
+    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.restir       = m_restir.enabled ? 1 : 0;
+
+    if (adaptive)
+    {
+        // Both lists together cover every mask once, so the two dispatches never write the same texel.
+        push_constants.mode = RAY_TRACE_MODE_TILES;
+
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdDispatchIndirect(cmd_buf->handle(), m_ray_trace.dispatch_args_buffer->handle(), 0);
+
+        push_constants.mode = RAY_TRACE_MODE_STABLE;
+
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdDispatchIndirect(cmd_buf->handle(), m_ray_trace.stable_dispatch_args_buffer->handle(), 0);
+    }
+    else
+    {
+        push_constants.mode = RAY_TRACE_MODE_ALL;
+
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedShadows::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Reset Args", cmd_buf);
+    HR_SCOPED_SAMPLE("Reset Args", cmd_buf);
+
+    // The ray trace pass read the tile lists of the previous frame.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline->handle());
 
     VkDescriptorSet descriptor_sets[] = {
-        m_temporal_accumulation.current_write_ds[m_common_resources->ping_pong]->handle()
+        m_temporal_accumulation.current_write_ds[m_common_resources->ping_pong]->handle(),
+        m_ray_trace.tiles_ds->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline_layout->handle(), 0, 1, descriptor_sets, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline_layout->handle(), 0, 2, descriptor_sets, 0, nullptr);
 
     vkCmdDispatch(cmd_buf->handle(), 1, 1, 1);
 }
@@ -1032,32 +1486,31 @@ void RayTracedShadows::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 
 void RayTracedShadows::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
+    HR_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    // The dispatch args were just reset and the tile lists are appended to.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    m_frame_graph.write(m_temporal_accumulation.current_output_image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.write(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_ray_trace.image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.prev_image, FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.read(m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.write(m_ray_trace.tile_state_image, FrameGraph::ACCESS_STORAGE_READ_WRITE);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline->handle());
 
     TemporalAccumulationPushConstants push_constants;
 
-    push_constants.alpha         = m_temporal_accumulation.alpha;
-    push_constants.moments_alpha = m_temporal_accumulation.moments_alpha;
-    push_constants.g_buffer_mip  = m_g_buffer_mip;
+    push_constants.alpha            = m_temporal_accumulation.alpha;
+    push_constants.moments_alpha    = m_temporal_accumulation.moments_alpha;
+    push_constants.g_buffer_mip     = m_g_buffer_mip;
+    push_constants.num_frames       = m_common_resources->num_frames;
+    push_constants.stable_frames    = static_cast<uint32_t>(std::max(m_ray_trace.stable_frames, 1));
+    push_constants.refresh_interval = static_cast<uint32_t>(std::max(m_ray_trace.refresh_interval, 1));
+    push_constants.camera_moved     = m_common_resources->camera_delta != glm::vec3(0.0f) ? 1 : 0;
 
     vkCmdPushConstants(cmd_buf->handle(), m_temporal_accumulation.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1067,76 +1520,48 @@ void RayTracedShadows::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
         m_g_buffer->history_ds()->handle(),
         m_ray_trace.read_ds->handle(),
         m_temporal_accumulation.prev_read_ds[!m_common_resources->ping_pong]->handle(),
-        m_common_resources->per_frame_ds->handle()
+        m_common_resources->per_frame_ds->handle(),
+        m_ray_trace.tiles_ds->handle()
     };
 
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 6, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), 1);
 
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    m_tiles_classified = true;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
+    HR_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
 
     const uint32_t NUM_THREADS = 32;
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
     bool    ping_pong = false;
     int32_t read_idx  = 0;
     int32_t write_idx = 1;
 
+    // The tile lists and indirect args written by the temporal accumulation pass.
+    m_frame_graph.memory_dependency(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    m_frame_graph.alias(m_a_trous.image[0]);
+    m_frame_graph.alias(m_a_trous.image[1]);
+
     for (int i = 0; i < m_a_trous.filter_iterations; i++)
     {
         read_idx  = (int32_t)ping_pong;
         write_idx = (int32_t)!ping_pong;
 
-        if (i == 0)
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-        else
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[read_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
+        m_frame_graph.write(m_a_trous.image[write_idx], FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+        m_frame_graph.read(i == 0 ? m_temporal_accumulation.current_output_image : m_a_trous.image[read_idx], FrameGraph::ACCESS_SAMPLED);
+        m_frame_graph.barrier(cmd_buf);
 
         {
-            DW_SCOPED_SAMPLE("Copy Uniform Tiles", cmd_buf);
+            HR_SCOPED_SAMPLE("Copy Uniform Tiles", cmd_buf);
 
             vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_uniform_tiles.pipeline->handle());
 
@@ -1151,18 +1576,19 @@ void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
         }
 
         {
-            DW_SCOPED_SAMPLE("Iteration " + std::to_string(i), cmd_buf);
+            HR_SCOPED_SAMPLE("Iteration " + std::to_string(i), cmd_buf);
 
             vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline->handle());
 
             ATrousFilterPushConstants push_constants;
 
-            push_constants.radius         = m_a_trous.radius;
-            push_constants.step_size      = 1 << i;
-            push_constants.phi_visibility = m_a_trous.phi_visibility;
-            push_constants.phi_normal     = m_a_trous.phi_normal;
-            push_constants.sigma_depth    = m_a_trous.sigma_depth;
-            push_constants.g_buffer_mip   = m_g_buffer_mip;
+            push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+            push_constants.radius          = m_a_trous.radius;
+            push_constants.step_size       = 1 << i;
+            push_constants.phi_visibility  = m_a_trous.phi_visibility;
+            push_constants.phi_normal      = m_a_trous.phi_normal;
+            push_constants.sigma_depth     = m_a_trous.sigma_depth;
+            push_constants.g_buffer_mip    = m_g_buffer_mip;
 
             vkCmdPushConstants(cmd_buf->handle(), m_a_trous.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1181,19 +1607,9 @@ void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
 
         if (m_a_trous.feedback_iteration == i)
         {
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_GENERAL,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                subresource_range);
+            m_frame_graph.read(m_a_trous.image[write_idx], FrameGraph::ACCESS_TRANSFER_SRC, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            m_frame_graph.write(m_temporal_accumulation.prev_image, FrameGraph::ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+            m_frame_graph.barrier(cmd_buf);
 
             VkImageCopy image_copy_region {};
             image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1213,56 +1629,29 @@ void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                 1,
                 &image_copy_region);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_GENERAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                subresource_range);
         }
     }
 
     m_a_trous.read_idx = write_idx;
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedShadows::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Upsample", cmd_buf);
-
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    HR_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    m_frame_graph.alias(m_upsample.image);
+    m_frame_graph.write(m_upsample.image, FrameGraph::ACCESS_STORAGE_WRITE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+    m_frame_graph.read(m_a_trous.image[m_a_trous.read_idx], FrameGraph::ACCESS_SAMPLED);
+    m_frame_graph.barrier(cmd_buf);
 
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
 
     UpsamplePushConstants push_constants;
 
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.z_buffer_params = m_common_resources->z_buffer_params;
+    push_constants.g_buffer_mip    = m_g_buffer_mip;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1278,13 +1667,6 @@ void RayTracedShadows::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common_resources.h"
+#include "frame_graph.h"
 
 class GBuffer;
 
@@ -26,20 +27,30 @@ public:
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
+    dw::vk::DescriptorSet::Ptr reservoir_ds();
+    dw::vk::Image::Ptr         reservoir_image();
+    bool                       update_transient_images();
 
     inline uint32_t      width() { return m_width; }
     inline uint32_t      height() { return m_height; }
     inline RayTraceScale scale() { return m_scale; }
     inline OutputType    current_output() { return m_current_output; }
     inline void          set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline void          set_active(bool value) { m_active = value; }
+    inline bool          restir() { return m_restir.enabled; }
+    inline bool          restir_active() { return m_active && m_restir.enabled; }
 
 private:
     void create_images();
+    void create_transient_images();
     void create_buffers();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_pipelines();
     void clear_images(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void temporal_resampling(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void spatial_resampling(dw::vk::CommandBuffer::Ptr cmd_buf);
     void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
     void reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
     void temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
@@ -47,21 +58,56 @@ private:
     void upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
 
 private:
+    // Instead of the sun alone, every pixel picks one light out of the sun and the point lights through reservoir resampling and
+    // the ray trace tests that light. The reservoirs of the spatial pass are the history of the next frame, the deferred pass
+    // shades the light they picked.
+    struct ReSTIR
+    {
+        bool                         enabled         = false;
+        int32_t                      num_candidates  = 8;
+        int32_t                      max_history     = 20;
+        int32_t                      spatial_samples = 4;
+        float                        spatial_radius  = 16.0f;
+        Pipeline::Ptr                temporal_pipeline;
+        dw::vk::PipelineLayout::Ptr  temporal_pipeline_layout;
+        Pipeline::Ptr                spatial_pipeline;
+        dw::vk::PipelineLayout::Ptr  spatial_pipeline_layout;
+        dw::vk::Image::Ptr           temporal_image;
+        dw::vk::ImageView::Ptr       temporal_view;
+        dw::vk::DescriptorSet::Ptr   temporal_write_ds;
+        dw::vk::DescriptorSet::Ptr   temporal_read_ds;
+        dw::vk::Image::Ptr           image[2];
+        dw::vk::ImageView::Ptr       view[2];
+        dw::vk::DescriptorSet::Ptr   write_ds[2];
+        dw::vk::DescriptorSet::Ptr   read_ds[2];
+    };
+
     struct RayTrace
     {
-        float                        bias = 0.5f;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       view;
-        dw::vk::DescriptorSet::Ptr   write_ds;
-        dw::vk::DescriptorSet::Ptr   read_ds;
+        float                            bias             = 0.5f;
+        bool                             adaptive         = true;
+        int32_t                          stable_frames    = 4;
+        int32_t                          refresh_interval = 8;
+        Pipeline::Ptr                    pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+        dw::vk::Image::Ptr               image;
+        dw::vk::ImageView::Ptr           view;
+        dw::vk::DescriptorSet::Ptr       write_ds;
+        dw::vk::DescriptorSet::Ptr       read_ds;
+        dw::vk::Image::Ptr               tile_state_image;
+        dw::vk::ImageView::Ptr           tile_state_view;
+        dw::vk::Buffer::Ptr              tile_coords_buffer;
+        dw::vk::Buffer::Ptr              dispatch_args_buffer;
+        dw::vk::Buffer::Ptr              stable_tile_coords_buffer;
+        dw::vk::Buffer::Ptr              stable_dispatch_args_buffer;
+        dw::vk::DescriptorSetLayout::Ptr tiles_ds_layout;
+        dw::vk::DescriptorSet::Ptr       tiles_ds;
     };
 
     struct ResetArgs
     {
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
     };
 
     struct TemporalAccumulation
@@ -72,7 +118,7 @@ private:
         dw::vk::Buffer::Ptr              dispatch_args_buffer;
         dw::vk::Buffer::Ptr              uniform_tile_coords_buffer;
         dw::vk::Buffer::Ptr              uniform_dispatch_args_buffer;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        Pipeline::Ptr                    pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
         dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
@@ -91,7 +137,7 @@ private:
     struct CopyUniformTiles
     {
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
     };
 
     struct ATrous
@@ -103,7 +149,7 @@ private:
         int32_t                      filter_iterations  = 4;
         int32_t                      feedback_iteration = 1;
         int32_t                      read_idx           = 0;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::PipelineLayout::Ptr  pipeline_layout;
         dw::vk::Image::Ptr           image[2];
         dw::vk::ImageView::Ptr       view[2];
@@ -114,7 +160,7 @@ private:
     struct Upsample
     {
         dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        Pipeline::Ptr                pipeline;
         dw::vk::Image::Ptr           image;
         dw::vk::ImageView::Ptr       image_view;
         dw::vk::DescriptorSet::Ptr   read_ds;
@@ -129,12 +175,20 @@ private:
     uint32_t                       m_g_buffer_mip   = 0;
     uint32_t                       m_width;
     uint32_t                       m_height;
-    bool                           m_denoise     = true;
-    bool                           m_first_frame = true;
+    bool                           m_denoise          = true;
+    bool                           m_first_frame      = true;
+    bool                           m_active           = true;
+    bool                           m_last_denoise     = true;
+    bool                           m_last_restir      = false;
+    bool                           m_tiles_classified = false;
+    OutputType                     m_last_output      = OUTPUT_UPSAMPLE;
+    OutputType                     m_transient_output = OUTPUT_UPSAMPLE;
+    ReSTIR                         m_restir;
     RayTrace                       m_ray_trace;
     ResetArgs                      m_reset_args;
     TemporalAccumulation           m_temporal_accumulation;
     CopyUniformTiles            m_copy_uniform_tiles;
     ATrous                         m_a_trous;
     Upsample                       m_upsample;
+    FrameGraph                     m_frame_graph;
 };
\ No newline at end of file
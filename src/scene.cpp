@@ -0,0 +1,673 @@
+#include "scene.h"
+#include "utilities.h"
+#include <macros.h>
+#include <logger.h>
+#include <algorithm>
+#include <float.h>
+#include <stdexcept>
+#include <string.h>
+
+// Matches Material in scene_descriptor_set.glsl.
+struct GPUMaterial
+{
+    glm::ivec4 texture_indices0;
+    glm::ivec4 texture_indices1;
+    glm::vec4  albedo;
+    glm::vec4  emissive;
+    glm::vec4  roughness_metallic;
+};
+
+// Matches Instance in scene_descriptor_set.glsl, std430 pads it to the alignment of the matrix.
+struct GPUInstance
+{
+    glm::mat4 model_matrix;
+    uint32_t  mesh_idx;
+    uint32_t  padding[3];
+};
+
+static_assert(sizeof(Vertex) == sizeof(float) * 4 * 5, "Vertex doesn't match the Vertex layout of the shaders.");
+static_assert(sizeof(GPUMaterial) == 80, "GPUMaterial doesn't match the Material layout of the shaders.");
+static_assert(sizeof(GPUInstance) == 80, "GPUInstance doesn't match the Instance layout of the shaders.");
+
+static uint32_t g_last_material_id = 0;
+static uint32_t g_last_mesh_id     = 0;
+static uint32_t g_last_scene_id    = 0;
+
+// ALLOW_UPDATE lets TlasUpdater refit the TLAS when only the transforms changed.
+static const VkBuildAccelerationStructureFlagsKHR kTlasBuildFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Material::Ptr Material::create(const MaterialDesc& desc, const std::vector<dw::vk::Image::Ptr>& images, const std::vector<dw::vk::ImageView::Ptr>& image_views)
+{
+    return std::make_shared<Material>(desc, images, image_views);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Material::Material(const MaterialDesc& desc, const std::vector<dw::vk::Image::Ptr>& images, const std::vector<dw::vk::ImageView::Ptr>& image_views) :
+    m_id(g_last_material_id++), m_desc(desc), m_images(images), m_image_views(image_views)
+{
+    m_images.resize(MATERIAL_TEXTURE_COUNT);
+    m_image_views.resize(MATERIAL_TEXTURE_COUNT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Mesh::Ptr Mesh::create(dw::vk::Backend::Ptr backend, const MeshData& data, const std::vector<Material::Ptr>& materials)
+{
+    if (data.vertices.empty() || data.indices.empty())
+    {
+        DW_LOG_ERROR("(Mesh) " + data.path + " has no triangles.");
+        return nullptr;
+    }
+
+    return std::make_shared<Mesh>(backend, data, materials);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Mesh::Mesh(dw::vk::Backend::Ptr backend, const MeshData& data, const std::vector<Material::Ptr>& materials) :
+    m_id(g_last_mesh_id++), m_path(data.path), m_sub_meshes(data.sub_meshes), m_materials(materials), m_num_vertices(data.vertices.size()), m_num_indices(data.indices.size()), m_min_extents(data.min_extents), m_max_extents(data.max_extents)
+{
+    // Read by the rasterizer, the hit shaders and the acceleration structure builds.
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+
+    m_vertex_buffer = dw::vk::Buffer::create(backend, usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(Vertex) * data.vertices.size(), VMA_MEMORY_USAGE_GPU_ONLY, 0, (void*)data.vertices.data());
+    m_vertex_buffer->set_name(data.path + " Vertices");
+
+    m_index_buffer = dw::vk::Buffer::create(backend, usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t) * data.indices.size(), VMA_MEMORY_USAGE_GPU_ONLY, 0, (void*)data.indices.data());
+    m_index_buffer->set_name(data.path + " Indices");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Mesh::initialize_for_ray_tracing(dw::vk::Backend::Ptr backend, VkBuildAccelerationStructureFlagsKHR flags)
+{
+    const VkDeviceAddress vertex_address = buffer_device_address(backend->device(), m_vertex_buffer->handle());
+    const VkDeviceAddress index_address  = buffer_device_address(backend->device(), m_index_buffer->handle());
+
+    std::vector<VkAccelerationStructureGeometryKHR>       geometries(m_sub_meshes.size());
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> build_ranges(m_sub_meshes.size());
+    std::vector<uint32_t>                                 max_primitive_counts(m_sub_meshes.size());
+
+    for (uint32_t i = 0; i < m_sub_meshes.size(); i++)
+    {
+        VkAccelerationStructureGeometryKHR& geometry = geometries[i];
+        DW_ZERO_MEMORY(geometry);
+
+        geometry.sType                                       = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        geometry.geometryType                                = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+        geometry.flags                                       = VK_GEOMETRY_OPAQUE_BIT_KHR;
+        geometry.geometry.triangles.sType                    = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+        geometry.geometry.triangles.vertexFormat             = VK_FORMAT_R32G32B32_SFLOAT;
+        geometry.geometry.triangles.vertexData.deviceAddress = vertex_address;
+        geometry.geometry.triangles.vertexStride             = m_vertex_stride;
+        geometry.geometry.triangles.maxVertex                = m_num_vertices - 1;
+        geometry.geometry.triangles.indexType                = VK_INDEX_TYPE_UINT32;
+        geometry.geometry.triangles.indexData.deviceAddress  = index_address;
+
+        VkAccelerationStructureBuildRangeInfoKHR& build_range = build_ranges[i];
+        DW_ZERO_MEMORY(build_range);
+
+        build_range.primitiveCount  = m_sub_meshes[i].index_count / 3;
+        build_range.primitiveOffset = m_sub_meshes[i].base_index * sizeof(uint32_t);
+
+        max_primitive_counts[i] = build_range.primitiveCount;
+    }
+
+    VkAccelerationStructureBuildGeometryInfoKHR build_info;
+    DW_ZERO_MEMORY(build_info);
+
+    build_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    build_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    build_info.flags         = flags;
+    build_info.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    build_info.geometryCount = geometries.size();
+    build_info.pGeometries   = geometries.data();
+
+    VkAccelerationStructureBuildSizesInfoKHR build_sizes;
+    DW_ZERO_MEMORY(build_sizes);
+
+    build_sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+
+    vkGetAccelerationStructureBuildSizesKHR(backend->device(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &build_info, max_primitive_counts.data(), &build_sizes);
+
+    m_blas = AccelerationStructure::create(backend, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, build_sizes.accelerationStructureSize);
+
+    if (!m_blas)
+        return;
+
+    m_blas->set_name(m_path + " BLAS");
+
+    AccelerationStructure::ScratchBuffer scratch = AccelerationStructure::create_scratch_buffer(backend, build_sizes.buildScratchSize);
+
+    build_info.dstAccelerationStructure  = m_blas->handle();
+    build_info.scratchData.deviceAddress = scratch.device_address;
+
+    const VkAccelerationStructureBuildRangeInfoKHR* build_range_ptr = build_ranges.data();
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    vkCmdBuildAccelerationStructuresKHR(cmd_buf->handle(), 1, &build_info, &build_range_ptr);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    // Waits for the build, so the scratch buffer can go right after.
+    backend->flush_graphics({ cmd_buf });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Mesh::set_vertex_buffer(dw::vk::Buffer::Ptr buffer, uint32_t stride)
+{
+    m_vertex_buffer = buffer;
+    m_vertex_stride = stride;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Scene::Ptr Scene::create(dw::vk::Backend::Ptr backend, const std::vector<Instance>& instances)
+{
+    Scene::Ptr scene = std::make_shared<Scene>(backend, instances);
+
+    if (scene->m_meshes.empty())
+    {
+        DW_LOG_ERROR("(Scene) Scene has no meshes.");
+        return nullptr;
+    }
+
+    return scene;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Scene::Scene(dw::vk::Backend::Ptr backend, const std::vector<Instance>& instances) :
+    m_id(g_last_scene_id++), m_backend(backend), m_instances(instances)
+{
+    gather_resources();
+
+    if (m_meshes.empty())
+        return;
+
+    create_descriptor_sets();
+    create_tlas();
+    write_descriptor_sets();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Scene::~Scene()
+{
+    auto backend = m_backend.lock();
+
+    if (backend && m_ds_pool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(backend->device(), m_ds_pool, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::update_instances()
+{
+    auto backend = m_backend.lock();
+
+    const uint32_t frame_idx = backend->current_frame_idx();
+
+    GPUInstance*                        instances      = (GPUInstance*)m_instance_buffer[frame_idx]->mapped_ptr();
+    VkAccelerationStructureInstanceKHR* tlas_instances = (VkAccelerationStructureInstanceKHR*)m_tlas_instance_buffer[frame_idx]->mapped_ptr();
+
+    for (uint32_t i = 0; i < m_instances.size(); i++)
+    {
+        const glm::mat4& transform = m_instances[i].transform;
+        Mesh::Ptr        mesh      = m_instances[i].mesh.lock();
+
+        instances[i].model_matrix = transform;
+        instances[i].mesh_idx     = m_instance_mesh_indices[i];
+
+        VkAccelerationStructureInstanceKHR& tlas_instance = tlas_instances[i];
+        DW_ZERO_MEMORY(tlas_instance);
+
+        // VkTransformMatrixKHR is a row-major 3x4 matrix.
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 4; col++)
+                tlas_instance.transform.matrix[row][col] = transform[col][row];
+        }
+
+        // The hit shaders look the instance up in the Instance buffer with gl_InstanceCustomIndexEXT. Instances without an
+        // acceleration structure keep a null reference, which makes them inactive.
+        tlas_instance.instanceCustomIndex                    = i;
+        tlas_instance.mask                                   = 0xFF;
+        tlas_instance.instanceShaderBindingTableRecordOffset = 0;
+        tlas_instance.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+        tlas_instance.accelerationStructureReference         = (mesh && mesh->acceleration_structure()) ? mesh->acceleration_structure()->device_address() : 0;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::build_tlas(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    record_tlas_build(cmd_buf, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::update_tlas(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    record_tlas_build(cmd_buf, VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::record_tlas_build(dw::vk::CommandBuffer::Ptr cmd_buf, VkBuildAccelerationStructureModeKHR mode)
+{
+    auto backend = m_backend.lock();
+
+    VkAccelerationStructureGeometryKHR geometry;
+    DW_ZERO_MEMORY(geometry);
+
+    geometry.sType                                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    geometry.geometryType                          = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    geometry.geometry.instances.sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    geometry.geometry.instances.arrayOfPointers    = VK_FALSE;
+    geometry.geometry.instances.data.deviceAddress = buffer_device_address(backend->device(), m_tlas_instance_buffer[backend->current_frame_idx()]->handle());
+
+    VkAccelerationStructureBuildGeometryInfoKHR build_info;
+    DW_ZERO_MEMORY(build_info);
+
+    build_info.sType                     = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    build_info.type                      = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    build_info.flags                     = kTlasBuildFlags;
+    build_info.mode                      = mode;
+    build_info.srcAccelerationStructure  = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? m_tlas->handle() : VK_NULL_HANDLE;
+    build_info.dstAccelerationStructure  = m_tlas->handle();
+    build_info.geometryCount             = 1;
+    build_info.pGeometries               = &geometry;
+    build_info.scratchData.deviceAddress = m_tlas_scratch.device_address;
+
+    VkAccelerationStructureBuildRangeInfoKHR build_range;
+    DW_ZERO_MEMORY(build_range);
+
+    build_range.primitiveCount = m_instances.size();
+
+    const VkAccelerationStructureBuildRangeInfoKHR* build_range_ptr = &build_range;
+
+    // The previous frame may still be tracing rays against the TLAS, and the previous build used the same scratch memory.
+    pipeline_barrier(cmd_buf, { memory_barrier(VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR) }, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR);
+
+    vkCmdBuildAccelerationStructuresKHR(cmd_buf->handle(), 1, &build_info, &build_range_ptr);
+
+    pipeline_barrier(cmd_buf, { memory_barrier(VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR) }, {}, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int32_t Scene::material_index(uint32_t material_id)
+{
+    for (uint32_t i = 0; i < m_materials.size(); i++)
+    {
+        if (m_materials[i]->id() == material_id)
+            return i;
+    }
+
+    return -1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Collects the meshes, materials and textures the instances reference, in the order they are first used.
+void Scene::gather_resources()
+{
+    m_min_extents = glm::vec3(FLT_MAX);
+    m_max_extents = glm::vec3(-FLT_MAX);
+
+    m_instance_mesh_indices.resize(m_instances.size());
+
+    for (uint32_t i = 0; i < m_instances.size(); i++)
+    {
+        Mesh::Ptr mesh = m_instances[i].mesh.lock();
+
+        if (!mesh)
+        {
+            m_instance_mesh_indices[i] = 0;
+            continue;
+        }
+
+        auto it = std::find(m_meshes.begin(), m_meshes.end(), mesh);
+
+        m_instance_mesh_indices[i] = it - m_meshes.begin();
+
+        if (it == m_meshes.end())
+            m_meshes.push_back(mesh);
+
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 position = glm::vec3((corner & 1) ? mesh->max_extents().x : mesh->min_extents().x,
+                                           (corner & 2) ? mesh->max_extents().y : mesh->min_extents().y,
+                                           (corner & 4) ? mesh->max_extents().z : mesh->min_extents().z);
+
+            position = glm::vec3(m_instances[i].transform * glm::vec4(position, 1.0f));
+
+            m_min_extents = glm::min(m_min_extents, position);
+            m_max_extents = glm::max(m_max_extents, position);
+        }
+    }
+
+    if (m_meshes.size() > kMaxMeshes)
+    {
+        DW_LOG_ERROR("(Scene) Scene has more than " + std::to_string(kMaxMeshes) + " meshes, the rest won't be visible to the shaders.");
+        m_meshes.resize(kMaxMeshes);
+    }
+
+    for (auto& mesh : m_meshes)
+    {
+        for (uint32_t i = 0; i < mesh->num_materials(); i++)
+        {
+            Material::Ptr material = mesh->material(i);
+
+            if (std::find(m_materials.begin(), m_materials.end(), material) != m_materials.end())
+                continue;
+
+            m_materials.push_back(material);
+
+            for (uint32_t j = 0; j < MATERIAL_TEXTURE_COUNT; j++)
+            {
+                dw::vk::ImageView::Ptr image_view = material->image_view((MaterialTexture)j);
+
+                if (image_view && std::find(m_textures.begin(), m_textures.end(), image_view) == m_textures.end())
+                    m_textures.push_back(image_view);
+            }
+        }
+    }
+
+    if (m_textures.size() > kMaxTextures)
+    {
+        DW_LOG_ERROR("(Scene) Scene has more than " + std::to_string(kMaxTextures) + " textures, materials will fall back to their constant values.");
+        m_textures.resize(kMaxTextures);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    dw::vk::DescriptorSetLayout::Desc desc;
+
+    desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
+    desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
+    desc.add_binding(2, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_ALL);
+    desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kMaxMeshes, VK_SHADER_STAGE_ALL);
+    desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kMaxMeshes, VK_SHADER_STAGE_ALL);
+    desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kMaxMeshes, VK_SHADER_STAGE_ALL);
+    desc.add_binding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, kMaxTextures, VK_SHADER_STAGE_ALL);
+
+    m_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+    m_ds_layout->set_name("Scene DS Layout");
+
+    // The sets are far larger than what the shared pool of the backend is sized for.
+    VkDescriptorPoolSize pool_sizes[3];
+
+    pool_sizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = (2 + 3 * kMaxMeshes) * dw::vk::Backend::kMaxFramesInFlight;
+    pool_sizes[1].type            = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+    pool_sizes[1].descriptorCount = dw::vk::Backend::kMaxFramesInFlight;
+    pool_sizes[2].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[2].descriptorCount = kMaxTextures * dw::vk::Backend::kMaxFramesInFlight;
+
+    VkDescriptorPoolCreateInfo pool_info;
+    DW_ZERO_MEMORY(pool_info);
+
+    pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets       = dw::vk::Backend::kMaxFramesInFlight;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes    = pool_sizes;
+
+    if (vkCreateDescriptorPool(backend->device(), &pool_info, nullptr, &m_ds_pool) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(Scene) Failed to create descriptor pool.");
+        throw std::runtime_error("(Scene) Failed to create descriptor pool.");
+    }
+
+    VkDescriptorSetLayout layouts[dw::vk::Backend::kMaxFramesInFlight];
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        layouts[i] = m_ds_layout->handle();
+
+    VkDescriptorSetAllocateInfo alloc_info;
+    DW_ZERO_MEMORY(alloc_info);
+
+    alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool     = m_ds_pool;
+    alloc_info.descriptorSetCount = dw::vk::Backend::kMaxFramesInFlight;
+    alloc_info.pSetLayouts        = layouts;
+
+    if (vkAllocateDescriptorSets(backend->device(), &alloc_info, m_ds) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(Scene) Failed to allocate descriptor sets.");
+        throw std::runtime_error("(Scene) Failed to allocate descriptor sets.");
+    }
+
+    std::vector<GPUMaterial> materials(m_materials.size());
+
+    for (uint32_t i = 0; i < m_materials.size(); i++)
+    {
+        const MaterialDesc& material_desc = m_materials[i]->desc();
+        int32_t             texture_indices[MATERIAL_TEXTURE_COUNT];
+
+        for (uint32_t j = 0; j < MATERIAL_TEXTURE_COUNT; j++)
+        {
+            auto it = std::find(m_textures.begin(), m_textures.end(), m_materials[i]->image_view((MaterialTexture)j));
+
+            texture_indices[j] = (m_materials[i]->image_view((MaterialTexture)j) && it != m_textures.end()) ? int32_t(it - m_textures.begin()) : -1;
+        }
+
+        materials[i].texture_indices0   = glm::ivec4(texture_indices[MATERIAL_TEXTURE_ALBEDO], texture_indices[MATERIAL_TEXTURE_NORMAL], texture_indices[MATERIAL_TEXTURE_ROUGHNESS], texture_indices[MATERIAL_TEXTURE_METALLIC]);
+        materials[i].texture_indices1   = glm::ivec4(texture_indices[MATERIAL_TEXTURE_EMISSIVE], 0, material_desc.roughness_channel, material_desc.metallic_channel);
+        materials[i].albedo             = material_desc.albedo;
+        materials[i].emissive           = material_desc.emissive;
+        materials[i].roughness_metallic = glm::vec4(material_desc.roughness, material_desc.metallic, 0.0f, 0.0f);
+    }
+
+    if (materials.empty())
+        materials.resize(1);
+
+    m_material_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(GPUMaterial) * materials.size(), VMA_MEMORY_USAGE_GPU_ONLY, 0, materials.data());
+    m_material_buffer->set_name("Scene Materials");
+
+    m_submesh_info_buffers.resize(m_meshes.size());
+
+    for (uint32_t i = 0; i < m_meshes.size(); i++)
+    {
+        const auto& sub_meshes = m_meshes[i]->sub_meshes();
+
+        std::vector<glm::uvec2> submesh_info(std::max(size_t(1), sub_meshes.size()), glm::uvec2(0));
+
+        for (uint32_t j = 0; j < sub_meshes.size(); j++)
+            submesh_info[j] = glm::uvec2(sub_meshes[j].base_index / 3, std::max(0, material_index(m_meshes[i]->material(sub_meshes[j].mat_idx)->id())));
+
+        m_submesh_info_buffers[i] = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(glm::uvec2) * submesh_info.size(), VMA_MEMORY_USAGE_GPU_ONLY, 0, submesh_info.data());
+        m_submesh_info_buffers[i]->set_name(m_meshes[i]->path() + " Submesh Info");
+    }
+
+    const size_t num_instances = std::max(size_t(1), m_instances.size());
+
+    for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        m_instance_buffer[i] = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GPUInstance) * num_instances, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_instance_buffer[i]->set_name("Scene Instances " + std::to_string(i));
+
+        m_tlas_instance_buffer[i] = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, sizeof(VkAccelerationStructureInstanceKHR) * num_instances, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_tlas_instance_buffer[i]->set_name("Scene TLAS Instances " + std::to_string(i));
+    }
+
+    // Every element of the texture array has to be valid, scenes without any textures point them all to a blank one.
+    if (m_textures.empty())
+    {
+        uint8_t white[4] = { 255, 255, 255, 255 };
+
+        m_default_image      = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, 1, 1, 1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_UNDEFINED, sizeof(white), white);
+        m_default_image_view = dw::vk::ImageView::create(backend, m_default_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::create_tlas()
+{
+    auto backend = m_backend.lock();
+
+    VkAccelerationStructureGeometryKHR geometry;
+    DW_ZERO_MEMORY(geometry);
+
+    geometry.sType                              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    geometry.geometryType                       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    geometry.geometry.instances.sType           = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+
+    VkAccelerationStructureBuildGeometryInfoKHR build_info;
+    DW_ZERO_MEMORY(build_info);
+
+    build_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    build_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    build_info.flags         = kTlasBuildFlags;
+    build_info.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    build_info.geometryCount = 1;
+    build_info.pGeometries   = &geometry;
+
+    const uint32_t max_instances = m_instances.size();
+
+    VkAccelerationStructureBuildSizesInfoKHR build_sizes;
+    DW_ZERO_MEMORY(build_sizes);
+
+    build_sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+
+    vkGetAccelerationStructureBuildSizesKHR(backend->device(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &build_info, &max_instances, &build_sizes);
+
+    m_tlas = AccelerationStructure::create(backend, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, build_sizes.accelerationStructureSize);
+
+    if (!m_tlas)
+    {
+        DW_LOG_ERROR("(Scene) Failed to create TLAS.");
+        throw std::runtime_error("(Scene) Failed to create TLAS.");
+    }
+
+    m_tlas->set_name("Scene TLAS");
+
+    // Builds and in-place updates share the scratch memory.
+    m_tlas_scratch = AccelerationStructure::create_scratch_buffer(backend, std::max(build_sizes.buildScratchSize, build_sizes.updateScratchSize));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Scene::write_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Every element of the arrays has to be valid, the ones past the last mesh or texture point to the first one. Built with
+    // COMPACT_VERTICES the vertex buffers hold CompactVertex, which no shader reads through Vertices.
+    std::vector<VkDescriptorBufferInfo> vertex_buffer_infos(kMaxMeshes);
+    std::vector<VkDescriptorBufferInfo> index_buffer_infos(kMaxMeshes);
+    std::vector<VkDescriptorBufferInfo> submesh_info_buffer_infos(kMaxMeshes);
+    std::vector<VkDescriptorImageInfo>  image_infos(kMaxTextures);
+
+    for (uint32_t i = 0; i < kMaxMeshes; i++)
+    {
+        const uint32_t mesh_idx = i < m_meshes.size() ? i : 0;
+
+        vertex_buffer_infos[i].buffer = m_meshes[mesh_idx]->vertex_buffer()->handle();
+        vertex_buffer_infos[i].offset = 0;
+        vertex_buffer_infos[i].range  = VK_WHOLE_SIZE;
+
+        index_buffer_infos[i].buffer = m_meshes[mesh_idx]->index_buffer()->handle();
+        index_buffer_infos[i].offset = 0;
+        index_buffer_infos[i].range  = VK_WHOLE_SIZE;
+
+        submesh_info_buffer_infos[i].buffer = m_submesh_info_buffers[mesh_idx]->handle();
+        submesh_info_buffer_infos[i].offset = 0;
+        submesh_info_buffer_infos[i].range  = VK_WHOLE_SIZE;
+    }
+
+    for (uint32_t i = 0; i < kMaxTextures; i++)
+    {
+        dw::vk::ImageView::Ptr image_view = m_textures.empty() ? m_default_image_view : m_textures[i < m_textures.size() ? i : 0];
+
+        image_infos[i].sampler     = backend->trilinear_sampler()->handle();
+        image_infos[i].imageView   = image_view->handle();
+        image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkDescriptorBufferInfo material_buffer_info;
+
+    material_buffer_info.buffer = m_material_buffer->handle();
+    material_buffer_info.offset = 0;
+    material_buffer_info.range  = VK_WHOLE_SIZE;
+
+    VkAccelerationStructureKHR tlas_handle = m_tlas->handle();
+
+    for (uint32_t frame_idx = 0; frame_idx < dw::vk::Backend::kMaxFramesInFlight; frame_idx++)
+    {
+        VkDescriptorBufferInfo instance_buffer_info;
+
+        instance_buffer_info.buffer = m_instance_buffer[frame_idx]->handle();
+        instance_buffer_info.offset = 0;
+        instance_buffer_info.range  = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSetAccelerationStructureKHR tlas_info;
+        DW_ZERO_MEMORY(tlas_info);
+
+        tlas_info.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+        tlas_info.accelerationStructureCount = 1;
+        tlas_info.pAccelerationStructures    = &tlas_handle;
+
+        VkWriteDescriptorSet write_data[7];
+        DW_ZERO_MEMORY(write_data[0]);
+        DW_ZERO_MEMORY(write_data[1]);
+        DW_ZERO_MEMORY(write_data[2]);
+        DW_ZERO_MEMORY(write_data[3]);
+        DW_ZERO_MEMORY(write_data[4]);
+        DW_ZERO_MEMORY(write_data[5]);
+        DW_ZERO_MEMORY(write_data[6]);
+
+        for (uint32_t i = 0; i < 7; i++)
+        {
+            write_data[i].sType      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i].dstBinding = i;
+            write_data[i].dstSet     = m_ds[frame_idx];
+        }
+
+        write_data[0].descriptorCount = 1;
+        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data[0].pBufferInfo     = &material_buffer_info;
+
+        write_data[1].descriptorCount = 1;
+        write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data[1].pBufferInfo     = &instance_buffer_info;
+
+        write_data[2].pNext           = &tlas_info;
+        write_data[2].descriptorCount = 1;
+        write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+        write_data[3].descriptorCount = kMaxMeshes;
+        write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data[3].pBufferInfo     = vertex_buffer_infos.data();
+
+        write_data[4].descriptorCount = kMaxMeshes;
+        write_data[4].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data[4].pBufferInfo     = index_buffer_infos.data();
+
+        write_data[5].descriptorCount = kMaxMeshes;
+        write_data[5].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data[5].pBufferInfo     = submesh_info_buffer_infos.data();
+
+        write_data[6].descriptorCount = kMaxTextures;
+        write_data[6].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data[6].pImageInfo      = image_infos.data();
+
+        vkUpdateDescriptorSets(backend->device(), 7, &write_data[0], 0, nullptr);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <vk.h>
+#include <glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "acceleration_structure.h"
+
+// Meshes, materials and scenes as the shaders see them through scene_descriptor_set.glsl. MeshLoader fills a MeshData from the
+// source file and turns it into a Mesh, the scene then gathers the meshes, materials and textures of its instances into the
+// descriptor set bound as set 0:
+//
+//   Mesh::Ptr sponza = m_mesh_loader->load("mesh/sponza.obj");
+//
+//   Scene::Instance instance;
+//
+//   instance.mesh      = sponza;
+//   instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
+//
+//   Scene::Ptr scene = Scene::create(backend, { instance });
+
+// Matches Vertex in scene_descriptor_set.glsl, the vertex buffers are read by the hit shaders as they are.
+struct Vertex
+{
+    glm::vec4 position;
+    glm::vec4 tex_coord;
+    glm::vec4 normal;
+    glm::vec4 tangent;
+    glm::vec4 bitangent;
+};
+
+// In the order of texture_indices0/1 in scene_descriptor_set.glsl.
+enum MaterialTexture
+{
+    MATERIAL_TEXTURE_ALBEDO,
+    MATERIAL_TEXTURE_NORMAL,
+    MATERIAL_TEXTURE_ROUGHNESS,
+    MATERIAL_TEXTURE_METALLIC,
+    MATERIAL_TEXTURE_EMISSIVE,
+    MATERIAL_TEXTURE_COUNT
+};
+
+// Textures are referenced by path, an empty path falls back to the constant value.
+struct MaterialDesc
+{
+    std::string name;
+    std::string textures[MATERIAL_TEXTURE_COUNT];
+    int32_t     roughness_channel = 0;
+    int32_t     metallic_channel  = 0;
+    float       roughness         = 1.0f;
+    float       metallic          = 0.0f;
+    glm::vec4   albedo            = glm::vec4(1.0f);
+    glm::vec4   emissive          = glm::vec4(0.0f);
+};
+
+// Indices are absolute, fetch_triangle() doesn't add a base vertex.
+struct SubMesh
+{
+    uint32_t  mat_idx;
+    uint32_t  index_count;
+    uint32_t  base_index;
+    glm::vec3 min_extents;
+    glm::vec3 max_extents;
+};
+
+// Everything a mesh is made from, without any Vulkan objects. Filled on the CPU only, so it can be read on any thread.
+struct MeshData
+{
+    std::string               path;
+    std::vector<Vertex>       vertices;
+    std::vector<uint32_t>     indices;
+    std::vector<SubMesh>      sub_meshes;
+    std::vector<MaterialDesc> materials;
+    glm::vec3                 min_extents = glm::vec3(0.0f);
+    glm::vec3                 max_extents = glm::vec3(0.0f);
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+class Material
+{
+public:
+    using Ptr = std::shared_ptr<Material>;
+
+    // Textures that aren't used by the material are left empty.
+    static Material::Ptr create(const MaterialDesc& desc, const std::vector<dw::vk::Image::Ptr>& images, const std::vector<dw::vk::ImageView::Ptr>& image_views);
+
+    Material(const MaterialDesc& desc, const std::vector<dw::vk::Image::Ptr>& images, const std::vector<dw::vk::ImageView::Ptr>& image_views);
+
+    inline uint32_t               id() { return m_id; }
+    inline const MaterialDesc&    desc() { return m_desc; }
+    inline dw::vk::ImageView::Ptr image_view(MaterialTexture texture) { return m_image_views[texture]; }
+
+private:
+    uint32_t                            m_id;
+    MaterialDesc                        m_desc;
+    std::vector<dw::vk::Image::Ptr>     m_images;
+    std::vector<dw::vk::ImageView::Ptr> m_image_views;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+class Mesh
+{
+public:
+    using Ptr = std::shared_ptr<Mesh>;
+
+public:
+    static Mesh::Ptr create(dw::vk::Backend::Ptr backend, const MeshData& data, const std::vector<Material::Ptr>& materials);
+
+    Mesh(dw::vk::Backend::Ptr backend, const MeshData& data, const std::vector<Material::Ptr>& materials);
+
+    // Builds the bottom level acceleration structure with one geometry per submesh, so that gl_GeometryIndexEXT indexes
+    // SubmeshInfo. Waits for the build to finish. BlasCache adds ALLOW_COMPACTION to the flags.
+    void initialize_for_ray_tracing(dw::vk::Backend::Ptr backend, VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+    // Replaces the vertex buffer and releases the previous one, before the mesh is rendered or its acceleration structure is
+    // built. The new vertices have to start with a float3 position, see CompactVertices.
+    void set_vertex_buffer(dw::vk::Buffer::Ptr buffer, uint32_t stride);
+
+    inline uint32_t                    id() { return m_id; }
+    inline const std::string&          path() { return m_path; }
+    inline const std::vector<SubMesh>& sub_meshes() { return m_sub_meshes; }
+    inline uint32_t                    num_materials() { return m_materials.size(); }
+    inline Material::Ptr               material(uint32_t idx) { return m_materials[idx]; }
+    inline dw::vk::Buffer::Ptr         vertex_buffer() { return m_vertex_buffer; }
+    inline uint32_t                    vertex_stride() { return m_vertex_stride; }
+    inline dw::vk::Buffer::Ptr         index_buffer() { return m_index_buffer; }
+    inline uint32_t                    num_vertices() { return m_num_vertices; }
+    inline uint32_t                    num_indices() { return m_num_indices; }
+    inline glm::vec3                   min_extents() { return m_min_extents; }
+    inline glm::vec3                   max_extents() { return m_max_extents; }
+    inline AccelerationStructure::Ptr  acceleration_structure() { return m_blas; }
+    inline void                        set_acceleration_structure(AccelerationStructure::Ptr blas) { m_blas = blas; }
+
+private:
+    uint32_t                   m_id;
+    std::string                m_path;
+    std::vector<SubMesh>       m_sub_meshes;
+    std::vector<Material::Ptr> m_materials;
+    dw::vk::Buffer::Ptr        m_vertex_buffer;
+    dw::vk::Buffer::Ptr        m_index_buffer;
+    uint32_t                   m_vertex_stride = sizeof(Vertex);
+    uint32_t                   m_num_vertices;
+    uint32_t                   m_num_indices;
+    glm::vec3                  m_min_extents;
+    glm::vec3                  m_max_extents;
+    AccelerationStructure::Ptr m_blas;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The descriptor set layout is the same for every scene, so pipelines created with the layout of one scene can bind the set of
+// any other. Each frame in flight has its own set, whose Instance buffer update_instances() writes at the start of the frame.
+class Scene
+{
+public:
+    using Ptr = std::shared_ptr<Scene>;
+
+    struct Instance
+    {
+        std::weak_ptr<Mesh> mesh;
+        glm::mat4           transform = glm::mat4(1.0f);
+    };
+
+    static const uint32_t kMaxMeshes   = 1024;
+    static const uint32_t kMaxTextures = 1024;
+
+public:
+    static Scene::Ptr create(dw::vk::Backend::Ptr backend, const std::vector<Instance>& instances);
+
+    Scene(dw::vk::Backend::Ptr backend, const std::vector<Instance>& instances);
+    ~Scene();
+
+    // Copies the current transforms into the Instance buffer and the TLAS instances of the current frame.
+    void update_instances();
+    void build_tlas(dw::vk::CommandBuffer::Ptr cmd_buf);
+    // Refits the TLAS in place to the current transforms. Only valid after build_tlas() and as long as the instances reference
+    // the same meshes, see TlasUpdater.
+    void update_tlas(dw::vk::CommandBuffer::Ptr cmd_buf);
+    // Scene-wide index of a material, as stored in SubmeshInfo.
+    int32_t material_index(uint32_t material_id);
+
+    inline uint32_t                         id() { return m_id; }
+    inline std::vector<Instance>&           instances() { return m_instances; }
+    inline glm::vec3                        min_extents() { return m_min_extents; }
+    inline glm::vec3                        max_extents() { return m_max_extents; }
+    inline AccelerationStructure::Ptr       acceleration_structure() { return m_tlas; }
+    inline dw::vk::DescriptorSetLayout::Ptr descriptor_set_layout() { return m_ds_layout; }
+    inline VkDescriptorSet                  descriptor_set() { return m_ds[m_backend.lock()->current_frame_idx()]; }
+
+private:
+    void gather_resources();
+    void create_descriptor_sets();
+    void create_tlas();
+    void record_tlas_build(dw::vk::CommandBuffer::Ptr cmd_buf, VkBuildAccelerationStructureModeKHR mode);
+    void write_descriptor_sets();
+
+private:
+    uint32_t                                 m_id;
+    std::weak_ptr<dw::vk::Backend>           m_backend;
+    std::vector<Instance>                    m_instances;
+    std::vector<uint32_t>                    m_instance_mesh_indices;
+    std::vector<Mesh::Ptr>                   m_meshes;
+    std::vector<Material::Ptr>               m_materials;
+    std::vector<dw::vk::ImageView::Ptr>      m_textures;
+    glm::vec3                                m_min_extents;
+    glm::vec3                                m_max_extents;
+    dw::vk::Image::Ptr                       m_default_image;
+    dw::vk::ImageView::Ptr                   m_default_image_view;
+    dw::vk::Buffer::Ptr                      m_material_buffer;
+    std::vector<dw::vk::Buffer::Ptr>         m_submesh_info_buffers;
+    dw::vk::Buffer::Ptr                      m_instance_buffer[dw::vk::Backend::kMaxFramesInFlight];
+    dw::vk::Buffer::Ptr                      m_tlas_instance_buffer[dw::vk::Backend::kMaxFramesInFlight];
+    AccelerationStructure::Ptr               m_tlas;
+    AccelerationStructure::ScratchBuffer     m_tlas_scratch;
+    dw::vk::DescriptorSetLayout::Ptr         m_ds_layout;
+    VkDescriptorPool                         m_ds_pool = VK_NULL_HANDLE;
+    VkDescriptorSet                          m_ds[dw::vk::Backend::kMaxFramesInFlight];
+};
@@ -0,0 +1,490 @@
+#include "scene_cache.h"
+#include "mesh_loader.h"
+#include <logger.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+static const uint32_t kCookedMeshMagic   = 0x534D5248; // "HRMS"
+static const uint32_t kCookedMeshVersion = 3;
+static const uint32_t kMaxPathLength     = 256;
+
+// hash covers the contents of the source files and is the key of the cooked file.
+struct CookedMeshHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t num_vertices;
+    uint32_t num_indices;
+    uint32_t num_sub_meshes;
+    uint32_t num_materials;
+    float    min_extents[3];
+    float    max_extents[3];
+};
+
+struct CookedSubMesh
+{
+    uint32_t mat_idx;
+    uint32_t index_count;
+    uint32_t base_index;
+    float    min_extents[3];
+    float    max_extents[3];
+};
+
+// Textures are referenced by path in the order of MaterialTexture.
+struct CookedMaterial
+{
+    char      name[kMaxPathLength];
+    char      textures[MATERIAL_TEXTURE_COUNT][kMaxPathLength];
+    int32_t   roughness_channel;
+    int32_t   metallic_channel;
+    float     roughness;
+    float     metallic;
+    glm::vec4 albedo;
+    glm::vec4 emissive;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Read-only view of a whole file, the pages are only read in once they are touched.
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path)
+    {
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+        if (m_file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+            return;
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (!m_mapping)
+            return;
+
+        m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        m_size = m_data ? size_t(size.QuadPart) : 0;
+#else
+        m_file = open(path.c_str(), O_RDONLY);
+
+        if (m_file == -1)
+            return;
+
+        struct stat file_stat;
+
+        if (fstat(m_file, &file_stat) != 0 || file_stat.st_size == 0)
+            return;
+
+        void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+
+        if (data == MAP_FAILED)
+            return;
+
+        m_data = data;
+        m_size = file_stat.st_size;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (m_data)
+            UnmapViewOfFile(m_data);
+
+        if (m_mapping)
+            CloseHandle(m_mapping);
+
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_data)
+            munmap(m_data, m_size);
+
+        if (m_file != -1)
+            close(m_file);
+#endif
+    }
+
+    inline const uint8_t* data() { return (const uint8_t*)m_data; }
+    inline size_t         size() { return m_size; }
+    inline bool           valid() { return m_data != nullptr; }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_file    = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    void*  m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The source file and the file holding the rest of its data (the material library of an OBJ, the buffer of a glTF) if it shares
+// the base name of the source.
+static std::vector<std::string> source_files(const std::string& path)
+{
+    std::string base_path = path.substr(0, path.find_last_of('.'));
+
+    return { path, base_path + ".mtl", base_path + ".bin" };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Reads every byte of the source files, a plain read of the mapped files which is still far cheaper than importing them.
+static uint64_t source_hash(const std::string& path)
+{
+    uint64_t hash = fnv1a(&kCookedMeshVersion, sizeof(kCookedMeshVersion));
+
+    for (const auto& file : source_files(path))
+    {
+        MappedFile mapped(file);
+
+        if (mapped.valid())
+            hash = fnv1a(mapped.data(), mapped.size(), hash);
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void copy_string(char* dst, const std::string& src)
+{
+    strncpy(dst, src.c_str(), kMaxPathLength - 1);
+    dst[kMaxPathLength - 1] = '\0';
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SceneCache::SceneCache(MeshLoader* mesh_loader, bool enabled) :
+    m_mesh_loader(mesh_loader), m_enabled(enabled)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SceneCache::~SceneCache()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneCache::read(const std::string& path, MeshData& data)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    bool cooked = false;
+
+    if (!m_enabled)
+    {
+        if (!m_mesh_loader->read(path, data))
+            return false;
+    }
+    else
+    {
+        const std::string cooked_path = path + ".hrmesh";
+        const uint64_t    content_hash = source_hash(path);
+
+        cooked = read_cooked(cooked_path, content_hash, data);
+
+        if (!cooked)
+        {
+            if (!m_mesh_loader->read(path, data))
+                return false;
+
+            if (!write_cooked(cooked_path, content_hash, data))
+                DW_LOG_ERROR("(SceneCache) Failed to write " + cooked_path);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (cooked)
+            m_stats.hits++;
+        else
+            m_stats.misses++;
+
+        m_hashes[path] = content_hash;
+    }
+
+    double load_ms = elapsed_ms(begin);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.load_time_ms += load_ms;
+    }
+
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "(SceneCache) Read %s in %.1f ms (%s).", path.c_str(), load_ms, cooked ? "cooked" : "source");
+    DW_LOG_INFO(buffer);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Also used as the key of the acceleration structures built for the mesh. Meshes read through the cache already know it, it's
+// only computed here if the cache is disabled.
+uint64_t SceneCache::hash(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_hashes.find(path);
+
+        if (it != m_hashes.end())
+            return it->second;
+    }
+
+    uint64_t value = source_hash(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_hashes[path] = value;
+
+    return value;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SceneCache::Stats SceneCache::stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Only times reading the mesh data, creating the buffers and textures costs the same either way.
+void SceneCache::benchmark(const std::vector<std::string>& paths, uint32_t iterations)
+{
+    for (const auto& path : paths)
+    {
+        const std::string cooked_path = path + ".hrmesh";
+
+        MeshData data;
+
+        // Makes sure the cooked file is up to date before timing it.
+        if (!read(path, data))
+        {
+            DW_LOG_ERROR("(SceneCache) Failed to cook " + path);
+            continue;
+        }
+
+        double source_ms = 0.0;
+        double cooked_ms = 0.0;
+
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            auto begin = std::chrono::high_resolution_clock::now();
+            m_mesh_loader->read(path, data);
+            source_ms += elapsed_ms(begin);
+
+            begin = std::chrono::high_resolution_clock::now();
+            read_cooked(cooked_path, source_hash(path), data);
+            cooked_ms += elapsed_ms(begin);
+        }
+
+        source_ms /= iterations;
+        cooked_ms /= iterations;
+
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer), "(SceneCache) %s: %.1f ms from source, %.1f ms cooked, %.1fx faster.", path.c_str(), source_ms, cooked_ms, source_ms / std::max(cooked_ms, 0.001));
+        DW_LOG_INFO(buffer);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneCache::read_cooked(const std::string& path, uint64_t hash, MeshData& data)
+{
+    MappedFile file(path);
+
+    if (!file.valid() || file.size() < sizeof(CookedMeshHeader))
+        return false;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data();
+
+    if (header->magic != kCookedMeshMagic || header->version != kCookedMeshVersion)
+        return false;
+
+    if (header->hash != hash)
+    {
+        DW_LOG_INFO("(SceneCache) Source of " + path + " changed, cooking it again.");
+        return false;
+    }
+
+    const size_t vertices_size   = sizeof(Vertex) * header->num_vertices;
+    const size_t indices_size    = sizeof(uint32_t) * header->num_indices;
+    const size_t sub_meshes_size = sizeof(CookedSubMesh) * header->num_sub_meshes;
+    const size_t materials_size  = sizeof(CookedMaterial) * header->num_materials;
+
+    if (file.size() != sizeof(CookedMeshHeader) + vertices_size + indices_size + sub_meshes_size + materials_size)
+    {
+        DW_LOG_ERROR("(SceneCache) Truncated cooked mesh: " + path);
+        return false;
+    }
+
+    const uint8_t*        ptr              = file.data() + sizeof(CookedMeshHeader);
+    const Vertex*         cooked_vertices  = (const Vertex*)ptr;
+    const uint32_t*       cooked_indices   = (const uint32_t*)(ptr + vertices_size);
+    const CookedSubMesh*  cooked_sub_mesh  = (const CookedSubMesh*)(ptr + vertices_size + indices_size);
+    const CookedMaterial* cooked_materials = (const CookedMaterial*)(ptr + vertices_size + indices_size + sub_meshes_size);
+
+    data = MeshData();
+
+    data.path        = path.substr(0, path.size() - strlen(".hrmesh"));
+    data.min_extents = glm::vec3(header->min_extents[0], header->min_extents[1], header->min_extents[2]);
+    data.max_extents = glm::vec3(header->max_extents[0], header->max_extents[1], header->max_extents[2]);
+
+    data.vertices.assign(cooked_vertices, cooked_vertices + header->num_vertices);
+    data.indices.assign(cooked_indices, cooked_indices + header->num_indices);
+    data.sub_meshes.resize(header->num_sub_meshes);
+    data.materials.resize(header->num_materials);
+
+    for (uint32_t i = 0; i < header->num_sub_meshes; i++)
+    {
+        data.sub_meshes[i].mat_idx     = cooked_sub_mesh[i].mat_idx;
+        data.sub_meshes[i].index_count = cooked_sub_mesh[i].index_count;
+        data.sub_meshes[i].base_index  = cooked_sub_mesh[i].base_index;
+        data.sub_meshes[i].min_extents = glm::vec3(cooked_sub_mesh[i].min_extents[0], cooked_sub_mesh[i].min_extents[1], cooked_sub_mesh[i].min_extents[2]);
+        data.sub_meshes[i].max_extents = glm::vec3(cooked_sub_mesh[i].max_extents[0], cooked_sub_mesh[i].max_extents[1], cooked_sub_mesh[i].max_extents[2]);
+    }
+
+    for (uint32_t i = 0; i < header->num_materials; i++)
+    {
+        const CookedMaterial& cooked = cooked_materials[i];
+        MaterialDesc&         desc   = data.materials[i];
+
+        desc.name = cooked.name;
+
+        for (uint32_t j = 0; j < MATERIAL_TEXTURE_COUNT; j++)
+            desc.textures[j] = cooked.textures[j];
+
+        desc.roughness_channel = cooked.roughness_channel;
+        desc.metallic_channel  = cooked.metallic_channel;
+        desc.roughness         = cooked.roughness;
+        desc.metallic          = cooked.metallic;
+        desc.albedo            = cooked.albedo;
+        desc.emissive          = cooked.emissive;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneCache::write_cooked(const std::string& path, uint64_t hash, const MeshData& data)
+{
+    CookedMeshHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic          = kCookedMeshMagic;
+    header.version        = kCookedMeshVersion;
+    header.hash           = hash;
+    header.num_vertices   = data.vertices.size();
+    header.num_indices    = data.indices.size();
+    header.num_sub_meshes = data.sub_meshes.size();
+    header.num_materials  = data.materials.size();
+
+    for (int i = 0; i < 3; i++)
+    {
+        header.min_extents[i] = data.min_extents[i];
+        header.max_extents[i] = data.max_extents[i];
+    }
+
+    std::vector<CookedSubMesh> cooked_sub_meshes(data.sub_meshes.size());
+
+    for (uint32_t i = 0; i < data.sub_meshes.size(); i++)
+    {
+        cooked_sub_meshes[i].mat_idx     = data.sub_meshes[i].mat_idx;
+        cooked_sub_meshes[i].index_count = data.sub_meshes[i].index_count;
+        cooked_sub_meshes[i].base_index  = data.sub_meshes[i].base_index;
+
+        for (int j = 0; j < 3; j++)
+        {
+            cooked_sub_meshes[i].min_extents[j] = data.sub_meshes[i].min_extents[j];
+            cooked_sub_meshes[i].max_extents[j] = data.sub_meshes[i].max_extents[j];
+        }
+    }
+
+    std::vector<CookedMaterial> cooked_materials(data.materials.size());
+
+    for (uint32_t i = 0; i < data.materials.size(); i++)
+    {
+        CookedMaterial&     cooked = cooked_materials[i];
+        const MaterialDesc& desc   = data.materials[i];
+
+        memset(&cooked, 0, sizeof(cooked));
+
+        copy_string(cooked.name, desc.name);
+
+        for (uint32_t j = 0; j < MATERIAL_TEXTURE_COUNT; j++)
+            copy_string(cooked.textures[j], desc.textures[j]);
+
+        cooked.roughness_channel = desc.roughness_channel;
+        cooked.metallic_channel  = desc.metallic_channel;
+        cooked.roughness         = desc.roughness;
+        cooked.metallic          = desc.metallic;
+        cooked.albedo            = desc.albedo;
+        cooked.emissive          = desc.emissive;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)data.vertices.data(), sizeof(Vertex) * data.vertices.size());
+    file.write((const char*)data.indices.data(), sizeof(uint32_t) * data.indices.size());
+    file.write((const char*)cooked_sub_meshes.data(), sizeof(CookedSubMesh) * cooked_sub_meshes.size());
+    file.write((const char*)cooked_materials.data(), sizeof(CookedMaterial) * cooked_materials.size());
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "scene.h"
+
+class MeshLoader;
+
+// Cooks meshes into a binary file next to their source (mesh/sponza.obj -> mesh/sponza.obj.hrmesh) the first time they are
+// imported through the mesh loader. Later runs map the cooked file instead of importing the source:
+//
+//   MeshData data;
+//   m_scene_cache->read("mesh/sponza.obj", data);
+//
+// The cooked file stores the vertices and indices in the layout scene_descriptor_set.glsl reads them in, the submeshes (base
+// index and material index, which end up in SubmeshInfo) and the material table. It is keyed by the content hash of the source
+// file and the files it references, so a source that changes without its size or modification time changing is still cooked
+// again. Hashing reads the source once but doesn't parse it. The same hash keys the acceleration structures built for the mesh.
+//
+// read() can run on several threads at once, benchmark() belongs to the thread that owns the cache.
+class SceneCache
+{
+public:
+    struct Stats
+    {
+        uint32_t hits         = 0;
+        uint32_t misses       = 0;
+        double   load_time_ms = 0.0;
+    };
+
+public:
+    SceneCache(MeshLoader* mesh_loader, bool enabled = true);
+    ~SceneCache();
+
+    bool     read(const std::string& path, MeshData& data);
+    uint64_t hash(const std::string& path);
+    void     benchmark(const std::vector<std::string>& paths, uint32_t iterations);
+    Stats    stats();
+
+private:
+    bool read_cooked(const std::string& path, uint64_t hash, MeshData& data);
+    bool write_cooked(const std::string& path, uint64_t hash, const MeshData& data);
+
+private:
+    MeshLoader*                               m_mesh_loader;
+    bool                                      m_enabled;
+    std::mutex                                m_mutex;
+    Stats                                     m_stats;
+    std::unordered_map<std::string, uint64_t> m_hashes;
+};
@@ -0,0 +1,103 @@
+#ifndef COMPACT_VERTEX_GLSL
+#define COMPACT_VERTEX_GLSL
+
+// Quantized vertices written by CompactVertices on the CPU, see compact_vertices.h. Only available when building with
+// HYBRID_RENDERING_COMPACT_VERTICES, which defines COMPACT_VERTICES. Include after scene_descriptor_set.glsl and define
+// COMPACT_VERTICES_SET to the set the pipeline binds them to.
+//
+//   Position  - 3x 32-bit float
+//   Tex Coord - 2x 16-bit float
+//   Normal    - 2x 16-bit SNORM octahedral
+//   Tangent   - 2x 16-bit SNORM octahedral, the lowest bit of Y holds the sign of the bitangent
+//
+// 24 bytes per vertex instead of the 80 of Vertex, the bitangent is rebuilt from the normal and the tangent.
+
+#if defined(COMPACT_VERTICES)
+
+#include "g_buffer_common.glsl"
+
+// ------------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+#define COMPACT_VERTICES_MAX_INSTANCES 1024 // DynamicInstances::kMaxInstances
+#define COMPACT_VERTEX_BITANGENT_SIGN_BIT 0x10000
+
+// ------------------------------------------------------------------------
+// STRUCTURES -------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+struct CompactVertex
+{
+    float position_x;
+    float position_y;
+    float position_z;
+    uint  tex_coord;
+    uint  normal;
+    uint  tangent;
+};
+
+// ------------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------------
+// ------------------------------------------------------------------------
+
+// Indexed like the Instance buffer (gl_InstanceCustomIndexEXT), instances of the same mesh share a buffer.
+layout(set = COMPACT_VERTICES_SET, binding = 0, std430) readonly buffer CompactVertexBuffer
+{
+    CompactVertex data[];
+}
+CompactVertices[COMPACT_VERTICES_MAX_INSTANCES];
+
+// ------------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+Vertex decode_compact_vertex(in CompactVertex compact)
+{
+    Vertex v;
+
+    vec3  normal         = octohedral_to_direction(unpackSnorm2x16(compact.normal));
+    vec3  tangent        = octohedral_to_direction(unpackSnorm2x16(compact.tangent));
+    float bitangent_sign = (compact.tangent & COMPACT_VERTEX_BITANGENT_SIGN_BIT) != 0 ? -1.0f : 1.0f;
+
+    v.position  = vec4(compact.position_x, compact.position_y, compact.position_z, 1.0f);
+    v.tex_coord = vec4(unpackHalf2x16(compact.tex_coord), 0.0f, 0.0f);
+    v.normal    = vec4(normal, 0.0f);
+    v.tangent   = vec4(tangent, 0.0f);
+    v.bitangent = vec4(cross(normal, tangent) * bitangent_sign, 0.0f);
+
+    return v;
+}
+
+// ------------------------------------------------------------------------
+
+Vertex get_compact_vertex(uint instance_idx, uint vertex_idx)
+{
+    return decode_compact_vertex(CompactVertices[nonuniformEXT(instance_idx)].data[vertex_idx]);
+}
+
+// ------------------------------------------------------------------------
+
+// Same as fetch_triangle(), the indices still come from the mesh.
+Triangle fetch_compact_triangle(in Instance instance, in uint instance_idx, in HitInfo hit_info)
+{
+    Triangle tri;
+
+    uint primitive_id = hit_info.primitive_id + hit_info.primitive_offset;
+
+    uvec3 idx = uvec3(Indices[nonuniformEXT(instance.mesh_idx)].data[3 * primitive_id],
+                      Indices[nonuniformEXT(instance.mesh_idx)].data[3 * primitive_id + 1],
+                      Indices[nonuniformEXT(instance.mesh_idx)].data[3 * primitive_id + 2]);
+
+    tri.v0 = get_compact_vertex(instance_idx, idx.x);
+    tri.v1 = get_compact_vertex(instance_idx, idx.y);
+    tri.v2 = get_compact_vertex(instance_idx, idx.z);
+
+    return tri;
+}
+
+// ------------------------------------------------------------------------
+
+#endif
+
+#endif
@@ -3,6 +3,15 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "common.glsl"
+#include "g_buffer_common.glsl"
+
+#define POINT_LIGHTS_SET 7
+#include "point_lights.glsl"
+
+#define TILED_LIGHTS_SET 9
+#include "tiled_lights.glsl"
+
+#include "shadows/shadows_restir.glsl"
 
 // ------------------------------------------------------------------------
 // INPUTS -----------------------------------------------------------------
@@ -30,9 +39,9 @@ const float IndirectSpecularStrength = 2.0f;
 // DESCRIPTOR SETS --------------------------------------------------------
 // ------------------------------------------------------------------------
 
-layout(set = 0, binding = 0) uniform sampler2D s_GBuffer1; // RGB: Albedo, A: Metallic
-layout(set = 0, binding = 1) uniform sampler2D s_GBuffer2; // RG: Normal, BA: Motion Vector
-layout(set = 0, binding = 2) uniform sampler2D s_GBuffer3; // R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+layout(set = 0, binding = 0) uniform sampler2D s_GBuffer1;
+layout(set = 0, binding = 1) uniform sampler2D s_GBuffer2;
+layout(set = 0, binding = 2) uniform sampler2D s_GBuffer3;
 layout(set = 0, binding = 3) uniform sampler2D s_GBufferDepth;
 
 layout(set = 1, binding = 0) uniform sampler2D s_AO;
@@ -60,6 +69,12 @@ layout(set = 6, binding = 1) uniform sampler2D s_IrradianceSH;
 layout(set = 6, binding = 2) uniform samplerCube s_Prefiltered;
 layout(set = 6, binding = 3) uniform sampler2D s_BRDF;
 
+// One layer per shadowed point light.
+layout(set = 8, binding = 0) uniform sampler2DArray s_PointLightShadows;
+
+// Light picked for every pixel in the ReSTIR mode of the ray traced shadows, at the resolution of the shadows.
+layout(set = 10, binding = 0) uniform usampler2D s_Reservoirs;
+
 // ------------------------------------------------------------------------
 // PUSH CONSTANTS ---------------------------------------------------------
 // ------------------------------------------------------------------------
@@ -70,6 +85,7 @@ layout(push_constant) uniform PushConstants
     int ao;
     int reflections;
     int gi;
+    int restir;
 }
 u_PushConstants;
 
@@ -212,14 +228,31 @@ vec3 fresnel_schlick_roughness(float cosTheta, vec3 F0, float roughness)
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(max(1.0 - cosTheta, 0.0), 5.0);
 }
 
-// ------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
 
-vec3 octohedral_to_direction(vec2 e)
+vec3 direct_lighting(vec3 N, vec3 Wo, vec3 Wi, vec3 Li, vec3 albedo, float metallic, float roughness, vec3 F0)
 {
-    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
-    if (v.z < 0.0)
-        v.xy = (1.0 - abs(v.yx)) * (step(0.0, v.xy) * 2.0 - vec2(1.0));
-    return normalize(v);
+    vec3 Wh = normalize(Wo + Wi);
+
+    // Cook-Torrance BRDF
+    float NDF = distribution_ggx(N, Wh, roughness);
+    float G   = geometry_smith(N, Wo, Wi, roughness);
+    vec3  F   = fresnel_schlick(max(dot(Wh, Wo), 0.0), F0);
+
+    vec3  nominator   = NDF * G * F;
+    float denominator = 4 * max(dot(N, Wo), 0.0) * max(dot(N, Wi), 0.0); // 0.001 to prevent divide by zero.
+    vec3  specular    = nominator / max(EPSILON, denominator);
+
+    // kS is equal to Fresnel
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    // scale light by NdotL
+    float NdotL = max(dot(N, Wi), 0.0);
+
+    // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+    return (kD * albedo / M_PI + specular) * Li * NdotL;
 }
 
 // ------------------------------------------------------------------------
@@ -228,18 +261,21 @@ vec3 octohedral_to_direction(vec2 e)
 
 void main()
 {
-    vec4 g_buffer_data_1 = texture(s_GBuffer1, FS_IN_TexCoord);
-    vec4 g_buffer_data_2 = texture(s_GBuffer2, FS_IN_TexCoord);
-    vec4 g_buffer_data_3 = texture(s_GBuffer3, FS_IN_TexCoord);
+    // Fetched rather than sampled, the compact layout packs bits that can't be filtered.
+    const ivec2 coord = ivec2(gl_FragCoord.xy);
+
+    vec4 g_buffer_data_1 = texelFetch(s_GBuffer1, coord, 0);
+    vec4 g_buffer_data_2 = texelFetch(s_GBuffer2, coord, 0);
+    vec4 g_buffer_data_3 = texelFetch(s_GBuffer3, coord, 0);
 
     const vec3  world_pos  = world_position_from_depth(FS_IN_TexCoord, texture(s_GBufferDepth, FS_IN_TexCoord).r);
-    const vec3  albedo     = g_buffer_data_1.rgb;
-    const float metallic   = g_buffer_data_1.a;
-    const float roughness  = g_buffer_data_3.r;
+    const vec3  albedo     = g_buffer_albedo(g_buffer_data_1);
+    const float metallic   = g_buffer_metallic(g_buffer_data_1, g_buffer_data_3);
+    const float roughness  = g_buffer_roughness(g_buffer_data_3);
     const float visibility = u_PushConstants.shadow == 1 ? texture(s_Shadow, FS_IN_TexCoord).r : 1.0f;
     const float ao         = u_PushConstants.ao == 1 ? texture(s_AO, FS_IN_TexCoord).r : 1.0f;
 
-    const vec3 N  = octohedral_to_direction(g_buffer_data_2.rg);
+    const vec3 N  = g_buffer_normal(g_buffer_data_2);
     const vec3 Wo = normalize(ubo.cam_pos.xyz - world_pos);
     const vec3 R  = reflect(-Wo, N);
 
@@ -248,33 +284,50 @@ void main()
     vec3 direct   = vec3(0.0f);
     vec3 indirect = vec3(0.0f);
 
-    // Direct Lighting
+    if (u_PushConstants.restir == 1)
+    {
+        // A single light out of the sun and the point lights, weighted by its reservoir. The denoised visibility of the shadow
+        // pass is the visibility of that light.
+        const ivec2     reservoir_coord = coord * textureSize(s_Reservoirs, 0) / textureSize(s_GBufferDepth, 0);
+        const Reservoir reservoir       = unpack_reservoir(texelFetch(s_Reservoirs, reservoir_coord, 0).xy);
+
+        vec3 Li;
+        vec3 Wi;
+
+        if (restir_light_radiance(reservoir.light, ubo.light, world_pos, N, Li, Wi))
+            direct += direct_lighting(N, Wo, Wi, Li, albedo, metallic, roughness, F0) * reservoir.W * visibility;
+    }
+    else
     {
-        Light light = ubo.light;
+        // Direct Lighting
+        {
+            Light light = ubo.light;
+
+            vec3 Li = light_color(light) * light_intensity(light);
+            vec3 Wi = light_direction(light);
+
+            direct += direct_lighting(N, Wo, Wi, Li, albedo, metallic, roughness, F0) * visibility;
+        }
 
-        vec3 Li = light_color(light) * light_intensity(light);
-        vec3 Wi = light_direction(light);
-        vec3 Wh = normalize(Wo + Wi);
+        // Point Lights, only the ones the cull pass found in the tile of this pixel. Sky tiles have none.
+        const uint tile_idx = light_tile_index(coord, textureSize(s_GBufferDepth, 0));
 
-        // Cook-Torrance BRDF
-        float NDF = distribution_ggx(N, Wh, roughness);
-        float G   = geometry_smith(N, Wo, Wi, roughness);
-        vec3  F   = fresnel_schlick(max(dot(Wh, Wo), 0.0), F0);
+        for (uint j = 0; j < light_tile_count(tile_idx); j++)
+        {
+            const uint       i     = light_tile_light(tile_idx, j);
+            const PointLight light = PointLights.lights[i];
 
-        vec3  nominator   = NDF * G * F;
-        float denominator = 4 * max(dot(N, Wo), 0.0) * max(dot(N, Wi), 0.0); // 0.001 to prevent divide by zero.
-        vec3  specular    = nominator / max(EPSILON, denominator);
+            if (!point_light_influences(light, world_pos, N))
+                continue;
 
-        // kS is equal to Fresnel
-        vec3 kS = F;
-        vec3 kD = vec3(1.0) - kS;
-        kD *= 1.0 - metallic;
+            vec3 Li = point_light_radiance(light) * point_light_attenuation(light, world_pos);
+            vec3 Wi = normalize(point_light_position(light) - world_pos);
 
-        // scale light by NdotL
-        float NdotL = max(dot(N, Wi), 0.0);
+            // Only the first lights have ray traced shadows.
+            float point_visibility = u_PushConstants.shadow == 1 && i < PointLights.num_shadowed_lights ? texture(s_PointLightShadows, vec3(FS_IN_TexCoord, float(i))).r : 1.0f;
 
-        // add to outgoing radiance Lo
-        direct += (kD * albedo / M_PI + specular) * Li * NdotL * visibility; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+            direct += direct_lighting(N, Wo, Wi, Li, albedo, metallic, roughness, F0) * point_visibility;
+        }
     }
 
     // Indirect lighting
@@ -2,8 +2,19 @@
 
 #extension GL_GOOGLE_include_directive : require
 
+#if defined(COMPACT_VERTICES)
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define COMPACT_VERTICES_SET 3
+#endif
+
 #include "common.glsl"
 
+#if defined(COMPACT_VERTICES)
+#include "scene_descriptor_set.glsl"
+#include "compact_vertex.glsl"
+#else
+
 // ------------------------------------------------------------------------
 // INPUTS -----------------------------------------------------------------
 // ------------------------------------------------------------------------
@@ -13,6 +24,7 @@ layout(location = 1) in vec2 VS_IN_Texcoord;
 layout(location = 2) in vec3 VS_IN_Normal;
 layout(location = 3) in vec3 VS_IN_Tangent;
 layout(location = 4) in vec3 VS_IN_Bitangent;
+#endif
 
 // ------------------------------------------------------------------------
 // OUTPUTS ----------------------------------------------------------------
@@ -25,12 +37,27 @@ layout(location = 3) out vec3 FS_IN_Tangent;
 layout(location = 4) out vec3 FS_IN_Bitangent;
 layout(location = 5) out vec4 FS_IN_CSPos;
 layout(location = 6) out vec4 FS_IN_PrevCSPos;
+layout(location = 7) flat out uint FS_IN_MaterialIdx;
+layout(location = 8) flat out uint FS_IN_MeshID;
 
 out gl_PerVertex
 {
     vec4 gl_Position;
 };
 
+// ------------------------------------------------------------------------
+// STRUCTURES -------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+struct DrawData
+{
+    mat4 model;
+    mat4 prev_model;
+    uint material_idx;
+    uint mesh_id;
+    uint instance_idx;
+};
+
 // ------------------------------------------------------------------------
 // DESCRIPTOR SETS --------------------------------------------------------
 // ------------------------------------------------------------------------
@@ -48,18 +75,12 @@ layout(set = 1, binding = 0) uniform PerFrameUBO
 }
 ubo;
 
-// ------------------------------------------------------------------------
-// PUSH CONSTANTS ---------------------------------------------------------
-// ------------------------------------------------------------------------
-
-layout(push_constant) uniform PushConstants
+// Written by the culling pass, the first instance of every indirect draw points to its entry.
+layout(set = 2, binding = 3, std430) readonly buffer DrawDatas_t
 {
-    mat4 model;
-    mat4 prev_model;
-    uint material_idx;
-    uint mesh_id;
+    DrawData data[];
 }
-u_PushConstants;
+DrawDatas;
 
 // ------------------------------------------------------------------------
 // MAIN -------------------------------------------------------------------
@@ -67,9 +88,22 @@ u_PushConstants;
 
 void main()
 {
+    DrawData draw_data = DrawDatas.data[gl_InstanceIndex];
+
+#if defined(COMPACT_VERTICES)
+    // gl_VertexIndex already includes the vertex offset of the submesh.
+    Vertex vertex = get_compact_vertex(draw_data.instance_idx, gl_VertexIndex);
+
+    vec3 VS_IN_Position  = vertex.position.xyz;
+    vec2 VS_IN_Texcoord  = vertex.tex_coord.xy;
+    vec3 VS_IN_Normal    = vertex.normal.xyz;
+    vec3 VS_IN_Tangent   = vertex.tangent.xyz;
+    vec3 VS_IN_Bitangent = vertex.bitangent.xyz;
+#endif
+
     // Transform position into world space
-    vec4 world_pos      = u_PushConstants.model * vec4(VS_IN_Position, 1.0);
-    vec4 prev_world_pos = u_PushConstants.prev_model * vec4(VS_IN_Position, 1.0);
+    vec4 world_pos      = draw_data.model * vec4(VS_IN_Position, 1.0);
+    vec4 prev_world_pos = draw_data.prev_model * vec4(VS_IN_Position, 1.0);
 
     // Transform world position into clip space
     gl_Position = ubo.view_proj * world_pos;
@@ -85,11 +119,14 @@ void main()
     FS_IN_Texcoord = VS_IN_Texcoord;
 
     // Transform vertex normal into world space
-    mat3 normal_mat = mat3(u_PushConstants.model);
+    mat3 normal_mat = mat3(draw_data.model);
 
     FS_IN_Normal    = normal_mat * VS_IN_Normal;
     FS_IN_Tangent   = normal_mat * VS_IN_Tangent;
     FS_IN_Bitangent = normal_mat * VS_IN_Bitangent;
+
+    FS_IN_MaterialIdx = draw_data.material_idx;
+    FS_IN_MeshID      = draw_data.mesh_id;
 }
 
 // ------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef G_BUFFER_COMMON_GLSL
+#define G_BUFFER_COMMON_GLSL
+
+// Encoding of the G-Buffer images, shared by the passes that write them and every effect that reads them. Building with
+// HYBRID_RENDERING_COMPACT_G_BUFFER defines COMPACT_G_BUFFER and selects the compact layout.
+//
+// Default layout, 20 bytes per pixel:
+//
+//   G-Buffer 1 (RGBA8)   - RGB: Albedo, A: Metallic
+//   G-Buffer 2 (RGBA16F) - RG: Normal, BA: Motion Vector
+//   G-Buffer 3 (RGBA16F) - R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+//
+// A half float holds every integer up to 2048 exactly, so the default layout limits the G-Buffer to 2048 draws (GBUFFER_MAX_DRAWS).
+//
+// Compact layout, 16 bytes per pixel:
+//
+//   G-Buffer 1 (RGBA8)   - RGB: Albedo, A: Curvature
+//   G-Buffer 2 (RGBA16F) - RG: Normal, BA: Motion Vector
+//   G-Buffer 3 (RGBA8)   - Roughness (8 bits), Metallic (8 bits) and Mesh ID (16 bits) packed into a single 32-bit word
+//
+// The compact layout rebuilds linear Z from the depth buffer instead of storing it, which is why the decode helper takes both.
+// Every image is read through a float sampler in both layouts, the 32-bit word is recovered with packUnorm4x8() which is exact
+// for 8-bit UNORM values.
+
+// ------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+#if defined(COMPACT_G_BUFFER)
+#define G_BUFFER_3_FORMAT rgba8
+#else
+#define G_BUFFER_3_FORMAT rgba16f
+#endif
+
+#define G_BUFFER_SKY_LINEAR_Z -1.0f
+
+// ------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------
+// ------------------------------------------------------------------
+
+// A simple utility to convert a float to a 2-component octohedral representation
+vec2 direction_to_octohedral(vec3 normal)
+{
+    vec2 p = normal.xy * (1.0f / dot(abs(normal), vec3(1.0f)));
+    return normal.z > 0.0f ? p : (1.0f - abs(p.yx)) * (step(0.0f, p) * 2.0f - vec2(1.0f));
+}
+
+// ------------------------------------------------------------------
+
+vec3 octohedral_to_direction(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * (step(0.0, v.xy) * 2.0 - vec2(1.0));
+    return normalize(v);
+}
+
+// ------------------------------------------------------------------
+
+void encode_g_buffer(vec3 albedo, float metallic, vec3 normal, vec2 motion, float roughness, float curvature, uint mesh_id, float linear_z, out vec4 g_buffer_1, out vec4 g_buffer_2, out vec4 g_buffer_3)
+{
+    g_buffer_2 = vec4(direction_to_octohedral(normal), motion);
+
+#if defined(COMPACT_G_BUFFER)
+    // Only whether the curvature is zero matters to the effects, so small values are rounded up rather than lost.
+    g_buffer_1 = vec4(albedo, ceil(clamp(curvature, 0.0f, 1.0f) * 255.0f) / 255.0f);
+    g_buffer_3 = unpackUnorm4x8(uint(round(clamp(roughness, 0.0f, 1.0f) * 255.0f)) | (uint(round(clamp(metallic, 0.0f, 1.0f) * 255.0f)) << 8) | ((mesh_id & 0xFFFF) << 16));
+#else
+    g_buffer_1 = vec4(albedo, metallic);
+    g_buffer_3 = vec4(roughness, curvature, float(mesh_id), linear_z);
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Same values the G-Buffer render pass clears to.
+void encode_empty_g_buffer(out vec4 g_buffer_1, out vec4 g_buffer_2, out vec4 g_buffer_3)
+{
+    g_buffer_1 = vec4(0.0f);
+    g_buffer_2 = vec4(0.0f);
+
+#if defined(COMPACT_G_BUFFER)
+    g_buffer_3 = vec4(0.0f);
+#else
+    g_buffer_3 = vec4(0.0f, 0.0f, 0.0f, G_BUFFER_SKY_LINEAR_Z);
+#endif
+}
+
+// ------------------------------------------------------------------
+
+vec3 g_buffer_albedo(vec4 g_buffer_1)
+{
+    return g_buffer_1.rgb;
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_metallic(vec4 g_buffer_1, vec4 g_buffer_3)
+{
+#if defined(COMPACT_G_BUFFER)
+    return float((packUnorm4x8(g_buffer_3) >> 8) & 0xFF) / 255.0f;
+#else
+    return g_buffer_1.a;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+vec3 g_buffer_normal(vec4 g_buffer_2)
+{
+    return octohedral_to_direction(g_buffer_2.rg);
+}
+
+// ------------------------------------------------------------------
+
+vec2 g_buffer_motion(vec4 g_buffer_2)
+{
+    return g_buffer_2.ba;
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_roughness(vec4 g_buffer_3)
+{
+#if defined(COMPACT_G_BUFFER)
+    return float(packUnorm4x8(g_buffer_3) & 0xFF) / 255.0f;
+#else
+    return g_buffer_3.r;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_curvature(vec4 g_buffer_1, vec4 g_buffer_3)
+{
+#if defined(COMPACT_G_BUFFER)
+    return g_buffer_1.a;
+#else
+    return g_buffer_3.g;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_mesh_id(vec4 g_buffer_3)
+{
+#if defined(COMPACT_G_BUFFER)
+    return float(packUnorm4x8(g_buffer_3) >> 16);
+#else
+    return g_buffer_3.b;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// gl_FragCoord.z / gl_FragCoord.w of the G-Buffer pass, or G_BUFFER_SKY_LINEAR_Z where nothing was drawn. The depth has to be
+// read from the same texel and level as the G-Buffer, the compact layout rebuilds it from the depth and z_buffer_params.
+float g_buffer_linear_z(vec4 g_buffer_3, float depth, vec4 z_buffer_params)
+{
+#if defined(COMPACT_G_BUFFER)
+    return depth == 1.0f ? G_BUFFER_SKY_LINEAR_Z : depth / (z_buffer_params.z * depth + z_buffer_params.w);
+#else
+    return g_buffer_3.a;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+#endif
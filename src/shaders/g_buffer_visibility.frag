@@ -0,0 +1,37 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "scene_descriptor_set.glsl"
+
+// ------------------------------------------------------------------------
+// INPUTS -----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+layout(location = 1) in vec2 FS_IN_TexCoord;
+layout(location = 7) flat in uint FS_IN_MaterialIdx;
+layout(location = 8) flat in uint FS_IN_MeshID;
+
+// ------------------------------------------------------------------------
+// OUTPUTS ----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+layout(location = 0) out uvec2 FS_OUT_Visibility; // R: Mesh ID, G: Primitive ID
+
+// ------------------------------------------------------------------------
+// MAIN -------------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+void main()
+{
+    const Material material = Materials.data[FS_IN_MaterialIdx];
+
+    // Alpha testing is the only material work left in the rasterizer, everything else happens once per pixel in the resolve.
+    if (fetch_albedo(material, FS_IN_TexCoord).a < 0.1)
+        discard;
+
+    FS_OUT_Visibility = uvec2(FS_IN_MeshID, gl_PrimitiveID);
+}
+
+// ------------------------------------------------------------------------
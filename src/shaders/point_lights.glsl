@@ -0,0 +1,98 @@
+#ifndef POINT_LIGHTS_GLSL
+#define POINT_LIGHTS_GLSL
+
+// Point lights written by PointLights on the CPU, see point_lights.h. Include after common.glsl and define POINT_LIGHTS_SET to
+// the set the pipeline binds them to.
+//
+//   Position Radius - XYZ: Position, W: Radius of the emitting sphere
+//   Color Range     - XYZ: Color multiplied by the intensity, W: Distance past which the light has no influence
+//
+// The first num_shadowed_lights lights cast ray traced shadows, one layer of the point light shadows each.
+
+// ------------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+#define MAX_POINT_LIGHTS 1024        // PointLights::kMaxLights
+#define MAX_SHADOWED_POINT_LIGHTS 8 // PointLights::kMaxShadowedLights
+
+// ------------------------------------------------------------------------
+// STRUCTURES -------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+struct PointLight
+{
+    vec4 position_radius;
+    vec4 color_range;
+};
+
+// ------------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------------
+// ------------------------------------------------------------------------
+
+layout(set = POINT_LIGHTS_SET, binding = 0, std430) readonly buffer PointLights_t
+{
+    uint       num_lights;
+    uint       num_shadowed_lights;
+    uint       padding[2];
+    PointLight lights[];
+}
+PointLights;
+
+// ------------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+vec3 point_light_position(in PointLight light)
+{
+    return light.position_radius.xyz;
+}
+
+// ------------------------------------------------------------------------
+
+float point_light_radius(in PointLight light)
+{
+    return light.position_radius.w;
+}
+
+// ------------------------------------------------------------------------
+
+vec3 point_light_radiance(in PointLight light)
+{
+    return light.color_range.xyz;
+}
+
+// ------------------------------------------------------------------------
+
+float point_light_range(in PointLight light)
+{
+    return light.color_range.w;
+}
+
+// ------------------------------------------------------------------------
+
+// Inverse square falloff, windowed so that it reaches zero at the range of the light instead of never.
+float point_light_attenuation(in PointLight light, vec3 world_pos)
+{
+    vec3  to_light = point_light_position(light) - world_pos;
+    float dist_sq  = dot(to_light, to_light);
+    float factor   = dist_sq / (point_light_range(light) * point_light_range(light));
+    float window   = clamp(1.0f - factor * factor, 0.0f, 1.0f);
+
+    return (window * window) / max(dist_sq, EPSILON);
+}
+
+// ------------------------------------------------------------------------
+
+// A surface past the range of the light or facing away from it gets nothing, so it doesn't need a shadow ray either.
+bool point_light_influences(in PointLight light, vec3 world_pos, vec3 normal)
+{
+    vec3  to_light = point_light_position(light) - world_pos;
+    float range    = point_light_range(light);
+
+    return dot(to_light, to_light) < range * range && dot(to_light, normal) > 0.0f;
+}
+
+// ------------------------------------------------------------------------
+
+#endif
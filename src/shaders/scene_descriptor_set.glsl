@@ -148,10 +148,9 @@ Vertex interpolated_vertex(in Triangle tri, in vec3 barycentrics)
 
 // ------------------------------------------------------------------------
 
-void transform_vertex(in Instance instance, inout Vertex v)
+void transform_vertex(in mat4 model_mat, inout Vertex v)
 {
-    mat4 model_mat = instance.model_matrix;
-    mat3 normal_mat = mat3(instance.model_matrix);
+    mat3 normal_mat = mat3(model_mat);
 
     v.position = model_mat * v.position; 
     v.normal.xyz = normalize(normal_mat * v.normal.xyz);
@@ -161,6 +160,13 @@ void transform_vertex(in Instance instance, inout Vertex v)
 
 // ------------------------------------------------------------------------
 
+void transform_vertex(in Instance instance, inout Vertex v)
+{
+    transform_vertex(instance.model_matrix, v);
+}
+
+// ------------------------------------------------------------------------
+
 vec3 get_normal_from_map(vec3 tangent, vec3 bitangent, vec3 normal, vec2 tex_coord, uint normal_map_idx)
 {
     // Create TBN matrix.
@@ -225,4 +231,60 @@ vec3 fetch_emissive(in Material material, in vec2 texcoord)
         return texture(s_Textures[nonuniformEXT(material.texture_indices1.x)], texcoord).rgb;
 }
 
-// ------------------------------------------------------------------------
\ No newline at end of file
+// ------------------------------------------------------------------------
+
+// Overloads with explicit texture coordinate gradients, for shaders without screen space derivatives (e.g the visibility buffer
+// resolve, which is a compute shader).
+
+// ------------------------------------------------------------------------
+
+vec3 get_normal_from_map(vec3 tangent, vec3 bitangent, vec3 normal, vec2 tex_coord, vec2 tex_coord_dx, vec2 tex_coord_dy, uint normal_map_idx)
+{
+    mat3 TBN = mat3(normalize(tangent), normalize(bitangent), normalize(normal));
+
+    vec3 n = normalize(textureGrad(s_Textures[nonuniformEXT(normal_map_idx)], tex_coord, tex_coord_dx, tex_coord_dy).rgb * 2.0 - 1.0);
+
+    return normalize(TBN * n);
+}
+
+// ------------------------------------------------------------------------
+
+vec4 fetch_albedo(in Material material, in vec2 texcoord, in vec2 texcoord_dx, in vec2 texcoord_dy)
+{
+    if (material.texture_indices0.x == -1)
+        return material.albedo;
+    else
+        return textureGrad(s_Textures[nonuniformEXT(material.texture_indices0.x)], texcoord, texcoord_dx, texcoord_dy);
+}
+
+// ------------------------------------------------------------------------
+
+vec3 fetch_normal(in Material material, in vec3 tangent, in vec3 bitangent, in vec3 normal, in vec2 texcoord, in vec2 texcoord_dx, in vec2 texcoord_dy)
+{
+    if (material.texture_indices0.y == -1)
+        return normal;
+    else
+        return get_normal_from_map(tangent, bitangent, normal, texcoord, texcoord_dx, texcoord_dy, material.texture_indices0.y);
+}
+
+// ------------------------------------------------------------------------
+
+float fetch_roughness(in Material material, in vec2 texcoord, in vec2 texcoord_dx, in vec2 texcoord_dy)
+{
+    if (material.texture_indices0.z == -1)
+        return material.roughness_metallic.r;
+    else
+        return textureGrad(s_Textures[nonuniformEXT(material.texture_indices0.z)], texcoord, texcoord_dx, texcoord_dy)[material.texture_indices1.z];
+}
+
+// ------------------------------------------------------------------------
+
+float fetch_metallic(in Material material, in vec2 texcoord, in vec2 texcoord_dx, in vec2 texcoord_dy)
+{
+    if (material.texture_indices0.w == -1)
+        return material.roughness_metallic.g;
+    else
+        return textureGrad(s_Textures[nonuniformEXT(material.texture_indices0.w)], texcoord, texcoord_dx, texcoord_dy)[material.texture_indices1.w];
+}
+
+// ------------------------------------------------------------------------
@@ -0,0 +1,84 @@
+#ifndef SHADOWS_POINT_TILES_GLSL
+#define SHADOWS_POINT_TILES_GLSL
+
+// Work of the shadowed point lights, written by the cull pass and read by the ray trace. Define SHADOWS_POINT_TILES_SET to the
+// set the pipeline binds them to.
+//
+//   Light Mask - One bit per shadowed point light that influences at least one pixel of the 8x4 ray mask
+//   Work Items - X: Ray mask coordinate, 16 bits per axis, Y: Index of the light
+//
+// Every work item is one 8x4 group of the ray trace, so a tile that no light reaches costs no rays at all. The groups are spread
+// over X and Y to stay within maxComputeWorkGroupCount, the last row can go past the number of items.
+
+// ------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define SHADOWS_POINT_MAX_GROUPS_X 65535 // Lowest maxComputeWorkGroupCount[0] the spec allows.
+
+// ------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(set = SHADOWS_POINT_TILES_SET, binding = 0, r32ui) uniform uimage2D i_LightMask;
+layout(set = SHADOWS_POINT_TILES_SET, binding = 1, std430) buffer WorkItems_t
+{
+    uvec2 items[];
+} WorkItems;
+layout(set = SHADOWS_POINT_TILES_SET, binding = 2, std430) buffer WorkDispatchArgs_t
+{
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+    uint num_items;
+} WorkDispatchArgs;
+
+// ------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------
+// ------------------------------------------------------------------
+
+// Appends num_items work items and returns the index of the first one. Both dispatch dimensions only ever grow with the count,
+// so whichever append finishes last leaves the ones of the final count.
+uint shadows_point_append_work_items(uint num_items)
+{
+    uint item_idx  = atomicAdd(WorkDispatchArgs.num_items, num_items);
+    uint num_total = item_idx + num_items;
+
+    atomicMax(WorkDispatchArgs.num_groups_x, min(num_total, SHADOWS_POINT_MAX_GROUPS_X));
+    atomicMax(WorkDispatchArgs.num_groups_y, (num_total + SHADOWS_POINT_MAX_GROUPS_X - 1) / SHADOWS_POINT_MAX_GROUPS_X);
+
+    return item_idx;
+}
+
+// ------------------------------------------------------------------
+
+// Index of the work item of the current group of the ray trace.
+uint shadows_point_work_item_index()
+{
+    return gl_WorkGroupID.y * SHADOWS_POINT_MAX_GROUPS_X + gl_WorkGroupID.x;
+}
+
+// ------------------------------------------------------------------
+
+uvec2 shadows_point_work_item(ivec2 tile_coord, uint light_idx)
+{
+    return uvec2(uint(tile_coord.x) | (uint(tile_coord.y) << 16), light_idx);
+}
+
+// ------------------------------------------------------------------
+
+ivec2 shadows_point_work_item_tile(uvec2 item)
+{
+    return ivec2(item.x & 0xFFFF, item.x >> 16);
+}
+
+// ------------------------------------------------------------------
+
+uint shadows_point_work_item_light(uvec2 item)
+{
+    return item.y;
+}
+
+// ------------------------------------------------------------------
+
+#endif
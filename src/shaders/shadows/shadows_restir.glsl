@@ -0,0 +1,162 @@
+#ifndef SHADOWS_RESTIR_GLSL
+#define SHADOWS_RESTIR_GLSL
+
+// Weighted reservoirs of light samples for the ReSTIR mode of the ray traced shadows. Include after point_lights.glsl.
+//
+// The lights are the sun and every point light. Candidates pick the sun half of the time and a uniformly chosen point light
+// otherwise, and are resampled against their unshadowed contribution to a diffuse surface. A reservoir is stored in two 32-bit
+// words:
+//
+//   X - Bits 0-23: Light, RESTIR_SUN_LIGHT for the sun. Bits 24-31: Number of candidates it has seen (M)
+//   Y - Unbiased contribution weight of the light (W)
+
+// ------------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+#define RESTIR_INVALID_LIGHT 0xFFFFFF
+#define RESTIR_SUN_LIGHT 0xFFFFFE
+#define RESTIR_LIGHT_MASK 0xFFFFFF
+#define RESTIR_MAX_M 255
+
+// ------------------------------------------------------------------------
+// STRUCTURES -------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+struct Reservoir
+{
+    uint  light;
+    float w_sum;
+    float M;
+    float W;
+};
+
+// ------------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+Reservoir empty_reservoir()
+{
+    Reservoir r;
+
+    r.light = RESTIR_INVALID_LIGHT;
+    r.w_sum = 0.0f;
+    r.M     = 0.0f;
+    r.W     = 0.0f;
+
+    return r;
+}
+
+// ------------------------------------------------------------------------
+
+uvec2 pack_reservoir(in Reservoir r)
+{
+    return uvec2((r.light & RESTIR_LIGHT_MASK) | (uint(min(r.M, float(RESTIR_MAX_M))) << 24), floatBitsToUint(r.W));
+}
+
+// ------------------------------------------------------------------------
+
+Reservoir unpack_reservoir(uvec2 data)
+{
+    Reservoir r;
+
+    r.light = data.x & RESTIR_LIGHT_MASK;
+    r.M     = float(data.x >> 24);
+    r.W     = uintBitsToFloat(data.y);
+    r.w_sum = 0.0f;
+
+    return r;
+}
+
+// ------------------------------------------------------------------------
+
+bool update_reservoir(inout Reservoir r, uint light, float weight, float M, float rnd)
+{
+    r.w_sum += weight;
+    r.M += M;
+
+    if (weight > 0.0f && rnd * r.w_sum < weight)
+    {
+        r.light = light;
+        return true;
+    }
+
+    return false;
+}
+
+// ------------------------------------------------------------------------
+
+// Picks the light of a new candidate from a uniform random number.
+uint restir_sample_light(float rnd, out float pdf)
+{
+    const uint num_lights = PointLights.num_lights;
+
+    if (num_lights == 0 || rnd < 0.5f)
+    {
+        pdf = num_lights == 0 ? 1.0f : 0.5f;
+        return RESTIR_SUN_LIGHT;
+    }
+
+    pdf = 0.5f / float(num_lights);
+
+    return min(uint((rnd - 0.5f) * 2.0f * float(num_lights)), num_lights - 1);
+}
+
+// ------------------------------------------------------------------------
+
+// Unshadowed incoming radiance and direction of the given light, false if it doesn't exist anymore or doesn't reach the point.
+bool restir_light_radiance(uint light, in Light sun, vec3 world_pos, vec3 normal, out vec3 Li, out vec3 Wi)
+{
+    Li = vec3(0.0f);
+    Wi = vec3(0.0f, 1.0f, 0.0f);
+
+    if (light == RESTIR_SUN_LIGHT)
+    {
+        Li = light_color(sun) * light_intensity(sun);
+        Wi = light_direction(sun);
+
+        return dot(Wi, normal) > 0.0f;
+    }
+
+    if (light >= PointLights.num_lights)
+        return false;
+
+    const PointLight point_light = PointLights.lights[light];
+
+    if (!point_light_influences(point_light, world_pos, normal))
+        return false;
+
+    Li = point_light_radiance(point_light) * point_light_attenuation(point_light, world_pos);
+    Wi = normalize(point_light_position(point_light) - world_pos);
+
+    return true;
+}
+
+// ------------------------------------------------------------------------
+
+// Target function of the resampling, the luminance of the light reflected by a white diffuse surface.
+float restir_target_pdf(uint light, in Light sun, vec3 world_pos, vec3 normal)
+{
+    vec3 Li;
+    vec3 Wi;
+
+    if (!restir_light_radiance(light, sun, world_pos, normal, Li, Wi))
+        return 0.0f;
+
+    return dot(Li, vec3(0.2126f, 0.7152f, 0.0722f)) * max(dot(normal, Wi), 0.0f);
+}
+
+// ------------------------------------------------------------------------
+
+// Turns the running sum of a reservoir into the contribution weight of its light.
+void finalize_reservoir(inout Reservoir r, float target_pdf)
+{
+    r.W = target_pdf > 0.0f && r.M > 0.0f ? r.w_sum / (r.M * target_pdf) : 0.0f;
+
+    if (r.W == 0.0f)
+        r.light = RESTIR_INVALID_LIGHT;
+}
+
+// ------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SHADOWS_TILES_GLSL
+#define SHADOWS_TILES_GLSL
+
+// Classification of the 8x4 ray masks, written by the reprojection pass and read by the ray trace of the next frame. Define
+// SHADOWS_TILES_SET to the set the pipeline binds them to.
+//
+//   Tile State - Bits 0-7: Number of frames the mask has been uniform and matched its history, Bit 8: Visibility of a uniform
+//                mask, Bit 9: The mask was in a penumbra
+//
+// Masks that have been stable for long enough are listed in StableTiles and only get a single ray, every other mask is listed
+// in RayTraceTiles and traced in full. The state belongs to a location on screen, so a mask whose pixels move covers a different
+// surface than the one it was stable for and starts over.
+
+// ------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define SHADOWS_TILE_STABLE_FRAMES_MASK 0xFF
+#define SHADOWS_TILE_VISIBLE_BIT 0x100
+#define SHADOWS_TILE_PENUMBRA_BIT 0x200
+#define SHADOWS_STABLE_TILES_PER_GROUP 32 // One thread per stable tile.
+#define SHADOWS_TILE_MOTION_EPSILON 0.01f // Motion in pixels below which a pixel counts as static.
+
+// ------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(set = SHADOWS_TILES_SET, binding = 0, r32ui) uniform uimage2D i_TileState;
+layout(set = SHADOWS_TILES_SET, binding = 1, std430) buffer RayTraceTiles_t
+{
+    ivec2 coord[];
+} RayTraceTiles;
+layout(set = SHADOWS_TILES_SET, binding = 2, std430) buffer RayTraceDispatchArgs_t
+{
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+    uint num_tiles;
+} RayTraceDispatchArgs;
+layout(set = SHADOWS_TILES_SET, binding = 3, std430) buffer StableTiles_t
+{
+    ivec2 coord[];
+} StableTiles;
+layout(set = SHADOWS_TILES_SET, binding = 4, std430) buffer StableDispatchArgs_t
+{
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+    uint num_tiles;
+} StableDispatchArgs;
+
+// ------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------
+// ------------------------------------------------------------------
+
+uint shadows_tile_state(uint stable_frames, bool visible, bool penumbra)
+{
+    return min(stable_frames, SHADOWS_TILE_STABLE_FRAMES_MASK) | (visible ? SHADOWS_TILE_VISIBLE_BIT : 0) | (penumbra ? SHADOWS_TILE_PENUMBRA_BIT : 0);
+}
+
+// ------------------------------------------------------------------
+
+uint shadows_tile_stable_frames(uint state)
+{
+    return state & SHADOWS_TILE_STABLE_FRAMES_MASK;
+}
+
+// ------------------------------------------------------------------
+
+bool shadows_tile_visible(uint state)
+{
+    return (state & SHADOWS_TILE_VISIBLE_BIT) != 0;
+}
+
+// ------------------------------------------------------------------
+
+bool shadows_tile_penumbra(uint state)
+{
+    return (state & SHADOWS_TILE_PENUMBRA_BIT) != 0;
+}
+
+// ------------------------------------------------------------------
+
+// Takes the motion vector of the G-Buffer, in UV space.
+bool shadows_pixel_moving(vec2 motion, vec2 size)
+{
+    return any(greaterThan(abs(motion * size), vec2(SHADOWS_TILE_MOTION_EPSILON)));
+}
+
+// ------------------------------------------------------------------
+
+#endif
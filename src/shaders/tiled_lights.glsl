@@ -0,0 +1,74 @@
+#ifndef TILED_LIGHTS_GLSL
+#define TILED_LIGHTS_GLSL
+
+// Lists of the point lights that reach each screen tile, built by deferred_light_cull.comp and walked by deferred.frag. Define
+// TILED_LIGHTS_SET to the set the pipeline binds them to, and TILED_LIGHTS_WRITE in the pass that builds them.
+//
+// Every tile owns a fixed slice of the buffer, the number of lights followed by their indices into PointLights.lights:
+//
+//   [count, light_0, light_1, ..., light_(count - 1), unused...]
+//
+// The indices are sorted. A tile keeps at most MAX_LIGHTS_PER_TILE lights, the ones with the highest indices are dropped, so the
+// same lights are kept from one frame to the next. The culling pass counts the tiles that had to drop lights in
+// TiledLightsStats, which the GUI shows.
+
+// ------------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+#define LIGHT_TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 255
+#define LIGHT_TILE_STRIDE (MAX_LIGHTS_PER_TILE + 1)
+
+// ------------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------------
+// ------------------------------------------------------------------------
+
+#if defined(TILED_LIGHTS_WRITE)
+layout(set = TILED_LIGHTS_SET, binding = 0, std430) buffer TiledLights_t
+#else
+layout(set = TILED_LIGHTS_SET, binding = 0, std430) readonly buffer TiledLights_t
+#endif
+{
+    uint data[];
+}
+TiledLights;
+
+#if defined(TILED_LIGHTS_WRITE)
+layout(set = TILED_LIGHTS_SET, binding = 1, std430) buffer TiledLightsStats_t
+{
+    uint overflowed_tiles;
+}
+TiledLightsStats;
+#endif
+
+// ------------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+// Index of the tile that covers the given pixel, size is the resolution the lights were culled at.
+uint light_tile_index(ivec2 coord, ivec2 size)
+{
+    const uint  num_tiles_x = (uint(size.x) + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    const uvec2 tile        = uvec2(coord) / LIGHT_TILE_SIZE;
+
+    return tile.y * num_tiles_x + tile.x;
+}
+
+// ------------------------------------------------------------------------
+
+uint light_tile_count(uint tile_idx)
+{
+    return TiledLights.data[tile_idx * LIGHT_TILE_STRIDE];
+}
+
+// ------------------------------------------------------------------------
+
+uint light_tile_light(uint tile_idx, uint i)
+{
+    return TiledLights.data[tile_idx * LIGHT_TILE_STRIDE + 1 + i];
+}
+
+// ------------------------------------------------------------------------
+
+#endif
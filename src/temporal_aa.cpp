@@ -6,6 +6,7 @@
 #include "ray_traced_reflections.h"
 #include "ddgi.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <imgui.h>
 #include <profiler.h>
 #include <macros.h>
@@ -92,7 +93,7 @@ void TemporalAA::render(dw::vk::CommandBuffer::Ptr cmd_buf,
 {
     if (m_enabled)
     {
-        DW_SCOPED_SAMPLE("TAA", cmd_buf);
+        HR_SCOPED_SAMPLE("TAA", cmd_buf);
 
         const uint32_t NUM_THREADS = 32;
         const uint32_t write_idx   = (uint32_t)m_common_resources->ping_pong;
@@ -328,12 +329,7 @@ void TemporalAA::create_pipeline(GBuffer* g_buffer)
 
     dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/taa.comp.spv");
 
-    dw::vk::ComputePipeline::Desc comp_desc;
-
-    comp_desc.set_pipeline_layout(m_pipeline_layout);
-    comp_desc.set_shader_stage(module, "main");
-
-    m_pipeline = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+    m_pipeline = m_common_resources->pipeline_cache->create_compute_pipeline(module, m_pipeline_layout);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <vk.h>
 #include <glm.hpp>
+#include "pipeline_cache.h"
 
 struct CommonResources;
 class GBuffer;
@@ -46,7 +47,7 @@ private:
     GBuffer*                                m_g_buffer;
     std::vector<dw::vk::Image::Ptr>         m_image;
     std::vector<dw::vk::ImageView::Ptr>     m_view;
-    dw::vk::ComputePipeline::Ptr            m_pipeline;
+    Pipeline::Ptr                           m_pipeline;
     dw::vk::PipelineLayout::Ptr             m_pipeline_layout;
     std::vector<dw::vk::DescriptorSet::Ptr> m_read_ds;
     std::vector<dw::vk::DescriptorSet::Ptr> m_write_ds;
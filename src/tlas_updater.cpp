@@ -0,0 +1,86 @@
+#include "tlas_updater.h"
+#include <imgui.h>
+
+static const char* kPathNames[] = { "Skipped", "Refit", "Rebuilt" };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TlasUpdater::Path TlasUpdater::update(Scene::Ptr scene, dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    const auto& instances = scene->instances();
+
+    // The Instance buffer is written every frame, each frame in flight has its own.
+    scene->update_instances();
+
+    const bool first_time = m_scenes.find(scene->id()) == m_scenes.end();
+
+    SceneState& state = m_scenes[scene->id()];
+
+    bool topology_changed   = first_time || state.meshes.size() != instances.size();
+    bool transforms_changed = false;
+
+    if (!topology_changed)
+    {
+        for (uint32_t i = 0; i < instances.size(); i++)
+        {
+            if (state.meshes[i] != instances[i].mesh.lock().get())
+            {
+                topology_changed = true;
+                break;
+            }
+
+            transforms_changed = transforms_changed || state.transforms[i] != instances[i].transform;
+        }
+    }
+
+    Path path = PATH_SKIP;
+
+    if (topology_changed || (transforms_changed && state.num_refits == kMaxRefits))
+        path = PATH_REBUILD;
+    else if (transforms_changed)
+        path = PATH_REFIT;
+
+    if (path == PATH_REBUILD)
+    {
+        scene->build_tlas(cmd_buf);
+
+        state.meshes.resize(instances.size());
+        state.transforms.resize(instances.size());
+        state.num_refits = 0;
+
+        for (uint32_t i = 0; i < instances.size(); i++)
+            state.meshes[i] = instances[i].mesh.lock().get();
+
+        m_stats.num_rebuilds++;
+    }
+    else if (path == PATH_REFIT)
+    {
+        scene->update_tlas(cmd_buf);
+
+        state.num_refits++;
+
+        m_stats.num_refits++;
+    }
+    else
+        m_stats.num_skipped++;
+
+    if (path != PATH_SKIP)
+    {
+        for (uint32_t i = 0; i < instances.size(); i++)
+            state.transforms[i] = instances[i].transform;
+    }
+
+    m_stats.last_path = path;
+
+    return path;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TlasUpdater::gui()
+{
+    ImGui::Text("TLAS: %s", kPathNames[m_stats.last_path]);
+    ImGui::Text("TLAS Skipped/Refit/Rebuilt: %u/%u/%u", m_stats.num_skipped, m_stats.num_refits, m_stats.num_rebuilds);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
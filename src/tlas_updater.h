@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vk.h>
+#include <unordered_map>
+#include <vector>
+#include "scene.h"
+
+// Decides how much work the top level acceleration structure of a scene needs each frame by comparing its instances against
+// the ones it was last built with:
+//
+//   - Nothing changed: the TLAS from the previous frame is used as is.
+//   - Only transforms changed: the TLAS is refit in place with Scene::update_tlas(), the scene builds it with ALLOW_UPDATE.
+//   - Instances were added, removed or point to a different mesh: full rebuild. Refits degrade the quality of the TLAS, so a
+//     rebuild also happens after kMaxRefits refits in a row.
+//
+// Every scene keeps its own TLAS, switching scenes doesn't force a rebuild.
+class TlasUpdater
+{
+public:
+    enum Path
+    {
+        PATH_SKIP,
+        PATH_REFIT,
+        PATH_REBUILD
+    };
+
+    struct Stats
+    {
+        Path     last_path    = PATH_REBUILD;
+        uint32_t num_skipped  = 0;
+        uint32_t num_refits   = 0;
+        uint32_t num_rebuilds = 0;
+    };
+
+    static const uint32_t kMaxRefits = 64;
+
+public:
+    Path update(Scene::Ptr scene, dw::vk::CommandBuffer::Ptr cmd_buf);
+    void gui();
+
+    inline Stats stats() { return m_stats; }
+
+private:
+    struct SceneState
+    {
+        std::vector<const Mesh*>     meshes;
+        std::vector<glm::mat4>       transforms;
+        uint32_t                     num_refits = 0;
+    };
+
+private:
+    std::unordered_map<uint32_t, SceneState> m_scenes;
+    Stats                                    m_stats;
+};
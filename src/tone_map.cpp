@@ -6,6 +6,7 @@
 #include "ray_traced_reflections.h"
 #include "ddgi.h"
 #include "utilities.h"
+#include "pass_timings.h"
 #include <imgui.h>
 #include <profiler.h>
 #include <macros.h>
@@ -20,13 +21,17 @@ struct ToneMapPushConstants
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-ToneMap::ToneMap(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources) :
+ToneMap::ToneMap(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, bool offscreen) :
     m_backend(backend), m_common_resources(common_resources)
 {
     auto vk_backend = backend.lock();
 
-    m_width  = vk_backend->swap_chain_extents().width;
-    m_height = vk_backend->swap_chain_extents().height;
+    m_width             = vk_backend->swap_chain_extents().width;
+    m_height            = vk_backend->swap_chain_extents().height;
+    m_offscreen.enabled = offscreen;
+
+    if (m_offscreen.enabled)
+        create_offscreen_target();
 
     create_pipeline();
 }
@@ -48,7 +53,7 @@ void ToneMap::render(dw::vk::CommandBuffer::Ptr                      cmd_buf,
                      DDGI*                                           ddgi,
                      std::function<void(dw::vk::CommandBuffer::Ptr)> gui_callback)
 {
-    DW_SCOPED_SAMPLE("Tone Map", cmd_buf);
+    HR_SCOPED_SAMPLE("Tone Map", cmd_buf);
 
     auto vk_backend = m_backend.lock();
 
@@ -66,8 +71,8 @@ void ToneMap::render(dw::vk::CommandBuffer::Ptr                      cmd_buf,
 
     VkRenderPassBeginInfo info    = {};
     info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    info.renderPass               = vk_backend->swapchain_render_pass()->handle();
-    info.framebuffer              = vk_backend->swapchain_framebuffer()->handle();
+    info.renderPass               = m_offscreen.enabled ? m_offscreen.rp->handle() : vk_backend->swapchain_render_pass()->handle();
+    info.framebuffer              = m_offscreen.enabled ? m_offscreen.fbo->handle() : vk_backend->swapchain_framebuffer()->handle();
     info.renderArea.extent.width  = m_width;
     info.renderArea.extent.height = m_height;
     info.clearValueCount          = 2;
@@ -145,6 +150,102 @@ void ToneMap::gui()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void ToneMap::copy_to_readback_buffer(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    HR_SCOPED_SAMPLE("Readback", cmd_buf);
+
+    VkBufferImageCopy region;
+    DW_ZERO_MEMORY(region);
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width           = m_width;
+    region.imageExtent.height          = m_height;
+    region.imageExtent.depth           = 1;
+
+    vkCmdCopyImageToBuffer(cmd_buf->handle(), m_offscreen.image->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_offscreen.readback_buffer->handle(), 1, &region);
+
+    VkBufferMemoryBarrier buffer_barrier;
+    DW_ZERO_MEMORY(buffer_barrier);
+
+    buffer_barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_barrier.dstAccessMask       = VK_ACCESS_HOST_READ_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer              = m_offscreen.readback_buffer->handle();
+    buffer_barrier.size                = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ToneMap::create_offscreen_target()
+{
+    auto vk_backend = m_backend.lock();
+
+    m_offscreen.image = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+    m_offscreen.image->set_name("Tone Map Offscreen");
+
+    m_offscreen.view = dw::vk::ImageView::create(vk_backend, m_offscreen.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+    m_offscreen.view->set_name("Tone Map Offscreen");
+
+    m_offscreen.readback_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_width * m_height * 4, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    std::vector<VkAttachmentDescription> attachments(1);
+
+    attachments[0].format         = VK_FORMAT_R8G8B8A8_UNORM;
+    attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentReference color_reference;
+
+    color_reference.attachment = 0;
+    color_reference.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    std::vector<VkSubpassDescription> subpass_description(1);
+
+    subpass_description[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_description[0].colorAttachmentCount    = 1;
+    subpass_description[0].pColorAttachments       = &color_reference;
+    subpass_description[0].pDepthStencilAttachment = nullptr;
+    subpass_description[0].inputAttachmentCount    = 0;
+    subpass_description[0].pInputAttachments       = nullptr;
+    subpass_description[0].preserveAttachmentCount = 0;
+    subpass_description[0].pPreserveAttachments    = nullptr;
+    subpass_description[0].pResolveAttachments     = nullptr;
+
+    // Subpass dependencies for layout transitions
+    std::vector<VkSubpassDependency> dependencies(2);
+
+    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass      = 0;
+    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    dependencies[1].srcSubpass      = 0;
+    dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    m_offscreen.rp  = dw::vk::RenderPass::create(vk_backend, attachments, subpass_description, dependencies);
+    m_offscreen.fbo = dw::vk::Framebuffer::create(vk_backend, m_offscreen.rp, { m_offscreen.view }, m_width, m_height, 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void ToneMap::create_pipeline()
 {
     auto vk_backend = m_backend.lock();
@@ -155,7 +256,7 @@ void ToneMap::create_pipeline()
     desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
 
     m_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
-    m_pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(vk_backend, "shaders/triangle.vert.spv", "shaders/tone_map.frag.spv", m_pipeline_layout, vk_backend->swapchain_render_pass());
+    m_pipeline        = m_common_resources->pipeline_cache->create_post_process_pipeline("shaders/triangle.vert.spv", "shaders/tone_map.frag.spv", m_pipeline_layout, m_offscreen.enabled ? m_offscreen.rp : vk_backend->swapchain_render_pass());
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <vk.h>
 #include <glm.hpp>
 #include <functional>
+#include "pipeline_cache.h"
 
 struct CommonResources;
 class TemporalAA;
@@ -15,7 +16,7 @@ class DDGI;
 class ToneMap
 {
 public:
-    ToneMap(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources);
+    ToneMap(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, bool offscreen = false);
     ~ToneMap();
 
     void render(dw::vk::CommandBuffer::Ptr                      cmd_buf,
@@ -27,16 +28,35 @@ public:
                 DDGI*                                           ddgi,
                 std::function<void(dw::vk::CommandBuffer::Ptr)> gui_callback);
     void gui();
+    void copy_to_readback_buffer(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+    inline bool           offscreen() { return m_offscreen.enabled; }
+    inline const uint8_t* readback_data() { return (const uint8_t*)m_offscreen.readback_buffer->mapped_ptr(); }
+    inline uint32_t       width() { return m_width; }
+    inline uint32_t       height() { return m_height; }
 
 private:
+    void create_offscreen_target();
     void create_pipeline();
 
+private:
+    struct Offscreen
+    {
+        bool                     enabled = false;
+        dw::vk::Image::Ptr       image;
+        dw::vk::ImageView::Ptr   view;
+        dw::vk::RenderPass::Ptr  rp;
+        dw::vk::Framebuffer::Ptr fbo;
+        dw::vk::Buffer::Ptr      readback_buffer;
+    };
+
 private:
     std::weak_ptr<dw::vk::Backend> m_backend;
     CommonResources*               m_common_resources;
     uint32_t                       m_width;
     uint32_t                       m_height;
     float                          m_exposure = 1.0f;
-    dw::vk::GraphicsPipeline::Ptr  m_pipeline;
+    Pipeline::Ptr                  m_pipeline;
     dw::vk::PipelineLayout::Ptr    m_pipeline_layout;
+    Offscreen                      m_offscreen;
 };
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "transient_allocator.h"
+#include <macros.h>
+#include <logger.h>
+#include <imgui.h>
+#include <algorithm>
+#include <stdio.h>
+
+// Large enough to hold a few screen sized images at 1080p, larger images get a block of their own.
+static const VkDeviceSize kMinBlockSize = 32 * 1024 * 1024;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float to_mb(VkDeviceSize size)
+{
+    return float(size) / (1024.0f * 1024.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TransientAllocator::TransientAllocator(std::weak_ptr<dw::vk::Backend> backend, bool aliasing) :
+    m_backend(backend), m_aliasing(aliasing)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TransientAllocator::~TransientAllocator()
+{
+    auto backend = m_backend.lock();
+
+    for (auto& allocation : m_allocations)
+        vkDestroyImage(backend->device(), allocation.handle, nullptr);
+
+    for (auto& block : m_blocks)
+        vmaFreeMemory(backend->allocator(), block.allocation);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::Image::Ptr TransientAllocator::create_image(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, Queue queue, Pass first_pass, Pass last_pass)
+{
+    auto backend = m_backend.lock();
+
+    collect_garbage();
+
+    VkImageCreateInfo image_info;
+    DW_ZERO_MEMORY(image_info);
+
+    image_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType     = VK_IMAGE_TYPE_2D;
+    image_info.extent.width  = width;
+    image_info.extent.height = height;
+    image_info.extent.depth  = 1;
+    image_info.mipLevels     = 1;
+    image_info.arrayLayers   = 1;
+    image_info.format        = format;
+    image_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage         = usage;
+    image_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+    image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+
+    if (vkCreateImage(backend->device(), &image_info, nullptr, &image) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("(TransientAllocator) Failed to create image.");
+        return nullptr;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(backend->device(), image, &requirements);
+
+    Allocation allocation;
+
+    allocation.handle     = image;
+    allocation.block      = VK_NULL_HANDLE;
+    allocation.offset     = 0;
+    allocation.size       = requirements.size;
+    allocation.queue      = queue;
+    allocation.first_pass = first_pass;
+    allocation.last_pass  = last_pass;
+
+    for (auto& block : m_blocks)
+    {
+        if ((requirements.memoryTypeBits & (1u << block.memory_type)) && find_offset(block, requirements, queue, first_pass, last_pass, allocation.offset))
+        {
+            allocation.block = block.allocation;
+            break;
+        }
+    }
+
+    if (allocation.block == VK_NULL_HANDLE)
+    {
+        VkMemoryRequirements block_requirements = requirements;
+        block_requirements.size                 = std::max(requirements.size, kMinBlockSize);
+
+        VmaAllocationCreateInfo alloc_create_info;
+        DW_ZERO_MEMORY(alloc_create_info);
+
+        alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        alloc_create_info.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        Block             block;
+        VmaAllocationInfo alloc_info;
+
+        if (vmaAllocateMemory(backend->allocator(), &block_requirements, &alloc_create_info, &block.allocation, &alloc_info) != VK_SUCCESS)
+        {
+            DW_LOG_ERROR("(TransientAllocator) Failed to allocate memory block.");
+            vkDestroyImage(backend->device(), image, nullptr);
+            return nullptr;
+        }
+
+        block.size        = block_requirements.size;
+        block.memory_type = alloc_info.memoryType;
+
+        m_blocks.push_back(block);
+
+        allocation.block  = block.allocation;
+        allocation.offset = 0;
+    }
+
+    vmaBindImageMemory2(backend->allocator(), allocation.block, allocation.offset, image, nullptr);
+
+    // The wrapper doesn't own the image or its memory, same as for swap chain images.
+    dw::vk::Image::Ptr wrapper = dw::vk::Image::create_from_swapchain(backend, image, VK_IMAGE_TYPE_2D, width, height, 1, 1, 1, format, VMA_MEMORY_USAGE_GPU_ONLY, usage, VK_SAMPLE_COUNT_1_BIT);
+
+    allocation.image = wrapper;
+
+    m_allocations.push_back(allocation);
+
+    update_stats();
+
+    return wrapper;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientAllocator::gui()
+{
+    ImGui::Text("Transient Images: %u (%u Blocks)", m_stats.num_images, m_stats.num_blocks);
+    ImGui::Text("Without Aliasing: %.1f MB (Peak %.1f MB)", to_mb(m_stats.unaliased_size), to_mb(m_stats.peak_unaliased));
+    ImGui::Text("%s: %.1f MB (Peak %.1f MB)", m_aliasing ? "Aliased" : "Allocated", to_mb(m_stats.allocated_size), to_mb(m_stats.peak_allocated));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientAllocator::log_stats()
+{
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer), "(TransientAllocator) %u images, %.1f MB without aliasing, %.1f MB allocated in %u blocks (peak %.1f MB / %.1f MB).", m_stats.num_images, to_mb(m_stats.unaliased_size), to_mb(m_stats.allocated_size), m_stats.num_blocks, to_mb(m_stats.peak_unaliased), to_mb(m_stats.peak_allocated));
+
+    DW_LOG_INFO(buffer);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientAllocator::collect_garbage()
+{
+    auto backend = m_backend.lock();
+
+    for (int32_t i = int32_t(m_allocations.size()) - 1; i >= 0; i--)
+    {
+        if (m_allocations[i].image.expired())
+        {
+            vkDestroyImage(backend->device(), m_allocations[i].handle, nullptr);
+            m_allocations.erase(m_allocations.begin() + i);
+        }
+    }
+
+    for (int32_t i = int32_t(m_blocks.size()) - 1; i >= 0; i--)
+    {
+        VmaAllocation block_allocation = m_blocks[i].allocation;
+
+        auto it = std::find_if(m_allocations.begin(), m_allocations.end(), [block_allocation](const Allocation& allocation) { return allocation.block == block_allocation; });
+
+        if (it == m_allocations.end())
+        {
+            vmaFreeMemory(backend->allocator(), block_allocation);
+            m_blocks.erase(m_blocks.begin() + i);
+        }
+    }
+
+    update_stats();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TransientAllocator::find_offset(const Block& block, const VkMemoryRequirements& requirements, Queue queue, Pass first_pass, Pass last_pass, VkDeviceSize& offset)
+{
+    // Ranges of the block that are in use while the new image is alive.
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> used_ranges;
+
+    for (const auto& allocation : m_allocations)
+    {
+        if (allocation.block != block.allocation)
+            continue;
+
+        const bool overlapping = !m_aliasing || allocation.queue != queue || (allocation.first_pass <= last_pass && first_pass <= allocation.last_pass);
+
+        if (overlapping)
+            used_ranges.push_back({ allocation.offset, allocation.offset + allocation.size });
+    }
+
+    std::sort(used_ranges.begin(), used_ranges.end());
+
+    // First fit, the candidates are the start of the block and the end of every used range.
+    VkDeviceSize candidate = 0;
+
+    for (const auto& range : used_ranges)
+    {
+        if (candidate + requirements.size <= range.first)
+            break;
+
+        candidate = std::max(candidate, align_up(range.second, requirements.alignment));
+    }
+
+    if (candidate + requirements.size > block.size)
+        return false;
+
+    offset = candidate;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientAllocator::update_stats()
+{
+    m_stats.num_images     = m_allocations.size();
+    m_stats.num_blocks     = m_blocks.size();
+    m_stats.unaliased_size = 0;
+    m_stats.allocated_size = 0;
+
+    for (const auto& allocation : m_allocations)
+        m_stats.unaliased_size += allocation.size;
+
+    for (const auto& block : m_blocks)
+        m_stats.allocated_size += block.size;
+
+    m_stats.peak_unaliased = std::max(m_stats.peak_unaliased, m_stats.unaliased_size);
+    m_stats.peak_allocated = std::max(m_stats.peak_allocated, m_stats.allocated_size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vk.h>
+#include <vk_mem_alloc.h>
+#include <memory>
+#include <vector>
+
+// Places images that are only alive for part of a frame into shared VMA memory blocks. Every image declares the first and the
+// last pass that uses it, images whose lifetimes don't overlap may end up at the same offset:
+//
+//   m_a_trous.image[1] = m_common_resources->transient_allocator->create_image(..., TransientAllocator::PASS_SHADOWS_A_TROUS,
+//                                                                                  TransientAllocator::PASS_SHADOWS_A_TROUS);
+//
+// The contents of a transient image don't survive from one frame to the next, the first access of every frame has to be a
+// discarding write preceded by FrameGraph::alias(). Images used on different queues never share memory.
+//
+// Memory is given back once the returned image is released, the next call to create_image() destroys it. Callers are expected
+// to wait for the device to idle before releasing transient images.
+class TransientAllocator
+{
+public:
+    // Passes that use transient images, in the order they execute within a frame.
+    enum Pass
+    {
+        PASS_SHADOWS_A_TROUS,
+        PASS_SHADOWS_UPSAMPLE,
+        PASS_AO_BILATERAL_BLUR,
+        PASS_AO_DISOCCLUSION_BLUR,
+        PASS_AO_UPSAMPLE,
+        PASS_DDGI_PROBE_UPDATE,
+        PASS_REFLECTIONS_A_TROUS,
+        PASS_REFLECTIONS_UPSAMPLE,
+        PASS_END_OF_FRAME
+    };
+
+    enum Queue
+    {
+        QUEUE_GRAPHICS,
+        QUEUE_ASYNC_COMPUTE
+    };
+
+    struct Stats
+    {
+        uint32_t     num_images     = 0;
+        uint32_t     num_blocks     = 0;
+        VkDeviceSize unaliased_size = 0;
+        VkDeviceSize allocated_size = 0;
+        VkDeviceSize peak_unaliased = 0;
+        VkDeviceSize peak_allocated = 0;
+    };
+
+public:
+    TransientAllocator(std::weak_ptr<dw::vk::Backend> backend, bool aliasing = true);
+    ~TransientAllocator();
+
+    dw::vk::Image::Ptr create_image(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, Queue queue, Pass first_pass, Pass last_pass);
+    void               gui();
+    void               log_stats();
+
+    inline Stats stats() { return m_stats; }
+    inline bool  aliasing() { return m_aliasing; }
+
+private:
+    struct Block
+    {
+        VmaAllocation allocation;
+        VkDeviceSize  size;
+        uint32_t      memory_type;
+    };
+
+    struct Allocation
+    {
+        std::weak_ptr<dw::vk::Image> image;
+        VkImage                      handle;
+        VmaAllocation                block;
+        VkDeviceSize                 offset;
+        VkDeviceSize                 size;
+        Queue                        queue;
+        Pass                         first_pass;
+        Pass                         last_pass;
+    };
+
+    void collect_garbage();
+    bool find_offset(const Block& block, const VkMemoryRequirements& requirements, Queue queue, Pass first_pass, Pass last_pass, VkDeviceSize& offset);
+    void update_stats();
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    bool                           m_aliasing;
+    std::vector<Block>             m_blocks;
+    std::vector<Allocation>        m_allocations;
+    Stats                          m_stats;
+};
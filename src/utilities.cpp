@@ -1,5 +1,8 @@
 #include "utilities.h"
 #include <macros.h>
+#include <logger.h>
+#include <fstream>
+#include <vector>
 
 void pipeline_barrier(dw::vk::CommandBuffer::Ptr        cmd_buf,
                       std::vector<VkMemoryBarrier>      memory_barriers,
@@ -53,4 +56,62 @@ VkMemoryBarrier memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAc
     memory_barrier.dstAccessMask = dstAccessFlags;
 
     return memory_barrier;
-}
\ No newline at end of file
+}
+
+uint64_t timestamp_mask(VkPhysicalDevice physical_device, uint32_t queue_family)
+{
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, families.data());
+
+    if (queue_family >= count)
+        return 0;
+
+    // Zero valid bits means the queue family can't write timestamps at all.
+    uint32_t valid_bits = families[queue_family].timestampValidBits;
+
+    return valid_bits >= 64 ? UINT64_MAX : (uint64_t(1) << valid_bits) - 1;
+}
+
+VkDeviceAddress buffer_device_address(VkDevice device, VkBuffer buffer)
+{
+    VkBufferDeviceAddressInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    info.buffer = buffer;
+
+    return vkGetBufferDeviceAddress(device, &info);
+}
+
+bool write_ppm(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba)
+{
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("Failed to open file for writing: " + path);
+        return false;
+    }
+
+    file << "P6\n"
+         << width << " " << height << "\n255\n";
+
+    std::vector<uint8_t> row(width * 3);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = rgba[(y * width + x) * 4 + 0];
+            row[x * 3 + 1] = rgba[(y * width + x) * 4 + 1];
+            row[x * 3 + 2] = rgba[(y * width + x) * 4 + 2];
+        }
+
+        file.write((const char*)row.data(), row.size());
+    }
+
+    return true;
+}
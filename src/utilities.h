@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vk.h>
+#include <string>
 
 extern void                 pipeline_barrier(dw::vk::CommandBuffer::Ptr        cmd_buf,
                                              std::vector<VkMemoryBarrier>      memory_barriers,
@@ -13,4 +14,7 @@ extern VkImageMemoryBarrier image_memory_barrier(dw::vk::Image::Ptr      image,
                                                  VkImageSubresourceRange subresourceRange,
                                                  VkAccessFlags           srcAccessFlags,
                                                  VkAccessFlags           dstAccessFlags);
-extern VkMemoryBarrier      memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAccessFlags);
\ No newline at end of file
+extern VkMemoryBarrier      memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAccessFlags);
+extern bool                 write_ppm(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba);
+extern uint64_t             timestamp_mask(VkPhysicalDevice physical_device, uint32_t queue_family);
+extern VkDeviceAddress      buffer_device_address(VkDevice device, VkBuffer buffer);